@@ -21,6 +21,9 @@ GlobalSettings::GlobalSettings(GlobalCommandController& commandController_)
 	        "turn power on/off", false, Setting::DONT_SAVE)
 	, autoSaveSetting(commandController, "save_settings_on_exit",
 	        "automatically save settings when openMSX exits", true)
+	, hdOverlaySetting(commandController, "hd_overlay",
+	        "keep writes to newly inserted hard disk images in memory until "
+	        "they are committed with 'hd<x> commit'", false)
 	, umrCallBackSetting(commandController, "umr_callback",
 		"Tcl proc to call when an UMR is detected", {})
 	, invalidPsgDirectionsSetting(commandController,
@@ -42,6 +45,13 @@ GlobalSettings::GlobalSettings(GlobalCommandController& commandController_)
 			{"hq",   ResampledSoundDevice::RESAMPLE_HQ},
 			{"fast", ResampledSoundDevice::RESAMPLE_LQ},
 			{"blip", ResampledSoundDevice::RESAMPLE_BLIP}})
+	, savestateFormatSetting(commandController, "savestate_format",
+		"file format used by store_machine (and thus savestate), "
+		"restore_machine accepts both",
+		SAVESTATE_XML,
+		EnumSetting<SavestateFormat>::Map{
+			{"xml",    SAVESTATE_XML},
+			{"binary", SAVESTATE_BINARY}})
 	, throttleManager(commandController)
 {
 	deadzoneSettings = to_vector(
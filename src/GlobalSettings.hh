@@ -23,6 +23,8 @@ class GlobalCommandController;
 class GlobalSettings final : private Observer<Setting>
 {
 public:
+	enum SavestateFormat { SAVESTATE_XML, SAVESTATE_BINARY };
+
 	explicit GlobalSettings(GlobalCommandController& commandController);
 	~GlobalSettings();
 
@@ -38,6 +40,9 @@ public:
 	BooleanSetting& getAutoSaveSetting() {
 		return autoSaveSetting;
 	}
+	BooleanSetting& getHDOverlaySetting() {
+		return hdOverlaySetting;
+	}
 	StringSetting& getUMRCallBackSetting() {
 		return umrCallBackSetting;
 	}
@@ -47,6 +52,9 @@ public:
 	EnumSetting<ResampledSoundDevice::ResampleType>& getResampleSetting() {
 		return resampleSetting;
 	}
+	EnumSetting<SavestateFormat>& getSavestateFormatSetting() {
+		return savestateFormatSetting;
+	}
 	IntegerSetting& getJoyDeadzoneSetting(int i) {
 		return *deadzoneSettings[i];
 	}
@@ -64,9 +72,11 @@ private:
 	BooleanSetting pauseSetting;
 	BooleanSetting powerSetting;
 	BooleanSetting autoSaveSetting;
+	BooleanSetting hdOverlaySetting;
 	StringSetting  umrCallBackSetting;
 	StringSetting  invalidPsgDirectionsSetting;
 	EnumSetting<ResampledSoundDevice::ResampleType> resampleSetting;
+	EnumSetting<SavestateFormat> savestateFormatSetting;
 	std::vector<std::unique_ptr<IntegerSetting>> deadzoneSettings;
 	ThrottleManager throttleManager;
 };
@@ -93,6 +93,7 @@ public:
 	void doReset();
 	void activate(bool active);
 	bool isActive() const { return active; }
+	bool isPowered() const { return powered; }
 	bool isFastForwarding() const { return fastForwarding; }
 
 	byte readIRQVector();
@@ -156,6 +156,17 @@ private:
 	Reactor& reactor;
 };
 
+class RunMachinesCommand final : public Command
+{
+public:
+	RunMachinesCommand(CommandController& commandController, Reactor& reactor);
+	void execute(span<const TclObject> tokens, TclObject& result) override;
+	string help(const vector<string>& tokens) const override;
+	void tabCompletion(vector<string>& tokens) const override;
+private:
+	Reactor& reactor;
+};
+
 class GetClipboardCommand final : public Command
 {
 public:
@@ -253,6 +264,8 @@ void Reactor::init()
 		*globalCommandController, *this);
 	restoreMachineCommand = make_unique<RestoreMachineCommand>(
 		*globalCommandController, *this);
+	runMachinesCommand = make_unique<RunMachinesCommand>(
+		*globalCommandController, *this);
 	getClipboardCommand = make_unique<GetClipboardCommand>(
 		*globalCommandController);
 	setClipboardCommand = make_unique<SetClipboardCommand>(
@@ -900,15 +913,18 @@ void StoreMachineCommand::execute(span<const TclObject> tokens, TclObject& resul
 {
 	checkNumArgs(tokens, Between{1, 3}, Prefix{1}, "?id? ?filename?");
 	string filename;
+	bool binary = reactor.getGlobalSettings().getSavestateFormatSetting().getEnum()
+	           == GlobalSettings::SAVESTATE_BINARY;
+	const char* extension = binary ? ".oms" : ".xml.gz";
 	string_view machineID;
 	switch (tokens.size()) {
 	case 1:
 		machineID = reactor.getMachineID();
-		filename = FileOperations::getNextNumberedFileName("savestates", "openmsxstate", ".xml.gz");
+		filename = FileOperations::getNextNumberedFileName("savestates", "openmsxstate", extension);
 		break;
 	case 2:
 		machineID = tokens[1].getString();
-		filename = FileOperations::getNextNumberedFileName("savestates", "openmsxstate", ".xml.gz");
+		filename = FileOperations::getNextNumberedFileName("savestates", "openmsxstate", extension);
 		break;
 	case 3:
 		machineID = tokens[1].getString();
@@ -918,9 +934,15 @@ void StoreMachineCommand::execute(span<const TclObject> tokens, TclObject& resul
 
 	auto& board = reactor.getMachine(machineID);
 
-	XmlOutputArchive out(filename);
-	out.serialize("machine", board);
-	out.close();
+	if (binary) {
+		BinOutputArchive out(filename);
+		out.serialize("machine", board);
+		out.close();
+	} else {
+		XmlOutputArchive out(filename);
+		out.serialize("machine", board);
+		out.close();
+	}
 	result = filename;
 }
 
@@ -931,6 +953,9 @@ string StoreMachineCommand::help(const vector<string>& /*tokens*/) const
 		"store_machine machineID             Save state of machine \"machineID\" to file \"openmsxNNNN.xml.gz\"\n"
 		"store_machine machineID <filename>  Save state of machine \"machineID\" to indicated file\n"
 		"\n"
+		"The 'savestate_format' setting selects between the XML and the (faster) binary\n"
+		"file format, in the latter case the default filename ends in \".oms\".\n"
+		"\n"
 		"This is a low-level command, the 'savestate' script is easier to use.";
 }
 
@@ -987,8 +1012,14 @@ void RestoreMachineCommand::execute(span<const TclObject> tokens,
 
 	//std::cerr << "Loading " << filename << '\n';
 	try {
-		XmlInputArchive in(filename);
-		in.serialize("machine", *newBoard);
+		// the file format is detected from the content, not the name
+		if (BinInputArchive::isBinFile(filename)) {
+			BinInputArchive in(filename);
+			in.serialize("machine", *newBoard);
+		} else {
+			XmlInputArchive in(filename);
+			in.serialize("machine", *newBoard);
+		}
 	} catch (XMLException& e) {
 		throw CommandException("Cannot load state, bad file format: ",
 		                       e.getMessage());
@@ -1020,6 +1051,63 @@ void RestoreMachineCommand::tabCompletion(vector<string>& tokens) const
 }
 
 
+// class RunMachinesCommand
+
+RunMachinesCommand::RunMachinesCommand(
+	CommandController& commandController_, Reactor& reactor_)
+	: Command(commandController_, "run_machines")
+	, reactor(reactor_)
+{
+}
+
+void RunMachinesCommand::execute(span<const TclObject> tokens,
+                                 TclObject& /*result*/)
+{
+	checkNumArgs(tokens, AtLeast{3}, "duration id ?id ...?");
+	double duration = tokens[1].getDouble(getInterpreter());
+	if (duration < 0.0) {
+		throw CommandException("Duration can't be negative");
+	}
+	vector<MSXMotherBoard*> machines;
+	for (const auto& arg : tokens.subspan(2)) {
+		auto& board = reactor.getMachine(arg.getString());
+		if (contains(machines, &board)) {
+			throw CommandException("Machine listed twice: ", arg.getString());
+		}
+		if (!board.isPowered()) {
+			throw CommandException("Machine is not powered on: ", arg.getString());
+		}
+		machines.push_back(&board);
+	}
+
+	// The machines share the Tcl interpreter (e.g. for 'after time'
+	// callbacks), the settings, the sound driver and the display. None of
+	// these are thread-safe, so emulate the machines one after the other
+	// on the main thread.
+	for (auto* board : machines) {
+		board->fastForward(board->getCurrentTime() + EmuDuration(duration), true);
+	}
+}
+
+string RunMachinesCommand::help(const vector<string>& /*tokens*/) const
+{
+	return "run_machines <duration> <id> [<id> ...]\n"
+	       "Emulates each of the given (powered on) machines for the given "
+	       "duration (in seconds of emulated time), one machine after the "
+	       "other. Intended for batch runs (e.g. a suite of test ROMs), so "
+	       "like during 'reverse goto' the machines run in fast-forward "
+	       "mode: no video or sound output and breakpoints and conditions "
+	       "are ignored.";
+}
+
+void RunMachinesCommand::tabCompletion(vector<string>& tokens) const
+{
+	if (tokens.size() >= 3) {
+		completeString(tokens, reactor.getMachineIDs());
+	}
+}
+
+
 // class GetClipboardCommand
 
 GetClipboardCommand::GetClipboardCommand(CommandController& commandController_)
@@ -45,6 +45,7 @@ class ListMachinesCommand;
 class ActivateMachineCommand;
 class StoreMachineCommand;
 class RestoreMachineCommand;
+class RunMachinesCommand;
 class GetClipboardCommand;
 class SetClipboardCommand;
 class AviRecorder;
@@ -165,6 +166,7 @@ private:
 	std::unique_ptr<ActivateMachineCommand> activateMachineCommand;
 	std::unique_ptr<StoreMachineCommand> storeMachineCommand;
 	std::unique_ptr<RestoreMachineCommand> restoreMachineCommand;
+	std::unique_ptr<RunMachinesCommand> runMachinesCommand;
 	std::unique_ptr<GetClipboardCommand> getClipboardCommand;
 	std::unique_ptr<SetClipboardCommand> setClipboardCommand;
 	std::unique_ptr<AviRecorder> aviRecordCommand;
@@ -205,6 +207,8 @@ private:
 	friend class ActivateMachineCommand;
 	friend class StoreMachineCommand;
 	friend class RestoreMachineCommand;
+	friend class RunMachinesCommand;
+	friend class GlobalCommandController; // for openmsx_subscribe
 };
 
 } // namespace openmsx
@@ -18,11 +18,16 @@
 #include "Display.hh"
 #include "Reactor.hh"
 #include "CommandException.hh"
+#include "ThreadPool.hh"
+#include "SpillFile.hh"
 #include "MemBuffer.hh"
+#include "parallelFor.hh"
 #include "ranges.hh"
 #include "serialize.hh"
 #include "serialize_meta.hh"
+#include "stl.hh"
 #include "view.hh"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iomanip>
@@ -100,12 +105,26 @@ struct Replay
 SERIALIZE_CLASS_VERSION(Replay, 4);
 
 
+// Also shared by all machines. Blocks that are moved to this store keep a
+// reference to it, so it's only removed when the last such block is gone.
+static const std::shared_ptr<SpillFile>& getSpillStore()
+{
+	static auto store = std::make_shared<SpillFile>();
+	return store;
+}
+
+
 // struct ReverseHistory
 
 void ReverseManager::ReverseHistory::swap(ReverseHistory& other)
 {
 	std::swap(chunks, other.chunks);
 	std::swap(events, other.events);
+	std::swap(blocks, other.blocks);
+	std::swap(blocksSize, other.blocksSize);
+	std::swap(chunksSize, other.chunksSize);
+	std::swap(recompressedUpTo, other.recompressedUpTo);
+	std::swap(spilledUpTo, other.spilledUpTo);
 }
 
 void ReverseManager::ReverseHistory::clear()
@@ -113,6 +132,78 @@ void ReverseManager::ReverseHistory::clear()
 	// clear() and free storage capacity
 	Chunks().swap(chunks);
 	Events().swap(events);
+	for (const auto& [block, count] : blocks) block->setMemoryCounter(nullptr);
+	decltype(blocks)().swap(blocks);
+	chunksSize = 0;
+	recompressedUpTo = 0;
+	spilledUpTo = 0;
+}
+
+void ReverseManager::ReverseHistory::addChunk(unsigned seqNum, ReverseChunk&& chunk)
+{
+	eraseChunk(seqNum);
+	addBlocks(chunk);
+	chunks.emplace(seqNum, std::move(chunk));
+	recompressedUpTo = std::min(recompressedUpTo, seqNum);
+	spilledUpTo = std::min(spilledUpTo, seqNum);
+}
+
+void ReverseManager::ReverseHistory::eraseChunk(unsigned seqNum)
+{
+	auto it = chunks.find(seqNum);
+	if (it != end(chunks)) eraseChunks(it, std::next(it));
+}
+
+void ReverseManager::ReverseHistory::eraseChunks(
+	Chunks::iterator first, Chunks::iterator last)
+{
+	for (auto it = first; it != last; ++it) removeBlocks(it->second);
+	chunks.erase(first, last);
+}
+
+// A snapshot typically adds only a few new blocks (and only removes a few), so
+// keeping 'blocks' sorted is cheap, and together with 'blocksSize' it avoids
+// visiting all blocks of all snapshots for each getMemoryUsage() call.
+void ReverseManager::ReverseHistory::addBlocks(const ReverseChunk& chunk)
+{
+	chunksSize += chunk.size;
+	auto add = [&](const DeltaBlock* block) {
+		auto it = ranges::lower_bound(blocks, block, LessTupleElement<0>());
+		if ((it != end(blocks)) && (it->first == block)) {
+			++it->second;
+		} else {
+			blocks.emplace(it, block, 1);
+			block->setMemoryCounter(blocksSize);
+		}
+	};
+	for (const auto& block : chunk.deltaBlocks) {
+		add(block.get());
+		if (auto* base = block->getBase()) add(base);
+	}
+}
+
+void ReverseManager::ReverseHistory::removeBlocks(const ReverseChunk& chunk)
+{
+	chunksSize -= chunk.size;
+	auto remove = [&](const DeltaBlock* block) {
+		auto it = ranges::lower_bound(blocks, block, LessTupleElement<0>());
+		assert((it != end(blocks)) && (it->first == block));
+		if (--it->second == 0) {
+			// (the block itself may still live a bit longer, e.g.
+			// while a background job on it finishes)
+			block->setMemoryCounter(nullptr);
+			blocks.erase(it);
+		}
+	};
+	for (const auto& block : chunk.deltaBlocks) {
+		remove(block.get());
+		if (auto* base = block->getBase()) remove(base);
+	}
+}
+
+size_t ReverseManager::ReverseHistory::getMemoryUsage() const
+{
+	return chunksSize + *blocksSize;
 }
 
 
@@ -140,6 +231,12 @@ ReverseManager::ReverseManager(MSXMotherBoard& motherBoard_)
 	, motherBoard(motherBoard_)
 	, eventDistributor(motherBoard.getReactor().getEventDistributor())
 	, reverseCmd(motherBoard.getCommandController())
+	, snapshotStallInfo(motherBoard.getMachineInfoCommand())
+	, memoryBudgetSetting(motherBoard.getCommandController(),
+		"reverse_memory_budget",
+		"maximum amount of memory (in MB) used by the reverse history, "
+		"when exceeded old snapshots are recompressed or moved to disk. "
+		"0 means unlimited", 0, 0, 1000000)
 	, keyboard(nullptr)
 	, eventDelay(nullptr)
 	, replayIndex(0)
@@ -148,6 +245,9 @@ ReverseManager::ReverseManager(MSXMotherBoard& motherBoard_)
 	, reRecordCount(0)
 {
 	eventDistributor.registerEventListener(OPENMSX_TAKE_REVERSE_SNAPSHOT, *this);
+	// The shared pool must outlive every ReverseHistory, because history
+	// is transferred between machines.
+	history.lastDeltaBlocks.setThreadPool(&getSharedThreadPool());
 
 	assert(!isCollecting());
 	assert(!isReplaying());
@@ -194,6 +294,15 @@ void ReverseManager::stop()
 	assert(!isReplaying());
 }
 
+void ReverseManager::clearHistory()
+{
+	assert(!isReplaying());
+	if (isCollecting()) {
+		stop();
+		start();
+	}
+}
+
 EmuTime::param ReverseManager::getEndTime(const ReverseHistory& hist) const
 {
 	if (!hist.events.empty()) {
@@ -252,7 +361,10 @@ void ReverseManager::debugInfo(TclObject& result) const
 		          " (next event index: ", chunk.eventCount, ")\n");
 		totalSize += chunk.size;
 	}
-	strAppend(res, "total size: ", totalSize, '\n');
+	strAppend(res, "total size: ", totalSize, '\n',
+	          "memory usage: ", getMemoryUsage(), '\n',
+	          "spilled to disk (all machines): ",
+	          getSpillStore()->getUsedSize(), '\n');
 	result = res;
 }
 
@@ -734,8 +846,8 @@ void ReverseManager::loadReplay(
 		}
 		newChunk.eventCount = replayIdx;
 
-		newHistory.chunks[newHistory.getNextSeqNum(newChunk.time)] =
-			move(newChunk);
+		newHistory.addChunk(newHistory.getNextSeqNum(newChunk.time),
+		                    std::move(newChunk));
 	}
 
 	// Note: untill this point we didn't make any changes to the current
@@ -850,6 +962,8 @@ unsigned ReverseManager::ReverseHistory::getNextSeqNum(EmuTime::param time) cons
 
 void ReverseManager::takeSnapshot(EmuTime::param time)
 {
+	auto startTime = Timer::getTime();
+
 	// (possibly) drop old snapshots
 	// TODO does snapshot pruning still happen correctly (often enough)
 	//      when going back/forward in time?
@@ -862,13 +976,72 @@ void ReverseManager::takeSnapshot(EmuTime::param time)
 	// the same moment in time).
 
 	// actually create new snapshot
-	ReverseChunk& newChunk = history.chunks[seqNum];
-	newChunk.deltaBlocks.clear();
+	history.eraseChunk(seqNum);
+	ReverseChunk newChunk;
 	MemOutputArchive out(history.lastDeltaBlocks, newChunk.deltaBlocks, true);
 	out.serialize("machine", motherBoard);
 	newChunk.time = time;
 	newChunk.savestate = out.releaseBuffer(newChunk.size);
 	newChunk.eventCount = replayIndex;
+	history.addChunk(seqNum, std::move(newChunk));
+
+	enforceMemoryBudget();
+
+	auto stall = unsigned(Timer::getTime() - startTime);
+	auto& stats = snapshotStallInfo;
+	++stats.count;
+	stats.last = stall;
+	stats.max = std::max(stats.max, stall);
+	stats.total += stall;
+}
+
+size_t ReverseManager::getMemoryUsage() const
+{
+	return history.getMemoryUsage();
+}
+
+void ReverseManager::enforceMemoryBudget()
+{
+	auto budget = size_t(memoryBudgetSetting.getInt()) * 1024 * 1024;
+	if (budget == 0) return; // unlimited
+
+	auto usage = getMemoryUsage();
+	if (usage <= budget) return;
+	size_t excess = usage - budget;
+
+	// Leave the most recent snapshots alone, those are the most likely
+	// ones to be used by 'reverse goback'.
+	static constexpr size_t KEEP_RECENT = 10;
+	if (history.chunks.size() <= KEEP_RECENT) return;
+	auto last = std::prev(end(history.chunks), KEEP_RECENT);
+
+	// First try to recompress the oldest snapshots, only if that's not
+	// enough move them to disk. The actual work happens in the background,
+	// the effect is re-evaluated after the next snapshot.
+	// Chunks that were already completely handled are skipped.
+	auto* pool = &getSharedThreadPool();
+	auto apply = [&](unsigned& doneUpTo, auto isDone, auto op) {
+		bool allDone = true; // for all chunks visited so far
+		for (auto it = history.chunks.lower_bound(doneUpTo);
+		     (it != end(history.chunks)) && (it->first < last->first); ++it) {
+			for (auto& block : it->second.deltaBlocks) {
+				auto saved = op(*block);
+				allDone &= isDone(*block);
+				if (saved >= excess) return true;
+				excess -= saved;
+			}
+			// e.g. a reference block that's still in use can only
+			// be handled later
+			if (allDone) doneUpTo = it->first + 1;
+		}
+		return false;
+	};
+	if (apply(history.recompressedUpTo,
+	          [](const DeltaBlock& b) { return b.isRecompressRequested(); },
+	          [&](DeltaBlock& b) { return b.recompress(pool); })) return;
+	apply(history.spilledUpTo,
+	      [](const DeltaBlock& b) { return b.isSpillRequested(); },
+	      [&](DeltaBlock& b) { return b.spill(getSpillStore(), pool); });
 }
 
 void ReverseManager::replayNextEvent()
@@ -915,7 +1088,7 @@ void ReverseManager::stopReplay(EmuTime::param time)
 		auto it = ranges::find_if(history.chunks, [&](auto& p) {
 			return p.second.time > time;
 		});
-		history.chunks.erase(it, end(history.chunks));
+		history.eraseChunks(it, end(history.chunks));
 		// this also means someone is changing history, record that
 		reRecordCount++;
 	}
@@ -943,7 +1116,7 @@ void ReverseManager::dropOldSnapshots(unsigned count)
 	while (true) {
 		y >>= 1;
 		if ((y == 0) || (count < d)) return;
-		history.chunks.erase(count - d);
+		history.eraseChunk(count - d);
 		d += d2;
 		d2 *= 2;
 	}
@@ -1030,4 +1203,30 @@ void ReverseManager::ReverseCmd::tabCompletion(vector<string>& tokens) const
 	}
 }
 
+
+
+// class SnapshotStallInfo
+
+ReverseManager::SnapshotStallInfo::SnapshotStallInfo(
+		InfoCommand& machineInfoCommand)
+	: InfoTopic(machineInfoCommand, "reverse_snapshot_stall")
+{
+}
+
+void ReverseManager::SnapshotStallInfo::execute(
+	span<const TclObject> /*tokens*/, TclObject& result) const
+{
+	result.addDictKeyValue("count", count);
+	result.addDictKeyValue("last", last);
+	result.addDictKeyValue("max", max);
+	result.addDictKeyValue("average", count ? double(total) / count : 0.0);
+}
+
+string ReverseManager::SnapshotStallInfo::help(const vector<string>& /*tokens*/) const
+{
+	return "Returns a dict with the time (in microseconds) the emulation "
+	       "thread was stalled while taking reverse snapshots: 'count', "
+	       "'last', 'max' and 'average'.\n";
+}
+
 } // namespace openmsx
@@ -5,13 +5,17 @@
 #include "EventListener.hh"
 #include "StateChangeListener.hh"
 #include "Command.hh"
+#include "InfoTopic.hh"
+#include "IntegerSetting.hh"
 #include "EmuTime.hh"
 #include "MemBuffer.hh"
 #include "DeltaBlock.hh"
 #include "span.hh"
 #include "outer.hh"
+#include <atomic>
 #include <vector>
 #include <map>
+#include <utility>
 #include <memory>
 #include <cstdint>
 
@@ -50,6 +54,12 @@ public:
 		reRecordCount = count;
 	}
 
+	/** Drop the reverse history (when it's being collected, a new history
+	  * starts at the current time). Used when the emulation can't
+	  * consistently go back to an earlier point in time anymore.
+	  */
+	void clearHistory();
+
 private:
 	struct ReverseChunk {
 		ReverseChunk() : time(EmuTime::zero()) {}
@@ -72,9 +82,37 @@ private:
 		void clear();
 		unsigned getNextSeqNum(EmuTime::param time) const;
 
+		// Only modify 'chunks' via these, they keep 'blocks' in sync.
+		void addChunk(unsigned seqNum, ReverseChunk&& chunk);
+		void eraseChunk(unsigned seqNum);
+		void eraseChunks(Chunks::iterator first, Chunks::iterator last);
+
+		/** Memory used by all snapshots. Blocks that are shared
+		  * between snapshots are only counted once. */
+		size_t getMemoryUsage() const;
+
 		Chunks chunks;
 		Events events;
 		LastDeltaBlocks lastDeltaBlocks;
+
+		// The blocks of all chunks with a lower sequence number have
+		// already been recompressed resp. spilled (see
+		// enforceMemoryBudget()).
+		unsigned recompressedUpTo = 0;
+		unsigned spilledUpTo = 0;
+
+	private:
+		void addBlocks(const ReverseChunk& chunk);
+		void removeBlocks(const ReverseChunk& chunk);
+
+		// All distinct blocks of 'chunks' (and the blocks those depend
+		// on), sorted on address, with their number of references.
+		std::vector<std::pair<const DeltaBlock*, unsigned>> blocks;
+		// Sum of the memory sizes of all 'blocks', kept up to date by
+		// the blocks themselves (see DeltaBlock::setMemoryCounter()).
+		std::shared_ptr<std::atomic<size_t>> blocksSize =
+			std::make_shared<std::atomic<size_t>>(0);
+		size_t chunksSize = 0; // sum of the 'size' of all chunks
 	};
 
 	bool isCollecting() const { return collecting; }
@@ -102,6 +140,8 @@ private:
 	void schedule(EmuTime::param time);
 	void replayNextEvent();
 	template<unsigned N> void dropOldSnapshots(unsigned count);
+	size_t getMemoryUsage() const;
+	void enforceMemoryBudget();
 
 	// Schedulable
 	struct SyncNewSnapshot final : Schedulable {
@@ -143,6 +183,24 @@ private:
 		void tabCompletion(std::vector<std::string>& tokens) const override;
 	} reverseCmd;
 
+	// Time (in us) the emulation thread spent in takeSnapshot(). The
+	// expensive parts (diffing, compressing) run in a ThreadPool.
+	struct SnapshotStallInfo final : InfoTopic {
+		explicit SnapshotStallInfo(InfoCommand& machineInfoCommand);
+		void execute(span<const TclObject> tokens,
+		             TclObject& result) const override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+
+		unsigned count = 0;
+		unsigned last = 0;
+		unsigned max = 0;
+		uint64_t total = 0;
+	} snapshotStallInfo;
+
+	// Maximum amount of memory (in MB) used by the reverse history of
+	// this machine, 0 means unlimited.
+	IntegerSetting memoryBudgetSetting;
+
 	Keyboard* keyboard;
 	EventDelay* eventDelay;
 	ReverseHistory history;
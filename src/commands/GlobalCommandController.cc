@@ -7,6 +7,9 @@
 #include "GlobalCliComm.hh"
 #include "CliConnection.hh"
 #include "CommandException.hh"
+#include "Debuggable.hh"
+#include "Debugger.hh"
+#include "MSXMotherBoard.hh"
 #include "SettingsManager.hh"
 #include "TclObject.hh"
 #include "Version.hh"
@@ -40,6 +43,7 @@ GlobalCommandController::GlobalCommandController(
 	, helpCmd(*this)
 	, tabCompletionCmd(*this)
 	, updateCmd(*this)
+	, subscribeCmd(*this)
 	, platformInfo(getOpenMSXInfoCommand())
 	, versionInfo (getOpenMSXInfoCommand())
 	, romInfoTopic(getOpenMSXInfoCommand())
@@ -579,6 +583,91 @@ void GlobalCommandController::UpdateCmd::tabCompletion(vector<string>& tokens) c
 }
 
 
+// class SubscribeCmd
+
+GlobalCommandController::SubscribeCmd::SubscribeCmd(CommandController& commandController_)
+	: Command(commandController_, "openmsx_subscribe")
+{
+}
+
+void GlobalCommandController::SubscribeCmd::execute(
+	span<const TclObject> tokens, TclObject& result)
+{
+	auto& controller = OUTER(GlobalCommandController, subscribeCmd);
+	auto* connection = controller.getConnection();
+	if (!connection) {
+		throw CommandException("This command only makes sense when "
+		                       "it's used from an external application.");
+	}
+	checkNumArgs(tokens, AtLeast{2}, "add|remove|list ?arg ...?");
+	if (tokens[1] == "list") {
+		checkNumArgs(tokens, 2, Prefix{2}, nullptr);
+		result.addListElements(connection->getSubscriptions());
+		return;
+	}
+
+	// optional '-machine <id>', default is the active machine
+	auto& reactor = controller.reactor;
+	string machine(reactor.getMachineID());
+	auto args = tokens.subspan(2);
+	if (!args.empty() && (args[0] == "-machine")) {
+		if (args.size() < 2) throw SyntaxError();
+		machine = string(args[1].getString());
+		args = args.subspan(2);
+	}
+	if (args.empty()) throw SyntaxError();
+	string name(args[0].getString());
+
+	if (tokens[1] == "add") {
+		if ((args.size() != 1) && (args.size() != 3)) throw SyntaxError();
+		auto& board = reactor.getMachine(machine);
+		auto* debuggable = board.getDebugger().findDebuggable(name);
+		if (!debuggable) {
+			throw CommandException("No such debuggable: ", name);
+		}
+		unsigned devSize = debuggable->getSize();
+		unsigned address = 0;
+		unsigned size = devSize;
+		if (args.size() == 3) {
+			auto& interp = getInterpreter();
+			address = args[1].getInt(interp);
+			if (address >= devSize) {
+				throw CommandException("Invalid address");
+			}
+			size = args[2].getInt(interp);
+			if (size > (devSize - address)) {
+				throw CommandException("Invalid size");
+			}
+		}
+		connection->subscribe(board, name, address, size);
+	} else if (tokens[1] == "remove") {
+		if (args.size() != 1) throw SyntaxError();
+		if (!connection->unsubscribe(machine, name)) {
+			throw CommandException("No subscription for: ", name);
+		}
+	} else {
+		throw SyntaxError();
+	}
+}
+
+string GlobalCommandController::SubscribeCmd::help(const vector<string>& /*tokens*/) const
+{
+	return "Stream the changes of a debuggable to an external application, "
+	       "once per frame. See doc/manual/openmsx-control.html.\n"
+	       "  openmsx_subscribe add [-machine <id>] <debuggable> [<address> <size>]\n"
+	       "  openmsx_subscribe remove [-machine <id>] <debuggable>\n"
+	       "  openmsx_subscribe list\n";
+}
+
+void GlobalCommandController::SubscribeCmd::tabCompletion(vector<string>& tokens) const
+{
+	if (tokens.size() == 2) {
+		static constexpr const char* const ops[] = { "add", "remove", "list" };
+		completeString(tokens, ops);
+	}
+}
+
+
 // Platform info
 
 GlobalCommandController::PlatformInfo::PlatformInfo(InfoCommand& openMSXInfoCommand_)
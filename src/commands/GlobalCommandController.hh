@@ -135,6 +135,13 @@ private:
 		CliConnection& getConnection();
 	} updateCmd;
 
+	struct SubscribeCmd final : Command {
+		explicit SubscribeCmd(CommandController& commandController);
+		void execute(span<const TclObject> tokens, TclObject& result) override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+		void tabCompletion(std::vector<std::string>& tokens) const override;
+	} subscribeCmd;
+
 	struct PlatformInfo final : InfoTopic {
 		explicit PlatformInfo(InfoCommand& openMSXInfoCommand);
 		void execute(span<const TclObject> tokens,
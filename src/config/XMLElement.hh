@@ -40,6 +40,9 @@ public:
 	}
 
 	// attribute
+	using Attribute = std::pair<std::string, std::string>;
+	using Attributes = std::vector<Attribute>;
+	const Attributes& getAttributes() const { return attributes; }
 	void addAttribute(std::string name, std::string value);
 	void setAttribute(std::string_view name, std::string value);
 	void removeAttribute(std::string_view name);
@@ -116,8 +119,6 @@ public:
 	static std::unique_ptr<FileContext> getLastSerializedFileContext();
 
 private:
-	using Attribute = std::pair<std::string, std::string>;
-	using Attributes = std::vector<Attribute>;
 	Attributes::iterator getAttributeIter(std::string_view attrName);
 	Attributes::const_iterator getAttributeIter(std::string_view attrName) const;
 	void dump(std::string& result, unsigned indentNum) const;
@@ -1,7 +1,9 @@
 #ifndef BREAKPOINTBASE_HH
 #define BREAKPOINTBASE_HH
 
+#include "CompiledCondition.hh"
 #include "TclObject.hh"
+#include <memory>
 #include <string_view>
 
 namespace openmsx {
@@ -20,7 +22,12 @@ public:
 	TclObject getCommandObj()   const { return command; }
 	bool onlyOnce() const { return once; }
 
-	void checkAndExecute(GlobalCliComm& cliComm, Interpreter& interp);
+	/** Evaluate the condition and, if true, execute the command.
+	  * When a context is given and the condition could be compiled, the
+	  * condition is evaluated natively instead of via Tcl.
+	  */
+	void checkAndExecute(GlobalCliComm& cliComm, Interpreter& interp,
+	                     CompiledCondition::Context* context = nullptr);
 
 protected:
 	// Note: we require GlobalCliComm here because breakpoint objects can
@@ -29,13 +36,16 @@ protected:
 	BreakPointBase(TclObject command_, TclObject condition_, bool once_)
 		: command(std::move(command_))
 		, condition(std::move(condition_))
+		, compiledCondition(CompiledCondition::compile(condition.getString()))
 		, once(once_) {}
 
 private:
-	bool isTrue(GlobalCliComm& cliComm, Interpreter& interp) const;
+	bool isTrue(GlobalCliComm& cliComm, Interpreter& interp,
+	            CompiledCondition::Context* context) const;
 
 	TclObject command;
 	TclObject condition;
+	std::shared_ptr<const CompiledCondition> compiledCondition; // can be nullptr
 	bool once;
 	bool executing = false;
 };
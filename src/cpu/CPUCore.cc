@@ -165,6 +165,7 @@
 #include "CliComm.hh"
 #include "TclCallback.hh"
 #include "Dasm.hh"
+#include "InstructionTrace.hh"
 #include "Z80.hh"
 #include "R800.hh"
 #include "Thread.hh"
@@ -172,6 +173,7 @@
 #include "likely.hh"
 #include "inline.hh"
 #include "unreachable.hh"
+#include "xrange.hh"
 #include <iostream>
 #include <type_traits>
 #include <cassert>
@@ -836,6 +838,21 @@ template<class T> inline void CPUCore<T>::irq2()
 	T::add(T::CC_IRQ2);
 }
 
+template<class T> inline void CPUCore<T>::traceInstruction()
+{
+	if (!instructionTrace) return;
+	auto time = T::getTimeFast();
+	byte opcode[4];
+	for (auto i : xrange(4)) {
+		unsigned address = (getPC() + i) & 0xFFFF;
+		const byte* line = readCacheLine[address >> CacheLine::BITS];
+		opcode[i] = (uintptr_t(line) > 1)
+		          ? line[address]
+		          : interface->peekMem(address, time);
+	}
+	instructionTrace->record(*this, time, opcode, T::isR800());
+}
+
 template<class T>
 void CPUCore<T>::executeInstructions()
 {
@@ -885,6 +902,7 @@ void CPUCore<T>::executeInstructions()
 	T::add(ii.cycles); \
 	T::R800Refresh(*this); \
 	if (likely(!T::limitReached())) { \
+		if constexpr (TRACE_INSTRUCTIONS) traceInstruction(); \
 		incR(1); \
 		unsigned address = getPC(); \
 		const byte* line = readCacheLine[address >> CacheLine::BITS]; \
@@ -949,6 +967,7 @@ void CPUCore<T>::executeInstructions()
 #ifndef USE_COMPUTED_GOTO
 start:
 #endif
+	if constexpr (TRACE_INSTRUCTIONS) traceInstruction();
 	unsigned ixy; // for dd_cb/fd_cb
 	byte opcodeMain = RDMEM_OPCODE<0>(T::CC_MAIN);
 	incR(1);
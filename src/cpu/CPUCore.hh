@@ -16,6 +16,7 @@
 namespace openmsx {
 
 class MSXCPUInterface;
+class InstructionTrace;
 class Scheduler;
 class MSXMotherBoard;
 class TclCallback;
@@ -54,6 +55,7 @@ public:
 	        TclCallback& diHaltCallback, EmuTime::param time);
 
 	void setInterface(MSXCPUInterface* interf) { interface = interf; }
+	void setInstructionTrace(InstructionTrace* trace) { instructionTrace = trace; }
 
 	/**
 	 * Reset the CPU.
@@ -136,6 +138,7 @@ private:
 	MSXMotherBoard& motherboard;
 	Scheduler& scheduler;
 	MSXCPUInterface* interface;
+	InstructionTrace* instructionTrace = nullptr; // see TRACE_INSTRUCTIONS
 
 	const BooleanSetting& traceSetting;
 	TclCallback& diHaltCallback;
@@ -168,6 +171,8 @@ private:
 	const bool isTurboR;
 
 
+	inline void traceInstruction();
+
 	inline void cpuTracePre();
 	inline void cpuTracePost();
 	void cpuTracePost_slow();
@@ -0,0 +1,593 @@
+#include "CompiledCondition.hh"
+#include "Debuggable.hh"
+#include "ranges.hh"
+#include "span.hh"
+#include "unreachable.hh"
+#include "xrange.hh"
+#include <cassert>
+#include <cctype>
+#include <limits>
+#include <utility>
+
+namespace openmsx {
+
+using Node = CompiledCondition::Node;
+using Env  = CompiledCondition::Env;
+
+static constexpr size_t MAX_DEBUGGABLES = 8;
+static constexpr int64_t MIN_VAL = std::numeric_limits<int64_t>::min();
+static constexpr int64_t MAX_VAL = std::numeric_limits<int64_t>::max();
+
+struct CompiledCondition::Env
+{
+	Context& context;
+	Debuggable* const* debuggables;
+};
+
+// Thrown while parsing: the expression is not supported.
+struct Unsupported {};
+// Thrown while evaluating: let Tcl evaluate the expression instead.
+struct EvalError {};
+
+struct Expr
+{
+	Node node;
+	// Tcl procs like 'pc_in_slot' return the string "true", that's only
+	// valid in a boolean context, e.g. '[pc_in_slot 1] == 1' is a string
+	// comparison that is always false. Such expressions are represented as
+	// 0/1 here, but can only be used as operand of && || ! and ?:.
+	bool boolOnly = false;
+};
+
+struct Word
+{
+	std::string literal;
+	std::optional<Expr> nested;
+};
+
+static bool isSpace(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+static bool isWordChar(char c)
+{
+	return std::isalnum(static_cast<unsigned char>(c)) || (c == '_') || (c == '.');
+}
+
+// Parses an integer like Tcl does (but without the octal notation with only
+// a leading zero, that notation changed meaning between Tcl versions).
+static int64_t parseInt(std::string_view s, bool allowSign)
+{
+	bool negative = false;
+	if (allowSign && !s.empty() && ((s[0] == '-') || (s[0] == '+'))) {
+		negative = s[0] == '-';
+		s.remove_prefix(1);
+	}
+	if (s.empty()) throw Unsupported();
+
+	unsigned base = 10;
+	if ((s.size() > 1) && (s[0] == '0')) {
+		switch (s[1]) {
+			case 'x': case 'X': base = 16; break;
+			case 'o': case 'O': base =  8; break;
+			case 'b': case 'B': base =  2; break;
+			default: throw Unsupported(); // octal or floating point
+		}
+		s.remove_prefix(2);
+		if (s.empty()) throw Unsupported();
+	}
+
+	uint64_t value = 0;
+	for (char c : s) {
+		unsigned digit;
+		if (('0' <= c) && (c <= '9')) {
+			digit = c - '0';
+		} else if (('a' <= c) && (c <= 'f')) {
+			digit = c - 'a' + 10;
+		} else if (('A' <= c) && (c <= 'F')) {
+			digit = c - 'A' + 10;
+		} else {
+			throw Unsupported();
+		}
+		if (digit >= base) throw Unsupported();
+		if (value > (uint64_t(MAX_VAL) - digit) / base) throw Unsupported();
+		value = value * base + digit;
+	}
+	return negative ? -int64_t(value) : int64_t(value);
+}
+
+static Node constant(int64_t value)
+{
+	return [value](Env&) { return value; };
+}
+
+static int64_t readByte(Env& env, unsigned idx, int64_t addr)
+{
+	auto* debuggable = env.debuggables[idx];
+	if ((addr < 0) || (addr >= debuggable->getSize())) {
+		throw EvalError(); // Tcl reports "Invalid address"
+	}
+	return debuggable->read(unsigned(addr));
+}
+
+static int64_t add(int64_t a, int64_t b)
+{
+	if (((b > 0) && (a > MAX_VAL - b)) || ((b < 0) && (a < MIN_VAL - b))) {
+		throw EvalError(); // Tcl switches to big integers
+	}
+	return a + b;
+}
+
+static int64_t sub(int64_t a, int64_t b)
+{
+	if (((b < 0) && (a > MAX_VAL + b)) || ((b > 0) && (a < MIN_VAL + b))) {
+		throw EvalError();
+	}
+	return a - b;
+}
+
+static int64_t mul(int64_t a, int64_t b)
+{
+	if (a == 0) return 0;
+	if (a == -1) {
+		if (b == MIN_VAL) throw EvalError();
+		return -b;
+	}
+	auto r = int64_t(uint64_t(a) * uint64_t(b));
+	if ((r / a) != b) throw EvalError();
+	return r;
+}
+
+static int64_t divide(int64_t a, int64_t b)
+{
+	if ((b == 0) || ((a == MIN_VAL) && (b == -1))) throw EvalError();
+	// Tcl rounds towards negative infinity
+	auto q = a / b;
+	if (((a % b) != 0) && ((a < 0) != (b < 0))) --q;
+	return q;
+}
+
+static int64_t modulo(int64_t a, int64_t b)
+{
+	if (b == 0) throw EvalError();
+	if (b == -1) return 0;
+	// result has the same sign as the divisor
+	auto r = a % b;
+	if ((r != 0) && ((r < 0) != (b < 0))) r += b;
+	return r;
+}
+
+static int64_t shiftLeft(int64_t a, int64_t b)
+{
+	if (b < 0) throw EvalError(); // negative shift argument
+	if (a == 0) return 0;
+	if (b >= 63) throw EvalError();
+	auto r = int64_t(uint64_t(a) << b);
+	if ((r >> b) != a) throw EvalError();
+	return r;
+}
+
+static int64_t shiftRight(int64_t a, int64_t b)
+{
+	if (b < 0) throw EvalError();
+	return a >> std::min<int64_t>(b, 63);
+}
+
+
+class ConditionParser
+{
+public:
+	ConditionParser(std::string_view str_, CompiledCondition& cc_)
+		: str(str_), cc(cc_) {}
+
+	Expr parse()
+	{
+		auto result = parseTernary();
+		skipSpace();
+		if (pos != str.size()) throw Unsupported();
+		return result;
+	}
+
+private:
+	void skipSpace()
+	{
+		while ((pos < str.size()) && isSpace(str[pos])) ++pos;
+	}
+
+	[[nodiscard]] char look(size_t offset = 0) const
+	{
+		return (pos + offset < str.size()) ? str[pos + offset] : '\0';
+	}
+
+	bool consume(std::string_view token)
+	{
+		skipSpace();
+		if (str.substr(pos, token.size()) != token) return false;
+		pos += token.size();
+		return true;
+	}
+
+	// Binary operators, from low to high priority. An operator does not
+	// match when it's followed by one of the 'notFollowedBy' characters
+	// (e.g. '<' should not match "<<" or "<=").
+	struct Operator {
+		std::string_view token;
+		std::string_view notFollowedBy;
+	};
+	static constexpr Operator ops0[] = {{"||", ""}};
+	static constexpr Operator ops1[] = {{"&&", ""}};
+	static constexpr Operator ops2[] = {{"|", "|"}};
+	static constexpr Operator ops3[] = {{"^", ""}};
+	static constexpr Operator ops4[] = {{"&", "&"}};
+	static constexpr Operator ops5[] = {{"==", ""}, {"!=", ""}};
+	static constexpr Operator ops6[] = {{"<=", ""}, {">=", ""}, {"<", "<="}, {">", ">="}};
+	static constexpr Operator ops7[] = {{"<<", ""}, {">>", ""}};
+	static constexpr Operator ops8[] = {{"+", ""}, {"-", ""}};
+	static constexpr Operator ops9[] = {{"*", "*"}, {"/", ""}, {"%", ""}};
+	static constexpr span<const Operator> levels[] = {
+		ops0, ops1, ops2, ops3, ops4, ops5, ops6, ops7, ops8, ops9,
+	};
+
+	std::string_view matchOperator(span<const Operator> ops)
+	{
+		skipSpace();
+		for (const auto& op : ops) {
+			if (str.substr(pos, op.token.size()) != op.token) continue;
+			char next = look(op.token.size());
+			if ((next != '\0') && (op.notFollowedBy.find(next) != std::string_view::npos)) continue;
+			pos += op.token.size();
+			return op.token;
+		}
+		return {};
+	}
+
+	Expr parseTernary()
+	{
+		auto cond = parseBinary(0);
+		if (!consume("?")) return cond;
+		auto t = parseTernary();
+		if (!consume(":")) throw Unsupported();
+		auto f = parseTernary();
+		bool boolOnly = t.boolOnly || f.boolOnly;
+		return {[c = std::move(cond.node), t = std::move(t.node), f = std::move(f.node)](Env& env) {
+				return c(env) ? t(env) : f(env);
+			}, boolOnly};
+	}
+
+	Expr parseBinary(size_t level)
+	{
+		if (level == std::size(levels)) return parseUnary();
+		auto lhs = parseBinary(level + 1);
+		while (true) {
+			auto op = matchOperator(levels[level]);
+			if (op.empty()) return lhs;
+			auto rhs = parseBinary(level + 1);
+			lhs = combine(op, std::move(lhs), std::move(rhs));
+		}
+	}
+
+	static Expr combine(std::string_view op, Expr lhs, Expr rhs)
+	{
+		auto a = std::move(lhs.node);
+		auto b = std::move(rhs.node);
+		if (op == "||") return {[a, b](Env& e) -> int64_t { return a(e) || b(e); }};
+		if (op == "&&") return {[a, b](Env& e) -> int64_t { return a(e) && b(e); }};
+
+		if (lhs.boolOnly || rhs.boolOnly) throw Unsupported();
+		if (op == "|")  return {[a, b](Env& e) -> int64_t { return a(e) |  b(e); }};
+		if (op == "^")  return {[a, b](Env& e) -> int64_t { return a(e) ^  b(e); }};
+		if (op == "&")  return {[a, b](Env& e) -> int64_t { return a(e) &  b(e); }};
+		if (op == "==") return {[a, b](Env& e) -> int64_t { return a(e) == b(e); }};
+		if (op == "!=") return {[a, b](Env& e) -> int64_t { return a(e) != b(e); }};
+		if (op == "<=") return {[a, b](Env& e) -> int64_t { return a(e) <= b(e); }};
+		if (op == ">=") return {[a, b](Env& e) -> int64_t { return a(e) >= b(e); }};
+		if (op == "<")  return {[a, b](Env& e) -> int64_t { return a(e) <  b(e); }};
+		if (op == ">")  return {[a, b](Env& e) -> int64_t { return a(e) >  b(e); }};
+		// Note: the 2nd operand must be evaluated after the 1st one, so
+		// don't pass both as function arguments.
+		auto binary = [&](int64_t (*f)(int64_t, int64_t)) -> Expr {
+			return {[a, b, f](Env& e) { auto x = a(e); return f(x, b(e)); }};
+		};
+		if (op == "<<") return binary(shiftLeft);
+		if (op == ">>") return binary(shiftRight);
+		if (op == "+")  return binary(add);
+		if (op == "-")  return binary(sub);
+		if (op == "*")  return binary(mul);
+		if (op == "/")  return binary(divide);
+		if (op == "%")  return binary(modulo);
+		UNREACHABLE; return {};
+	}
+
+	Expr parseUnary()
+	{
+		skipSpace();
+		char c = look();
+		if ((c == '-') || (c == '+') || (c == '~') || (c == '!')) {
+			if ((c == '!') && (look(1) == '=')) throw Unsupported();
+			++pos;
+			auto e = parseUnary();
+			auto a = std::move(e.node);
+			if (c == '!') return {[a](Env& env) -> int64_t { return !a(env); }};
+			if (e.boolOnly) throw Unsupported();
+			if (c == '+') return {std::move(a)};
+			if (c == '~') return {[a](Env& env) -> int64_t { return ~a(env); }};
+			return {[a](Env& env) { return sub(0, a(env)); }};
+		}
+		return parsePrimary();
+	}
+
+	Expr parsePrimary()
+	{
+		skipSpace();
+		char c = look();
+		if (c == '(') {
+			++pos;
+			auto e = parseTernary();
+			if (!consume(")")) throw Unsupported();
+			return e;
+		} else if (c == '[') {
+			return parseCommand();
+		} else if (std::isdigit(static_cast<unsigned char>(c))) {
+			auto start = pos;
+			while (isWordChar(look())) ++pos;
+			return {constant(parseInt(str.substr(start, pos - start), false))};
+		}
+		// variables, strings, functions, ...
+		throw Unsupported();
+	}
+
+	// Parse a Tcl command substitution, only a few specific commands are
+	// supported.
+	Expr parseCommand()
+	{
+		assert(look() == '[');
+		++pos;
+		std::vector<Word> words;
+		while (true) {
+			while ((look() == ' ') || (look() == '\t')) ++pos;
+			char c = look();
+			if (c == ']') { ++pos; break; }
+			if (c == '\0') throw Unsupported();
+			words.push_back(parseWord());
+			char next = look();
+			if ((next != ' ') && (next != '\t') && (next != ']')) {
+				throw Unsupported();
+			}
+		}
+		return translateCommand(words);
+	}
+
+	Word parseWord()
+	{
+		Word result;
+		char c = look();
+		if (c == '[') {
+			result.nested = parseCommand();
+			return result;
+		}
+		auto isSpecial = [](char ch) {
+			return (ch == '$') || (ch == '[') || (ch == '\\') || (ch == ';') ||
+			       (ch == '{') || (ch == '}') || (ch == '"')  || (ch == '\n');
+		};
+		char close = (c == '"') ? '"' : (c == '{') ? '}' : '\0';
+		if (close) ++pos;
+		while (true) {
+			char ch = look();
+			if (ch == '\0') throw Unsupported();
+			if (close) {
+				if (ch == close) { ++pos; break; }
+			} else {
+				if ((ch == ' ') || (ch == '\t') || (ch == ']')) break;
+			}
+			if (isSpecial(ch)) throw Unsupported();
+			result.literal += ch;
+			++pos;
+		}
+		return result;
+	}
+
+	static Node intArg(const Word& arg)
+	{
+		if (arg.nested) {
+			if (arg.nested->boolOnly) throw Unsupported();
+			return arg.nested->node;
+		}
+		return constant(parseInt(arg.literal, true));
+	}
+
+	static const std::string& literalArg(const Word& arg)
+	{
+		if (arg.nested) throw Unsupported();
+		return arg.literal;
+	}
+
+	unsigned debuggable(std::string_view name)
+	{
+		auto& names = cc.debuggableNames;
+		if (auto it = ranges::find(names, name); it != end(names)) {
+			return unsigned(it - begin(names));
+		}
+		if (names.size() == MAX_DEBUGGABLES) throw Unsupported();
+		names.emplace_back(name);
+		return unsigned(names.size() - 1);
+	}
+
+	Expr translateCommand(const std::vector<Word>& words)
+	{
+		if (words.empty()) throw Unsupported();
+		std::string_view cmd = literalArg(words[0]);
+		if (cmd.substr(0, 2) == "::") cmd.remove_prefix(2);
+
+		if (cmd == "reg") {
+			return reg(words);
+		} else if (cmd == "debug") {
+			if ((words.size() != 4) || (literalArg(words[1]) != "read")) {
+				throw Unsupported();
+			}
+			auto idx = debuggable(literalArg(words[2]));
+			return {[idx, addr = intArg(words[3])](Env& env) {
+				return readByte(env, idx, addr(env));
+			}};
+		} else if (cmd == "pc_in_slot") {
+			return pcInSlot(words);
+		} else {
+			return peekCmd(cmd, words);
+		}
+	}
+
+	// See 'reg' in _cpuregs.tcl
+	Expr reg(const std::vector<Word>& words)
+	{
+		if (words.size() != 2) throw Unsupported(); // setting a register
+		std::string name = literalArg(words[1]);
+		for (auto& ch : name) ch = char(std::toupper(static_cast<unsigned char>(ch)));
+
+		static constexpr std::pair<std::string_view, unsigned> regB[] = {
+			{"A",    0}, {"F",    1}, {"B",    2}, {"C",    3},
+			{"D",    4}, {"E",    5}, {"H",    6}, {"L",    7},
+			{"A2",   8}, {"F2",   9}, {"B2",  10}, {"C2",  11},
+			{"D2",  12}, {"E2",  13}, {"H2",  14}, {"L2",  15},
+			{"IXH", 16}, {"IXL", 17}, {"IYH", 18}, {"IYL", 19},
+			{"PCH", 20}, {"PCL", 21}, {"SPH", 22}, {"SPL", 23},
+			{"I",   24}, {"R",   25}, {"IM",  26}, {"IFF", 27},
+		};
+		static constexpr std::pair<std::string_view, unsigned> regW[] = {
+			{"AF",   0}, {"BC",   2}, {"DE",   4}, {"HL",   6},
+			{"AF2",  8}, {"BC2", 10}, {"DE2", 12}, {"HL2", 14},
+			{"IX",  16}, {"IY",  18}, {"PC",  20}, {"SP",  22},
+		};
+		auto idx = debuggable("CPU regs");
+		if (auto it = ranges::find_if(regB, [&](auto& p) { return p.first == name; });
+		    it != std::end(regB)) {
+			return {[idx, i = it->second](Env& env) {
+				return readByte(env, idx, i);
+			}};
+		}
+		if (auto it = ranges::find_if(regW, [&](auto& p) { return p.first == name; });
+		    it != std::end(regW)) {
+			return {[idx, i = it->second](Env& env) {
+				return 256 * readByte(env, idx, i) + readByte(env, idx, i + 1);
+			}};
+		}
+		throw Unsupported(); // let Tcl report the error
+	}
+
+	// See the 'peek' procs in _disasm.tcl
+	Expr peekCmd(std::string_view cmd, const std::vector<Word>& words)
+	{
+		enum Kind { U8, S8, U16LE, U16BE, S16LE, S16BE };
+		static constexpr std::pair<std::string_view, Kind> procs[] = {
+			{"peek",       U8   }, {"peek8",      U8   }, {"peek_u8",    U8   },
+			{"peek_s8",    S8   },
+			{"peek16",     U16LE}, {"peek16_LE",  U16LE}, {"peek_u16",   U16LE},
+			{"peek_u16LE", U16LE},
+			{"peek16_BE",  U16BE}, {"peek_u16BE", U16BE},
+			{"peek_s16",   S16LE}, {"peek_s16LE", S16LE},
+			{"peek_s16BE", S16BE},
+		};
+		auto it = ranges::find_if(procs, [&](auto& p) { return p.first == cmd; });
+		if (it == std::end(procs)) throw Unsupported();
+		if ((words.size() != 2) && (words.size() != 3)) throw Unsupported();
+
+		auto idx = debuggable((words.size() == 3) ? literalArg(words[2])
+		                                           : std::string_view("memory"));
+		auto addr = intArg(words[1]);
+		auto read16 = [idx](Env& env, int64_t a, bool le) {
+			auto b0 = readByte(env, idx, a);
+			auto b1 = readByte(env, idx, a + 1);
+			return le ? (b0 + 256 * b1) : (256 * b0 + b1);
+		};
+		switch (it->second) {
+		case U8:
+			return {[idx, addr](Env& env) {
+				return readByte(env, idx, addr(env));
+			}};
+		case S8:
+			return {[idx, addr](Env& env) {
+				auto b = readByte(env, idx, addr(env));
+				return (b < 128) ? b : (b - 256);
+			}};
+		case U16LE:
+		case U16BE:
+			return {[addr, read16, le = it->second == U16LE](Env& env) {
+				return read16(env, addr(env), le);
+			}};
+		case S16LE:
+		case S16BE:
+			return {[addr, read16, le = it->second == S16LE](Env& env) {
+				auto w = read16(env, addr(env), le);
+				return (w < 32768) ? w : (w - 65536);
+			}};
+		}
+		UNREACHABLE; return {};
+	}
+
+	// See 'pc_in_slot' and 'address_in_slot' in _slot.tcl (the variant
+	// with a mapper block is not supported).
+	Expr pcInSlot(const std::vector<Word>& words)
+	{
+		if ((words.size() != 2) && (words.size() != 3)) throw Unsupported();
+		auto slotArg = [](const Word& arg) -> int64_t {
+			if (literalArg(arg) == "X") return -1; // any slot
+			return parseInt(arg.literal, true);
+		};
+		auto ps = slotArg(words[1]);
+		auto ss = (words.size() == 3) ? slotArg(words[2]) : -1;
+
+		auto regs    = debuggable("CPU regs");
+		auto ioports = debuggable("ioports");
+		auto slotted = debuggable("slotted memory");
+		return {[=](Env& env) -> int64_t {
+			auto pc = 256 * readByte(env, regs, 20) + readByte(env, regs, 21);
+			auto page = pc >> 14;
+			auto pcPs = (readByte(env, ioports, 0xA8) >> (2 * page)) & 3;
+			if ((ps != -1) && (pcPs != ps)) return 0;
+			if ((ss != -1) && env.context.isExpanded(int(pcPs))) {
+				auto ssReg = readByte(env, slotted, 0x40000 * pcPs + 0xFFFF);
+				auto pcSs = ((ssReg ^ 255) >> (2 * page)) & 3;
+				if (pcSs != ss) return 0;
+			}
+			return 1; // "true"
+		}, true};
+	}
+
+private:
+	std::string_view str;
+	size_t pos = 0;
+	CompiledCondition& cc;
+};
+
+
+std::unique_ptr<CompiledCondition> CompiledCondition::compile(
+	std::string_view expression)
+{
+	// (private constructor, so can't use std::make_unique())
+	std::unique_ptr<CompiledCondition> result(new CompiledCondition());
+	try {
+		result->root = ConditionParser(expression, *result).parse().node;
+	} catch (Unsupported&) {
+		return nullptr;
+	}
+	return result;
+}
+
+std::optional<bool> CompiledCondition::evaluate(Context& context) const
+{
+	// Look up the debuggables on each evaluation, they can be (un)registered
+	// at any time (e.g. when a cartridge is inserted) and a condition can be
+	// transferred to a different machine.
+	Debuggable* debuggables[MAX_DEBUGGABLES];
+	for (auto i : xrange(debuggableNames.size())) {
+		debuggables[i] = context.findDebuggable(debuggableNames[i]);
+		if (!debuggables[i]) return {};
+	}
+	Env env{context, debuggables};
+	try {
+		return root(env) != 0;
+	} catch (EvalError&) {
+		return {};
+	}
+}
+
+} // namespace openmsx
@@ -0,0 +1,75 @@
+#ifndef COMPILEDCONDITION_HH
+#define COMPILEDCONDITION_HH
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace openmsx {
+
+class Debuggable;
+
+/** Native version of a (simple) breakpoint/condition Tcl expression.
+ *
+ * Conditions are evaluated after every emulated instruction, evaluating them
+ * via Tcl is very slow. This class handles the most common subset of Tcl
+ * expressions:
+ *  - integer literals, parentheses, the ?: operator
+ *  - the unary operators - + ~ !
+ *  - the binary operators * / % + - << >> < > <= >= == != & ^ | && ||
+ *  - the commands 'reg', 'peek' (and all its variants from _disasm.tcl),
+ *    'debug read' and 'pc_in_slot <ps> [<ss>]'
+ * These commands are evaluated directly on the debuggables, just like the
+ * corresponding Tcl procs would do.
+ *
+ * Anything outside this subset (variables, strings, floating point, other
+ * commands, ...) makes compile() fail, in that case the condition should be
+ * evaluated via Tcl like before.
+ */
+class CompiledCondition
+{
+public:
+	/** Provides access to the machine on which the condition is checked. */
+	class Context
+	{
+	public:
+		virtual Debuggable* findDebuggable(std::string_view name) = 0;
+		virtual bool isExpanded(int ps) = 0;
+	protected:
+		~Context() = default;
+	};
+
+	/** Try to compile the given Tcl expression.
+	  * @return nullptr if the expression is not supported.
+	  */
+	[[nodiscard]] static std::unique_ptr<CompiledCondition> compile(
+		std::string_view expression);
+
+	/** Evaluate the condition.
+	  * @return An empty optional when the evaluation failed (e.g. unknown
+	  *         debuggable, invalid address, division by zero, integer
+	  *         overflow). The caller should then fall back to Tcl, which
+	  *         will either calculate the correct result or report the
+	  *         error.
+	  */
+	[[nodiscard]] std::optional<bool> evaluate(Context& context) const;
+
+	// internal
+	struct Env;
+	using Node = std::function<int64_t(Env&)>;
+
+private:
+	CompiledCondition() = default;
+	friend class ConditionParser;
+
+	std::vector<std::string> debuggableNames;
+	Node root;
+};
+
+} // namespace openmsx
+
+#endif
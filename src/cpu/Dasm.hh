@@ -21,6 +21,14 @@ class MSXCPUInterface;
 unsigned dasm(const MSXCPUInterface& interf, word pc, byte buf[4],
               std::string& dest, EmuTime::param time);
 
+/** Disassemble an already fetched opcode
+  * @param opcode The (up to 4) bytes at the given position
+  * @param pc The position (program counter) of the opcode
+  * @param dest String representation of the disassembled opcode
+  * @return Length of the disassembled opcode in bytes
+  */
+unsigned dasm(const byte opcode[4], word pc, std::string& dest);
+
 } // namespace openmsx
 
 #endif
@@ -0,0 +1,157 @@
+#include "InstructionTrace.hh"
+#include "Dasm.hh"
+#include "MSXMotherBoard.hh"
+#include "CommandException.hh"
+#include "TclObject.hh"
+#include "outer.hh"
+#include "strCat.hh"
+#include "xrange.hh"
+
+using std::string;
+using std::vector;
+
+namespace openmsx {
+
+InstructionTraceBuffer::InstructionTraceBuffer()
+	: ring(std::make_unique<Entry[]>(CAPACITY))
+{
+}
+
+void InstructionTraceBuffer::format(const Entry& e, string& result, string& dasmOutput)
+{
+	dasmOutput.clear();
+	unsigned len = dasm(e.opcode, e.pc, dasmOutput);
+	string bytes;
+	for (auto j : xrange(4u)) {
+		if (j < len) {
+			strAppend(bytes, hex_string<2>(e.opcode[j]), ' ');
+		} else {
+			bytes += "   ";
+		}
+	}
+	strAppend(result, EmuDuration(e.time).toDouble(), ' ',
+	          (e.iff & 0x80) ? "r800" : "z80 ", ' ',
+	          hex_string<4>(e.pc), "  ", bytes, dasmOutput,
+	          " AF=", hex_string<4>(e.af),
+	          " BC=", hex_string<4>(e.bc),
+	          " DE=", hex_string<4>(e.de),
+	          " HL=", hex_string<4>(e.hl),
+	          " IX=", hex_string<4>(e.ix),
+	          " IY=", hex_string<4>(e.iy),
+	          " SP=", hex_string<4>(e.sp),
+	          " AF'=", hex_string<4>(e.af2),
+	          " BC'=", hex_string<4>(e.bc2),
+	          " DE'=", hex_string<4>(e.de2),
+	          " HL'=", hex_string<4>(e.hl2),
+	          " I=", hex_string<2>(e.i),
+	          " R=", hex_string<2>(e.r),
+	          " IM=", int(e.im),
+	          " IFF=", int(e.iff & 3), '\n');
+}
+
+
+// class InstructionTrace
+
+InstructionTrace::InstructionTrace(MSXMotherBoard& motherBoard)
+	: debuggable(motherBoard)
+	, traceCmd(motherBoard.getCommandController())
+{
+}
+
+void InstructionTrace::dump(span<const TclObject> tokens, TclObject& result) const
+{
+	unsigned num = size();
+	if (tokens.size() == 3) {
+		int n = tokens[2].getInt(traceCmd.getInterpreter());
+		if (n < 0) throw CommandException("count must be non-negative");
+		num = std::min(num, unsigned(n));
+	}
+	string res;
+	string dasmOutput;
+	for (auto n : xrange(size() - num, size())) {
+		format((*this)[n], res, dasmOutput);
+	}
+	result = res;
+}
+
+
+// class Debuggable
+
+InstructionTrace::Debuggable::Debuggable(MSXMotherBoard& motherboard_)
+	: SimpleDebuggable(motherboard_, "cpu trace",
+		strCat("The most recently executed CPU instructions, oldest "
+		       "first. Each entry is ", sizeof(Entry), " bytes: the "
+		       "EmuTime (64-bit), AF BC DE HL AF' BC' DE' HL' IX IY SP "
+		       "PC (16-bit each), I R IM, IFF1 (bit 0) IFF2 (bit 1) "
+		       "R800 (bit 7) and the 4 bytes at PC. All multi-byte "
+		       "values are little endian. Unused entries read as 0."),
+		CAPACITY * sizeof(Entry))
+{
+}
+
+byte InstructionTrace::Debuggable::read(unsigned address)
+{
+	auto& trace = OUTER(InstructionTrace, debuggable);
+	unsigned n = address / sizeof(Entry);
+	if (n >= trace.size()) return 0;
+	const auto& e = trace[n];
+	unsigned offset = address % sizeof(Entry);
+	if (offset < 8) {
+		return byte(e.time >> (8 * offset));
+	}
+	offset -= 8;
+	if (offset < 24) {
+		const uint16_t words[12] = {
+			e.af, e.bc, e.de, e.hl, e.af2, e.bc2, e.de2, e.hl2,
+			e.ix, e.iy, e.sp, e.pc,
+		};
+		auto w = words[offset / 2];
+		return (offset & 1) ? byte(w >> 8) : byte(w & 0xFF);
+	}
+	offset -= 24;
+	const byte bytes[8] = {
+		e.i, e.r, e.im, e.iff,
+		e.opcode[0], e.opcode[1], e.opcode[2], e.opcode[3],
+	};
+	return bytes[offset];
+}
+
+
+// class TraceCmd
+
+InstructionTrace::TraceCmd::TraceCmd(CommandController& controller)
+	: Command(controller, "cpu_trace")
+{
+}
+
+void InstructionTrace::TraceCmd::execute(span<const TclObject> tokens, TclObject& result)
+{
+	checkNumArgs(tokens, AtLeast{2}, "subcommand ?arg ...?");
+	auto& trace = OUTER(InstructionTrace, traceCmd);
+	executeSubCommand(tokens[1].getString(),
+		"dump",  [&]{
+			checkNumArgs(tokens, Between{2, 3}, "?count?");
+			trace.dump(tokens, result);
+		},
+		"size",  [&]{ result = int(trace.size()); },
+		"clear", [&]{ trace.clear(); });
+}
+
+string InstructionTrace::TraceCmd::help(const vector<string>& /*tokens*/) const
+{
+	return "dump [<count>]  show the last <count> (default all) executed instructions\n"
+	       "size            number of recorded instructions\n"
+	       "clear           remove all recorded instructions\n";
+}
+
+void InstructionTrace::TraceCmd::tabCompletion(vector<string>& tokens) const
+{
+	if (tokens.size() == 2) {
+		static constexpr const char* const subCommands[] = {
+			"dump", "size", "clear",
+		};
+		completeString(tokens, subCommands);
+	}
+}
+
+} // namespace openmsx
@@ -0,0 +1,113 @@
+#ifndef INSTRUCTIONTRACE_HH
+#define INSTRUCTIONTRACE_HH
+
+#include "Command.hh"
+#include "SimpleDebuggable.hh"
+#include "CPURegs.hh"
+#include "EmuTime.hh"
+#include "openmsx.hh"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace openmsx {
+
+class MSXMotherBoard;
+
+// Set to true to record the most recently executed CPU instructions in a ring
+// buffer (see the 'cpu_trace' command and the "cpu trace" debuggable). This is
+// meant for debugging the emulator itself (or for very detailed debugging of
+// MSX software). When false, all related code is optimized away.
+constexpr bool TRACE_INSTRUCTIONS = false;
+
+/** Records the state of the CPU right before each executed instruction.
+  *
+  * The storage is allocated once (in the constructor), recording an
+  * instruction only copies a few registers into the next ring buffer slot.
+  * There is one buffer per MSX machine, shared by the Z80 and the R800 (only
+  * one of them is active at any time).
+  */
+class InstructionTraceBuffer
+{
+public:
+	/** Number of recorded instructions, must be a power of 2. */
+	static constexpr unsigned CAPACITY = 1 << 16;
+
+	struct Entry {
+		uint64_t time; // in EmuTime ticks
+		uint16_t af, bc, de, hl, af2, bc2, de2, hl2, ix, iy, sp, pc;
+		byte i, r, im;
+		byte iff; // bit 0: IFF1, bit 1: IFF2, bit 7: executed by the R800
+		byte opcode[4];
+	};
+	static_assert(sizeof(Entry) == 40);
+
+	InstructionTraceBuffer();
+
+	void record(const CPURegs& regs, EmuTime::param time,
+	            const byte opcode[4], bool r800)
+	{
+		auto& e = ring[head++ & (CAPACITY - 1)];
+		e.time = (time - EmuTime::zero()).length();
+		e.af  = regs.getAF();  e.bc  = regs.getBC();
+		e.de  = regs.getDE();  e.hl  = regs.getHL();
+		e.af2 = regs.getAF2(); e.bc2 = regs.getBC2();
+		e.de2 = regs.getDE2(); e.hl2 = regs.getHL2();
+		e.ix  = regs.getIX();  e.iy  = regs.getIY();
+		e.sp  = regs.getSP();  e.pc  = regs.getPC();
+		e.i = regs.getI();
+		e.r = regs.getR();
+		e.im = regs.getIM();
+		e.iff = (regs.getIFF1() ? 1 : 0) | (regs.getIFF2() ? 2 : 0) |
+		        (r800 ? 0x80 : 0);
+		std::copy_n(opcode, 4, e.opcode);
+	}
+
+	/** Number of entries currently in the buffer. */
+	[[nodiscard]] unsigned size() const {
+		return unsigned(std::min<uint64_t>(head, CAPACITY));
+	}
+	/** Get an entry, 0 is the oldest, size()-1 the most recent one. */
+	[[nodiscard]] const Entry& operator[](unsigned n) const {
+		return ring[(head - size() + n) & (CAPACITY - 1)];
+	}
+	void clear() { head = 0; }
+
+	/** Append one line (as shown by 'cpu_trace dump') for the given entry.
+	  * @param dasmOutput Scratch buffer, to avoid allocations per line.
+	  */
+	static void format(const Entry& e, std::string& result, std::string& dasmOutput);
+
+private:
+	const std::unique_ptr<Entry[]> ring;
+	uint64_t head = 0; // total number of recorded instructions
+};
+
+/** InstructionTraceBuffer plus the 'cpu_trace' command and the "cpu trace"
+  * debuggable of a machine.
+  */
+class InstructionTrace final : public InstructionTraceBuffer
+{
+public:
+	explicit InstructionTrace(MSXMotherBoard& motherBoard);
+
+private:
+	void dump(span<const TclObject> tokens, TclObject& result) const;
+
+	struct Debuggable final : SimpleDebuggable {
+		explicit Debuggable(MSXMotherBoard& motherBoard);
+		byte read(unsigned address) override;
+	} debuggable;
+
+	struct TraceCmd final : Command {
+		explicit TraceCmd(CommandController& controller);
+		void execute(span<const TclObject> tokens, TclObject& result) override;
+		std::string help(const std::vector<std::string>& tokens) const override;
+		void tabCompletion(std::vector<std::string>& tokens) const override;
+	} traceCmd;
+};
+
+} // namespace openmsx
+
+#endif
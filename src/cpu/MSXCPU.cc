@@ -5,6 +5,7 @@
 #include "Scheduler.hh"
 #include "IntegerSetting.hh"
 #include "CPUCore.hh"
+#include "InstructionTrace.hh"
 #include "Z80.hh"
 #include "R800.hh"
 #include "TclObject.hh"
@@ -43,6 +44,9 @@ MSXCPU::MSXCPU(MSXMotherBoard& motherboard_)
 			motherboard.getMachineInfoCommand(), "r800_freq", *r800)
 		: nullptr)
 	, debuggable(motherboard_)
+	, instructionTrace(TRACE_INSTRUCTIONS
+		? std::make_unique<InstructionTrace>(motherboard)
+		: nullptr)
 	, reference(EmuTime::zero())
 {
 	z80Active = true; // setActiveCPU(CPU_Z80);
@@ -58,6 +62,8 @@ MSXCPU::MSXCPU(MSXMotherBoard& motherboard_)
 		r800->freqLocked.attach(*this);
 		r800->freqValue.attach(*this);
 	}
+	          z80 ->setInstructionTrace(instructionTrace.get());
+	if (r800) r800->setInstructionTrace(instructionTrace.get());
 	invalidateMemCacheSlot();
 }
 
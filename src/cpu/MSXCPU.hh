@@ -19,6 +19,7 @@ class MSXMotherBoard;
 class MSXCPUInterface;
 class CPUClock;
 class CPURegs;
+class InstructionTrace;
 class Z80TYPE;
 class R800TYPE;
 template <typename T> class CPUCore;
@@ -205,6 +206,9 @@ private:
 		void write(unsigned address, byte value) override;
 	} debuggable;
 
+	// only allocated when TRACE_INSTRUCTIONS is enabled
+	const std::unique_ptr<InstructionTrace> instructionTrace;
+
 	EmuTime reference;
 	bool z80Active;
 	bool newZ80Active;
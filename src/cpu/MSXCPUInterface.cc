@@ -7,6 +7,7 @@
 #include "RealTime.hh"
 #include "MSXMotherBoard.hh"
 #include "MSXCPU.hh"
+#include "Debugger.hh"
 #include "VDPIODelay.hh"
 #include "CliComm.hh"
 #include "MSXMultiIODevice.hh"
@@ -802,6 +803,26 @@ void MSXCPUInterface::removeBreakPoint(unsigned id)
 	}
 }
 
+namespace {
+// Lets compiled breakpoint conditions access the machine they're checked on.
+class ConditionContext final : public CompiledCondition::Context
+{
+public:
+	explicit ConditionContext(MSXMotherBoard& motherBoard_)
+		: motherBoard(motherBoard_) {}
+
+	Debuggable* findDebuggable(std::string_view name) override {
+		return motherBoard.getDebugger().findDebuggable(name);
+	}
+	bool isExpanded(int ps) override {
+		return motherBoard.getCPUInterface().isExpanded(ps);
+	}
+
+private:
+	MSXMotherBoard& motherBoard;
+};
+} // namespace
+
 void MSXCPUInterface::checkBreakPoints(
 	std::pair<BreakPoints::const_iterator,
 	          BreakPoints::const_iterator> range,
@@ -813,15 +834,16 @@ void MSXCPUInterface::checkBreakPoints(
 	BreakPoints bpCopy(range.first, range.second);
 	auto& globalCliComm = motherBoard.getReactor().getGlobalCliComm();
 	auto& interp        = motherBoard.getReactor().getInterpreter();
+	ConditionContext context(motherBoard);
 	for (auto& p : bpCopy) {
-		p.checkAndExecute(globalCliComm, interp);
+		p.checkAndExecute(globalCliComm, interp, &context);
 		if (p.onlyOnce()) {
 			removeBreakPoint(p.getId());
 		}
 	}
 	auto condCopy = conditions;
 	for (auto& c : condCopy) {
-		c.checkAndExecute(globalCliComm, interp);
+		c.checkAndExecute(globalCliComm, interp, &context);
 		if (c.onlyOnce()) {
 			removeCondition(c.getId());
 		}
@@ -980,12 +1002,13 @@ void MSXCPUInterface::executeMemWatch(WatchPoint::Type type,
 		                   TclObject(int(value)));
 	}
 
+	ConditionContext context(motherBoard);
 	auto wpCopy = watchPoints;
 	for (auto& w : wpCopy) {
 		if ((w->getBeginAddress() <= address) &&
 		    (w->getEndAddress()   >= address) &&
 		    (w->getType()         == type)) {
-			w->checkAndExecute(globalCliComm, interp);
+			w->checkAndExecute(globalCliComm, interp, &context);
 			if (w->onlyOnce()) {
 				removeWatchPoint(w);
 			}
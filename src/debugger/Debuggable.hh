@@ -2,6 +2,7 @@
 #define DEBUGGABLE_HH
 
 #include "openmsx.hh"
+#include "span.hh"
 #include <string>
 
 namespace openmsx {
@@ -12,6 +13,13 @@ public:
 	virtual unsigned getSize() const = 0;
 	virtual const std::string& getDescription() const = 0;
 	virtual byte read(unsigned address) = 0;
+	/** Read 'output.size()' bytes starting at 'address', that range must
+	  * be inside the debuggable. By default this calls read() per byte,
+	  * override it when there's a faster way.
+	  */
+	virtual void readBlock(unsigned address, span<byte> output) {
+		for (auto& b : output) b = read(address++);
+	}
 	virtual void write(unsigned address, byte value) = 0;
 
 protected:
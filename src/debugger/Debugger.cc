@@ -296,9 +296,7 @@ void Debugger::Cmd::readBlock(span<const TclObject> tokens, TclObject& result)
 	}
 
 	MemBuffer<byte> buf(num);
-	for (unsigned i = 0; i < num; ++i) {
-		buf[i] = device.read(addr + i);
-	}
+	device.readBlock(addr, span<byte>{buf.data(), num});
 	result = span<byte>{buf.data(), num};
 }
 
@@ -2,7 +2,8 @@
 #include "utf8_unchecked.hh"
 
 
-AdhocCliCommParser::AdhocCliCommParser(std::function<void(const std::string&)> callback_)
+AdhocCliCommParser::AdhocCliCommParser(
+		std::function<void(const std::string&, const std::string&)> callback_)
 	: callback(std::move(callback_))
 	, state(O0)
 {
@@ -34,6 +35,30 @@ void AdhocCliCommParser::parse(char c)
 	case O7: // matched <comman
 		state = (c == 'd') ? O8 : O0; break;
 	case O8: // matched <command
+		id.clear();
+		if (c == '>') {
+			state = C0;
+			command.clear();
+		} else if (c == ' ') {
+			state = I0;
+		} else {
+			state = O0;
+		}
+		break;
+	case I0: // matched <command followed by a space
+		// 'id' is the only supported attribute
+		state = (c == 'i') ? I1 : O0; break;
+	case I1: // matched <command i
+		state = (c == 'd') ? I2 : O0; break;
+	case I2: // matched <command id
+		state = (c == '=') ? I3 : O0; break;
+	case I3: // matched <command id=
+		state = (c == '"') ? I4 : O0; break;
+	case I4: // matched <command id="
+		if (c == '"') state = I5;
+		else          id += c;
+		break;
+	case I5: // matched <command id="..."
 		if (c == '>') {
 			state = C0;
 			command.clear();
@@ -63,7 +88,7 @@ void AdhocCliCommParser::parse(char c)
 	case C8: // matched </comman
 		state = (c == 'd') ? C9 : O0; break;
 	case C9: // matched </command
-		if (c == '>') callback(command);
+		if (c == '>') callback(command, id);
 		state = O0;
 		break;
 	case A1: // matched &
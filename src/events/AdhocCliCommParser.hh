@@ -8,14 +8,20 @@
 class AdhocCliCommParser
 {
 public:
-	explicit AdhocCliCommParser(std::function<void(const std::string&)> callback);
+	/** The callback gets the command and the value of the (optional) id
+	  * attribute, e.g. '<command id="42">foo</command>'. When there's no
+	  * id attribute, the id is empty.
+	  */
+	explicit AdhocCliCommParser(
+		std::function<void(const std::string&, const std::string&)> callback);
 	void parse(const char* buf, size_t n);
 
 private:
 	void parse(char c);
 
-	std::function<void(const std::string&)> callback;
+	std::function<void(const std::string&, const std::string&)> callback;
 	std::string command;
+	std::string id;
 	uint32_t unicode;
 	enum State {
 		O0, // no tag char matched yet
@@ -27,6 +33,12 @@ private:
 		O6, //         <comma
 		O7, //         <comman
 		O8, //         <command
+		I0, // matched <command followed by a space
+		I1, //         <command i
+		I2, //         <command id
+		I3, //         <command id=
+		I4, //         <command id=", now parsing the id up to "
+		I5, //         <command id="...", expecting >
 		C0, // matched <command>, now parsing xml entities and </command>
 		C1, // matched <
 		C2, //         </
@@ -6,10 +6,17 @@
 // - Unsubscribe at CliComm after stream is closed.
 
 #include "CliConnection.hh"
+#include "Base64.hh"
 #include "EventDistributor.hh"
 #include "Event.hh"
 #include "CommandController.hh"
 #include "CommandException.hh"
+#include "Debuggable.hh"
+#include "Debugger.hh"
+#include "FinishFrameEvent.hh"
+#include "MSXMotherBoard.hh"
+#include "ScopedAssign.hh"
+#include "StreamDiff.hh"
 #include "TclObject.hh"
 #include "XMLElement.hh"
 #include "checked_cast.hh"
@@ -34,14 +41,16 @@ namespace openmsx {
 class CliCommandEvent final : public Event
 {
 public:
-	CliCommandEvent(string command_, const CliConnection* id_)
+	using Commands = std::vector<std::pair<string, string>>; // {command, id}
+
+	CliCommandEvent(Commands commands_, const CliConnection* id_)
 		: Event(OPENMSX_CLICOMMAND_EVENT)
-		, command(std::move(command_)), id(id_)
+		, commands(std::move(commands_)), id(id_)
 	{
 	}
-	const string& getCommand() const
+	const Commands& getCommands() const
 	{
-		return command;
+		return commands;
 	}
 	const CliConnection* getId() const
 	{
@@ -49,15 +58,17 @@ public:
 	}
 	TclObject toTclList() const override
 	{
-		return makeTclList("CliCmd", getCommand());
+		TclObject result = makeTclList("CliCmd");
+		for (auto& c : commands) result.addListElement(c.first);
+		return result;
 	}
 	bool lessImpl(const Event& other) const override
 	{
 		auto& otherCmdEvent = checked_cast<const CliCommandEvent&>(other);
-		return getCommand() < otherCmdEvent.getCommand();
+		return getCommands() < otherCmdEvent.getCommands();
 	}
 private:
-	const string command;
+	const Commands commands;
 	const CliConnection* id;
 };
 
@@ -66,30 +77,42 @@ private:
 
 CliConnection::CliConnection(CommandController& commandController_,
                              EventDistributor& eventDistributor_)
-	: parser([this](const std::string& cmd) { execute(cmd); })
-	, commandController(commandController_)
+	: commandController(commandController_)
 	, eventDistributor(eventDistributor_)
+	, parser([this](const std::string& cmd, const std::string& id) {
+		batch.emplace_back(cmd, id);
+	})
 {
 	ranges::fill(updateEnabled, false);
 
 	eventDistributor.registerEventListener(OPENMSX_CLICOMMAND_EVENT, *this);
+	eventDistributor.registerEventListener(OPENMSX_FINISH_FRAME_EVENT, *this);
 }
 
 CliConnection::~CliConnection()
 {
+	eventDistributor.unregisterEventListener(OPENMSX_FINISH_FRAME_EVENT, *this);
 	eventDistributor.unregisterEventListener(OPENMSX_CLICOMMAND_EVENT, *this);
 }
 
 void CliConnection::log(CliComm::LogLevel level, std::string_view message)
 {
 	auto levelStr = CliComm::getLevelStrings();
-	output(strCat("<log level=\"", levelStr[level], "\">",
-	              XMLElement::XMLEscape(message), "</log>\n"));
+	send(strCat("<log level=\"", levelStr[level], "\">",
+	            XMLElement::XMLEscape(message), "</log>\n"));
 }
 
 void CliConnection::update(CliComm::UpdateType type, std::string_view machine,
                            std::string_view name, std::string_view value)
 {
+	if ((type == CliComm::HARDWARE) && (value == "remove")) {
+		// The machine is about to be deleted, this also ends the
+		// subscriptions on it.
+		auto it = ranges::remove_if(subscriptions, [&](auto& s) {
+			return s.machine == name;
+		});
+		subscriptions.erase(it, std::end(subscriptions));
+	}
 	if (!getUpdateEnable(type)) return;
 
 	auto updateStr = CliComm::getUpdateStrings();
@@ -102,7 +125,63 @@ void CliConnection::update(CliComm::UpdateType type, std::string_view machine,
 	}
 	strAppend(tmp, '>', XMLElement::XMLEscape(value), "</update>\n");
 
-	output(tmp);
+	send(tmp);
+}
+
+void CliConnection::subscribe(MSXMotherBoard& board, string name,
+                              unsigned address, unsigned size)
+{
+	string machine(board.getMachineID());
+	unsubscribe(machine, name);
+	subscriptions.push_back(Subscription{
+		std::move(machine), std::move(name), address, size, &board, {}});
+}
+
+bool CliConnection::unsubscribe(std::string_view machine, std::string_view name)
+{
+	auto it = ranges::find_if(subscriptions, [&](auto& s) {
+		return (s.machine == machine) && (s.name == name);
+	});
+	if (it == std::end(subscriptions)) return false;
+	subscriptions.erase(it);
+	return true;
+}
+
+std::vector<string> CliConnection::getSubscriptions() const
+{
+	std::vector<string> result;
+	for (auto& s : subscriptions) {
+		result.emplace_back(makeTclList(
+			s.machine, s.name, s.address, s.size).getString());
+	}
+	return result;
+}
+
+void CliConnection::sendSubscriptions()
+{
+	std::vector<byte> current;
+	string payload;
+	for (auto& s : subscriptions) {
+		// The device that owns the debuggable might be gone.
+		auto* debuggable = s.board->getDebugger().findDebuggable(s.name);
+		if (!debuggable) continue;
+		// the size of e.g. the VRAM debuggable can change
+		unsigned end = std::min(s.address + s.size, debuggable->getSize());
+		current.resize((end > s.address) ? (end - s.address) : 0);
+		if (!current.empty()) debuggable->readBlock(s.address, current);
+		payload.clear();
+		appendStreamDiff(payload, current, s.sent);
+		std::swap(current, s.sent);
+		if (payload.empty()) continue;
+
+		// The records are binary, so base64 encode them.
+		output(strCat("<stream machine=\"", s.machine,
+		              "\" name=\"", XMLElement::XMLEscape(s.name),
+		              "\" size=\"", payload.size(), "\">",
+		              Base64::encode(reinterpret_cast<const uint8_t*>(payload.data()),
+		                             payload.size()),
+		              "</stream>\n"));
+	}
 }
 
 void CliConnection::startOutput()
@@ -127,30 +206,66 @@ void CliConnection::end()
 	}
 }
 
-void CliConnection::execute(const string& command)
+void CliConnection::parseCommands(const char* buf, size_t n)
 {
+	parser.parse(buf, n);
+	if (batch.empty()) return;
 	eventDistributor.distributeEvent(
-		std::make_shared<CliCommandEvent>(command, this));
+		std::make_shared<CliCommandEvent>(std::move(batch), this));
+	batch.clear();
 }
 
-static string reply(const string& message, bool status)
+void CliConnection::send(std::string_view message)
 {
-	return strCat("<reply result=\"", (status ? "ok" : "nok"), "\">",
-	              XMLElement::XMLEscape(message), "</reply>\n");
+	if (inBatch) {
+		batchOutput += message;
+	} else {
+		output(message);
+	}
+}
+
+static string reply(const string& message, bool status, const string& id)
+{
+	string result = "<reply";
+	if (!id.empty()) {
+		strAppend(result, " id=\"", XMLElement::XMLEscape(id), '"');
+	}
+	strAppend(result, " result=\"", (status ? "ok" : "nok"), "\">",
+	          XMLElement::XMLEscape(message), "</reply>\n");
+	return result;
 }
 
 int CliConnection::signalEvent(const std::shared_ptr<const Event>& event)
 {
+	if (event->getType() == OPENMSX_FINISH_FRAME_EVENT) {
+		// Several video sources can finish a frame, only react to the
+		// displayed one, so that there's one message per frame.
+		auto& ffe = checked_cast<const FinishFrameEvent&>(*event);
+		if (!subscriptions.empty() &&
+		    (ffe.getSource() == ffe.getSelectedSource())) {
+			sendSubscriptions();
+		}
+		return 0;
+	}
+
 	auto& commandEvent = checked_cast<const CliCommandEvent&>(*event);
 	if (commandEvent.getId() == this) {
-		try {
-			string result(commandController.executeCommand(
-				commandEvent.getCommand(), this).getString());
-			output(reply(result, true));
-		} catch (CommandException& e) {
-			string result = std::move(e).getMessage() + '\n';
-			output(reply(result, false));
+		assert(!inBatch);
+		{
+			ScopedAssign sa(inBatch, true);
+			for (auto& [command, id] : commandEvent.getCommands()) {
+				try {
+					string result(commandController.executeCommand(
+						command, this).getString());
+					batchOutput += reply(result, true, id);
+				} catch (CommandException& e) {
+					string result = std::move(e).getMessage() + '\n';
+					batchOutput += reply(result, false, id);
+				}
+			}
 		}
+		output(batchOutput);
+		batchOutput.clear();
 	}
 	return 0;
 }
@@ -183,7 +298,7 @@ void StdioConnection::run()
 		char buf[BUF_SIZE];
 		int n = read(STDIN_FILENO, buf, sizeof(buf));
 		if (n > 0) {
-			parser.parse(buf, n);
+			parseCommands(buf, n);
 		} else if (n < 0) {
 			break;
 		}
@@ -273,7 +388,7 @@ void PipeConnection::run()
 			if (!GetOverlappedResult(pipeHandle, &overlapped, &bytesRead, TRUE)) {
 				break; // Pipe broke
 			}
-			parser.parse(buf, bytesRead);
+			parseCommands(buf, bytesRead);
 		} else if (wait == WAIT_OBJECT_0) {
 			break; // Shutdown
 		} else {
@@ -352,7 +467,7 @@ void SocketConnection::run()
 		char buf[BUF_SIZE];
 		int n = sock_recv(sd, buf, BUF_SIZE);
 		if (n > 0) {
-			parser.parse(buf, n);
+			parseCommands(buf, n);
 		} else if (n < 0) {
 			break;
 		}
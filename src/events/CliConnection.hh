@@ -7,14 +7,17 @@
 #include "CliComm.hh"
 #include "AdhocCliCommParser.hh"
 #include "Poller.hh"
+#include "openmsx.hh"
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace openmsx {
 
 class CommandController;
 class EventDistributor;
+class MSXMotherBoard;
 
 class CliConnection : public CliListener, private EventListener
 {
@@ -26,6 +29,22 @@ public:
 		return updateEnabled[type];
 	}
 
+	/** Stream the changes in (a range of) a debuggable to this connection.
+	  * Once per frame, all bytes in [address, address + size) that changed
+	  * since the previous frame are sent in a binary '<stream>' message
+	  * (see openmsx-control.html). The first message contains the whole
+	  * range. A subscription for the same machine and debuggable replaces
+	  * the old one. The subscription ends when the machine is deleted. The
+	  * debuggable is looked up (by name) every frame, while it doesn't
+	  * exist (anymore) nothing is sent.
+	  */
+	void subscribe(MSXMotherBoard& board, std::string name,
+	               unsigned address, unsigned size);
+	/** Returns false if there was no such subscription. */
+	bool unsubscribe(std::string_view machine, std::string_view name);
+	/** Returns a '{machine name address size}' string per subscription. */
+	std::vector<std::string> getSubscriptions() const;
+
 	/** Starts the helper thread.
 	  * Called when this CliConnection is added to GlobalCliComm (and
 	  * after it's allowed to respond to external commands).
@@ -58,13 +77,23 @@ protected:
 	  */
 	void startOutput();
 
-	AdhocCliCommParser parser;
+	/** Parse a chunk of input received from the external application.
+	  * All complete commands in it are executed together, in one go on
+	  * the main thread, and their output is sent in one go as well.
+	  * Called from the helper thread.
+	  */
+	void parseCommands(const char* buf, size_t n);
+
 	Poller poller;
 
 private:
 	virtual void run() = 0;
 
-	void execute(const std::string& command);
+	/** Like output(), but while executing a batch of commands the message
+	  * is collected in 'batchOutput'. This keeps log and update messages
+	  * triggered by a command in front of the reply of that command.
+	  */
+	void send(std::string_view message);
 
 	// CliListener
 	void log(CliComm::LogLevel level, std::string_view message) override;
@@ -74,11 +103,31 @@ private:
 	// EventListener
 	int signalEvent(const std::shared_ptr<const Event>& event) override;
 
+	void sendSubscriptions();
+
 	CommandController& commandController;
 	EventDistributor& eventDistributor;
 
 	std::thread thread;
 
+	AdhocCliCommParser parser;
+	// Commands parsed from the current chunk of input (helper thread).
+	std::vector<std::pair<std::string, std::string>> batch; // {command, id}
+	// Output of the batch that is being executed (main thread).
+	std::string batchOutput;
+	bool inBatch = false;
+
+	struct Subscription {
+		std::string machine;
+		std::string name;
+		unsigned address;
+		unsigned size;
+		MSXMotherBoard* board; // subscription is removed with the machine
+		std::vector<byte> sent; // content of the previous message,
+		                        // empty if nothing was sent yet
+	};
+	std::vector<Subscription> subscriptions;
+
 	bool updateEnabled[CliComm::NUM_UPDATES];
 };
 
@@ -17,6 +17,7 @@ namespace openmsx {
 
 EventDistributor::EventDistributor(Reactor& reactor_)
 	: reactor(reactor_)
+	, scheduledEvents(256)
 {
 }
 
@@ -86,28 +87,24 @@ void EventDistributor::deliverEvents()
 	// unsubscribe from the ols MSXEventDistributor. This really should be
 	// done before we exit this method.
 	while (!scheduledEvents.empty()) {
-		EventQueue eventsCopy;
-		swap(eventsCopy, scheduledEvents);
-
-		for (auto& event : eventsCopy) {
-			auto type = event->getType();
-			auto priorityMapCopy = listeners[type];
-			lock.unlock();
-			auto blockPriority = unsigned(-1); // allow all
-			for (const auto& [priority, listener] : priorityMapCopy) {
-				// It's possible delivery to one of the previous
-				// Listeners unregistered the current Listener.
-				if (!isRegistered(type, listener)) continue;
+		auto event = scheduledEvents.pop_front();
+		auto type = event->getType();
+		priorityMapCopy.assign(begin(listeners[type]), end(listeners[type]));
+		lock.unlock();
+		auto blockPriority = unsigned(-1); // allow all
+		for (const auto& [priority, listener] : priorityMapCopy) {
+			// It's possible delivery to one of the previous
+			// Listeners unregistered the current Listener.
+			if (!isRegistered(type, listener)) continue;
 
-				if (priority >= blockPriority) break;
+			if (priority >= blockPriority) break;
 
-				if (unsigned block = listener->signalEvent(event)) {
-					assert(block > priority);
-					blockPriority = block;
-				}
+			if (unsigned block = listener->signalEvent(event)) {
+				assert(block > priority);
+				blockPriority = block;
 			}
-			lock.lock();
 		}
+		lock.lock();
 	}
 }
 
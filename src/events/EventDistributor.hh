@@ -2,6 +2,7 @@
 #define EVENTDISTRIBUTOR_HH
 
 #include "Event.hh"
+#include "circular_buffer.hh"
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -55,7 +56,7 @@ public:
 
 	/** This actually delivers the events. It may only be called from the
 	  * main loop in Reactor (and only from the main thread). Also see
-	  * the distributeEvent() method.
+	  * the distributeEvent() method. This method is not reentrant.
 	  */
 	void deliverEvents();
 
@@ -74,8 +75,12 @@ private:
 
 	using PriorityMap = std::vector<std::pair<Priority, EventListener*>>; // sorted on priority
 	PriorityMap listeners[NUM_EVENT_TYPES];
-	using EventQueue = std::vector<EventPtr>;
-	EventQueue scheduledEvents;
+	// Ring buffer, it only grows (when needed) so in steady state
+	// scheduling an event doesn't allocate.
+	cb_queue<EventPtr> scheduledEvents;
+	// Copy of the listeners of the event that's being delivered, a member
+	// so that its capacity is reused between events.
+	PriorityMap priorityMapCopy;
 	std::mutex mutex; // lock datastructures
 	std::mutex cvMutex; // lock condition_variable
 	std::condition_variable condition;
@@ -1,6 +1,7 @@
 #include "InputEventFactory.hh"
 #include "InputEvents.hh"
 #include "CommandException.hh"
+#include "PoolAllocator.hh"
 #include "StringOp.hh"
 #include "TclObject.hh"
 #include <stdexcept>
@@ -17,9 +18,9 @@ static EventPtr parseKeyEvent(std::string_view str, uint32_t unicode)
 		throw CommandException("Invalid keycode: ", str);
 	}
 	if (keyCode & Keys::KD_RELEASE) {
-		return make_shared<KeyUpEvent>(keyCode);
+		return make_pooled_shared<KeyUpEvent>(keyCode);
 	} else {
-		return make_shared<KeyDownEvent>(keyCode, unicode);
+		return make_pooled_shared<KeyDownEvent>(keyCode, unicode);
 	}
 }
 
@@ -79,7 +80,7 @@ static EventPtr parseMouseEvent(const TclObject& str, Interpreter& interp)
 				} else {
 					// for bw-compat also allow events without absX,absY
 				}
-				return make_shared<MouseMotionEvent>(
+				return make_pooled_shared<MouseMotionEvent>(
 					str.getListIndex(interp, 2).getInt(interp),
 					str.getListIndex(interp, 3).getInt(interp),
 					absX, absY);
@@ -94,9 +95,9 @@ static EventPtr parseMouseEvent(const TclObject& str, Interpreter& interp)
 				try {
 					unsigned button = StringOp::fast_stou(comp1.substr(6));
 					if (upDown(str.getListIndex(interp, 2).getString())) {
-						return make_shared<MouseButtonUpEvent>  (button);
+						return make_pooled_shared<MouseButtonUpEvent>  (button);
 					} else {
-						return make_shared<MouseButtonDownEvent>(button);
+						return make_pooled_shared<MouseButtonDownEvent>(button);
 					}
 				} catch (std::invalid_argument&) {
 					// parse error in fast_stou()
@@ -109,7 +110,7 @@ static EventPtr parseMouseEvent(const TclObject& str, Interpreter& interp)
 					std::vector<EventType>{OPENMSX_MOUSE_WHEEL_EVENT},
 					makeTclList("mouse", comp1));
 			} else if (len == 4) {
-				return make_shared<MouseWheelEvent>(
+				return make_pooled_shared<MouseWheelEvent>(
 					str.getListIndex(interp, 2).getInt(interp),
 					str.getListIndex(interp, 3).getInt(interp));
 			}
@@ -140,9 +141,9 @@ static EventPtr parseOsdControlEvent(const TclObject& str, Interpreter& interp)
 		}
 		auto buttonAction = str.getListIndex(interp, 2).getString();
 		if (buttonAction == "RELEASE") {
-			return make_shared<OsdControlReleaseEvent>(button, nullptr);
+			return make_pooled_shared<OsdControlReleaseEvent>(button, nullptr);
 		} else if (buttonAction == "PRESS") {
-			return make_shared<OsdControlPressEvent>  (button, nullptr);
+			return make_pooled_shared<OsdControlPressEvent>  (button, nullptr);
 		}
 	}
 error:	throw CommandException("Invalid OSDcontrol event: ", str.getString());
@@ -180,14 +181,14 @@ static EventPtr parseJoystickEvent(const TclObject& str, Interpreter& interp)
 				if (StringOp::startsWith(comp1, "button")) {
 					unsigned button = StringOp::fast_stou(comp1.substr(6));
 					if (upDown(comp2.getString())) {
-						return make_shared<JoystickButtonUpEvent>  (joystick, button);
+						return make_pooled_shared<JoystickButtonUpEvent>  (joystick, button);
 					} else {
-						return make_shared<JoystickButtonDownEvent>(joystick, button);
+						return make_pooled_shared<JoystickButtonDownEvent>(joystick, button);
 					}
 				} else if (StringOp::startsWith(comp1, "axis")) {
 					unsigned axis = StringOp::fast_stou(comp1.substr(4));
 					int value = str.getListIndex(interp, 2).getInt(interp);
-					return make_shared<JoystickAxisMotionEvent>(joystick, axis, value);
+					return make_pooled_shared<JoystickAxisMotionEvent>(joystick, axis, value);
 				} else if (StringOp::startsWith(comp1, "hat")) {
 					unsigned hat = StringOp::fast_stou(comp1.substr(3));
 					auto valueStr = str.getListIndex(interp, 2).getString();
@@ -204,7 +205,7 @@ static EventPtr parseJoystickEvent(const TclObject& str, Interpreter& interp)
 					else {
 						throw CommandException("Invalid hat value: ", valueStr);
 					}
-					return make_shared<JoystickHatEvent>(joystick, hat, value);
+					return make_pooled_shared<JoystickHatEvent>(joystick, hat, value);
 				}
 			} catch (std::invalid_argument&) {
 				// parse error in fast_stou()
@@ -4,6 +4,7 @@
 #include "IntegerSetting.hh"
 #include "GlobalSettings.hh"
 #include "Keys.hh"
+#include "PoolAllocator.hh"
 #include "checked_cast.hh"
 #include "outer.hh"
 #include "unreachable.hh"
@@ -137,11 +138,11 @@ void InputEventGenerator::setNewOsdControlButtonState(
 		if (deltaState & (1 << i)) {
 			if (newState & (1 << i)) {
 				eventDistributor.distributeEvent(
-					make_shared<OsdControlReleaseEvent>(
+					make_pooled_shared<OsdControlReleaseEvent>(
 						i, origEvent));
 			} else {
 				eventDistributor.distributeEvent(
-					make_shared<OsdControlPressEvent>(
+					make_pooled_shared<OsdControlPressEvent>(
 						i, origEvent));
 			}
 		}
@@ -247,12 +248,12 @@ void InputEventGenerator::handleKeyDown(const SDL_KeyboardEvent& key, uint32_t u
 {
 	EventPtr event;
 	/*if (PLATFORM_ANDROID && evt.key.keysym.sym == SDLK_WORLD_93) {
-		event = make_shared<JoystickButtonDownEvent>(0, 0);
+		event = make_pooled_shared<JoystickButtonDownEvent>(0, 0);
 		triggerOsdControlEventsFromJoystickButtonEvent(
 			0, false, event);
 		androidButtonA = true;
 	} else if (PLATFORM_ANDROID && evt.key.keysym.sym == SDLK_WORLD_94) {
-		event = make_shared<JoystickButtonDownEvent>(0, 1);
+		event = make_pooled_shared<JoystickButtonDownEvent>(0, 1);
 		triggerOsdControlEventsFromJoystickButtonEvent(
 			1, false, event);
 		androidButtonB = true;
@@ -260,7 +261,7 @@ void InputEventGenerator::handleKeyDown(const SDL_KeyboardEvent& key, uint32_t u
 		auto keyCode = Keys::getCode(
 			key.keysym.sym, key.keysym.mod,
 			key.keysym.scancode, false);
-		event = make_shared<KeyDownEvent>(keyCode, unicode);
+		event = make_pooled_shared<KeyDownEvent>(keyCode, unicode);
 		triggerOsdControlEventsFromKeyEvent(keyCode, false, event);
 	}
 	eventDistributor.distributeEvent(event);
@@ -272,7 +273,7 @@ void InputEventGenerator::handleText(const char* utf8)
 		auto unicode = utf8::unchecked::next(utf8);
 		if (unicode == 0) return;
 		eventDistributor.distributeEvent(
-			make_shared<KeyDownEvent>(Keys::K_NONE, unicode));
+			make_pooled_shared<KeyDownEvent>(Keys::K_NONE, unicode));
 	}
 }
 
@@ -289,12 +290,12 @@ void InputEventGenerator::handle(const SDL_Event& evt)
 		// and 1).
 		// TODO Android code should be rewritten for SDL2
 		/*if (PLATFORM_ANDROID && evt.key.keysym.sym == SDLK_WORLD_93) {
-			event = make_shared<JoystickButtonUpEvent>(0, 0);
+			event = make_pooled_shared<JoystickButtonUpEvent>(0, 0);
 			triggerOsdControlEventsFromJoystickButtonEvent(
 				0, true, event);
 			androidButtonA = false;
 		} else if (PLATFORM_ANDROID && evt.key.keysym.sym == SDLK_WORLD_94) {
-			event = make_shared<JoystickButtonUpEvent>(0, 1);
+			event = make_pooled_shared<JoystickButtonUpEvent>(0, 1);
 			triggerOsdControlEventsFromJoystickButtonEvent(
 				1, true, event);
 			androidButtonB = false;
@@ -302,7 +303,7 @@ void InputEventGenerator::handle(const SDL_Event& evt)
 			auto keyCode = Keys::getCode(
 				evt.key.keysym.sym, evt.key.keysym.mod,
 				evt.key.keysym.scancode, true);
-			event = make_shared<KeyUpEvent>(keyCode);
+			event = make_pooled_shared<KeyUpEvent>(keyCode);
 			triggerOsdControlEventsFromKeyEvent(keyCode, true, event);
 		}
 		break;
@@ -311,10 +312,10 @@ void InputEventGenerator::handle(const SDL_Event& evt)
 		break;
 
 	case SDL_MOUSEBUTTONUP:
-		event = make_shared<MouseButtonUpEvent>(evt.button.button);
+		event = make_pooled_shared<MouseButtonUpEvent>(evt.button.button);
 		break;
 	case SDL_MOUSEBUTTONDOWN:
-		event = make_shared<MouseButtonDownEvent>(evt.button.button);
+		event = make_pooled_shared<MouseButtonDownEvent>(evt.button.button);
 		break;
 	case SDL_MOUSEWHEEL: {
 		int x = evt.wheel.x;
@@ -324,23 +325,23 @@ void InputEventGenerator::handle(const SDL_Event& evt)
 			x = -x;
 			y = -y;
 		}
-		event = make_shared<MouseWheelEvent>(x, y);
+		event = make_pooled_shared<MouseWheelEvent>(x, y);
 		break;
 	}
 	case SDL_MOUSEMOTION:
-		event = make_shared<MouseMotionEvent>(
+		event = make_pooled_shared<MouseMotionEvent>(
 			evt.motion.xrel, evt.motion.yrel,
 			evt.motion.x,    evt.motion.y);
 		break;
 
 	case SDL_JOYBUTTONUP:
-		event = make_shared<JoystickButtonUpEvent>(
+		event = make_pooled_shared<JoystickButtonUpEvent>(
 			evt.jbutton.which, evt.jbutton.button);
 		triggerOsdControlEventsFromJoystickButtonEvent(
 			evt.jbutton.button, true, event);
 		break;
 	case SDL_JOYBUTTONDOWN:
-		event = make_shared<JoystickButtonDownEvent>(
+		event = make_pooled_shared<JoystickButtonDownEvent>(
 			evt.jbutton.which, evt.jbutton.button);
 		triggerOsdControlEventsFromJoystickButtonEvent(
 			evt.jbutton.button, false, event);
@@ -351,14 +352,14 @@ void InputEventGenerator::handle(const SDL_Event& evt)
 		auto value = (evt.jaxis.value < -threshold) ? evt.jaxis.value
 		           : (evt.jaxis.value >  threshold) ? evt.jaxis.value
 		                                            : 0;
-		event = make_shared<JoystickAxisMotionEvent>(
+		event = make_pooled_shared<JoystickAxisMotionEvent>(
 			evt.jaxis.which, evt.jaxis.axis, value);
 		triggerOsdControlEventsFromJoystickAxisMotion(
 			evt.jaxis.axis, value, event);
 		break;
 	}
 	case SDL_JOYHATMOTION:
-		event = make_shared<JoystickHatEvent>(
+		event = make_pooled_shared<JoystickHatEvent>(
 			evt.jhat.which, evt.jhat.hat, evt.jhat.value);
 		triggerOsdControlEventsFromJoystickHat(evt.jhat.value, event);
 		break;
@@ -0,0 +1,49 @@
+#include "StreamDiff.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cstdint>
+
+namespace openmsx {
+
+static void appendLE32(std::string& out, uint32_t value)
+{
+	for (auto i : xrange(4)) {
+		out += char(value >> (8 * i));
+	}
+}
+
+static void appendRecord(std::string& out, span<const byte> current,
+                         size_t begin, size_t end)
+{
+	appendLE32(out, uint32_t(begin));
+	appendLE32(out, uint32_t(end - begin));
+	out.append(reinterpret_cast<const char*>(current.data() + begin),
+	           end - begin);
+}
+
+void appendStreamDiff(std::string& out, span<const byte> current,
+                      span<const byte> previous)
+{
+	constexpr size_t HEADER_SIZE = 8;
+	auto size = current.size();
+	if (previous.size() != size) {
+		appendRecord(out, current, 0, size);
+		return;
+	}
+	const auto* cur = current.data();
+	const auto* prev = previous.data();
+	size_t i = 0;
+	while (true) {
+		i = std::mismatch(cur + i, cur + size, prev + i).first - cur;
+		if (i == size) return;
+		size_t begin = i;
+		size_t end = i + 1; // one past the last changed byte
+		for (i = end; (i < size) && (i - end < HEADER_SIZE); ++i) {
+			if (cur[i] != prev[i]) end = i + 1;
+		}
+		appendRecord(out, current, begin, end);
+		i = end;
+	}
+}
+
+} // namespace openmsx
@@ -0,0 +1,23 @@
+#ifndef STREAMDIFF_HH
+#define STREAMDIFF_HH
+
+#include "openmsx.hh"
+#include "span.hh"
+#include <string>
+
+namespace openmsx {
+
+/** Appends the changes from 'previous' to 'current' to 'out', in the format
+  * of the '<stream>' message (see openmsx-control.html): a sequence of
+  * records, each a 32-bit little-endian offset, a 32-bit little-endian length
+  * and then the new bytes. Unchanged gaps shorter than a record header are
+  * included in the surrounding record, that's more compact than starting a
+  * new record. When the sizes differ, one record contains all of 'current'.
+  * Nothing is appended when there are no changes.
+  */
+void appendStreamDiff(std::string& out, span<const byte> current,
+                      span<const byte> previous);
+
+} // namespace openmsx
+
+#endif
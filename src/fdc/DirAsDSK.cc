@@ -263,6 +263,7 @@ DirAsDSK::DirAsDSK(DiskChanger& diskChanger_, CliComm& cliComm_,
 	, cliComm(cliComm_)
 	, hostDir(hostDir_.getResolved() + '/')
 	, syncMode(syncMode_)
+	, hostWatcher(hostDir)
 	, lastAccess(EmuTime::zero())
 	, nofSectors((diskChanger_.isDoubleSidedDrive() ? 2 : 1) * SECTORS_PER_TRACK * NUM_TRACKS)
 	, nofSectorsPerFat((((3 * nofSectors) / (2 * SECTORS_PER_CLUSTER)) + SECTOR_SIZE - 1) / SECTOR_SIZE)
@@ -340,7 +341,7 @@ void DirAsDSK::checkCaches()
 		// Happens when dirasdisk is used in virtual_drive.
 		needSync = true;
 	}
-	if (needSync) {
+	if (needSync && hostWatcher.hasChanges()) {
 		flushCaches();
 	}
 }
@@ -364,7 +365,9 @@ void DirAsDSK::readSectorImpl(size_t sector, SectorBuffer& buf)
 			// Happens when dirasdisk is used in virtual_drive.
 			needSync = true;
 		}
-		if (needSync) {
+		// Checking whether anything changed on the host is cheap, a
+		// rescan of a (possibly large) host directory is not.
+		if (needSync && hostWatcher.hasChanges()) {
 			syncWithHost();
 			flushCaches(); // e.g. sha1sum
 			// Let the diskdrive report the disk has been ejected.
@@ -380,6 +383,9 @@ void DirAsDSK::readSectorImpl(size_t sector, SectorBuffer& buf)
 
 void DirAsDSK::syncWithHost()
 {
+	// Changes made from now on will trigger the next sync.
+	hostWatcher.clear();
+
 	// Check for removed host files. This frees up space in the virtual
 	// disk. Do this first because otherwise later actions may fail (run
 	// out of virtual disk space) for no good reason.
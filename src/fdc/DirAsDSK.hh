@@ -3,6 +3,7 @@
 
 #include "SectorBasedDisk.hh"
 #include "DiskImageUtils.hh"
+#include "DirWatcher.hh"
 #include "FileOperations.hh"
 #include "EmuTime.hh"
 #include "hash_map.hh"
@@ -126,6 +127,8 @@ private:
 	const std::string hostDir;
 	const SyncMode syncMode;
 
+	// Avoids a full rescan of the host directory when nothing changed.
+	DirWatcher hostWatcher;
 	EmuTime lastAccess; // last time there was a sector read/write
 
 	// For each directory entry that has a mapped host file/directory we
@@ -0,0 +1,128 @@
+#include "DirWatcher.hh"
+#if HAVE_INOTIFY_INIT1
+#include "FileOperations.hh"
+#include "ReadDir.hh"
+#include "StringOp.hh"
+#include "strCat.hh"
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace openmsx {
+
+#if HAVE_INOTIFY_INIT1
+
+// Everything that can change the result of a DirAsDSK sync.
+constexpr uint32_t WATCH_MASK =
+	IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MODIFY |
+	IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+DirWatcher::DirWatcher(const std::string& directory)
+	: fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+	if (fd == -1) return; // fallback to polling
+	addWatches(directory);
+}
+
+DirWatcher::~DirWatcher()
+{
+	if (fd != -1) close(fd);
+}
+
+void DirWatcher::addWatches(const std::string& directory)
+{
+	if (fd == -1) return;
+	int wd = inotify_add_watch(fd, directory.c_str(), WATCH_MASK);
+	if (wd == -1) {
+		// Typically because the limit on the number of watches is
+		// reached. We can't reliably detect changes anymore.
+		fail();
+		return;
+	}
+	watches[wd] = directory;
+
+	ReadDir dir(directory);
+	while (auto* d = dir.getEntry()) {
+		std::string_view name = d->d_name;
+		if (StringOp::startsWith(name, '.')) continue;
+		auto path = strCat(directory, name, '/');
+		if (FileOperations::isDirectory(path)) {
+			addWatches(path);
+			if (fd == -1) return;
+		}
+	}
+}
+
+void DirWatcher::fail()
+{
+	close(fd);
+	fd = -1;
+	watches.clear();
+}
+
+void DirWatcher::readEvents()
+{
+	alignas(inotify_event) char buf[4096];
+	while (fd != -1) {
+		auto len = read(fd, buf, sizeof(buf));
+		if (len <= 0) {
+			if ((len == -1) && (errno == EINTR)) continue;
+			if ((len == -1) && (errno != EAGAIN)) fail();
+			return;
+		}
+		// Any event (including IN_Q_OVERFLOW) means the tree may have
+		// changed. Additionally new subdirectories must be watched.
+		changed = true;
+		for (char* p = buf; p < buf + len; /**/) {
+			auto* event = reinterpret_cast<inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_IGNORED) {
+				// watched directory was removed
+				watches.erase(event->wd);
+			} else if ((event->mask & IN_ISDIR) &&
+			           (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+			           (event->len != 0) && (event->name[0] != '.')) {
+				if (auto* parent = lookup(watches, event->wd)) {
+					addWatches(strCat(*parent, event->name, '/'));
+				}
+			}
+		}
+	}
+}
+
+bool DirWatcher::hasChanges()
+{
+	if (fd == -1) return true;
+	readEvents();
+	return changed || (fd == -1);
+}
+
+void DirWatcher::clear()
+{
+	if (fd == -1) return;
+	readEvents();
+	changed = false;
+}
+
+#else
+
+DirWatcher::DirWatcher(const std::string& /*directory*/)
+{
+}
+
+DirWatcher::~DirWatcher() = default;
+
+bool DirWatcher::hasChanges()
+{
+	return true; // always poll
+}
+
+void DirWatcher::clear()
+{
+}
+
+#endif
+
+} // namespace openmsx
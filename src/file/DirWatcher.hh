@@ -0,0 +1,58 @@
+#ifndef DIRWATCHER_HH
+#define DIRWATCHER_HH
+
+#include "systemfuncs.hh"
+#include <string>
+#if HAVE_INOTIFY_INIT1
+#include "hash_map.hh"
+#endif
+
+namespace openmsx {
+
+/** Detects changes (new, removed or modified files and directories) in a
+  * directory tree on the host filesystem.
+  *
+  * Where inotify is available, checking for changes is cheap: it doesn't
+  * touch the filesystem at all. On other platforms, or when inotify can't be
+  * used (e.g. because the limit on the number of watches is reached),
+  * hasChanges() always returns true, so the caller falls back to polling.
+  *
+  * Like in DirAsDSK, subdirectories whose name starts with a '.' are not
+  * watched.
+  */
+class DirWatcher
+{
+public:
+	DirWatcher(const DirWatcher&) = delete;
+	DirWatcher& operator=(const DirWatcher&) = delete;
+
+	/** @param directory Root of the tree to watch, must end with a '/'. */
+	explicit DirWatcher(const std::string& directory);
+	~DirWatcher();
+
+	/** Did something (possibly) change since the last call to clear()?
+	  * Initially this returns true.
+	  */
+	[[nodiscard]] bool hasChanges();
+
+	/** Forget about the changes seen so far. Call this right before
+	  * scanning the directory tree, so that changes made during the scan
+	  * are not missed.
+	  */
+	void clear();
+
+private:
+#if HAVE_INOTIFY_INIT1
+	void readEvents();
+	void addWatches(const std::string& directory);
+	void fail();
+
+	hash_map<int, std::string> watches; // watch descriptor -> directory
+	int fd;
+	bool changed = true;
+#endif
+};
+
+} // namespace openmsx
+
+#endif
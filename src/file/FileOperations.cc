@@ -53,6 +53,7 @@
 #include <algorithm>
 #include <sstream>
 #include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <stdexcept>
 #include <cassert>
@@ -287,6 +288,16 @@ int unlink(const std::string& path)
 #endif
 }
 
+int rename(const std::string& oldPath, const std::string& newPath)
+{
+#ifdef _WIN32
+	return MoveFileExW(utf8to16(oldPath).c_str(), utf8to16(newPath).c_str(),
+	                   MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+	return ::rename(oldPath.c_str(), newPath.c_str());
+#endif
+}
+
 int rmdir(const std::string& path)
 {
 #ifdef _WIN32
@@ -55,6 +55,12 @@ namespace openmsx::FileOperations {
 	 */
 	int unlink(const std::string& path);
 
+	/**
+	 * Call rename() in a platform-independent manner. Unlike the Windows
+	 * rename() function, an already existing 'newPath' gets replaced.
+	 */
+	int rename(const std::string& oldPath, const std::string& newPath);
+
 	/**
 	 * Call rmdir() in a platform-independent manner
 	 */
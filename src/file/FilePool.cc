@@ -11,9 +11,18 @@
 #include "EventDistributor.hh"
 #include "CliComm.hh"
 #include "Reactor.hh"
+#include "ThreadPool.hh"
 #include "Timer.hh"
+#include "hash_map.hh"
+#include "parallelFor.hh"
 #include "ranges.hh"
 #include "sha1.hh"
+#include "stl.hh"
+#include "xrange.hh"
+#include "xxhash.hh"
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <fstream>
 #include <memory>
 
@@ -38,6 +47,77 @@ private:
 
 const char* const FILE_CACHE = "/.filecache";
 
+// Maximum number of files that one scan has queued for hashing (on the shared
+// thread pool) at the same time. This bounds the number of open files (and of
+// mapped file content). Hashing is mostly limited by I/O (and for compressed
+// files by the decompression), so a few threads are enough, this also leaves
+// workers available for other tasks.
+static size_t maxPendingHashes()
+{
+	return std::min(getSharedThreadPool().size(), 4u);
+}
+
+namespace {
+struct HashJob {
+	HashJob(string filename_, time_t time_)
+		: filename(std::move(filename_)), time(time_) {}
+
+	string filename;
+	time_t time;
+	File file; // stays open, returned when the sum matches
+	Sha1Sum sum;
+	bool ok = false; // false when the file couldn't be read
+	std::shared_future<void> done;
+	// progress of the calculation, for large files
+	std::atomic<size_t> size = 0;
+	std::atomic<size_t> hashed = 0;
+};
+// oldest first
+struct HashJobs : std::deque<HashJob> {
+	~HashJobs() {
+		// the worker threads write into these objects
+		for (auto& job : *this) {
+			if (job.done.valid()) job.done.wait();
+		}
+	}
+};
+}
+
+// Start calculating the sha1sum of the given file on a worker thread.
+static void startHash(HashJobs& jobs, string filename, time_t time)
+{
+	// Note: a deque doesn't move its elements in push_back() or pop_front()
+	auto& job = jobs.emplace_back(std::move(filename), time);
+	job.done = getSharedThreadPool().enqueue([&job] {
+		try {
+			job.file = File(job.filename);
+			auto data = job.file.mmap();
+			// Hash in steps, so that finishHash() can show the
+			// progress for large files.
+			constexpr size_t STEP_SIZE = 1024 * 1024; // 1MB
+			job.size = data.size();
+			SHA1 sha1;
+			size_t done = 0;
+			while (done < data.size()) {
+				auto n = std::min(STEP_SIZE, data.size() - done);
+				sha1.update(&data[done], n);
+				done += n;
+				job.hashed = done;
+			}
+			job.sum = sha1.digest();
+			job.ok = true;
+		} catch (MSXException&) {
+			job.file = File();
+		}
+	});
+}
+
+struct FilePool::ScanProgress {
+	uint64_t lastTime;
+	unsigned amountScanned;
+	HashJobs pending;
+};
+
 static string initialFilePoolSettingValue()
 {
 	TclObject result;
@@ -60,8 +140,17 @@ FilePool::FilePool(CommandController& controller, Reactor& reactor_)
 		initialFilePoolSettingValue())
 	, reactor(reactor_)
 	, quit(false)
+	, preIndexSetting(
+		controller, "filepool_preindex",
+		"Calculate the sha1sums of all files in the filepool in the "
+		"background at startup. Later lookups of files by sha1sum "
+		"(e.g. for replays or savestates) then don't need to scan the "
+		"filepool anymore.",
+		false)
+	, indexStop(false)
 {
 	filePoolSetting.attach(*this);
+	preIndexSetting.attach(*this);
 	reactor.getEventDistributor().registerEventListener(OPENMSX_QUIT_EVENT, *this);
 	try {
 		readSha1sums();
@@ -71,14 +160,20 @@ FilePool::FilePool(CommandController& controller, Reactor& reactor_)
 	needWrite = false;
 
 	sha1SumCommand = std::make_unique<Sha1SumCommand>(controller, *this);
+
+	if (preIndexSetting.getBoolean()) {
+		startIndexing();
+	}
 }
 
 FilePool::~FilePool()
 {
+	stopIndexing();
 	if (needWrite) {
 		writeSha1sums();
 	}
 	reactor.getEventDistributor().unregisterEventListener(OPENMSX_QUIT_EVENT, *this);
+	preIndexSetting.detach(*this);
 	filePoolSetting.detach(*this);
 }
 
@@ -253,7 +348,15 @@ static int parseTypes(Interpreter& interp, const TclObject& list)
 
 void FilePool::update(const Setting& setting)
 {
-	assert(&setting == &filePoolSetting); (void)setting;
+	if (&setting == &preIndexSetting) {
+		if (preIndexSetting.getBoolean()) {
+			startIndexing();
+		} else {
+			stopIndexing();
+		}
+		return;
+	}
+	assert(&setting == &filePoolSetting);
 	getDirectories(); // check for syntax errors
 }
 
@@ -301,6 +404,7 @@ FilePool::Directories FilePool::getDirectories() const
 
 File FilePool::getFile(FileType fileType, const Sha1Sum& sha1sum)
 {
+	mergeIndexResults();
 	File result = getFromPool(sha1sum);
 	if (result.is_open()) return result;
 
@@ -320,11 +424,23 @@ File FilePool::getFile(FileType fileType, const Sha1Sum& sha1sum)
 		if (d.types & fileType) {
 			string path = FileOperations::expandTilde(d.path);
 			result = scanDirectory(sha1sum, path, d.path, progress);
-			if (result.is_open()) return result;
+			if (result.is_open()) break;
 		}
 	}
+	// Also when the file was already found, wait for the files that are
+	// still being hashed and store their sums in the pool.
+	while (!progress.pending.empty()) {
+		auto file = finishHash(sha1sum, progress);
+		if (!result.is_open()) result = std::move(file);
+	}
 
-	return result; // not found
+	// Scanning may have taken a long time, store the (incrementally
+	// updated) pool right away instead of only on exit.
+	if (needWrite) {
+		writeSha1sums();
+		needWrite = false;
+	}
+	return result;
 }
 
 static void reportProgress(const string& filename, size_t percentage,
@@ -473,47 +589,75 @@ File FilePool::scanFile(const Sha1Sum& sha1sum, const string& filename,
 	// Note: do NOT call 'reactor.getEventDistributor().deliverEvents()'.
 	// See comment in ReverseManager::goTo() for more details.
 
+	auto time = FileOperations::getModificationDate(st);
 	auto it = findInDatabase(filename);
-	if (it == end(pool)) {
-		// not in pool
-		try {
-			File file(filename);
-			auto sum = calcSha1sum(file, reactor);
-			auto time = FileOperations::getModificationDate(st);
-			insert(sum, time, filename);
-			if (sum == sha1sum) {
-				return file;
-			}
-		} catch (FileException&) {
-			// ignore
-		}
-	} else {
+	if (it != end(pool)) {
 		// already in pool
 		assert(filename == it->filename);
 		assert(it->time != time_t(-1));
-		try {
-			auto time = FileOperations::getModificationDate(st);
-			if (it->time == time) {
-				// db is still up to date
-				if (it->sum == sha1sum) {
-					return File(filename);
-				}
-			} else {
-				// db outdated
-				File file(filename);
-				auto sum = calcSha1sum(file, reactor);
-				it->setTime(time);
-				adjust(it, sum);
-				if (sum == sha1sum) {
-					return file;
-				}
+		if (it->time == time) {
+			// db is still up to date
+			if (it->sum != sha1sum) return File();
+			try {
+				return File(filename);
+			} catch (FileException&) {
+				// error reading file, remove from db
+				remove(it);
+				return File();
 			}
-		} catch (FileException&) {
-			// error reading file, remove from db
-			remove(it);
 		}
 	}
-	return File(); // not found
+	// Not in pool or db outdated: calculate the sha1sum on a worker
+	// thread and continue scanning. Only when there are too many files
+	// in flight, wait for the oldest one.
+	startHash(progress.pending, filename, time);
+	if (progress.pending.size() > maxPendingHashes()) {
+		return finishHash(sha1sum, progress);
+	}
+	return File(); // not found (yet)
+}
+
+// Wait for the oldest pending sha1sum calculation and store the result in the
+// pool. Returns the file if it has the requested sha1sum.
+File FilePool::finishHash(const Sha1Sum& sha1sum, ScanProgress& progress)
+{
+	auto& job = progress.pending.front();
+	// Like calcSha1sum(), show the progress when hashing takes long.
+	auto lastShowedProgress = Timer::getTime();
+	bool everShowedProgress = false;
+	while (job.done.wait_for(std::chrono::milliseconds(100)) !=
+	       std::future_status::ready) {
+		auto now = Timer::getTime();
+		auto size = job.size.load();
+		if (((now - lastShowedProgress) > 1000000) && size) {
+			reportProgress(job.filename, (100 * job.hashed) / size, reactor);
+			lastShowedProgress = now;
+			everShowedProgress = true;
+		}
+	}
+	if (everShowedProgress) {
+		reportProgress(job.filename, 100, reactor);
+	}
+
+	File result;
+	auto it = findInDatabase(job.filename);
+	if (job.ok) {
+		if (it == end(pool)) {
+			insert(job.sum, job.time, job.filename);
+		} else {
+			// db outdated
+			it->setTime(job.time);
+			adjust(it, job.sum);
+		}
+		if (job.sum == sha1sum) {
+			result = std::move(job.file);
+		}
+	} else if (it != end(pool)) {
+		// error reading file, remove from db
+		remove(it);
+	}
+	progress.pending.pop_front();
+	return result;
 }
 
 FilePool::Pool::iterator FilePool::findInDatabase(const string& filename)
@@ -544,6 +688,7 @@ FilePool::Pool::iterator FilePool::findInDatabase(const string& filename)
 
 Sha1Sum FilePool::getSha1Sum(File& file)
 {
+	mergeIndexResults();
 	auto time = file.getModificationDate();
 	const auto& filename = file.getURL();
 
@@ -573,10 +718,132 @@ int FilePool::signalEvent(const std::shared_ptr<const Event>& event)
 	(void)event; // avoid warning for non-assert compiles
 	assert(event->getType() == OPENMSX_QUIT_EVENT);
 	quit = true;
+	indexStop = true;
 	return 0;
 }
 
 
+// Background indexing
+
+void FilePool::startIndexing()
+{
+	if (indexThread.joinable()) return; // already running
+
+	Directories directories;
+	try {
+		directories = getDirectories();
+	} catch (CommandException&) {
+		return; // error is reported when the file pool is used
+	}
+	vector<string> paths;
+	for (auto& d : directories) {
+		paths.push_back(FileOperations::expandTilde(d.path));
+	}
+	// The index thread doesn't access 'pool', give it a (sorted) copy of
+	// the files that are already indexed.
+	vector<std::pair<string, time_t>> known;
+	known.reserve(pool.size());
+	for (auto& e : pool) {
+		auto time = e.getTime();
+		if (time != time_t(-1)) known.emplace_back(e.filename, time);
+	}
+	ranges::sort(known);
+
+	indexStop = false;
+	indexThread = std::thread([this, paths = std::move(paths), known = std::move(known)] {
+		for (auto& p : paths) {
+			if (indexStop) break;
+			indexDirectory(p, known);
+		}
+	});
+}
+
+void FilePool::stopIndexing()
+{
+	if (!indexThread.joinable()) return;
+	indexStop = true;
+	indexThread.join();
+	mergeIndexResults();
+}
+
+// Executed on the index thread.
+void FilePool::indexDirectory(
+	const string& directory, const vector<std::pair<string, time_t>>& known)
+{
+	HashJobs jobs;
+	auto storeOldest = [&] {
+		auto& job = jobs.front();
+		job.done.wait();
+		if (job.ok) {
+			std::lock_guard<std::mutex> lock(indexMutex);
+			indexResults.push_back({std::move(job.filename), job.time, job.sum});
+		}
+		jobs.pop_front();
+	};
+
+	vector<string> todo = {directory};
+	while (!todo.empty() && !indexStop) {
+		string dirName = std::move(todo.back());
+		todo.pop_back();
+		ReadDir dir(dirName);
+		while (dirent* d = dir.getEntry()) {
+			if (indexStop) break;
+			string file = d->d_name;
+			string path = strCat(dirName, '/', file);
+			FileOperations::Stat st;
+			if (!FileOperations::getStat(path, st)) continue;
+			if (FileOperations::isRegularFile(st)) {
+				auto time = FileOperations::getModificationDate(st);
+				auto it = ranges::lower_bound(known, path, LessTupleElement<0>());
+				if ((it != end(known)) && (it->first == path) &&
+				    (it->second == time)) {
+					continue; // already indexed
+				}
+				startHash(jobs, std::move(path), time);
+				if (jobs.size() > maxPendingHashes()) storeOldest();
+			} else if (FileOperations::isDirectory(st)) {
+				if ((file != ".") && (file != "..")) {
+					todo.push_back(std::move(path));
+				}
+			}
+		}
+	}
+	while (!jobs.empty()) storeOldest();
+}
+
+// Add the results of the index thread to the pool.
+void FilePool::mergeIndexResults()
+{
+	vector<IndexResult> results;
+	{
+		std::lock_guard<std::mutex> lock(indexMutex);
+		swap(results, indexResults);
+	}
+	if (results.empty()) return;
+
+	// Calling insert() or adjust() for each result is quadratic in the
+	// pool size. Instead update or append all entries and sort once.
+	stringBuffer.reserve(stringBuffer.size() + results.size());
+	hash_map<std::string_view, size_t, XXHasher> index;
+	index.reserve(unsigned(pool.size()));
+	for (auto i : xrange(pool.size())) {
+		index.insert(std::pair(std::string_view(pool[i].filename), i));
+	}
+	for (auto& r : results) {
+		if (auto* i = lookup(index, std::string_view(r.filename))) {
+			auto& entry = pool[*i];
+			entry.setTime(r.time);
+			entry.sum = r.sum;
+		} else {
+			stringBuffer.push_back(std::move(r.filename));
+			pool.emplace_back(r.sum, r.time, stringBuffer.back().c_str());
+		}
+	}
+	ranges::stable_sort(pool, ComparePool());
+	needWrite = true;
+}
+
+
 // class Sha1SumCommand
 
 Sha1SumCommand::Sha1SumCommand(
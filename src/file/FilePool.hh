@@ -2,16 +2,20 @@
 #define FILEPOOL_HH
 
 #include "FileOperations.hh"
+#include "BooleanSetting.hh"
 #include "StringSetting.hh"
 #include "Observer.hh"
 #include "EventListener.hh"
 #include "MemBuffer.hh"
 #include "sha1.hh"
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <ctime>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace openmsx {
@@ -44,10 +48,7 @@ public:
 	Sha1Sum getSha1Sum(File& file);
 
 private:
-	struct ScanProgress {
-		uint64_t lastTime;
-		unsigned amountScanned;
-	};
+	struct ScanProgress;
 	struct Entry {
 		std::string path;
 		int types;
@@ -89,6 +90,12 @@ private:
 	};
 	using Pool = std::vector<PoolEntry>; // sorted with 'ComparePool'
 
+	struct IndexResult {
+		std::string filename;
+		time_t time;
+		Sha1Sum sum;
+	};
+
 	void insert(const Sha1Sum& sum, time_t time, const std::string& filename);
 	void remove(Pool::iterator it);
 	bool adjust(Pool::iterator it, const Sha1Sum& newSum);
@@ -106,8 +113,15 @@ private:
 	              const FileOperations::Stat& st,
 	              const std::string& poolPath,
 	              ScanProgress& progress);
+	File finishHash(const Sha1Sum& sha1sum, ScanProgress& progress);
 	Pool::iterator findInDatabase(const std::string& filename);
 
+	void startIndexing();
+	void stopIndexing();
+	void indexDirectory(const std::string& directory,
+	                    const std::vector<std::pair<std::string, time_t>>& known);
+	void mergeIndexResults();
+
 	Directories getDirectories() const;
 
 	// Observer<Setting>
@@ -126,6 +140,15 @@ private:
 	Pool pool;
 	bool quit;
 	bool needWrite;
+
+	// Background indexing of all filepool directories (when enabled by
+	// 'preIndexSetting'). The index thread doesn't access 'pool', instead
+	// it passes its results via 'indexResults'.
+	BooleanSetting preIndexSetting;
+	std::thread indexThread;
+	std::atomic<bool> indexStop;
+	std::mutex indexMutex; // protects 'indexResults'
+	std::vector<IndexResult> indexResults;
 };
 
 } // namespace openmsx
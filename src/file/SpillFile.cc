@@ -0,0 +1,123 @@
+#include "SpillFile.hh"
+#include "FileOperations.hh"
+#include "FileException.hh"
+#include <cassert>
+#include <iterator>
+
+namespace openmsx {
+
+SpillFile::~SpillFile()
+{
+	if (file.is_open()) {
+		file.close();
+		if (!filename.empty()) FileOperations::unlink(filename);
+	}
+}
+
+void SpillFile::open()
+{
+	std::string tmpDir = FileOperations::getTempDir();
+	auto fp = FileOperations::openUniqueFile(tmpDir, filename);
+	if (!fp) {
+		throw FileException("Couldn't create temp file");
+	}
+	fp.reset();
+	file = File(filename, File::TRUNCATE);
+#ifndef _WIN32
+	// The open file remains usable. Windows can't remove an open file.
+	FileOperations::unlink(filename);
+	filename.clear();
+#endif
+}
+
+size_t SpillFile::allocate(size_t size)
+{
+	for (auto it = freeList.begin(); it != freeList.end(); ++it) {
+		auto [offset, holeSize] = *it;
+		if (holeSize < size) continue;
+		freeList.erase(it);
+		if (holeSize > size) {
+			freeList.emplace(offset + size, holeSize - size);
+		}
+		return offset;
+	}
+	auto offset = fileEnd;
+	fileEnd += size;
+	return offset;
+}
+
+SpillFile::Handle SpillFile::store(const uint8_t* data, size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!file.is_open()) open();
+
+	Handle handle;
+	handle.offset = allocate(size);
+	handle.size = size;
+	try {
+		file.seek(handle.offset);
+		file.write(data, size);
+	} catch (MSXException&) {
+		if (handle.offset + size == fileEnd) {
+			fileEnd = handle.offset;
+		} else {
+			freeList.emplace(handle.offset, size);
+		}
+		throw;
+	}
+	usedSize += size;
+	return handle;
+}
+
+void SpillFile::load(const Handle& handle, uint8_t* dst)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	assert(file.is_open());
+	file.seek(handle.offset);
+	file.read(dst, handle.size);
+}
+
+void SpillFile::release(const Handle& handle)
+{
+	if (handle.size == 0) return;
+	std::lock_guard<std::mutex> lock(mutex);
+	assert(usedSize >= handle.size);
+	usedSize -= handle.size;
+
+	auto offset = handle.offset;
+	auto size = handle.size;
+	// merge with the following hole
+	auto next = freeList.lower_bound(offset);
+	if ((next != freeList.end()) && (offset + size == next->first)) {
+		size += next->second;
+		next = freeList.erase(next);
+	}
+	// merge with the preceding hole
+	if (next != freeList.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			freeList.erase(prev);
+		}
+	}
+	if (offset + size == fileEnd) {
+		// hole at the end of the file, just shrink the file
+		fileEnd = offset;
+		try {
+			file.truncate(fileEnd);
+		} catch (MSXException&) {
+			// ignore, the space is reused anyway
+		}
+	} else {
+		freeList.emplace(offset, size);
+	}
+}
+
+size_t SpillFile::getUsedSize() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return usedSize;
+}
+
+} // namespace openmsx
@@ -0,0 +1,51 @@
+#ifndef SPILLFILE_HH
+#define SPILLFILE_HH
+
+#include "DeltaBlock.hh"
+#include "File.hh"
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace openmsx {
+
+/** Stores DeltaBlock data in a temporary file.
+ *
+ * Used to move old reverse history out of memory when the memory budget is
+ * exceeded. The file is only created on first use. It's unlinked right after
+ * it's opened, so it also disappears when openMSX crashes (except on Windows,
+ * there it's only removed when this object is destroyed). Freed regions are
+ * reused (first-fit), so the file does not keep on growing during a long
+ * session.
+ *
+ * All methods are thread-safe.
+ */
+class SpillFile final : public DeltaBlockStore
+{
+public:
+	SpillFile() = default;
+	~SpillFile() override;
+
+	Handle store(const uint8_t* data, size_t size) override;
+	void load(const Handle& handle, uint8_t* dst) override;
+	void release(const Handle& handle) override;
+
+	/** Number of bytes currently stored (excluding unused holes). */
+	size_t getUsedSize() const;
+
+private:
+	void open();
+	size_t allocate(size_t size);
+
+private:
+	mutable std::mutex mutex;
+	File file;
+	std::string filename; // empty once unlinked
+	std::map<size_t, size_t> freeList; // offset -> size
+	size_t fileEnd = 0;
+	size_t usedSize = 0;
+};
+
+} // namespace openmsx
+
+#endif
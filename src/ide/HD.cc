@@ -1,6 +1,7 @@
 #include "HD.hh"
 #include "FileContext.hh"
 #include "FilePool.hh"
+#include "FileOperations.hh"
 #include "DeviceConfig.hh"
 #include "CliComm.hh"
 #include "HDImageCLI.hh"
@@ -9,13 +10,19 @@
 #include "Display.hh"
 #include "GlobalSettings.hh"
 #include "MSXException.hh"
+#include "FileException.hh"
 #include "HDCommand.hh"
 #include "Timer.hh"
+#include "ScopedAssign.hh"
 #include "serialize.hh"
+#include "sha1.hh"
+#include "strCat.hh"
 #include "tiger.hh"
 #include "xrange.hh"
 #include <cassert>
+#include <cstdio>
 #include <memory>
+#include <vector>
 
 namespace openmsx {
 
@@ -61,6 +68,9 @@ HD::HD(const DeviceConfig& config)
 	}
 	tigerTree = std::make_unique<TigerTree>(
 		*this, filesize, filename.getResolved());
+	loadTigerTreeCache();
+	useOverlay = motherBoard.getReactor().getGlobalSettings()
+	                .getHDOverlaySetting().getBoolean();
 
 	(*hdInUse)[id] = true;
 	hdCommand = std::make_unique<HDCommand>(
@@ -75,6 +85,7 @@ HD::HD(const DeviceConfig& config)
 
 HD::~HD()
 {
+	saveTigerTreeCache();
 	motherBoard.getMSXCliComm().update(CliComm::HARDWARE, name, "remove");
 
 	unsigned id = name[2] - 'a';
@@ -84,11 +95,16 @@ HD::~HD()
 
 void HD::switchImage(const Filename& newFilename)
 {
+	saveTigerTreeCache();
 	file = File(newFilename);
 	filename = newFilename;
 	filesize = file.getSize();
 	tigerTree = std::make_unique<TigerTree>(*this, filesize,
 			filename.getResolved());
+	loadTigerTreeCache();
+	overlay.clear();
+	useOverlay = motherBoard.getReactor().getGlobalSettings()
+	                .getHDOverlaySetting().getBoolean();
 	motherBoard.getMSXCliComm().update(CliComm::MEDIA, getName(),
 	                                   filename.getResolved());
 }
@@ -100,18 +116,34 @@ size_t HD::getNbSectorsImpl() const
 
 void HD::readSectorImpl(size_t sector, SectorBuffer& buf)
 {
+	if (!bypassOverlay && overlay.read(sector, buf)) return;
 	file.seek(sector * sizeof(buf));
 	file.read(&buf, sizeof(buf));
 }
 
 void HD::writeSectorImpl(size_t sector, const SectorBuffer& buf)
 {
+	if (useOverlay) {
+		overlay.write(sector, buf);
+		return;
+	}
 	file.seek(sector * sizeof(buf));
 	file.write(&buf, sizeof(buf));
 	tigerTree->notifyChange(sector * sizeof(buf), sizeof(buf),
 	                        file.getModificationDate());
 }
 
+void HD::commitOverlay()
+{
+	overlay.commit([&](size_t sector, const SectorBuffer& buf) {
+		auto offset = sector * sizeof(SectorBuffer);
+		file.seek(offset);
+		file.write(&buf, sizeof(buf));
+		tigerTree->notifyChange(offset, sizeof(buf),
+		                        file.getModificationDate());
+	});
+}
+
 bool HD::isWriteProtectedImpl() const
 {
 	return file.isReadOnly();
@@ -119,7 +151,7 @@ bool HD::isWriteProtectedImpl() const
 
 Sha1Sum HD::getSha1SumImpl(FilePool& filePool)
 {
-	if (hasPatches()) {
+	if (hasPatches() || !overlay.empty()) {
 		return SectorAccessibleDisk::getSha1SumImpl(filePool);
 	}
 	return filePool.getSha1Sum(file);
@@ -149,7 +181,69 @@ std::string HD::getTigerTreeHash()
 	lastProgressTime = Timer::getTime();
 	everDidProgress = false;
 	auto callback = [this](size_t p, size_t t) { showProgress(p, t); };
-	return tigerTree->calcHash(callback).toString(); // calls HD::getData()
+	auto result = tigerTree->calcHash(callback).toString(); // calls HD::getData()
+	if (everDidProgress) {
+		// This took a while, don't risk losing it.
+		saveTigerTreeCache();
+	}
+	return result;
+}
+
+// The upper part of the tiger-tree is stored in the user data directory, so
+// that the hash of a large image doesn't need to be fully recalculated in each
+// openMSX session (e.g. on the first savestate).
+static string getTigerTreeCacheFile(const Filename& filename)
+{
+	const auto& path = filename.getResolved();
+	auto key = SHA1::calc(reinterpret_cast<const uint8_t*>(path.data()), path.size());
+	return strCat(FileOperations::getUserDataDir(), "/tigertree/",
+	              key.toString(), ".tth");
+}
+
+void HD::loadTigerTreeCache()
+{
+	auto size = tigerTree->getCacheSize();
+	std::vector<uint8_t> buf;
+	try {
+		File cache(getTigerTreeCacheFile(filename));
+		// Only read the full cache when its header matches the current
+		// image (size and modification time).
+		if (cache.getSize() != size) return;
+		buf.resize(size);
+		span<const uint8_t> header(buf.data(), TigerTree::CACHE_HEADER_SIZE);
+		cache.read(buf.data(), header.size());
+		if (!tigerTree->isCacheHeaderValid(header)) return;
+		cache.read(buf.data() + header.size(), size - header.size());
+	} catch (MSXException&) {
+		// no (readable) cache, ignore
+		return;
+	}
+	tigerTree->loadCache(buf);
+}
+
+void HD::saveTigerTreeCache()
+{
+	if (!tigerTree->needsCacheSave()) return;
+	string tmpName;
+	try {
+		file.flush(); // so that the modification date is final
+		auto buf = tigerTree->saveCache(file.getModificationDate());
+		auto cacheFile = getTigerTreeCacheFile(filename);
+		string dir(FileOperations::getDirName(cacheFile));
+		FileOperations::mkdirp(dir);
+		// Write a temporary file and then move it in place, so that
+		// (concurrent) readers never see a partially written cache.
+		auto fp = FileOperations::openUniqueFile(dir, tmpName);
+		if (!fp) throw FileException("Couldn't create ", tmpName);
+		bool ok = fwrite(buf.data(), 1, buf.size(), fp.get()) == buf.size();
+		ok = (fclose(fp.release()) == 0) && ok;
+		if (!ok || (FileOperations::rename(tmpName, cacheFile) != 0)) {
+			FileOperations::unlink(tmpName);
+		}
+	} catch (MSXException&) {
+		// ignore, the hash can always be recalculated
+		if (!tmpName.empty()) FileOperations::unlink(tmpName);
+	}
 }
 
 uint8_t* HD::getData(size_t offset, size_t size)
@@ -165,6 +259,10 @@ uint8_t* HD::getData(size_t offset, size_t size)
 	};
 	static Work work; // not reentrant
 
+	// The hash covers the image file (with patches), not the overlay. So
+	// in 'hd_overlay' mode it never changes and it's (almost) free to
+	// recalculate it.
+	ScopedAssign sa(bypassOverlay, true);
 	size_t sector = offset / sizeof(SectorBuffer);
 	for (auto i : xrange(size / sizeof(SectorBuffer))) {
 		// This possibly applies IPS patches.
@@ -208,6 +306,7 @@ int HD::insertDisk(std::string_view newFilename)
 
 // version 1: initial version
 // version 2: replaced 'checksum'(=sha1) with 'tthsum`
+// version 3: added 'hd_overlay' mode
 template<typename Archive>
 void HD::serialize(Archive& ar, unsigned version)
 {
@@ -232,6 +331,7 @@ void HD::serialize(Archive& ar, unsigned version)
 			//    savestate we again close the file. Otherwise the
 			//    checksum-check code below goes wrong.
 			file.close();
+			overlay.clear();
 		} else {
 			tmp.updateAfterLoadState();
 			if (filename != tmp) switchImage(tmp);
@@ -272,6 +372,12 @@ void HD::serialize(Archive& ar, unsigned version)
 			}
 		}
 
+		if (ar.versionAtLeast(version, 3)) {
+			serializeOverlay(ar);
+		} else if (ar.isLoader()) {
+			overlay.clear();
+		}
+
 		if (ar.isLoader() && mismatch) {
 			motherBoard.getMSXCliComm().printWarning(
 				"The content of the harddisk ",
@@ -284,6 +390,12 @@ void HD::serialize(Archive& ar, unsigned version)
 		}
 	}
 }
+template<typename Archive>
+void HD::serializeOverlay(Archive& ar)
+{
+	ar.serialize("overlay", useOverlay);
+	overlay.serialize(ar, 0); // inline, not in a separate tag
+}
 INSTANTIATE_SERIALIZE_METHODS(HD);
 
 } // namespace openmsx
@@ -4,6 +4,7 @@
 #include "Filename.hh"
 #include "File.hh"
 #include "SectorAccessibleDisk.hh"
+#include "SectorOverlay.hh"
 #include "DiskContainer.hh"
 #include "TigerTree.hh"
 #include "serialize_meta.hh"
@@ -28,6 +29,18 @@ public:
 	const Filename& getImageName() const { return filename; }
 	void switchImage(const Filename& filename);
 
+	/** Is the 'hd_overlay' mode active for the current image? In that mode
+	  * writes are kept in memory (and in savestates and reverse snapshots)
+	  * instead of being written to the image file.
+	  */
+	bool hasOverlay() const { return useOverlay; }
+	size_t getNbOverlaySectors() const { return overlay.size(); }
+	/** Write all sectors in the overlay to the image file. The caller must
+	  * make sure that the emulation can't go back to a state before this
+	  * (that state would have an older overlay on top of a newer file).
+	  */
+	void commitOverlay();
+
 	std::string getTigerTreeHash();
 
 	template<typename Archive>
@@ -54,6 +67,10 @@ private:
 	bool isCacheStillValid(time_t& time) override;
 
 	void showProgress(size_t position, size_t maxPosition);
+	void loadTigerTreeCache();
+	void saveTigerTreeCache();
+	template<typename Archive>
+	void serializeOverlay(Archive& ar);
 
 	MSXMotherBoard& motherBoard;
 	std::string name;
@@ -64,6 +81,11 @@ private:
 	Filename filename;
 	size_t filesize;
 
+	// Sectors written in 'hd_overlay' mode, these are not (yet) in 'file'.
+	SectorOverlay overlay;
+	bool useOverlay = false;
+	bool bypassOverlay = false; // read the image without the overlay
+
 	static constexpr unsigned MAX_HD = 26;
 	using HDInUse = std::bitset<MAX_HD>;
 	std::shared_ptr<HDInUse> hdInUse;
@@ -73,7 +95,7 @@ private:
 };
 
 REGISTER_BASE_CLASS(HD, "HD");
-SERIALIZE_CLASS_VERSION(HD, 2);
+SERIALIZE_CLASS_VERSION(HD, 3);
 
 } // namespace openmsx
 
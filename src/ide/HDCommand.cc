@@ -1,5 +1,8 @@
 #include "HDCommand.hh"
 #include "HD.hh"
+#include "MSXMotherBoard.hh"
+#include "ReverseManager.hh"
+#include "StateChangeDistributor.hh"
 #include "FileContext.hh"
 #include "FileException.hh"
 #include "CommandException.hh"
@@ -31,10 +34,31 @@ void HDCommand::execute(span<const TclObject> tokens, TclObject& result,
 		result.addListElement(hd.getName() + ':',
 		                      hd.getImageName().getResolved());
 
-		if (hd.isWriteProtected()) {
-			TclObject options = makeTclList("readonly");
+		if (hd.isWriteProtected() || hd.hasOverlay()) {
+			TclObject options;
+			if (hd.isWriteProtected()) options.addListElement("readonly");
+			if (hd.hasOverlay())       options.addListElement("overlay");
 			result.addListElement(options);
 		}
+	} else if ((tokens.size() == 2) && (tokens[1] == "-commit")) {
+		// A snapshot from before the commit would put its (older)
+		// overlay on top of the already updated image file. So
+		// committing restarts the reverse history.
+		auto& motherBoard = hd.getMotherBoard();
+		if (motherBoard.getStateChangeDistributor().isReplaying()) {
+			throw CommandException(
+				"Can't commit the hard disk image while replaying.");
+		}
+		auto& reverseManager = motherBoard.getReverseManager();
+		try {
+			hd.commitOverlay();
+		} catch (FileException& e) {
+			// part of the overlay may already be written
+			reverseManager.clearHistory();
+			throw CommandException("Can't write hard disk image: ",
+			                       e.getMessage());
+		}
+		reverseManager.clearHistory();
 	} else if ((tokens.size() == 2) ||
 	           ((tokens.size() == 3) && tokens[1] == "insert")) {
 		if (powerSetting.getBoolean()) {
@@ -69,21 +93,26 @@ void HDCommand::execute(span<const TclObject> tokens, TclObject& result,
 
 string HDCommand::help(const vector<string>& /*tokens*/) const
 {
-	return hd.getName() + ": change the hard disk image for this hard disk drive\n";
+	return hd.getName() + ": change the hard disk image for this hard disk drive\n" +
+	       hd.getName() + " -commit: write the changes kept in memory in "
+	       "'hd_overlay' mode to the image file, this also clears the "
+	       "reverse history\n";
 }
 
 void HDCommand::tabCompletion(vector<string>& tokens) const
 {
 	vector<const char*> extra;
 	if (tokens.size() < 3) {
-		extra = { "insert" };
+		extra = { "insert", "-commit" };
 	}
 	completeFileName(tokens, userFileContext(), extra);
 }
 
 bool HDCommand::needRecord(span<const TclObject> tokens) const
 {
-	return tokens.size() > 1;
+	// Committing doesn't change the emulated state (the disk content as
+	// seen by the MSX stays the same), so don't replay it.
+	return (tokens.size() > 1) && (tokens[1] != "-commit");
 }
 
 } // namespace openmsx
@@ -0,0 +1,50 @@
+#include "SectorOverlay.hh"
+#include "serialize.hh"
+#include "serialize_stl.hh"
+#include "xrange.hh"
+#include <vector>
+
+namespace openmsx {
+
+bool SectorOverlay::read(size_t sector, SectorBuffer& buf) const
+{
+	auto it = sectors.find(sector);
+	if (it == sectors.end()) return false;
+	buf = it->second;
+	return true;
+}
+
+void SectorOverlay::write(size_t sector, const SectorBuffer& buf)
+{
+	sectors[sector] = buf;
+}
+
+template<typename Archive>
+void SectorOverlay::serialize(Archive& ar, unsigned /*version*/)
+{
+	// Stored as a sparse delta on top of the image file: the numbers of
+	// the written sectors plus one blob with their content.
+	std::vector<size_t> numbers;
+	std::vector<SectorBuffer> data;
+	if (!ar.isLoader()) {
+		numbers.reserve(sectors.size());
+		data.reserve(sectors.size());
+		for (const auto& [sector, buf] : sectors) {
+			numbers.push_back(sector);
+			data.push_back(buf);
+		}
+	}
+	ar.serialize("overlaySectors", numbers);
+	if (ar.isLoader()) data.resize(numbers.size());
+	ar.serialize_blob("overlayData", data.data(),
+	                  data.size() * sizeof(SectorBuffer));
+	if (ar.isLoader()) {
+		sectors.clear();
+		for (auto i : xrange(numbers.size())) {
+			sectors.emplace_hint(sectors.end(), numbers[i], data[i]);
+		}
+	}
+}
+INSTANTIATE_SERIALIZE_METHODS(SectorOverlay);
+
+} // namespace openmsx
@@ -0,0 +1,49 @@
+#ifndef SECTOROVERLAY_HH
+#define SECTOROVERLAY_HH
+
+#include "DiskImageUtils.hh"
+#include <cstddef>
+#include <map>
+
+namespace openmsx {
+
+/** Copy-on-write layer on top of a disk image: the sectors written in
+  * 'hd_overlay' mode. Sectors that are not in the overlay should be read
+  * from the image itself.
+  */
+class SectorOverlay
+{
+public:
+	/** If the sector is in the overlay, copy it into 'buf' and return true.
+	  */
+	[[nodiscard]] bool read(size_t sector, SectorBuffer& buf) const;
+	void write(size_t sector, const SectorBuffer& buf);
+
+	/** Pass all sectors (in increasing order) to 'writeSector(sector, buf)'
+	  * and remove them from the overlay. When that throws, the sectors
+	  * that were not yet written remain in the overlay.
+	  */
+	template<typename WriteSector>
+	void commit(WriteSector writeSector)
+	{
+		while (!sectors.empty()) {
+			auto it = sectors.begin();
+			writeSector(it->first, it->second);
+			sectors.erase(it); // only after a successful write
+		}
+	}
+
+	[[nodiscard]] bool empty() const { return sectors.empty(); }
+	[[nodiscard]] size_t size() const { return sectors.size(); }
+	void clear() { sectors.clear(); }
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned version);
+
+private:
+	std::map<size_t, SectorBuffer> sectors;
+};
+
+} // namespace openmsx
+
+#endif
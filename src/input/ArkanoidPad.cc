@@ -3,6 +3,7 @@
 #include "StateChangeDistributor.hh"
 #include "InputEvents.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "checked_cast.hh"
 #include "serialize.hh"
 #include "serialize_meta.hh"
@@ -19,7 +20,6 @@
 
 using std::string;
 using std::shared_ptr;
-using std::make_shared;
 
 namespace openmsx {
 
@@ -130,7 +130,7 @@ void ArkanoidPad::signalMSXEvent(const shared_ptr<const Event>& event,
 		int delta = newPos - dialpos;
 		if (delta != 0) {
 			stateChangeDistributor.distributeNew(
-				make_shared<ArkanoidState>(
+				make_pooled_shared<ArkanoidState>(
 					time, delta, false, false));
 		}
 		break;
@@ -139,7 +139,7 @@ void ArkanoidPad::signalMSXEvent(const shared_ptr<const Event>& event,
 		// any button will press the Arkanoid Pad button
 		if (buttonStatus & 2) {
 			stateChangeDistributor.distributeNew(
-				make_shared<ArkanoidState>(
+				make_pooled_shared<ArkanoidState>(
 					time, 0, true, false));
 		}
 		break;
@@ -147,7 +147,7 @@ void ArkanoidPad::signalMSXEvent(const shared_ptr<const Event>& event,
 		// any button will unpress the Arkanoid Pad button
 		if (!(buttonStatus & 2)) {
 			stateChangeDistributor.distributeNew(
-				make_shared<ArkanoidState>(
+				make_pooled_shared<ArkanoidState>(
 					time, 0, false, true));
 		}
 		break;
@@ -174,7 +174,7 @@ void ArkanoidPad::stopReplay(EmuTime::param time)
 	int delta = POS_CENTER - dialpos;
 	bool release = (buttonStatus & 2) == 0;
 	if ((delta != 0) || release) {
-		stateChangeDistributor.distributeNew(make_shared<ArkanoidState>(
+		stateChangeDistributor.distributeNew(make_pooled_shared<ArkanoidState>(
 			time, delta, false, release));
 	}
 }
@@ -5,6 +5,7 @@
 #include "InputEvents.hh"
 #include "InputEventGenerator.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "checked_cast.hh"
 #include "serialize.hh"
 #include "serialize_meta.hh"
@@ -227,12 +228,20 @@ unsigned JoyMega::calcInitialState()
 // MSXEventListener
 void JoyMega::signalMSXEvent(const shared_ptr<const Event>& event, EmuTime::param time)
 {
-	auto joyEvent = dynamic_cast<const JoystickEvent*>(event.get());
-	if (!joyEvent) return;
+	switch (event->getType()) {
+	case OPENMSX_JOY_AXIS_MOTION_EVENT:
+	case OPENMSX_JOY_HAT_EVENT:
+	case OPENMSX_JOY_BUTTON_UP_EVENT:
+	case OPENMSX_JOY_BUTTON_DOWN_EVENT:
+		break;
+	default:
+		return; // not a joystick event
+	}
+	auto& joyEvent = checked_cast<const JoystickEvent&>(*event);
 
 	// TODO: It would be more efficient to make a dispatcher instead of
 	//       sending the event to all joysticks.
-	if (joyEvent->getJoystick() != joyNum) return;
+	if (joyEvent.getJoystick() != joyNum) return;
 
 	switch (event->getType()) {
 	case OPENMSX_JOY_AXIS_MOTION_EVENT: {
@@ -300,7 +309,7 @@ void JoyMega::createEvent(EmuTime::param time, unsigned newStatus)
 	// make sure we create an event with minimal changes
 	unsigned press   =    status & diff;
 	unsigned release = newStatus & diff;
-	stateChangeDistributor.distributeNew(std::make_shared<JoyMegaState>(
+	stateChangeDistributor.distributeNew(make_pooled_shared<JoyMegaState>(
 		time, joyNum, press, release));
 }
 
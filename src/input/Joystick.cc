@@ -6,6 +6,7 @@
 #include "InputEvents.hh"
 #include "InputEventGenerator.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "TclObject.hh"
 #include "GlobalSettings.hh"
 #include "IntegerSetting.hh"
@@ -14,6 +15,7 @@
 #include "serialize.hh"
 #include "serialize_meta.hh"
 #include "StringOp.hh"
+#include "checked_cast.hh"
 #include "xrange.hh"
 #include <memory>
 
@@ -302,12 +304,20 @@ bool Joystick::getState(Interpreter& interp, const TclObject& dict,
 void Joystick::signalMSXEvent(const shared_ptr<const Event>& event,
                               EmuTime::param time)
 {
-	auto joyEvent = dynamic_cast<const JoystickEvent*>(event.get());
-	if (!joyEvent) return;
+	switch (event->getType()) {
+	case OPENMSX_JOY_AXIS_MOTION_EVENT:
+	case OPENMSX_JOY_HAT_EVENT:
+	case OPENMSX_JOY_BUTTON_UP_EVENT:
+	case OPENMSX_JOY_BUTTON_DOWN_EVENT:
+		break;
+	default:
+		return; // not a joystick event
+	}
+	auto& joyEvent = checked_cast<const JoystickEvent&>(*event);
 
 	// TODO: It would be more efficient to make a dispatcher instead of
 	//       sending the event to all joysticks.
-	if (joyEvent->getJoystick() != joyNum) return;
+	if (joyEvent.getJoystick() != joyNum) return;
 
 	// TODO: Currently this recalculates the whole joystick state. It might
 	// be possible to implement this more efficiently by using the specific
@@ -329,7 +339,7 @@ void Joystick::createEvent(EmuTime::param time, byte newStatus)
 	// make sure we create an event with minimal changes
 	byte press   =    status & diff;
 	byte release = newStatus & diff;
-	stateChangeDistributor.distributeNew(std::make_shared<JoyState>(
+	stateChangeDistributor.distributeNew(make_pooled_shared<JoyState>(
 		time, joyNum, press, release));
 }
 
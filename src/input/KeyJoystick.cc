@@ -3,6 +3,7 @@
 #include "StateChangeDistributor.hh"
 #include "InputEvents.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "checked_cast.hh"
 #include "serialize.hh"
 #include "serialize_meta.hh"
@@ -141,7 +142,7 @@ void KeyJoystick::signalMSXEvent(const shared_ptr<const Event>& event,
 	}
 
 	if (((status & ~press) | release) != status) {
-		stateChangeDistributor.distributeNew(std::make_shared<KeyJoyState>(
+		stateChangeDistributor.distributeNew(make_pooled_shared<KeyJoyState>(
 			time, name, press, release));
 	}
 }
@@ -163,7 +164,7 @@ void KeyJoystick::stopReplay(EmuTime::param time)
 	                 JOY_BUTTONA | JOY_BUTTONB;
 	if (newStatus != status) {
 		byte release = newStatus & ~status;
-		stateChangeDistributor.distributeNew(std::make_shared<KeyJoyState>(
+		stateChangeDistributor.distributeNew(make_pooled_shared<KeyJoyState>(
 			time, name, 0, release));
 	}
 }
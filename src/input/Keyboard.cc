@@ -11,6 +11,7 @@
 #include "CommandException.hh"
 #include "InputEvents.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "TclArgParser.hh"
 #include "utf8_checked.hh"
 #include "checked_cast.hh"
@@ -31,7 +32,6 @@
 using std::string;
 using std::vector;
 using std::shared_ptr;
-using std::make_shared;
 
 namespace openmsx {
 
@@ -338,7 +338,7 @@ void Keyboard::changeKeyMatrixEvent(EmuTime::param time, byte row, byte newValue
 	if (diff == 0) return;
 	byte press   = userKeyMatrix[row] & diff;
 	byte release = newValue           & diff;
-	stateChangeDistributor.distributeNew(make_shared<KeyMatrixState>(
+	stateChangeDistributor.distributeNew(make_pooled_shared<KeyMatrixState>(
 		time, row, press, release));
 }
 
@@ -992,7 +992,7 @@ void Keyboard::MsxKeyEventQueue::executeUntil(EmuTime::param time)
 		// The processor pressed the CODE/KANA key
 		// Schedule a CODE/KANA release event, to be processed
 		// before any of the other events in the queue
-		eventQueue.push_front(make_shared<KeyUpEvent>(
+		eventQueue.push_front(make_pooled_shared<KeyUpEvent>(
 			keyboard.keyboardSettings.getCodeKanaHostKey()));
 	} else {
 		// The event has been completely processed. Delete it from the queue
@@ -1204,7 +1204,7 @@ void Keyboard::CapsLockAligner::executeUntil(EmuTime::param time)
 			break;
 		case MUST_DISTRIBUTE_KEY_RELEASE: {
 			auto& keyboard = OUTER(Keyboard, capsLockAligner);
-			auto event = make_shared<KeyUpEvent>(Keys::K_CAPSLOCK);
+			auto event = make_pooled_shared<KeyUpEvent>(Keys::K_CAPSLOCK);
 			keyboard.msxEventDistributor.distributeEvent(event, time);
 			state = IDLE;
 			break;
@@ -1232,7 +1232,7 @@ void Keyboard::CapsLockAligner::alignCapsLock(EmuTime::param time)
 		keyboard.debug("Resyncing host and MSX CAPS lock\n");
 		// note: send out another event iso directly calling
 		// processCapslockEvent() because we want this to be recorded
-		auto event = make_shared<KeyDownEvent>(Keys::K_CAPSLOCK);
+		auto event = make_pooled_shared<KeyDownEvent>(Keys::K_CAPSLOCK);
 		keyboard.msxEventDistributor.distributeEvent(event, time);
 		keyboard.debug("Sending fake CAPS release\n");
 		state = MUST_DISTRIBUTE_KEY_RELEASE;
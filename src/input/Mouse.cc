@@ -3,6 +3,7 @@
 #include "StateChangeDistributor.hh"
 #include "InputEvents.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "Clock.hh"
 #include "checked_cast.hh"
 #include "serialize.hh"
@@ -296,7 +297,7 @@ void Mouse::signalMSXEvent(const shared_ptr<const Event>& event, EmuTime::param
 void Mouse::createMouseStateChange(
 	EmuTime::param time, int deltaX, int deltaY, byte press, byte release)
 {
-	stateChangeDistributor.distributeNew(std::make_shared<MouseState>(
+	stateChangeDistributor.distributeNew(make_pooled_shared<MouseState>(
 		time, deltaX, deltaY, press, release));
 }
 
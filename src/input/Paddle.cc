@@ -3,6 +3,7 @@
 #include "StateChangeDistributor.hh"
 #include "InputEvents.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "checked_cast.hh"
 #include "serialize.hh"
 #include "serialize_meta.hh"
@@ -105,7 +106,7 @@ void Paddle::signalMSXEvent(const std::shared_ptr<const Event>& event,
 	if (delta == 0) return;
 
 	stateChangeDistributor.distributeNew(
-		std::make_shared<PaddleState>(time, delta));
+		make_pooled_shared<PaddleState>(time, delta));
 }
 
 // StateChangeListener
@@ -10,6 +10,7 @@
 #include "StateChangeDistributor.hh"
 #include "InputEvents.hh"
 #include "StateChange.hh"
+#include "PoolAllocator.hh"
 #include "Display.hh"
 #include "OutputSurface.hh"
 #include "CommandController.hh"
@@ -260,7 +261,7 @@ void Touchpad::signalMSXEvent(const shared_ptr<const Event>& event,
 void Touchpad::createTouchpadStateChange(
 	EmuTime::param time, byte x_, byte y_, bool touch_, bool button_)
 {
-	stateChangeDistributor.distributeNew(std::make_shared<TouchpadState>(
+	stateChangeDistributor.distributeNew(make_pooled_shared<TouchpadState>(
 		time, x_, y_, touch_, button_));
 }
 
@@ -280,7 +281,7 @@ void Touchpad::stopReplay(EmuTime::param time)
 	// TODO Get actual mouse state. Is it worth the trouble?
 	if (x || y || touch || button) {
 		stateChangeDistributor.distributeNew(
-			std::make_shared<TouchpadState>(
+			make_pooled_shared<TouchpadState>(
 				time, 0, 0, false, false));
 	}
 }
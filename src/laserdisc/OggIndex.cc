@@ -0,0 +1,158 @@
+#include "OggIndex.hh"
+#include "File.hh"
+#include "MSXException.hh"
+#include "endian.hh"
+#include "ranges.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace openmsx {
+
+constexpr char INDEX_MAGIC[8] = {'o', 'M', 'S', 'X', 'O', 'G', 'I', '1'};
+constexpr size_t INDEX_HEADER_SIZE = sizeof(INDEX_MAGIC) + 4 * 8;
+constexpr size_t VIDEO_PAGE_SIZE = 3 * 8;
+constexpr size_t AUDIO_PAGE_SIZE = 2 * 8;
+constexpr size_t OGG_PAGE_HEADER_SIZE = 27;
+
+std::unique_ptr<OggIndex> OggIndex::build(
+	File& ogg, int videoSerial, int audioSerial, int granuleShift,
+	const std::atomic<bool>& abort)
+{
+	auto idx = std::make_unique<OggIndex>();
+	idx->fileSize = ogg.getSize();
+	idx->modificationTime = ogg.getModificationDate();
+
+	uint8_t header[OGG_PAGE_HEADER_SIZE + 255];
+	size_t offset = 0;
+	while ((offset + OGG_PAGE_HEADER_SIZE) <= idx->fileSize) {
+		if (abort) return nullptr;
+
+		ogg.seek(offset);
+		ogg.read(header, OGG_PAGE_HEADER_SIZE);
+		if (memcmp(header, "OggS", 4) != 0) {
+			throw MSXException("Damaged ogg file at offset ", offset);
+		}
+		unsigned numSegments = header[26];
+		if ((offset + OGG_PAGE_HEADER_SIZE + numSegments) > idx->fileSize) {
+			break; // truncated
+		}
+		ogg.read(header + OGG_PAGE_HEADER_SIZE, numSegments);
+		size_t bodySize = 0;
+		for (auto i : xrange(numSegments)) {
+			bodySize += header[OGG_PAGE_HEADER_SIZE + i];
+		}
+
+		// -1 when no packet ends in this page
+		auto granulePos = int64_t(Endian::read_UA_L64(header + 6));
+		auto serial = int(Endian::read_UA_L32(header + 14));
+		if (granulePos != -1) {
+			if (serial == videoSerial) {
+				size_t key = size_t(granulePos) >> granuleShift;
+				size_t intra = size_t(granulePos) & ((size_t(1) << granuleShift) - 1);
+				idx->video.push_back({offset, key, key + intra});
+			} else if (serial == audioSerial) {
+				idx->audio.push_back({offset, size_t(granulePos)});
+			}
+		}
+		offset += OGG_PAGE_HEADER_SIZE + numSegments + bodySize;
+	}
+	if (idx->video.empty() || idx->audio.empty()) return nullptr;
+	return idx;
+}
+
+std::unique_ptr<OggIndex> OggIndex::load(
+	span<const uint8_t> buf, size_t fileSize, time_t modificationTime)
+{
+	if (buf.size() < INDEX_HEADER_SIZE) return nullptr;
+	const auto* p = buf.data();
+	if ((memcmp(p, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) ||
+	    (Endian::read_UA_L64(p +  8) != fileSize) ||
+	    (time_t(Endian::read_UA_L64(p + 16)) != modificationTime)) {
+		return nullptr; // for an older version of the file
+	}
+	// Check the counts one by one, so that a damaged file can't cause an
+	// overflow in the calculation of the expected size.
+	auto numVideo = Endian::read_UA_L64(p + 24);
+	auto numAudio = Endian::read_UA_L64(p + 32);
+	auto available = buf.size() - INDEX_HEADER_SIZE;
+	if ((numVideo == 0) || (numVideo > available / VIDEO_PAGE_SIZE)) return nullptr;
+	available -= numVideo * VIDEO_PAGE_SIZE;
+	if ((numAudio == 0) || (numAudio != available / AUDIO_PAGE_SIZE) ||
+	    ((available % AUDIO_PAGE_SIZE) != 0)) {
+		return nullptr;
+	}
+
+	auto idx = std::make_unique<OggIndex>();
+	idx->fileSize = fileSize;
+	idx->modificationTime = modificationTime;
+	p += INDEX_HEADER_SIZE;
+	idx->video.resize(numVideo);
+	for (auto& page : idx->video) {
+		page.offset   = Endian::read_UA_L64(p +  0);
+		page.keyFrame = Endian::read_UA_L64(p +  8);
+		page.frame    = Endian::read_UA_L64(p + 16);
+		p += VIDEO_PAGE_SIZE;
+	}
+	idx->audio.resize(numAudio);
+	for (auto& page : idx->audio) {
+		page.offset = Endian::read_UA_L64(p + 0);
+		page.sample = Endian::read_UA_L64(p + 8);
+		p += AUDIO_PAGE_SIZE;
+	}
+	return idx;
+}
+
+std::vector<uint8_t> OggIndex::save() const
+{
+	std::vector<uint8_t> buf(INDEX_HEADER_SIZE +
+	                         video.size() * VIDEO_PAGE_SIZE +
+	                         audio.size() * AUDIO_PAGE_SIZE);
+	auto* p = buf.data();
+	memcpy(p, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	Endian::write_UA_L64(p +  8, fileSize);
+	Endian::write_UA_L64(p + 16, uint64_t(modificationTime));
+	Endian::write_UA_L64(p + 24, video.size());
+	Endian::write_UA_L64(p + 32, audio.size());
+	p += INDEX_HEADER_SIZE;
+	for (const auto& page : video) {
+		Endian::write_UA_L64(p +  0, page.offset);
+		Endian::write_UA_L64(p +  8, page.keyFrame);
+		Endian::write_UA_L64(p + 16, page.frame);
+		p += VIDEO_PAGE_SIZE;
+	}
+	for (const auto& page : audio) {
+		Endian::write_UA_L64(p + 0, page.offset);
+		Endian::write_UA_L64(p + 8, page.sample);
+		p += AUDIO_PAGE_SIZE;
+	}
+	return buf;
+}
+
+OggIndex::Position OggIndex::find(size_t frame, size_t sample) const
+{
+	if ((sample > audio.back().sample) || (frame > getTotalFrames())) {
+		sample = audio.back().sample;
+		frame = getTotalFrames();
+	}
+
+	// The key frame for 'frame' is the last one that starts at or before it.
+	auto v = ranges::upper_bound(video, frame,
+		[](size_t f, const auto& page) { return f < page.keyFrame; });
+	if (v == begin(video)) return {0, 1};
+	auto keyFrame = std::prev(v)->keyFrame;
+
+	// Start reading at the last page that only completes frames before the
+	// key frame, the key frame itself starts in that page or in a later
+	// one. Similar for the audio.
+	auto vs = ranges::lower_bound(video, keyFrame,
+		[](const auto& page, size_t f) { return page.frame < f; });
+	auto as = ranges::lower_bound(audio, sample,
+		[](const auto& page, size_t s) { return page.sample < s; });
+	size_t videoOffset = (vs == begin(video)) ? 0 : std::prev(vs)->offset;
+	size_t audioOffset = (as == begin(audio)) ? 0 : std::prev(as)->offset;
+	return {std::min(videoOffset, audioOffset), keyFrame};
+}
+
+} // namespace openmsx
@@ -0,0 +1,63 @@
+#ifndef OGGINDEX_HH
+#define OGGINDEX_HH
+
+#include "span.hh"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+namespace openmsx {
+
+class File;
+
+/** Per ogg page the file offset and the (last) granule position in it.
+  * This replaces the bisection in OggReader::findOffset(), as long as the
+  * file didn't change since the index was made.
+  */
+struct OggIndex
+{
+	struct VideoPage { size_t offset, keyFrame, frame; };
+	struct AudioPage { size_t offset, sample; };
+
+	/** Create the index for the given file. This only reads the ogg page
+	  * headers, the page contents are skipped.
+	  * @return The index, or nullptr when 'abort' got set or when the file
+	  *         doesn't contain both a video and an audio stream.
+	  * @throws MSXException when the file is damaged or can't be read.
+	  */
+	[[nodiscard]] static std::unique_ptr<OggIndex> build(
+		File& ogg, int videoSerial, int audioSerial, int granuleShift,
+		const std::atomic<bool>& abort);
+
+	/** Restore the result of an earlier save() call.
+	  * @return The index, or nullptr when 'buf' is damaged or when it was
+	  *         made for a different version (size or modification time)
+	  *         of the ogg file.
+	  */
+	[[nodiscard]] static std::unique_ptr<OggIndex> load(
+		span<const uint8_t> buf, size_t fileSize, time_t modificationTime);
+
+	[[nodiscard]] std::vector<uint8_t> save() const;
+
+	struct Position {
+		size_t offset;   // start reading the file here
+		size_t keyFrame; // the key frame that the requested frame needs
+	};
+	/** Find where to start reading to decode the given video frame and
+	  * audio sample. Positions past the end are clamped to the end.
+	  */
+	[[nodiscard]] Position find(size_t frame, size_t sample) const;
+
+	[[nodiscard]] size_t getTotalFrames() const { return video.back().frame; }
+
+	size_t fileSize;
+	time_t modificationTime;
+	std::vector<VideoPage> video; // never empty
+	std::vector<AudioPage> audio; // never empty
+};
+
+} // namespace openmsx
+
+#endif
@@ -1,14 +1,23 @@
 #include "OggReader.hh"
+#include "OggIndex.hh"
 #include "MSXException.hh"
 #include "yuv2rgb.hh"
 #include "likely.hh"
 #include "CliComm.hh"
+#include "FileOperations.hh"
+#include "Filename.hh"
 #include "MemoryOps.hh"
+#include "RawFrame.hh"
 #include "ranges.hh"
+#include "sha1.hh"
 #include "stl.hh"
+#include "strCat.hh"
 #include "stringsp.hh" // for strncasecmp
 #include "view.hh"
+#include "xrange.hh"
+#include <array>
 #include <cstring> // for memcpy, memcmp
+#include <exception>
 #include <cstdlib> // for atoi
 #include <cctype> // for isspace
 #include <memory>
@@ -19,6 +28,40 @@
 // - Clean up this mess!
 namespace openmsx {
 
+// Number of decoded frames (and audio fragments) the decode-ahead thread
+// keeps ready. Audio is only limited so that it doesn't pile up while the
+// player doesn't need it.
+constexpr size_t FRAMES_AHEAD = 8;
+constexpr size_t AUDIO_FRAGMENTS_AHEAD = 64;
+
+// Taken by the methods that read from the stream. While a client is waiting
+// for the lock, the decode-ahead thread doesn't start on a new packet, so
+// the client waits for at most one packet decode (or frame conversion).
+class OggReader::ClientLock
+{
+public:
+	explicit ClientLock(OggReader& reader_)
+		: reader(reader_)
+	{
+		++reader.clients;
+		lock = std::unique_lock<std::mutex>(reader.mutex);
+	}
+
+	~ClientLock()
+	{
+		--reader.clients; // while holding the lock, see decodeAheadLoop()
+		lock.unlock();
+		reader.condition.notify_all();
+	}
+
+	ClientLock(const ClientLock&) = delete;
+	ClientLock& operator=(const ClientLock&) = delete;
+
+private:
+	OggReader& reader;
+	std::unique_lock<std::mutex> lock;
+};
+
 Frame::Frame(const th_ycbcr_buffer& yuv)
 {
 	unsigned y_size  = yuv[0].height * yuv[0].stride;
@@ -46,6 +89,7 @@ Frame::~Frame()
 OggReader::OggReader(const Filename& filename, CliComm& cli_)
 	: cli(cli_)
 	, file(filename)
+	, oggPath(filename.getResolved())
 {
 	audioSerial = -1;
 	videoSerial = -1;
@@ -201,6 +245,9 @@ OggReader::OggReader(const Filename& filename, CliComm& cli_)
 	th_setup_free(tsi);
 	th_info_clear(&ti);
 	th_comment_clear(&tc);
+
+	indexThread  = std::thread([this] { indexLoop(); });
+	decodeThread = std::thread([this] { decodeAheadLoop(); });
 }
 
 void OggReader::cleanup()
@@ -227,6 +274,14 @@ void OggReader::cleanup()
 
 OggReader::~OggReader()
 {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exitThreads = true;
+	}
+	condition.notify_all();
+	indexThread.join();
+	decodeThread.join();
+
 	cleanup();
 }
 
@@ -574,6 +629,7 @@ void OggReader::readTheora(ogg_packet* packet)
 		frame = std::move(recycleFrameList.back());
 		recycleFrameList.pop_back();
 	}
+	frame->converted = false;
 
 	int y_size  = yuv[0].height * yuv[0].stride;
 	int uv_size = yuv[1].height * yuv[1].stride;
@@ -613,6 +669,26 @@ void OggReader::readTheora(ogg_packet* packet)
 
 void OggReader::getFrameNo(RawFrame& rawFrame, size_t frameno)
 {
+	ClientLock lock(*this);
+
+	const auto& format = rawFrame.getPixelFormat();
+	if (!haveRgbFormat ||
+	    (format.getBpp()   != rgbFormat.getBpp()) ||
+	    (format.getRmask() != rgbFormat.getRmask()) ||
+	    (format.getGmask() != rgbFormat.getGmask()) ||
+	    (format.getBmask() != rgbFormat.getBmask())) {
+		// (Renderer changed,) frames converted so far are unusable.
+		// Note that the RawFrames refer to 'rgbFormat'.
+		auto invalidate = [](auto& f) {
+			f->rgb.reset();
+			f->converted = false;
+		};
+		for (auto& f : frameList)        invalidate(f);
+		for (auto& f : recycleFrameList) invalidate(f);
+		rgbFormat = format;
+		haveRgbFormat = true;
+	}
+
 	Frame* frame;
 	while (true) {
 		// If there are no frames or the frames we have read
@@ -669,7 +745,17 @@ void OggReader::getFrameNo(RawFrame& rawFrame, size_t frameno)
 		}
 	}
 
-	yuv2rgb::convert(frame->buffer, rawFrame);
+	if (frame->converted) {
+		unsigned width = frame->buffer[0].width;
+		size_t bytes = width * rgbFormat.getBytesPerPixel();
+		for (auto y : xrange(unsigned(frame->buffer[0].height))) {
+			memcpy(rawFrame.getLinePtrDirect<uint8_t>(y),
+			       frame->rgb->getLinePtrDirect<uint8_t>(y), bytes);
+			rawFrame.setLineWidth(y, width);
+		}
+	} else {
+		yuv2rgb::convert(frame->buffer, rawFrame);
+	}
 }
 
 void OggReader::recycleAudio(std::unique_ptr<AudioFragment> audio)
@@ -680,6 +766,8 @@ void OggReader::recycleAudio(std::unique_ptr<AudioFragment> audio)
 
 const AudioFragment* OggReader::getAudio(size_t sample)
 {
+	ClientLock lock(*this);
+
 	// Read while position is unknown
 	while (audioList.empty() ||
 	       audioList.front()->position == AudioFragment::UNKNOWN_POS) {
@@ -863,6 +951,9 @@ size_t OggReader::findOffset(size_t frame, size_t sample)
 	// we assume that only data will be added to it and the ogg streams
 	// are exactly as before
 	fileSize = file.getSize();
+	if (index && (index->fileSize == fileSize)) {
+		return findOffsetInIndex(frame, sample);
+	}
 	auto offset = fileSize - 1;
 
 	while (offset > 0) {
@@ -933,8 +1024,18 @@ size_t OggReader::findOffset(size_t frame, size_t sample)
 	return bisection(keyFrame, sample, maxOffset, maxSamples, maxFrames);
 }
 
+size_t OggReader::findOffsetInIndex(size_t frame, size_t sample)
+{
+	totalFrames = index->getTotalFrames();
+	auto pos = index->find(frame, sample);
+	keyFrame = pos.keyFrame;
+	return pos.offset;
+}
+
 bool OggReader::seek(size_t frame, size_t samples)
 {
+	ClientLock lock(*this);
+
 	// Remove all queued frames
 	recycleFrameList.insert(end(recycleFrameList),
 		std::move_iterator(begin(frameList)),
@@ -960,10 +1061,136 @@ bool OggReader::seek(size_t frame, size_t samples)
 	currentSample = samples;
 
 	vorbis_synthesis_restart(&vd);
+	endOfStream = false;
 
 	return true;
 }
 
+// The index is stored next to the .ogv file or, when that directory is not
+// writable, in the user data directory.
+static std::array<std::string, 2> getIndexFiles(const std::string& oggPath)
+{
+	auto key = SHA1::calc(reinterpret_cast<const uint8_t*>(oggPath.data()), oggPath.size());
+	return {strCat(oggPath, ".idx"),
+	        strCat(FileOperations::getUserDataDir(), "/laserdisc/",
+	               key.toString(), ".idx")};
+}
+
+// Executed on 'indexThread'. Without an index, seek() uses bisection.
+void OggReader::indexLoop()
+{
+	std::unique_ptr<OggIndex> idx;
+	try {
+		File ogg(oggPath);
+		idx = loadIndex(ogg);
+		if (!idx) {
+			idx = OggIndex::build(ogg, videoSerial, audioSerial,
+			                      granuleShift, exitThreads);
+			if (idx) saveIndex(*idx);
+		}
+	} catch (MSXException& e) {
+		cli.printWarning("Not creating index for ", oggPath, ": ",
+		                 e.getMessage());
+	} catch (std::exception& e) {
+		// e.g. std::bad_alloc, don't let it terminate openMSX
+		cli.printWarning("Not creating index for ", oggPath, ": ",
+		                 e.what());
+	}
+	if (!idx) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	index = std::move(idx);
+}
+
+std::unique_ptr<OggIndex> OggReader::loadIndex(File& ogg)
+{
+	auto oggSize = ogg.getSize();
+	auto time = ogg.getModificationDate();
+	for (const auto& name : getIndexFiles(oggPath)) {
+		std::vector<uint8_t> buf;
+		try {
+			File cache(name);
+			buf.resize(cache.getSize());
+			cache.read(buf.data(), buf.size());
+		} catch (MSXException&) {
+			continue; // no (readable) index file
+		}
+		if (auto idx = OggIndex::load(buf, oggSize, time)) return idx;
+	}
+	return nullptr;
+}
+
+void OggReader::saveIndex(const OggIndex& idx)
+{
+	auto buf = idx.save();
+	for (const auto& name : getIndexFiles(oggPath)) {
+		try {
+			FileOperations::mkdirp(FileOperations::getDirName(name));
+			File cache(name, File::TRUNCATE);
+			cache.write(buf.data(), buf.size());
+			return;
+		} catch (MSXException&) {
+			// try the next location
+		}
+	}
+	// ignore, the index can always be rebuilt
+}
+
+// Executed on 'decodeThread'. Works in small steps (a packet or a frame
+// conversion), and between steps gives priority to waiting clients.
+void OggReader::decodeAheadLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		Frame* frame = nullptr;
+		condition.wait(lock, [&] {
+			if (exitThreads) return true;
+			if (clients != 0) return false;
+			frame = findUnconvertedFrame();
+			return frame || needDecodeAhead();
+		});
+		if (exitThreads) return;
+
+		if (frame) {
+			convertFrame(*frame);
+		} else {
+			try {
+				if (!nextPacket()) endOfStream = true;
+			} catch (MSXException&) {
+				// stop reading ahead, a client will run into
+				// (and report) the same error
+				endOfStream = true;
+			}
+		}
+	}
+}
+
+Frame* OggReader::findUnconvertedFrame()
+{
+	if (!haveRgbFormat) return nullptr; // don't know the format yet
+	for (auto& frame : frameList) {
+		if (!frame->converted) return frame.get();
+	}
+	return nullptr;
+}
+
+bool OggReader::needDecodeAhead() const
+{
+	return !endOfStream &&
+	       (frameList.size() < FRAMES_AHEAD) &&
+	       (audioList.size() < AUDIO_FRAGMENTS_AHEAD);
+}
+
+void OggReader::convertFrame(Frame& frame)
+{
+	if (!frame.rgb) {
+		frame.rgb = std::make_unique<RawFrame>(
+			rgbFormat, frame.buffer[0].width, frame.buffer[0].height);
+	}
+	yuv2rgb::convert(frame.buffer, *frame.rgb);
+	frame.converted = true;
+}
+
 bool OggReader::stopFrame(size_t frame) const
 {
 	return ranges::binary_search(stopFrames, frame);
@@ -2,12 +2,18 @@
 #define OGGREADER_HH
 
 #include "File.hh"
+#include "PixelFormat.hh"
 #include "circular_buffer.hh"
 #include <ogg/ogg.h>
 #include <vorbis/codec.h>
 #include <theora/theoradec.h>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <list>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -16,6 +22,7 @@ namespace openmsx {
 class CliComm;
 class RawFrame;
 class Filename;
+struct OggIndex;
 
 struct AudioFragment
 {
@@ -34,6 +41,11 @@ struct Frame
 	th_ycbcr_buffer buffer;
 	size_t no;
 	int length;
+
+	// Same picture, already converted to RGB by the decode-ahead thread
+	// (only valid when 'converted' is set).
+	std::unique_ptr<RawFrame> rgb;
+	bool converted = false;
 };
 
 class OggReader
@@ -45,10 +57,13 @@ public:
 	OggReader(const Filename& filename, CliComm& cli);
 	~OggReader();
 
+	// These three methods may block while the decode-ahead thread
+	// finishes decoding the current packet.
 	bool seek(size_t frame, size_t sample);
-	unsigned getSampleRate() const { return vi.rate; }
 	void getFrameNo(RawFrame& frame, size_t frameno);
 	const AudioFragment* getAudio(size_t sample);
+
+	unsigned getSampleRate() const { return vi.rate; }
 	size_t getFrames() const { return totalFrames; }
 	int getFrameRate() const { return frameRate; }
 
@@ -57,6 +72,8 @@ public:
 	size_t getChapter(int chapterNo) const;
 
 private:
+	class ClientLock;
+
 	void cleanup();
 	void readTheora(ogg_packet* packet);
 	void theoraHeaderPage(ogg_page* page, th_info& ti, th_comment& tc,
@@ -71,11 +88,22 @@ private:
 	size_t frameNo(ogg_packet* packet);
 
 	size_t findOffset(size_t frame, size_t sample);
+	size_t findOffsetInIndex(size_t frame, size_t sample);
 	size_t bisection(size_t frame, size_t sample,
 	                 size_t maxOffset, size_t maxSamples, size_t maxFrames);
 
+	void indexLoop();
+	std::unique_ptr<OggIndex> loadIndex(File& ogg);
+	void saveIndex(const OggIndex& idx);
+
+	void decodeAheadLoop();
+	Frame* findUnconvertedFrame();
+	bool needDecodeAhead() const;
+	void convertFrame(Frame& frame);
+
 	CliComm& cli;
 	File file;
+	const std::string oggPath;
 
 	enum State {
 		PLAYING,
@@ -119,6 +147,22 @@ private:
 	// Metadata
 	std::vector<size_t> stopFrames;
 	std::vector<std::pair<int, size_t>> chapters;
+
+	// The index is built (or loaded from its cache file) on 'indexThread'.
+	// 'decodeThread' reads and decodes packets ahead of the calls to
+	// getFrameNo() and getAudio(). 'mutex' protects the stream state
+	// above and the members below (the metadata and stream parameters
+	// don't change after the constructor).
+	std::thread indexThread;
+	std::thread decodeThread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::unique_ptr<OggIndex> index;
+	PixelFormat rgbFormat; // of the last RawFrame passed to getFrameNo()
+	bool haveRgbFormat = false;
+	bool endOfStream = false;
+	std::atomic<unsigned> clients = 0; // threads waiting for 'mutex'
+	std::atomic<bool> exitThreads = false;
 };
 
 } // namespace openmsx
@@ -6,6 +6,7 @@
 #include "StringSetting.hh"
 #include "likely.hh"
 #include <cassert>
+#include <utility>
 
 namespace openmsx {
 
@@ -17,13 +18,21 @@ static std::bitset<CacheLine::SIZE> getBitSetAllTrue()
 }
 
 CheckedRam::CheckedRam(const DeviceConfig& config, const std::string& name,
-                       const std::string& description, unsigned size)
+                       const std::string& description, unsigned size,
+                       InvalidateCallback invalidateCallback_)
 	: completely_initialized_cacheline(size / CacheLine::SIZE, false)
 	, uninitialized(size / CacheLine::SIZE, getBitSetAllTrue())
 	, ram(config, name, description, size)
 	, msxcpu(config.getMotherBoard().getCPU())
+	, invalidateCallback(std::move(invalidateCallback_))
 	, umrCallback(config.getGlobalSettings().getUMRCallBackSetting())
 {
+	static_assert(CacheLine::SIZE == DirtyPages::PAGE_SIZE);
+	ram.enableDirtyTracking();
+	ram.getDirtyPages()->setCleanCallback([this] {
+		// Revoke the write cache lines of the (now clean) pages.
+		msxcpu.invalidateAllSlotsRWCache(0, 0x10000);
+	});
 	umrCallback.getSetting().attach(*this);
 	init();
 }
@@ -52,7 +61,8 @@ const byte* CheckedRam::getReadCacheLine(unsigned addr) const
 
 byte* CheckedRam::getWriteCacheLine(unsigned addr) const
 {
-	return (completely_initialized_cacheline[addr >> CacheLine::BITS])
+	unsigned line = addr >> CacheLine::BITS;
+	return (completely_initialized_cacheline[line] && isDirty(line))
 	     ? const_cast<byte*>(&ram[addr]) : nullptr;
 }
 
@@ -62,7 +72,8 @@ byte* CheckedRam::getRWCacheLines(unsigned addr, unsigned size) const
 	unsigned num = size >> CacheLine::BITS;
 	unsigned first = addr >> CacheLine::BITS;
 	for (unsigned i = 0; i < num; ++i) {
-		if (!completely_initialized_cacheline[first + i]) {
+		if (!completely_initialized_cacheline[first + i] ||
+		    !isDirty(first + i)) {
 			return nullptr;
 		}
 	}
@@ -87,6 +98,15 @@ void CheckedRam::write(unsigned addr, const byte value)
 			msxcpu.invalidateAllSlotsRWCache(0, 0x10000);
 		}
 	}
+	if (unlikely(!isDirty(line))) {
+		ram.markDirty(addr);
+		// From now on, writes to this page can use the cache again.
+		if (invalidateCallback) {
+			invalidateCallback(line * CacheLine::SIZE, CacheLine::SIZE);
+		} else {
+			msxcpu.invalidateAllSlotsRWCache(0, 0x10000);
+		}
+	}
 	ram[addr] = value;
 }
 
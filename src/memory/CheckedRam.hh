@@ -6,8 +6,9 @@
 #include "CacheLine.hh"
 #include "Observer.hh"
 #include "openmsx.hh"
-#include <vector>
 #include <bitset>
+#include <functional>
+#include <vector>
 
 namespace openmsx {
 
@@ -23,12 +24,25 @@ class Setting;
  * the turboR, only the normal memory mapper runs via CheckedRam. The RAM
  * accessed in DRAM mode or via the ROM mapper are unchecked! Note that there
  * is basically no overhead for using CheckedRam over Ram, thanks to Wouter.
+ *
+ * This class also keeps track of which pages were written since the last
+ * reverse snapshot (see DirtyPages). For this, no write cache lines are
+ * handed out for clean pages, so the first write to such a page goes via
+ * write(). That write then invalidates the CPU cache for that page, via the
+ * owner's InvalidateCallback (or for the whole address space when there is
+ * no callback).
  */
 class CheckedRam final : private Observer<Setting>
 {
 public:
+	/** Invalidate the CPU cache lines that map the given range of this Ram.
+	  * Only the owner knows at which CPU address(es) the Ram is visible.
+	  */
+	using InvalidateCallback = std::function<void(unsigned start, unsigned size)>;
+
 	CheckedRam(const DeviceConfig& config, const std::string& name,
-	           const std::string& description, unsigned size);
+	           const std::string& description, unsigned size,
+	           InvalidateCallback invalidateCallback = {});
 	~CheckedRam();
 
 	byte read(unsigned addr);
@@ -56,6 +70,10 @@ public:
 
 private:
 	void init();
+	[[nodiscard]] bool isDirty(unsigned line) const {
+		auto* dirty = ram.getDirtyPages();
+		return !dirty || dirty->isDirty(line);
+	}
 
 	// Observer<Setting>
 	void update(const Setting& setting) override;
@@ -64,6 +82,7 @@ private:
 	std::vector<std::bitset<CacheLine::SIZE>> uninitialized;
 	Ram ram;
 	MSXCPU& msxcpu;
+	InvalidateCallback invalidateCallback;
 	TclCallback umrCallback;
 };
 
@@ -4,6 +4,7 @@
 #include "outer.hh"
 #include "ranges.hh"
 #include "serialize.hh"
+#include "xrange.hh"
 
 namespace openmsx {
 
@@ -22,7 +23,8 @@ unsigned MSXMemoryMapperBase::getRamSize() const
 MSXMemoryMapperBase::MSXMemoryMapperBase(const DeviceConfig& config)
 	: MSXDevice(config)
 	, MSXMapperIOClient(getMotherBoard())
-	, checkedRam(config, getName(), "memory mapper", getRamSize())
+	, checkedRam(config, getName(), "memory mapper", getRamSize(),
+	             [this](unsigned start, unsigned size) { invalidateRam(start, size); })
 	, debuggable(getMotherBoard(), getName())
 {
 }
@@ -71,6 +73,17 @@ unsigned MSXMemoryMapperBase::segmentOffset(byte page) const
 	return segment * 0x4000;
 }
 
+void MSXMemoryMapperBase::invalidateRam(unsigned start, unsigned size)
+{
+	// The same segment can be selected in more than one page.
+	for (auto page : xrange(4)) {
+		unsigned offset = start - segmentOffset(page);
+		if (offset < 0x4000) {
+			invalidateDeviceRWCache(page * 0x4000 + offset, size);
+		}
+	}
+}
+
 unsigned MSXMemoryMapperBase::calcAddress(word address) const
 {
 	return segmentOffset(address / 0x4000) | (address & 0x3fff);
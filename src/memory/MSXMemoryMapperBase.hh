@@ -55,6 +55,7 @@ protected:
 
 private:
 	unsigned getRamSize() const;
+	void invalidateRam(unsigned start, unsigned size);
 
 	struct Debuggable final : SimpleDebuggable {
 		Debuggable(MSXMotherBoard& motherBoard, const std::string& name);
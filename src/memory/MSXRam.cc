@@ -1,5 +1,6 @@
 #include "MSXRam.hh"
 #include "CheckedRam.hh"
+#include "CacheLine.hh"
 #include "XMLElement.hh"
 #include "serialize.hh"
 #include <cassert>
@@ -29,7 +30,18 @@ void MSXRam::init()
 	assert((base + size) <= 0x10000);
 
 	checkedRam = std::make_unique<CheckedRam>(
-		getDeviceConfig2(), getName(), "ram", size);
+		getDeviceConfig2(), getName(), "ram", size,
+		[this](unsigned start, unsigned num) { invalidateRam(start, num); });
+}
+
+void MSXRam::invalidateRam(unsigned start, unsigned num)
+{
+	// The ram can be mirrored, so check all cache lines.
+	for (unsigned addr = 0; addr < 0x10000; addr += CacheLine::SIZE) {
+		if ((translate(addr) - start) < num) {
+			invalidateDeviceRWCache(addr, CacheLine::SIZE);
+		}
+	}
 }
 
 void MSXRam::powerUp(EmuTime::param /*time*/)
@@ -27,6 +27,7 @@ public:
 private:
 	void init() override;
 	inline unsigned translate(unsigned address) const;
+	void invalidateRam(unsigned start, unsigned num);
 
 	/*const*/ unsigned base;
 	/*const*/ unsigned size;
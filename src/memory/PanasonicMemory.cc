@@ -38,6 +38,8 @@ void PanasonicMemory::registerRam(Ram& ram_)
 {
 	ram = &ram_[0];
 	ramSize = ram_.getSize();
+	// The ROM mapper and the DRAM mode write to this RAM directly.
+	ram_.disableDirtyTracking();
 }
 
 const byte* PanasonicMemory::getRomBlock(unsigned block)
@@ -21,6 +21,7 @@ public:
 	RamDebuggable(MSXMotherBoard& motherBoard, const string& name,
 	              const string& description, Ram& ram);
 	byte read(unsigned address) override;
+	void readBlock(unsigned address, span<byte> output) override;
 	void write(unsigned address, byte value) override;
 private:
 	Ram& ram;
@@ -89,7 +90,17 @@ void Ram::clear(byte c)
 		// no init pattern specified
 		memset(ram.data(), c, size);
 	}
+	markAllDirty();
+}
+
+void Ram::enableDirtyTracking()
+{
+	if (!dirtyPages) dirtyPages = std::make_unique<DirtyPages>(size);
+}
 
+void Ram::disableDirtyTracking()
+{
+	dirtyPages.reset();
 }
 
 const string& Ram::getName() const
@@ -110,16 +121,22 @@ byte RamDebuggable::read(unsigned address)
 	return ram[address];
 }
 
+void RamDebuggable::readBlock(unsigned address, span<byte> output)
+{
+	memcpy(output.data(), &ram[address], output.size());
+}
+
 void RamDebuggable::write(unsigned address, byte value)
 {
 	ram[address] = value;
+	ram.markDirty(address);
 }
 
 
 template<typename Archive>
 void Ram::serialize(Archive& ar, unsigned /*version*/)
 {
-	ar.serialize_blob("ram", ram.data(), size);
+	ar.serialize_blob("ram", ram.data(), size, dirtyPages.get());
 }
 INSTANTIATE_SERIALIZE_METHODS(Ram);
 
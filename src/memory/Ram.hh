@@ -1,6 +1,7 @@
 #ifndef RAM_HH
 #define RAM_HH
 
+#include "DirtyPages.hh"
 #include "MemBuffer.hh"
 #include "openmsx.hh"
 #include <string>
@@ -37,6 +38,23 @@ public:
 	const std::string& getName() const;
 	void clear(byte c = 0xff);
 
+	/** Keep track of which pages were written since the last reverse
+	  * snapshot (see DirtyPages). Writes via the debuggable and via
+	  * clear() are tracked automatically, writes via operator[] must be
+	  * reported via markDirty().
+	  */
+	void enableDirtyTracking();
+	/** For when it's not possible to track all writes. */
+	void disableDirtyTracking();
+	      DirtyPages* getDirtyPages()       { return dirtyPages.get(); }
+	const DirtyPages* getDirtyPages() const { return dirtyPages.get(); }
+	void markDirty(unsigned addr) {
+		if (dirtyPages) dirtyPages->mark(addr);
+	}
+	void markAllDirty() {
+		if (dirtyPages) dirtyPages->markAll();
+	}
+
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
@@ -45,6 +63,7 @@ private:
 	MemBuffer<byte> ram;
 	unsigned size; // must come before debuggable
 	const std::unique_ptr<RamDebuggable> debuggable; // can be nullptr
+	std::unique_ptr<DirtyPages> dirtyPages; // can be nullptr
 };
 
 } // namespace openmsx
@@ -19,8 +19,10 @@
 #include "StringOp.hh"
 #include "ranges.hh"
 #include "sha1.hh"
+#include <algorithm>
 #include <cstring>
 #include <limits>
+#include <map>
 #include <memory>
 
 using std::string;
@@ -43,6 +45,33 @@ private:
 	Rom* rom;
 };
 
+// Patched or padded ROM content is shared between all Rom objects with the
+// same (sha1 of the) content. E.g. when several MSX machines of the same type
+// are running, or when a machine is recreated (loadstate, reverse).
+//
+// The content of the ROM files themselves is not copied at all: local files
+// are mapped in memory, compressed files are decompressed only once (see
+// CompressedFileAdapter).
+static std::shared_ptr<const MemBuffer<byte>> shareRomContent(
+	const Sha1Sum& sum, MemBuffer<byte>&& content)
+{
+	static std::map<Sha1Sum, std::weak_ptr<const MemBuffer<byte>>> cache;
+
+	auto& entry = cache[sum];
+	if (auto result = entry.lock()) return result;
+
+	auto result = std::make_shared<const MemBuffer<byte>>(std::move(content));
+	entry = result;
+	// cleanup entries of ROMs that are no longer in use
+	for (auto it = cache.begin(); it != cache.end(); /**/) {
+		if (it->second.expired()) {
+			it = cache.erase(it);
+		} else {
+			++it;
+		}
+	}
+	return result;
+}
 
 Rom::Rom(string name_, string description_,
          const DeviceConfig& config, const string& id /*= {}*/)
@@ -213,9 +242,10 @@ void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
 		// the size of the mapper (and you don't care about initial
 		// content)
 		size = config.getChildDataAsInt("size", 0) * 1024; // in kb
-		extendedRom.resize(size);
-		memset(extendedRom.data(), 0xff, size);
-		rom = extendedRom.data();
+		auto blank = std::make_shared<MemBuffer<byte>>(size);
+		memset(blank->data(), 0xff, size);
+		rom = blank->data();
+		extendedRom = std::move(blank);
 
 		// Content does not depend on external files. No need to check
 		checkResolvedSha1 = false;
@@ -234,18 +264,16 @@ void Rom::init(MSXMotherBoard& motherBoard, const XMLElement& config,
 					Filename(p->getData(), context),
 					std::move(patch));
 			}
-			auto patchSize = unsigned(patch->getSize());
-			if (patchSize <= size) {
-				patch->copyBlock(0, const_cast<byte*>(rom), size);
-			} else {
-				size = patchSize;
-				extendedRom.resize(size);
-				patch->copyBlock(0, extendedRom.data(), size);
-				rom = extendedRom.data();
-			}
+			// Never patch in-place: 'rom' may point to memory that's
+			// shared with other users of the same file.
+			size = std::max(size, unsigned(patch->getSize()));
+			MemBuffer<byte> patched(size);
+			patch->copyBlock(0, patched.data(), size);
 
 			// calculated because it's different from original
-			actualSha1 = SHA1::calc(rom, size);
+			actualSha1 = SHA1::calc(patched.data(), size);
+			extendedRom = shareRomContent(actualSha1, std::move(patched));
+			rom = extendedRom->data();
 
 			// Content altered by external patch file -> check.
 			checkResolvedSha1 = true;
@@ -378,8 +406,8 @@ void Rom::addPadding(unsigned newSize, byte filler)
 	memcpy(newData, rom, size);
 	memset(newData + size, filler, newSize - size);
 
-	extendedRom = std::move(tmp);
-	rom = newData;
+	extendedRom = shareRomContent(SHA1::calc(newData, newSize), std::move(tmp));
+	rom = extendedRom->data();
 	size = newSize;
 }
 
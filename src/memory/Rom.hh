@@ -47,7 +47,9 @@ private:
 private:
 	// !! update the move constructor when changing these members !!
 	const byte* rom;
-	MemBuffer<byte> extendedRom;
+	// Content that's not directly in 'file' (patched, padded, ...). This
+	// is never modified, so it can be shared between Rom objects.
+	std::shared_ptr<const MemBuffer<byte>> extendedRom;
 
 	File file; // can be a closed file
 
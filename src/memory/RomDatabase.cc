@@ -3,19 +3,27 @@
 #include "FileContext.hh"
 #include "File.hh"
 #include "FileOperations.hh"
+#include "FileException.hh"
 #include "CliComm.hh"
 #include "MSXException.hh"
 #include "StringOp.hh"
 #include "String32.hh"
+#include "Version.hh"
 #include "hash_map.hh"
 #include "ranges.hh"
 #include "rapidsax.hh"
 #include "unreachable.hh"
 #include "stl.hh"
 #include "view.hh"
+#include "xrange.hh"
 #include "xxhash.hh"
 #include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <new>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 
 using std::string;
 using std::string_view;
@@ -48,6 +56,7 @@ public:
 	void doctype(string_view txt);
 
 	string_view getSystemID() const { return systemID; }
+	bool hasWarnings() const { return warnings; }
 
 private:
 	String32 cIndex(string_view str);
@@ -87,6 +96,7 @@ private:
 	UnknownTypes& unknownTypes;
 	CliComm& cliComm;
 	char* bufStart;
+	bool warnings = false;
 
 	string_view systemID;
 	string_view type;
@@ -328,6 +338,7 @@ void DBParser::text(string_view txt)
 		try {
 			genMSXid = StringOp::fast_stou(txt);
 		} catch (std::invalid_argument&) {
+			warnings = true;
 			cliComm.printWarning(
 				"Ignoring bad Generation MSX id (genmsxid) "
 				"in entry with title '", title,
@@ -409,6 +420,7 @@ void DBParser::addAllEntries()
 	// move non-duplicates up
 	while (it2 != last) {
 		if (it1->first == it2->first) {
+			warnings = true;
 			cliComm.printWarning(
 				"duplicate softwaredb entry SHA1: ",
 				it2->first.toString());
@@ -546,8 +558,9 @@ void DBParser::doctype(string_view txt)
 	systemID = t.substr(0, pos2);
 }
 
-static void parseDB(CliComm& cliComm, char* buf, char* bufStart,
-                    RomDatabase::RomDB& db, UnknownTypes& unknownTypes)
+// Returns false when warnings were printed while parsing.
+[[nodiscard]] static bool parseDB(CliComm& cliComm, char* buf, char* bufStart,
+                                  RomDatabase::RomDB& db, UnknownTypes& unknownTypes)
 {
 	DBParser handler(db, unknownTypes, cliComm, bufStart);
 	rapidsax::parse<rapidsax::trimWhitespace>(handler, buf);
@@ -558,25 +571,78 @@ static void parseDB(CliComm& cliComm, char* buf, char* bufStart,
 			"You're probably using an old incompatible file format.",
 			nullptr);
 	}
+	return !handler.hasWarnings();
+}
+
+// Parsing the XML files takes a noticeable part of the startup time. So the
+// parsed database is stored in a binary cache file, on the next startup that
+// file is mapped in memory and used as-is. Layout of that file:
+//   CacheHeader
+//   key       keySize bytes, padded to a multiple of 8
+//   entries   numEntries * sizeof(RomDatabase::Entry), sorted on sha1sum
+//   strings   stringsSize bytes, the String32 members are offsets in here
+// The key contains the openMSX version (e.g. the RomType enum may change) and
+// the path, size and modification time of each softwaredb.xml file. The cache
+// uses the native byte order and struct layout, it's not meant to be copied to
+// a different machine.
+static constexpr const char* const CACHE_FILE = "/.softwaredb.cache";
+static constexpr char CACHE_MAGIC[8] = {'o', 'M', 'S', 'X', 's', 'd', 'b', 0};
+static constexpr uint32_t CACHE_VERSION = 1;
+
+// On 32-bit systems String32 is a pointer, that can't be stored in a file.
+static constexpr bool CACHE_SUPPORTED = std::is_same_v<String32, uint32_t>;
+
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entrySize;
+	uint64_t keySize;
+	uint64_t numEntries;
+	uint64_t stringsSize;
+};
+
+static_assert(std::is_trivially_copyable_v<Sha1Sum>);
+static_assert(std::is_trivially_copyable_v<RomInfo>);
+
+[[nodiscard]] static constexpr size_t entriesOffset(size_t keySize)
+{
+	return (sizeof(CacheHeader) + keySize + 7) & ~size_t(7);
 }
 
 RomDatabase::RomDatabase(CliComm& cliComm)
 {
+	// first user- then system-directory
+	vector<string> filenames;
+	string key = Version::full();
+	for (auto& p : systemFileContext().getPaths()) {
+		auto filename = FileOperations::join(p, "softwaredb.xml");
+		FileOperations::Stat st;
+		if (!FileOperations::getStat(filename, st)) {
+			// Ignore. It's not unusual the DB in the user
+			// directory is not found. In case there's an error
+			// with both user and system DB, we must give a
+			// warning, but that's done below.
+			continue;
+		}
+		strAppend(key, '\n', filename,
+		          ' ', uint64_t(st.st_size),
+		          ' ', int64_t(FileOperations::getModificationDate(st)));
+		filenames.push_back(std::move(filename));
+	}
+	if (!filenames.empty() && loadCache(key)) return;
+
 	db.reserve(3500);
 	UnknownTypes unknownTypes;
-	// first user- then system-directory
-	vector<string> paths = systemFileContext().getPaths();
 	vector<File> files;
 	size_t bufferSize = 0;
-	for (auto& p : paths) {
+	bool complete = true;
+	for (auto& filename : filenames) {
 		try {
-			auto& f = files.emplace_back(FileOperations::join(p, "softwaredb.xml"));
+			auto& f = files.emplace_back(filename);
 			bufferSize += f.getSize() + rapidsax::EXTRA_BUFFER_SPACE;
 		} catch (MSXException& /*e*/) {
-			// Ignore. It's not unusual the DB in the user
-			// directory is not found. In case there's an error
-			// with both user and system DB, we must give a
-			// warning, but that's done below.
+			// Ignore, see above
+			complete = false;
 		}
 	}
 	buffer.resize(bufferSize);
@@ -589,15 +655,21 @@ RomDatabase::RomDatabase(CliComm& cliComm)
 			file.read(buf, size);
 			buf[size] = 0;
 
-			parseDB(cliComm, buf, buffer.data(), db, unknownTypes);
+			if (!parseDB(cliComm, buf, buffer.data(), db, unknownTypes)) {
+				complete = false;
+			}
 		} catch (rapidsax::ParseError& e) {
 			cliComm.printWarning(
 				"Rom database parsing failed: ", e.what());
+			complete = false;
 		} catch (MSXException& /*e*/) {
 			// Ignore, see above
+			complete = false;
 		}
 	}
 	if (bufferSize) buffer[0] = 0;
+	entries = db;
+	bufferStart = buffer.data();
 	if (db.empty()) {
 		cliComm.printWarning(
 			"Couldn't load software database.\n"
@@ -610,12 +682,138 @@ RomDatabase::RomDatabase(CliComm& cliComm)
 		}
 		cliComm.printWarning(output);
 	}
+	// Don't cache a database with problems, so that the above warnings
+	// are repeated on the next startup.
+	if (complete && !db.empty() && unknownTypes.empty()) {
+		writeCache(key);
+	}
+}
+
+bool RomDatabase::loadCache(const string& key)
+{
+	if (!CACHE_SUPPORTED) return false;
+	try {
+		File file(FileOperations::getUserDataDir() + CACHE_FILE);
+		auto data = file.mmap();
+		if (data.size() < sizeof(CacheHeader)) return false;
+
+		CacheHeader header;
+		memcpy(&header, data.data(), sizeof(header));
+		if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+		    (header.version != CACHE_VERSION) ||
+		    (header.entrySize != sizeof(Entry)) ||
+		    (header.keySize != key.size())) {
+			return false;
+		}
+		auto start = entriesOffset(key.size());
+		if ((header.numEntries > (data.size() - start) / sizeof(Entry)) ||
+		    (data.size() != start + header.numEntries * sizeof(Entry)
+		                          + header.stringsSize) ||
+		    (header.stringsSize == 0) || (data.back() != 0)) {
+			// e.g. truncated or otherwise damaged
+			return false;
+		}
+		auto* keyStart = reinterpret_cast<const char*>(&data[sizeof(CacheHeader)]);
+		if (string_view(keyStart, key.size()) != key) return false;
+
+		entries = span(reinterpret_cast<const Entry*>(&data[start]),
+		               header.numEntries);
+		bufferStart = reinterpret_cast<const char*>(
+			&data[start + header.numEntries * sizeof(Entry)]);
+		cacheFile = std::move(file); // keep the mapping alive
+		return true;
+	} catch (MSXException& /*e*/) {
+		// No (readable) cache file, that's fine.
+		return false;
+	}
+}
+
+void RomDatabase::writeCache(const string& key) const
+{
+	if (!CACHE_SUPPORTED) return;
+
+	// The XML buffer mostly contains markup and fields that are not part
+	// of the database. Only store the referenced strings, and each
+	// distinct string only once (e.g. company names repeat a lot).
+	string strings(1, '\0'); // offset 0 is the empty string
+	hash_map<string_view, uint32_t, XXHasher> offsets;
+	auto intern = [&](string_view str) {
+		if (!str.empty() && offsets.insert(std::pair(str, uint32_t(strings.size()))).second) {
+			strings.append(str.data(), str.size());
+			strings += '\0';
+		}
+	};
+	const char* buf = buffer.data();
+	for (const auto& [sum, info] : db) {
+		intern(info.getTitle   (buf));
+		intern(info.getYear    (buf));
+		intern(info.getCompany (buf));
+		intern(info.getCountry (buf));
+		intern(info.getOrigType(buf));
+		intern(info.getRemark  (buf));
+	}
+	auto toStr32 = [&](string_view str) {
+		const auto* p = lookup(offsets, str);
+		String32 result;
+		toString32(strings.data(), strings.data() + (p ? *p : 0), result);
+		return result;
+	};
+	// Construct the entries in-place in zero-initialized memory, so that
+	// their padding bytes are written as zeros instead of as whatever
+	// happened to be in memory.
+	std::vector<uint8_t> compact(db.size() * sizeof(Entry));
+	auto* compactEntries = reinterpret_cast<Entry*>(compact.data());
+	for (auto i : xrange(db.size())) {
+		const auto& [sum, info] = db[i];
+		new (&compactEntries[i]) Entry(std::piecewise_construct,
+			std::forward_as_tuple(sum),
+			std::forward_as_tuple(
+				toStr32(info.getTitle(buf)),   toStr32(info.getYear(buf)),
+				toStr32(info.getCompany(buf)), toStr32(info.getCountry(buf)),
+				info.getOriginal(),            toStr32(info.getOrigType(buf)),
+				toStr32(info.getRemark(buf)),  info.getRomType(),
+				info.getGenMSXid()));
+	}
+
+	CacheHeader header = {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.entrySize = sizeof(Entry);
+	header.keySize = key.size();
+	header.numEntries = db.size();
+	header.stringsSize = strings.size();
+	static constexpr char padding[8] = {};
+	string tmpName;
+	try {
+		auto dir = FileOperations::getUserDataDir();
+		FileOperations::mkdirp(dir);
+		// Write a temporary file and then move it in place, so that a
+		// concurrently starting openMSX process never maps a partially
+		// written cache.
+		auto fp = FileOperations::openUniqueFile(dir, tmpName);
+		if (!fp) throw FileException("Couldn't create ", tmpName);
+		auto write = [&](const void* data, size_t size) {
+			return fwrite(data, 1, size, fp.get()) == size;
+		};
+		bool ok = write(&header, sizeof(header)) &&
+		          write(key.data(), key.size()) &&
+		          write(padding, entriesOffset(key.size()) - sizeof(header) - key.size()) &&
+		          write(compact.data(), compact.size()) &&
+		          write(strings.data(), strings.size());
+		ok = (fclose(fp.release()) == 0) && ok;
+		if (!ok || (FileOperations::rename(tmpName, dir + CACHE_FILE) != 0)) {
+			FileOperations::unlink(tmpName);
+		}
+	} catch (MSXException& /*e*/) {
+		// Ignore, the cache is only an optimization.
+		if (!tmpName.empty()) FileOperations::unlink(tmpName);
+	}
 }
 
 const RomInfo* RomDatabase::fetchRomInfo(const Sha1Sum& sha1sum) const
 {
-	auto it = ranges::lower_bound(db, sha1sum, LessTupleElement<0>());
-	return ((it != end(db)) && (it->first == sha1sum))
+	auto it = ranges::lower_bound(entries, sha1sum, LessTupleElement<0>());
+	return ((it != end(entries)) && (it->first == sha1sum))
 		? &it->second : nullptr;
 }
 
@@ -1,33 +1,54 @@
 #ifndef ROMDATABASE_HH
 #define ROMDATABASE_HH
 
+#include "File.hh"
 #include "MemBuffer.hh"
+#include "RomInfo.hh"
 #include "sha1.hh"
+#include "span.hh"
+#include <string>
 #include <utility>
 #include <vector>
 
 namespace openmsx {
 
 class CliComm;
-class RomInfo;
 
 class RomDatabase
 {
 public:
-	using RomDB = std::vector<std::pair<Sha1Sum, RomInfo>>;
+	using Entry = std::pair<Sha1Sum, RomInfo>;
+	using RomDB = std::vector<Entry>;
 
 	RomDatabase(CliComm& cliComm);
+	// 'entries' and 'bufferStart' point into this object.
+	RomDatabase(const RomDatabase&) = delete;
+	RomDatabase(RomDatabase&&) = delete;
+	RomDatabase& operator=(const RomDatabase&) = delete;
+	RomDatabase& operator=(RomDatabase&&) = delete;
 
 	/** Lookup an entry in the database by sha1sum.
 	 * Returns nullptr when no corresponding entry was found.
 	 */
 	const RomInfo* fetchRomInfo(const Sha1Sum& sha1sum) const;
 
-	const char* getBufferStart() const { return buffer.data(); }
+	const char* getBufferStart() const { return bufferStart; }
+
+private:
+	[[nodiscard]] bool loadCache(const std::string& key);
+	void writeCache(const std::string& key) const;
 
 private:
 	RomDB db;
 	MemBuffer<char> buffer;
+
+	// Binary cache of a previous parse (see loadCache()), stays mapped in
+	// memory as long as this object exists.
+	File cacheFile;
+
+	// Sorted on sha1sum, points either to 'db' or inside 'cacheFile'.
+	span<const Entry> entries{db};
+	const char* bufferStart = nullptr;
 };
 
 } // namespace openmsx
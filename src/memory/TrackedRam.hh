@@ -12,10 +12,16 @@ public:
 	// Most methods simply delegate to the internal 'ram' object.
 	TrackedRam(const DeviceConfig& config, const std::string& name,
 	           const std::string& description, unsigned size)
-		: ram(config, name, description, size) {}
+		: ram(config, name, description, size)
+	{
+		ram.enableDirtyTracking();
+	}
 
 	TrackedRam(const XMLElement& xml, unsigned size)
-		: ram(xml, size) {}
+		: ram(xml, size)
+	{
+		ram.enableDirtyTracking();
+	}
 
 	unsigned getSize() const {
 		return ram.getSize();
@@ -36,13 +42,12 @@ public:
 
 	// Only allow write/clear via an explicit method.
 	void write(unsigned addr, byte value) {
-		writeSinceLastReverseSnapshot = true;
+		ram.markDirty(addr);
 		ram[addr] = value;
 	}
 
 	void clear(byte c = 0xff) {
-		writeSinceLastReverseSnapshot = true;
-		ram.clear(c);
+		ram.clear(c); // marks all pages dirty
 	}
 
 	// Some write operations are more efficient in bulk. For those this
@@ -50,7 +55,7 @@ public:
 	// invocation, so the resulting pointer (although the same each time)
 	// should not be reused for multiple (distinct) bulk write operations.
 	byte* getWriteBackdoor() {
-		writeSinceLastReverseSnapshot = true;
+		ram.markAllDirty();
 		return &ram[0];
 	}
 
@@ -59,7 +64,6 @@ public:
 
 private:
 	Ram ram;
-	bool writeSinceLastReverseSnapshot = true;
 };
 
 } // namespace openmsx
@@ -5,11 +5,15 @@
 #include "XMLElement.hh"
 #include "ConfigException.hh"
 #include "XMLException.hh"
+#include "File.hh"
+#include "FileException.hh"
 #include "DeltaBlock.hh"
 #include "MemBuffer.hh"
 #include "FileOperations.hh"
 #include "Version.hh"
 #include "Date.hh"
+#include "endian.hh"
+#include "lz4.hh"
 #include "stl.hh"
 #include "cstdiop.hh" // for dup()
 #include <cstring>
@@ -29,6 +33,7 @@ void ArchiveBase<Derived>::attribute(const char* name, const char* value)
 }
 template class ArchiveBase<MemOutputArchive>;
 template class ArchiveBase<XmlOutputArchive>;
+template class ArchiveBase<BinOutputArchive>;
 
 ////
 
@@ -72,7 +77,7 @@ unsigned OutputArchiveBase2::getID2(
 
 template<typename Derived>
 void OutputArchiveBase<Derived>::serialize_blob(
-	const char* tag, const void* data_, size_t len, bool /*diff*/)
+	const char* tag, const void* data_, size_t len, DirtyPages* /*dirty*/)
 {
 	auto* data = static_cast<const uint8_t*>(data_);
 
@@ -107,6 +112,7 @@ void OutputArchiveBase<Derived>::serialize_blob(
 
 template class OutputArchiveBase<MemOutputArchive>;
 template class OutputArchiveBase<XmlOutputArchive>;
+template class OutputArchiveBase<BinOutputArchive>;
 
 ////
 
@@ -132,8 +138,10 @@ unsigned InputArchiveBase2::getId(const void* ptr) const
 
 template<typename Derived>
 void InputArchiveBase<Derived>::serialize_blob(
-	const char* tag, void* data, size_t len, bool /*diff*/)
+	const char* tag, void* data, size_t len, DirtyPages* dirty)
 {
+	if (dirty) dirty->markAll();
+
 	this->self().beginTag(tag);
 	string encoding;
 	this->self().attribute("encoding", encoding);
@@ -166,6 +174,7 @@ void InputArchiveBase<Derived>::serialize_blob(
 
 template class InputArchiveBase<MemInputArchive>;
 template class InputArchiveBase<XmlInputArchive>;
+template class InputArchiveBase<BinInputArchive>;
 
 ////
 
@@ -212,17 +221,17 @@ string_view MemInputArchive::loadStr()
 // registers won't be compressed.
 constexpr size_t SMALL_SIZE = 64;
 void MemOutputArchive::serialize_blob(const char* /*tag*/, const void* data,
-                                      size_t len, bool diff)
+                                      size_t len, DirtyPages* dirty)
 {
 	// Delta-compress in-memory blobs, see DeltaBlock.hh for more details.
 	if (len > SMALL_SIZE) {
 		auto deltaBlockIdx = unsigned(deltaBlocks.size());
 		save(deltaBlockIdx); // see comment below in MemInputArchive
-		deltaBlocks.push_back(diff
-			? lastDeltaBlocks.createNew(
-				data, static_cast<const uint8_t*>(data), len)
-			: lastDeltaBlocks.createNullDiff(
-				data, static_cast<const uint8_t*>(data), len));
+		// Only reverse snapshots consume the dirty state, other
+		// snapshots compare the full data.
+		deltaBlocks.push_back(lastDeltaBlocks.createNew(
+			data, static_cast<const uint8_t*>(data), len,
+			reverseSnapshot ? dirty : nullptr));
 	} else {
 		uint8_t* buf = buffer.allocate(len);
 		memcpy(buf, data, len);
@@ -231,8 +240,9 @@ void MemOutputArchive::serialize_blob(const char* /*tag*/, const void* data,
 }
 
 void MemInputArchive::serialize_blob(const char* /*tag*/, void* data,
-                                     size_t len, bool /*diff*/)
+                                     size_t len, DirtyPages* dirty)
 {
+	if (dirty) dirty->markAll();
 	if (len > SMALL_SIZE) {
 		// Usually blobs are saved in the same order as they are loaded
 		// (via the serialize_blob() methods in respectively
@@ -252,12 +262,148 @@ void MemInputArchive::serialize_blob(const char* /*tag*/, void* data,
 
 ////
 
-XmlOutputArchive::XmlOutputArchive(const string& filename)
+template<typename Derived>
+TreeOutputArchiveBase<Derived>::TreeOutputArchiveBase()
 	: root("serial")
 {
 	root.addAttribute("openmsx_version", Version::full());
 	root.addAttribute("date_time", Date::toString(time(nullptr)));
 	root.addAttribute("platform", TARGET_PLATFORM);
+	current.push_back(&root);
+}
+
+template<typename Derived>
+void TreeOutputArchiveBase<Derived>::setData(string str)
+{
+	assert(!current.empty());
+	assert(current.back()->getData().empty());
+	current.back()->setData(std::move(str));
+}
+
+template<typename Derived>
+void TreeOutputArchiveBase<Derived>::attribute(const char* name, const string& str)
+{
+	assert(!current.empty());
+	assert(!current.back()->hasAttribute(name));
+	current.back()->addAttribute(name, str);
+}
+template<typename Derived>
+void TreeOutputArchiveBase<Derived>::attribute(const char* name, int i)
+{
+	attributeImpl(name, i);
+}
+template<typename Derived>
+void TreeOutputArchiveBase<Derived>::attribute(const char* name, unsigned u)
+{
+	attributeImpl(name, u);
+}
+
+template<typename Derived>
+void TreeOutputArchiveBase<Derived>::beginTag(const char* tag)
+{
+	assert(!current.empty());
+	auto& elem = current.back()->addChild(tag);
+	current.push_back(&elem);
+}
+template<typename Derived>
+void TreeOutputArchiveBase<Derived>::endTag(const char* tag)
+{
+	assert(!current.empty());
+	assert(current.back()->getName() == tag); (void)tag;
+	current.pop_back();
+}
+
+template class TreeOutputArchiveBase<XmlOutputArchive>;
+template class TreeOutputArchiveBase<BinOutputArchive>;
+
+////
+
+template<typename Derived>
+TreeInputArchiveBase<Derived>::TreeInputArchiveBase(XMLElement rootElem_)
+	: rootElem(std::move(rootElem_))
+{
+	elems.emplace_back(&rootElem, 0);
+}
+
+template<typename Derived>
+string_view TreeInputArchiveBase<Derived>::loadStr()
+{
+	if (!elems.back().first->getChildren().empty()) {
+		throw XMLException("No child tags expected for primitive type");
+	}
+	return elems.back().first->getData();
+}
+
+template<typename Derived>
+void TreeInputArchiveBase<Derived>::beginTag(const char* tag)
+{
+	auto* child = elems.back().first->findNextChild(
+		tag, elems.back().second);
+	if (!child) {
+		string path;
+		for (auto& e : elems) {
+			strAppend(path, e.first->getName(), '/');
+		}
+		throw XMLException("No child tag \"", tag,
+		                   "\" found at location \"", path, '\"');
+	}
+	elems.emplace_back(child, 0);
+}
+template<typename Derived>
+void TreeInputArchiveBase<Derived>::endTag(const char* tag)
+{
+	const auto& elem = *elems.back().first;
+	if (elem.getName() != tag) {
+		throw XMLException("End tag \"", elem.getName(),
+		                   "\" not equal to begin tag \"", tag, "\"");
+	}
+	auto& elem2 = const_cast<XMLElement&>(elem);
+	elem2.clearName(); // mark this elem for later beginTag() calls
+	elems.pop_back();
+}
+
+template<typename Derived>
+void TreeInputArchiveBase<Derived>::attribute(const char* name, string& t)
+{
+	try {
+		t = elems.back().first->getAttribute(name);
+	} catch (ConfigException& e) {
+		throw XMLException(std::move(e).getMessage());
+	}
+}
+template<typename Derived>
+void TreeInputArchiveBase<Derived>::attribute(const char* name, int& i)
+{
+	attributeImpl(name, i);
+}
+template<typename Derived>
+void TreeInputArchiveBase<Derived>::attribute(const char* name, unsigned& u)
+{
+	attributeImpl(name, u);
+}
+template<typename Derived>
+bool TreeInputArchiveBase<Derived>::hasAttribute(const char* name)
+{
+	return elems.back().first->hasAttribute(name);
+}
+template<typename Derived>
+bool TreeInputArchiveBase<Derived>::findAttribute(const char* name, unsigned& value)
+{
+	return elems.back().first->findAttributeInt(name, value);
+}
+template<typename Derived>
+int TreeInputArchiveBase<Derived>::countChildren() const
+{
+	return int(elems.back().first->getChildren().size());
+}
+
+template class TreeInputArchiveBase<XmlInputArchive>;
+template class TreeInputArchiveBase<BinInputArchive>;
+
+////
+
+XmlOutputArchive::XmlOutputArchive(const string& filename)
+{
 	{
 		auto f = FileOperations::openFile(filename, "wb");
 		if (!f) goto error;
@@ -268,7 +414,6 @@ XmlOutputArchive::XmlOutputArchive(const string& filename)
 			::close(duped_fd);
 			goto error;
 		}
-		current.push_back(&root);
 		return; // success
 		// on scope-exit 'File* f' is closed, and 'gzFile file'
 		// uses the dup()'ed file descriptor.
@@ -311,15 +456,11 @@ void XmlOutputArchive::saveChar(char c)
 }
 void XmlOutputArchive::save(const string& str)
 {
-	assert(!current.empty());
-	assert(current.back()->getData().empty());
-	current.back()->setData(str);
+	setData(str);
 }
 void XmlOutputArchive::save(bool b)
 {
-	assert(!current.empty());
-	assert(current.back()->getData().empty());
-	current.back()->setData(b ? "true" : "false");
+	setData(b ? "true" : "false");
 }
 void XmlOutputArchive::save(unsigned char b)
 {
@@ -346,49 +487,13 @@ void XmlOutputArchive::save(unsigned long long ull)
 	saveImpl(ull);
 }
 
-void XmlOutputArchive::attribute(const char* name, const string& str)
-{
-	assert(!current.empty());
-	assert(!current.back()->hasAttribute(name));
-	current.back()->addAttribute(name, str);
-}
-void XmlOutputArchive::attribute(const char* name, int i)
-{
-	attributeImpl(name, i);
-}
-void XmlOutputArchive::attribute(const char* name, unsigned u)
-{
-	attributeImpl(name, u);
-}
-
-void XmlOutputArchive::beginTag(const char* tag)
-{
-	assert(!current.empty());
-	auto& elem = current.back()->addChild(tag);
-	current.push_back(&elem);
-}
-void XmlOutputArchive::endTag(const char* tag)
-{
-	assert(!current.empty());
-	assert(current.back()->getName() == tag); (void)tag;
-	current.pop_back();
-}
-
 ////
 
 XmlInputArchive::XmlInputArchive(const string& filename)
-	: rootElem(XMLLoader::load(filename, "openmsx-serialize.dtd"))
+	: TreeInputArchiveBase(XMLLoader::load(filename, "openmsx-serialize.dtd"))
 {
-	elems.emplace_back(&rootElem, 0);
 }
 
-string_view XmlInputArchive::loadStr()
-{
-	if (!elems.back().first->getChildren().empty()) {
-		throw XMLException("No child tags expected for primitive type");
-	}
-	return elems.back().first->getData();
-}
 void XmlInputArchive::load(string& t)
 {
 	t = loadStr();
@@ -499,59 +604,301 @@ void XmlInputArchive::load(char& c)
 	c = i;
 }
 
-void XmlInputArchive::beginTag(const char* tag)
+////
+
+// Layout of a Bin archive file: the magic header, followed by the root
+// element. An element is stored as:
+//   name, number of attributes, attributes (name + value), data,
+//   number of child elements, child elements
+// Counts, lengths and integer values are stored as (unsigned) LEB128 values.
+// Tag and attribute names are stored once, later occurrences refer to the
+// first one by index.
+constexpr char BIN_MAGIC[8] = {'o', 'M', 'S', 'X', 'b', 'i', 'n', '1'};
+
+static void storeUleb(string& result, uint64_t value)
+{
+	do {
+		auto b = uint8_t(value & 0x7F);
+		value >>= 7;
+		if (value) b |= 0x80;
+		result += char(b);
+	} while (value);
+}
+
+static uint64_t loadUleb(string_view& data)
+{
+	uint64_t result = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (data.empty()) break;
+		auto b = uint8_t(data.front());
+		data.remove_prefix(1);
+		result |= uint64_t(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) return result;
+	}
+	throw XMLException("Corrupt binary savestate.");
+}
+
+// zig-zag encoding: small negative numbers also get a short encoding
+static uint64_t toZigZag(int64_t i)
 {
-	auto* child = elems.back().first->findNextChild(
-		tag, elems.back().second);
-	if (!child) {
-		string path;
-		for (auto& e : elems) {
-			strAppend(path, e.first->getName(), '/');
+	return (uint64_t(i) << 1) ^ uint64_t(i >> 63);
+}
+static int64_t fromZigZag(uint64_t u)
+{
+	return int64_t(u >> 1) ^ -int64_t(u & 1);
+}
+
+namespace {
+struct BinWriter
+{
+	string out;
+	hash_map<string_view, unsigned> names;
+
+	void writeStr(string_view s)
+	{
+		storeUleb(out, s.size());
+		out.append(s.data(), s.size());
+	}
+	void writeName(const string& name)
+	{
+		auto [it, inserted] = names.emplace(name, unsigned(names.size()));
+		storeUleb(out, it->second);
+		if (inserted) writeStr(name);
+	}
+	void write(const XMLElement& elem)
+	{
+		writeName(elem.getName());
+		const auto& attributes = elem.getAttributes();
+		storeUleb(out, attributes.size());
+		for (const auto& [name, value] : attributes) {
+			writeName(name);
+			writeStr(value);
+		}
+		writeStr(elem.getData());
+		const auto& children = elem.getChildren();
+		storeUleb(out, children.size());
+		for (const auto& c : children) {
+			write(c);
 		}
-		throw XMLException("No child tag \"", tag,
-		                   "\" found at location \"", path, '\"');
 	}
-	elems.emplace_back(child, 0);
+};
+
+struct BinReader
+{
+	static constexpr unsigned MAX_DEPTH = 256;
+
+	string_view in;
+	std::vector<string> names;
+
+	string_view readStr()
+	{
+		auto len = loadUleb(in);
+		if (len > in.size()) {
+			throw XMLException("Corrupt binary savestate.");
+		}
+		auto result = in.substr(0, len);
+		in.remove_prefix(len);
+		return result;
+	}
+	string readName()
+	{
+		auto idx = loadUleb(in);
+		if (idx == names.size()) {
+			names.emplace_back(readStr());
+		} else if (idx > names.size()) {
+			throw XMLException("Corrupt binary savestate.");
+		}
+		return names[idx];
+	}
+	void read(XMLElement& elem, unsigned depth = 0)
+	{
+		// Real savestates are nowhere near this deep, this only
+		// protects against stack overflow on corrupt input.
+		if (depth > MAX_DEPTH) {
+			throw XMLException("Corrupt binary savestate.");
+		}
+		elem.setName(readName());
+		auto numAttributes = loadUleb(in);
+		for (uint64_t i = 0; i < numAttributes; ++i) {
+			auto name = readName();
+			elem.addAttribute(std::move(name), string(readStr()));
+		}
+		elem.setData(string(readStr()));
+		auto numChildren = loadUleb(in);
+		for (uint64_t i = 0; i < numChildren; ++i) {
+			read(elem.addChild({}), depth + 1);
+		}
+	}
+};
+} // namespace
+
+BinOutputArchive::BinOutputArchive(const string& filename)
+	: file(FileOperations::openFile(filename, "wb"))
+{
+	if (!file) {
+		throw XMLException("Could not open file \"", filename, "\"");
+	}
 }
-void XmlInputArchive::endTag(const char* tag)
+
+void BinOutputArchive::close()
 {
-	const auto& elem = *elems.back().first;
-	if (elem.getName() != tag) {
-		throw XMLException("End tag \"", elem.getName(),
-		                   "\" not equal to begin tag \"", tag, "\"");
+	if (!file) return; // already closed
+
+	assert(current.back() == &root);
+	BinWriter writer;
+	writer.out.assign(BIN_MAGIC, sizeof(BIN_MAGIC));
+	writer.write(root);
+
+	auto size = writer.out.size();
+	bool ok = fwrite(writer.out.data(), 1, size, file.get()) == size;
+	ok &= fclose(file.release()) == 0;
+	if (!ok) {
+		throw XMLException("Could not write savestate file.");
 	}
-	auto& elem2 = const_cast<XMLElement&>(elem);
-	elem2.clearName(); // mark this elem for later beginTag() calls
-	elems.pop_back();
 }
 
-void XmlInputArchive::attribute(const char* name, string& t)
+BinOutputArchive::~BinOutputArchive()
 {
 	try {
-		t = elems.back().first->getAttribute(name);
-	} catch (ConfigException& e) {
-		throw XMLException(std::move(e).getMessage());
+		close();
+	} catch (...) {
+		// Eat exception. Explicitly call close() if you want to handle errors.
 	}
 }
-void XmlInputArchive::attribute(const char* name, int& i)
+
+void BinOutputArchive::saveChar(char c)
 {
-	attributeImpl(name, i);
+	save(c);
 }
-void XmlInputArchive::attribute(const char* name, unsigned& u)
+void BinOutputArchive::save(const string& str)
 {
-	attributeImpl(name, u);
+	setData(str);
 }
-bool XmlInputArchive::hasAttribute(const char* name)
+void BinOutputArchive::saveInt(int64_t i)
 {
-	return elems.back().first->hasAttribute(name);
+	string buf;
+	storeUleb(buf, toZigZag(i));
+	setData(std::move(buf));
 }
-bool XmlInputArchive::findAttribute(const char* name, unsigned& value)
+void BinOutputArchive::saveFloat(double d)
 {
-	return elems.back().first->findAttributeInt(name, value);
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	char buf[8];
+	Endian::write_UA_L64(buf, u);
+	setData(string(buf, sizeof(buf)));
+}
+
+void BinOutputArchive::serialize_blob(const char* tag, const void* data,
+                                      size_t len, DirtyPages* /*dirty*/)
+{
+	// LZ4 is much faster than zlib and, unlike XML, the result doesn't
+	// need to be base64 encoded.
+	string buf(LZ4::compressBound(int(len)), '\0');
+	auto dstLen = LZ4::compress(static_cast<const uint8_t*>(data),
+	                            reinterpret_cast<uint8_t*>(buf.data()), int(len));
+	buf.resize(dstLen);
+
+	beginTag(tag);
+	attribute("encoding", string("lz4"));
+	setData(std::move(buf));
+	endTag(tag);
 }
-int XmlInputArchive::countChildren() const
+
+////
+
+static XMLElement loadBin(const string& filename)
 {
-	return int(elems.back().first->getChildren().size());
+	MemBuffer<char> buf;
+	size_t size;
+	try {
+		File file(filename);
+		size = file.getSize();
+		buf.resize(size);
+		file.read(buf.data(), size);
+	} catch (FileException& e) {
+		throw XMLException(filename, ": failed to read: ", e.getMessage());
+	}
+	string_view data(buf.data(), size);
+	if ((data.size() < sizeof(BIN_MAGIC)) ||
+	    (memcmp(data.data(), BIN_MAGIC, sizeof(BIN_MAGIC)) != 0)) {
+		throw XMLException(filename, ": not a binary savestate");
+	}
+	data.remove_prefix(sizeof(BIN_MAGIC));
+
+	BinReader reader{data, {}};
+	XMLElement root;
+	reader.read(root);
+	return root;
+}
+
+bool BinInputArchive::isBinFile(const string& filename)
+{
+	try {
+		File file(filename);
+		if (file.getSize() < sizeof(BIN_MAGIC)) return false;
+		char buf[sizeof(BIN_MAGIC)];
+		file.read(buf, sizeof(buf));
+		return memcmp(buf, BIN_MAGIC, sizeof(buf)) == 0;
+	} catch (MSXException&) {
+		return false;
+	}
+}
+
+BinInputArchive::BinInputArchive(const string& filename)
+	: TreeInputArchiveBase(loadBin(filename))
+{
+}
+
+void BinInputArchive::loadChar(char& c)
+{
+	load(c);
+}
+void BinInputArchive::load(string& t)
+{
+	t = loadStr();
+}
+int64_t BinInputArchive::loadInt()
+{
+	auto data = loadStr();
+	auto result = fromZigZag(loadUleb(data));
+	if (!data.empty()) {
+		throw XMLException("Invalid integer in binary savestate");
+	}
+	return result;
 }
+double BinInputArchive::loadFloat()
+{
+	auto data = loadStr();
+	if (data.size() != 8) {
+		throw XMLException("Invalid float in binary savestate");
+	}
+	auto u = Endian::read_UA_L64(data.data());
+	double d;
+	memcpy(&d, &u, sizeof(d));
+	return d;
+}
+
+void BinInputArchive::serialize_blob(const char* tag, void* data,
+                                     size_t len, DirtyPages* dirty)
+{
+	if (dirty) dirty->markAll();
+
+	beginTag(tag);
+	string encoding;
+	attribute("encoding", encoding);
+	string_view tmp = loadStr();
+	endTag(tag);
+
+	if (encoding != "lz4") {
+		throw XMLException("Unsupported encoding \"", encoding, "\" for blob");
+	}
 
+	// the file may be damaged (or crafted), so use the checked decoder
+	if (LZ4::decompressSafe(reinterpret_cast<const uint8_t*>(tmp.data()),
+	                        static_cast<uint8_t*>(data),
+	                        int(tmp.size()), int(len)) != int(len)) {
+		throw MSXException("Error while decompressing blob.");
+	}
+}
 } // namespace openmsx
@@ -4,6 +4,7 @@
 #include "serialize_core.hh"
 #include "SerializeBuffer.hh"
 #include "XMLElement.hh"
+#include "FileOperations.hh"
 #include "MemBuffer.hh"
 #include "hash_map.hh"
 #include "inline.hh"
@@ -21,6 +22,7 @@
 namespace openmsx {
 
 class LastDeltaBlocks;
+class DirtyPages;
 class DeltaBlock;
 
 // TODO move somewhere in utils once we use this more often
@@ -59,6 +61,10 @@ template<typename T> struct SerializeClassVersion;
 //      is not a design goal (e.g. simply changing a value will probably work,
 //      but swapping the position of two tag or adding or removing tags can
 //      easily break the stream).
+//   - Bin
+//      Stores the same information as the XML archives (including the
+//      version information), but in a compact binary form. It's much faster
+//      to save and load, but it's not human readable.
 //   - Text
 //      This stores to stream in a flat ascii file (one item per line). This
 //      format is only written as a proof-of-concept to test the design. It's
@@ -136,13 +142,16 @@ public:
 	//
 	//
 	// void serialize_blob(const char* tag, const void* data, size_t len,
-	//                     bool diff = true)
+	//                     DirtyPages* dirty = nullptr)
 	//
 	//   Serialize the given data as a binary blob.
 	//   This cannot be part of the serialize() method above because we
 	//   cannot know whether a byte-array should be serialized as a blob
 	//   or as a collection of bytes (IOW we cannot decide it based on the
 	//   type).
+	//   The optional DirtyPages object tracks which parts of the data
+	//   were written, this speeds up taking reverse snapshots. After
+	//   loading, all pages are marked dirty.
 	//
 	//
 	// template<typename T> void serialize(const char* tag, const T& t)
@@ -457,7 +466,7 @@ public:
 	// Default implementation is to base64-encode the blob and serialize
 	// the resulting string. But memory archives will memcpy the blob.
 	void serialize_blob(const char* tag, const void* data, size_t len,
-	                    bool diff = true);
+	                    DirtyPages* dirty = nullptr);
 
 	template<typename T> void serialize(const char* tag, const T& t)
 	{
@@ -552,7 +561,7 @@ public:
 		doSerialize(tag, t, std::tuple<Args...>(args...));
 	}
 	void serialize_blob(const char* tag, void* data, size_t len,
-	                    bool diff = true);
+	                    DirtyPages* dirty = nullptr);
 
 	template<typename T>
 	void serialize(const char* tag, T& t)
@@ -662,7 +671,7 @@ public:
 	}
 	void save(const std::string& s);
 	void serialize_blob(const char* tag, const void* data, size_t len,
-	                    bool diff = true);
+	                    DirtyPages* dirty = nullptr);
 
 	using OutputArchiveBase<MemOutputArchive>::serialize;
 	template<typename T, typename ...Args>
@@ -774,7 +783,7 @@ public:
 	void load(std::string& s);
 	std::string_view loadStr();
 	void serialize_blob(const char* tag, void* data, size_t len,
-	                    bool diff = true);
+	                    DirtyPages* dirty = nullptr);
 
 	using InputArchiveBase<MemInputArchive>::serialize;
 	template<typename T, typename ...Args>
@@ -834,39 +843,19 @@ private:
 
 ////
 
-class XmlOutputArchive final : public OutputArchiveBase<XmlOutputArchive>
+// The XML and Bin archives both build (or read) a tree of XMLElement objects,
+// they only differ in how that tree and the primitive values in it are
+// stored in the file. These two base classes contain the common part.
+template<typename Derived>
+class TreeOutputArchiveBase : public OutputArchiveBase<Derived>
 {
 public:
-	explicit XmlOutputArchive(const std::string& filename);
-	void close();
-	~XmlOutputArchive();
-
-	template <typename T> void saveImpl(const T& t)
-	{
-		// TODO make sure floating point is printed with enough digits
-		//      maybe print as hex?
-		save(strCat(t));
-	}
-	template <typename T> void save(const T& t)
-	{
-		saveImpl(t);
-	}
-	void saveChar(char c);
-	void save(const std::string& str);
-	void save(bool b);
-	void save(unsigned char b);
-	void save(signed char c);
-	void save(char c);
-	void save(int i);                  // these 3 are not strictly needed
-	void save(unsigned u);             // but having them non-inline
-	void save(unsigned long long ull); // saves quite a bit of code
-
 	void beginSection() { /*nothing*/ }
 	void endSection()   { /*nothing*/ }
 
 	// workaround(?) for visual studio 2015:
 	//   put the default here instead of in the base class
-	using OutputArchiveBase<XmlOutputArchive>::serialize;
+	using OutputArchiveBase<Derived>::serialize;
 	template<typename T, typename ...Args>
 	ALWAYS_INLINE void serialize(const char* tag, const T& t, Args&& ...args)
 	{
@@ -895,17 +884,18 @@ public:
 	void attribute(const char* name, int i);
 	void attribute(const char* name, unsigned u);
 
-private:
-	gzFile file;
+protected:
+	TreeOutputArchiveBase();
+	void setData(std::string str);
+
 	XMLElement root;
 	std::vector<XMLElement*> current;
 };
 
-class XmlInputArchive final : public InputArchiveBase<XmlInputArchive>
+template<typename Derived>
+class TreeInputArchiveBase : public InputArchiveBase<Derived>
 {
 public:
-	explicit XmlInputArchive(const std::string& filename);
-
 	inline bool versionAtLeast(unsigned actual, unsigned required) const
 	{
 		return actual >= required;
@@ -915,29 +905,13 @@ public:
 		return actual < required;
 	}
 
-	template<typename T> void load(T& t)
-	{
-		std::string str;
-		load(str);
-		std::istringstream is(str);
-		is >> t;
-	}
-	void loadChar(char& c);
-	void load(bool& b);
-	void load(unsigned char& b);
-	void load(signed char& c);
-	void load(char& c);
-	void load(int& i);                  // these 3 are not strictly needed
-	void load(unsigned& u);             // but having them non-inline
-	void load(unsigned long long& ull); // saves quite a bit of code
-	void load(std::string& t);
 	std::string_view loadStr();
 
 	void skipSection(bool /*skip*/) { /*nothing*/ }
 
 	// workaround(?) for visual studio 2015:
 	//   put the default here instead of in the base class
-	using InputArchiveBase<XmlInputArchive>::serialize;
+	using InputArchiveBase<Derived>::serialize;
 	template<typename T, typename ...Args>
 	ALWAYS_INLINE void serialize(const char* tag, T& t, Args&& ...args)
 	{
@@ -973,16 +947,141 @@ public:
 	bool findAttribute(const char* name, unsigned& value);
 	int countChildren() const;
 
+protected:
+	explicit TreeInputArchiveBase(XMLElement rootElem);
+
 private:
 	XMLElement rootElem;
 	std::vector<std::pair<const XMLElement*, size_t>> elems;
 };
 
+class XmlOutputArchive final : public TreeOutputArchiveBase<XmlOutputArchive>
+{
+public:
+	explicit XmlOutputArchive(const std::string& filename);
+	void close();
+	~XmlOutputArchive();
+
+	template <typename T> void saveImpl(const T& t)
+	{
+		// TODO make sure floating point is printed with enough digits
+		//      maybe print as hex?
+		save(strCat(t));
+	}
+	template <typename T> void save(const T& t)
+	{
+		saveImpl(t);
+	}
+	void saveChar(char c);
+	void save(const std::string& str);
+	void save(bool b);
+	void save(unsigned char b);
+	void save(signed char c);
+	void save(char c);
+	void save(int i);                  // these 3 are not strictly needed
+	void save(unsigned u);             // but having them non-inline
+	void save(unsigned long long ull); // saves quite a bit of code
+
+private:
+	gzFile file;
+};
+
+class XmlInputArchive final : public TreeInputArchiveBase<XmlInputArchive>
+{
+public:
+	explicit XmlInputArchive(const std::string& filename);
+
+	template<typename T> void load(T& t)
+	{
+		std::string str;
+		load(str);
+		std::istringstream is(str);
+		is >> t;
+	}
+	void loadChar(char& c);
+	void load(bool& b);
+	void load(unsigned char& b);
+	void load(signed char& c);
+	void load(char& c);
+	void load(int& i);                  // these 3 are not strictly needed
+	void load(unsigned& u);             // but having them non-inline
+	void load(unsigned long long& ull); // saves quite a bit of code
+	void load(std::string& t);
+};
+
+////
+
+// Compact binary variant of the XML archives. The file contains the same
+// tree of tags and attributes (so it supports versioning in the same way),
+// but primitive values are stored in a binary form and blobs are compressed
+// with LZ4 instead of gzip+base64. Saving and loading is a lot faster, but
+// unlike XML the result is not human readable.
+class BinOutputArchive final : public TreeOutputArchiveBase<BinOutputArchive>
+{
+public:
+	explicit BinOutputArchive(const std::string& filename);
+	void close();
+	~BinOutputArchive();
+
+	template<typename T> void save(const T& t)
+	{
+		if constexpr (std::is_integral_v<T>) {
+			saveInt(int64_t(t));
+		} else {
+			static_assert(std::is_floating_point_v<T>);
+			saveFloat(double(t));
+		}
+	}
+	void saveChar(char c);
+	void save(const std::string& str);
+	void serialize_blob(const char* tag, const void* data, size_t len,
+	                    DirtyPages* dirty = nullptr);
+
+private:
+	void saveInt(int64_t i);
+	void saveFloat(double d);
+
+	FileOperations::FILE_t file;
+};
+
+class BinInputArchive final : public TreeInputArchiveBase<BinInputArchive>
+{
+public:
+	explicit BinInputArchive(const std::string& filename);
+
+	/** Does the given file start like a file written by BinOutputArchive?
+	  * Used to choose between this archive and XmlInputArchive.
+	  */
+	[[nodiscard]] static bool isBinFile(const std::string& filename);
+
+	template<typename T> void load(T& t)
+	{
+		if constexpr (std::is_same_v<T, bool>) {
+			t = loadInt() != 0;
+		} else if constexpr (std::is_integral_v<T>) {
+			t = T(loadInt());
+		} else {
+			static_assert(std::is_floating_point_v<T>);
+			t = T(loadFloat());
+		}
+	}
+	void loadChar(char& c);
+	void load(std::string& t);
+	void serialize_blob(const char* tag, void* data, size_t len,
+	                    DirtyPages* dirty = nullptr);
+
+private:
+	[[nodiscard]] int64_t loadInt();
+	[[nodiscard]] double loadFloat();
+};
+
 #define INSTANTIATE_SERIALIZE_METHODS(CLASS) \
 template void CLASS::serialize(MemInputArchive&,   unsigned); \
 template void CLASS::serialize(MemOutputArchive&,  unsigned); \
 template void CLASS::serialize(XmlInputArchive&,   unsigned); \
-template void CLASS::serialize(XmlOutputArchive&,  unsigned);
+template void CLASS::serialize(XmlOutputArchive&,  unsigned); \
+template void CLASS::serialize(BinInputArchive&,   unsigned); \
+template void CLASS::serialize(BinOutputArchive&,  unsigned);
 
 } // namespace openmsx
 
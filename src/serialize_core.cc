@@ -33,8 +33,9 @@ unsigned loadVersionHelper(MemInputArchive& /*ar*/, const char* /*className*/,
 	UNREACHABLE; return 0;
 }
 
-unsigned loadVersionHelper(XmlInputArchive& ar, const char* className,
-                           unsigned latestVersion)
+template<typename Archive>
+static unsigned loadVersionHelper2(Archive& ar, const char* className,
+                                   unsigned latestVersion)
 {
 	assert(ar.canHaveOptionalAttributes());
 	unsigned version;
@@ -47,4 +48,16 @@ unsigned loadVersionHelper(XmlInputArchive& ar, const char* className,
 	return version;
 }
 
+unsigned loadVersionHelper(XmlInputArchive& ar, const char* className,
+                           unsigned latestVersion)
+{
+	return loadVersionHelper2(ar, className, latestVersion);
+}
+
+unsigned loadVersionHelper(BinInputArchive& ar, const char* className,
+                           unsigned latestVersion)
+{
+	return loadVersionHelper2(ar, className, latestVersion);
+}
+
 } // namespace openmsx
@@ -16,10 +16,13 @@
 #include "stl.hh"
 #include "aligned.hh"
 #include "outer.hh"
+#include "parallelFor.hh"
 #include "ranges.hh"
 #include "unreachable.hh"
 #include "view.hh"
 #include "vla.hh"
+#include "xrange.hh"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
@@ -42,6 +45,7 @@ MSXMixer::MSXMixer(Mixer& mixer_, MSXMotherBoard& motherBoard_,
 	, motherBoard(motherBoard_)
 	, commandController(motherBoard.getMSXCommandController())
 	, masterVolume(mixer.getMasterVolume())
+	, parallelSetting(mixer.getParallelSetting())
 	, speedSetting(globalSettings.getSpeedSetting())
 	, throttleManager(globalSettings.getThrottleManager())
 	, prevTime(getCurrentTime(), 44100)
@@ -432,37 +436,74 @@ void MSXMixer::generate(float* output, EmuTime::param time, unsigned samples)
 	VLA_SSE_ALIGNED(float, stereoBuf, 2 * samples + 3);
 	VLA_SSE_ALIGNED(float, tmpBuf,    2 * samples + 3);
 
+	// In parallel mode, first let all devices generate their output in
+	// separate buffers (devices only touch their own state). The
+	// accumulation below then happens in the same order and with the same
+	// operations as in the serial case, so the result is bit-exact.
+	bool parallel = parallelSetting.getBoolean() && (infos.size() > 1);
+	unsigned pitch = (2 * samples + 3 + 3) & ~3; // keep SSE alignment
+	if (parallel) {
+		auto num = infos.size();
+		deviceBufs.resize(num * pitch);
+		deviceHasOutput.resize(num);
+		parallelFor(num, [&](size_t i) {
+			deviceHasOutput[i] = infos[i].device->updateBuffer(
+				samples, &deviceBufs[i * pitch], time);
+		});
+	}
+	// Get the output of the i-th device in 'buf', returns false if the
+	// device is silent.
+	auto generateInto = [&](size_t i, float* buf) {
+		if (!parallel) {
+			return infos[i].device->updateBuffer(samples, buf, time);
+		}
+		if (!deviceHasOutput[i]) return false;
+		auto num = infos[i].device->isStereo() ? 2 * samples : samples;
+		std::copy_n(&deviceBufs[i * pitch], num, buf);
+		return true;
+	};
+	// Similar, but it may return a pointer to a different buffer (to avoid
+	// a copy), returns nullptr if the device is silent.
+	auto getOutput = [&](size_t i, float* buf) -> const float* {
+		if (!parallel) {
+			return infos[i].device->updateBuffer(samples, buf, time)
+			     ? buf : nullptr;
+		}
+		return deviceHasOutput[i] ? &deviceBufs[i * pitch] : nullptr;
+	};
+
 	constexpr unsigned HAS_MONO_FLAG = 1;
 	constexpr unsigned HAS_STEREO_FLAG = 2;
 	unsigned usedBuffers = 0;
 
 	// FIXME: The Infos should be ordered such that all the mono
 	// devices are handled first
-	for (auto& info : infos) {
+	for (auto i : xrange(infos.size())) {
+		auto& info = infos[i];
 		SoundDevice& device = *info.device;
 		auto l1 = info.left1;
 		auto r1 = info.right1;
 		if (!device.isStereo()) {
 			if (l1 == r1) {
 				if (!(usedBuffers & HAS_MONO_FLAG)) {
-					if (device.updateBuffer(samples, monoBuf, time)) {
+					if (generateInto(i, monoBuf)) {
 						usedBuffers |= HAS_MONO_FLAG;
 						mul(monoBuf, samples, l1);
 					}
 				} else {
-					if (device.updateBuffer(samples, tmpBuf, time)) {
-						mulAcc(monoBuf, tmpBuf, samples, l1);
+					if (auto* buf = getOutput(i, tmpBuf)) {
+						mulAcc(monoBuf, buf, samples, l1);
 					}
 				}
 			} else {
 				if (!(usedBuffers & HAS_STEREO_FLAG)) {
-					if (device.updateBuffer(samples, stereoBuf, time)) {
+					if (generateInto(i, stereoBuf)) {
 						usedBuffers |= HAS_STEREO_FLAG;
 						mulExpand(stereoBuf, samples, l1, r1);
 					}
 				} else {
-					if (device.updateBuffer(samples, tmpBuf, time)) {
-						mulExpandAcc(stereoBuf, tmpBuf, samples, l1, r1);
+					if (auto* buf = getOutput(i, tmpBuf)) {
+						mulExpandAcc(stereoBuf, buf, samples, l1, r1);
 					}
 				}
 			}
@@ -473,24 +514,24 @@ void MSXMixer::generate(float* output, EmuTime::param time, unsigned samples)
 				assert(l2 == 0.0f);
 				assert(r1 == 0.0f);
 				if (!(usedBuffers & HAS_STEREO_FLAG)) {
-					if (device.updateBuffer(samples, stereoBuf, time)) {
+					if (generateInto(i, stereoBuf)) {
 						usedBuffers |= HAS_STEREO_FLAG;
 						mul(stereoBuf, 2 * samples, l1);
 					}
 				} else {
-					if (device.updateBuffer(samples, tmpBuf, time)) {
-						mulAcc(stereoBuf, tmpBuf, 2 * samples, l1);
+					if (auto* buf = getOutput(i, tmpBuf)) {
+						mulAcc(stereoBuf, buf, 2 * samples, l1);
 					}
 				}
 			} else {
 				if (!(usedBuffers & HAS_STEREO_FLAG)) {
-					if (device.updateBuffer(samples, stereoBuf, time)) {
+					if (generateInto(i, stereoBuf)) {
 						usedBuffers |= HAS_STEREO_FLAG;
 						mulMix2(stereoBuf, samples, l1, l2, r1, r2);
 					}
 				} else {
-					if (device.updateBuffer(samples, tmpBuf, time)) {
-						mulMix2Acc(stereoBuf, tmpBuf, samples, l1, l2, r1, r2);
+					if (auto* buf = getOutput(i, tmpBuf)) {
+						mulMix2Acc(stereoBuf, buf, samples, l1, l2, r1, r2);
 					}
 				}
 			}
@@ -6,6 +6,8 @@
 #include "InfoTopic.hh"
 #include "EmuTime.hh"
 #include "DynamicClock.hh"
+#include "MemBuffer.hh"
+#include <cstdint>
 #include <vector>
 #include <memory>
 
@@ -155,6 +157,7 @@ private:
 	MSXCommandController& commandController;
 
 	IntegerSetting& masterVolume;
+	BooleanSetting& parallelSetting;
 	IntegerSetting& speedSetting;
 	ThrottleManager& throttleManager;
 
@@ -173,6 +176,10 @@ private:
 
 	unsigned muteCount;
 	float tl0, tr0; // internal DC-filter state
+
+	// In parallel mode, the output of each device (see 'parallelSetting')
+	MemBuffer<float, SSE2_ALIGNMENT> deviceBufs;
+	std::vector<uint8_t> deviceHasOutput; // not vector<bool>, written concurrently
 };
 
 } // namespace openmsx
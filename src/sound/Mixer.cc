@@ -48,6 +48,10 @@ Mixer::Mixer(Reactor& reactor_, CommandController& commandController_)
 	, samplesSetting(
 		commandController, "samples",
 		"mixer samples", defaultsamples, 64, 8192)
+	, parallelSetting(
+		commandController, "sound_parallel",
+		"generate the sound of the different sound devices in parallel "
+		"on multiple threads", false)
 	, muteCount(0)
 {
 	muteSetting       .attach(*this);
@@ -46,6 +46,7 @@ public:
 	void uploadBuffer(MSXMixer& msxMixer, float* buffer, unsigned len);
 
 	IntegerSetting& getMasterVolume() { return masterVolume; }
+	BooleanSetting& getParallelSetting() { return parallelSetting; }
 
 private:
 	void reloadDriver();
@@ -65,6 +66,7 @@ private:
 	IntegerSetting masterVolume;
 	IntegerSetting frequencySetting;
 	IntegerSetting samplesSetting;
+	BooleanSetting parallelSetting;
 
 	int muteCount;
 };
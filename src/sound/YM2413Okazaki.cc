@@ -11,9 +11,16 @@
 #include "ranges.hh"
 #include "serialize.hh"
 #include "unreachable.hh"
+#include <algorithm>
 #include <cstring>
 #include <cassert>
 #include <iostream>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define YM2413_AVX2 1
+#include <immintrin.h>
+#else
+#define YM2413_AVX2 0
+#endif
 
 namespace openmsx {
 namespace YM2413Okazaki {
@@ -1097,6 +1104,154 @@ Patch& YM2413::getPatch(unsigned instrument, bool carrier)
 	return patches[instrument][carrier];
 }
 
+static YM2413::Simd detectSimd()
+{
+	return YM2413::isSupported(YM2413::Simd::AVX2) ? YM2413::Simd::AVX2
+	                                               : YM2413::Simd::SCALAR;
+}
+static YM2413::Simd selectedSimd = detectSimd();
+
+bool YM2413::isSupported(Simd simd)
+{
+	switch (simd) {
+	case Simd::SCALAR:
+		return true;
+	case Simd::AVX2:
+#if YM2413_AVX2
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+YM2413::Simd YM2413::getSimd()
+{
+	return selectedSimd;
+}
+
+void YM2413::setSimd(Simd simd)
+{
+	assert(isSupported(simd));
+	selectedSimd = simd;
+}
+
+#if YM2413_AVX2
+// Not all x86_64 CPUs have AVX2, so these routines are compiled for AVX2
+// separately and only used when the CPU supports it (see detectSimd()).
+
+// Calculate the (not yet averaged) output of a slot with a fixed envelope and
+// without vibrato for 'num' samples (must be a multiple of 8). In that case the
+// phase is a simple arithmetic progression, so 8 samples can be calculated at
+// once. 'fm' is the (optional) phase modulation by the modulator slot, 'am'
+// the (optional) per-sample LFO amplitude modulation.
+template<bool HAS_AM, bool HAS_FM>
+__attribute__((target("avx2")))
+static inline void lookupSlotAVX2(
+	const Slot& slot, unsigned fixed_env, const int* am, const int* fm,
+	int* out, unsigned num)
+{
+	constexpr int FM_SHIFT = PG_BITS + 2 - SLOT_AMP_BITS; // see wave2_8pi()
+	static_assert(FM_SHIFT > 0);
+	const auto* wave = reinterpret_cast<const int*>(slot.patch.WF);
+	unsigned dphase = slot.dphase[0];
+	__m256i phase = _mm256_add_epi32(
+		_mm256_set1_epi32(slot.cphase),
+		_mm256_mullo_epi32(_mm256_set1_epi32(dphase),
+		                   _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 8)));
+	__m256i dphase8 = _mm256_set1_epi32(8 * dphase);
+	__m256i env = _mm256_set1_epi32(fixed_env);
+	__m256i mask = _mm256_set1_epi32(PG_MASK);
+	__m256i three = _mm256_set1_epi32(3);
+	for (unsigned i = 0; i < num; i += 8) {
+		__m256i p = _mm256_srli_epi32(phase, DP_BASE_BITS);
+		if (HAS_FM) {
+			auto f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fm + i));
+			p = _mm256_add_epi32(p, _mm256_slli_epi32(f, FM_SHIFT));
+		}
+		__m256i db = _mm256_i32gather_epi32(wave, _mm256_and_si256(p, mask), 4);
+		__m256i egout = env;
+		if (HAS_AM) {
+			auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(am + i));
+			egout = _mm256_or_si256(_mm256_add_epi32(env, a), three);
+		}
+		__m256i lin = _mm256_i32gather_epi32(dB2Lin.tab, _mm256_add_epi32(db, egout), 4);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), lin);
+		phase = _mm256_add_epi32(phase, dphase8);
+	}
+}
+
+// Bit-exact equivalent of calcChannel() for a channel in the 'steady state':
+// both slots have a fixed envelope and there's no vibrato. This is the state
+// a sustained note spends most of its time in. Only the modulator feedback and
+// the averaging of the carrier output remain sequential.
+template<bool HAS_CAR_AM, bool HAS_MOD_AM, bool HAS_MOD_FB>
+__attribute__((target("avx2")))
+static void calcSteadyChannelAVX2(
+	Channel& ch, float* buf, unsigned num, unsigned am_phase,
+	unsigned car_fixed_env, unsigned mod_fixed_env)
+{
+	constexpr unsigned CHUNK = 64;
+	int am[CHUNK];
+	int fm[CHUNK];
+	int out[CHUNK + 8];
+	if (!HAS_CAR_AM && !HAS_MOD_AM) std::fill_n(am, CHUNK, 0); // unused
+	do {
+		unsigned n = std::min(num, CHUNK);
+		unsigned nv = (n + 7) & ~7; // the extra samples are discarded
+		if (HAS_CAR_AM || HAS_MOD_AM) {
+			for (unsigned i = 0; i < n; ++i) {
+				++am_phase;
+				if (am_phase == (LFO_AM_TAB_ELEMENTS * 64)) {
+					am_phase = 0;
+				}
+				am[i] = lfo_am_table[am_phase / 64];
+			}
+			std::fill(am + n, am + nv, 0);
+		}
+
+		// modulator
+		if (HAS_MOD_FB) {
+			for (unsigned i = 0; i < n; ++i) {
+				fm[i] = ch.mod.calc_slot_mod<HAS_MOD_AM, true, true>(
+					0, am[i], mod_fixed_env);
+			}
+			std::fill(fm + n, fm + nv, 0);
+		} else {
+			out[0] = ch.mod.output;
+			lookupSlotAVX2<HAS_MOD_AM, false>(
+				ch.mod, mod_fixed_env, am, nullptr, out + 1, nv);
+			for (unsigned i = 0; i < nv; i += 8) {
+				// feedback = (previous output + new output) / 2
+				auto o0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i + 0));
+				auto o1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i + 1));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(fm + i),
+					_mm256_srai_epi32(_mm256_add_epi32(o0, o1), 1));
+			}
+			ch.mod.cphase += n * ch.mod.dphase[0];
+			ch.mod.output = out[n];
+			ch.mod.feedback = fm[n - 1];
+		}
+
+		// carrier
+		lookupSlotAVX2<HAS_CAR_AM, true>(
+			ch.car, car_fixed_env, am, fm, out, nv);
+		ch.car.cphase += n * ch.car.dphase[0];
+		int output = ch.car.output;
+		for (unsigned i = 0; i < n; ++i) {
+			output = (output + out[i]) >> 1;
+			buf[i] += output;
+		}
+		ch.car.output = output;
+
+		buf += n;
+		num -= n;
+	} while (num);
+}
+#endif
+
 template <unsigned FLAGS>
 ALWAYS_INLINE void YM2413::calcChannel(Channel& ch, float* buf, unsigned num)
 {
@@ -1124,6 +1279,16 @@ ALWAYS_INLINE void YM2413::calcChannel(Channel& ch, float* buf, unsigned num)
 	if (HAS_MOD_FIXED_ENV) {
 		mod_fixed_env = ch.mod.calc_fixed_env<HAS_MOD_AM>();
 	}
+#if YM2413_AVX2
+	if constexpr (HAS_CAR_FIXED_ENV && HAS_MOD_FIXED_ENV &&
+	              !HAS_CAR_PM && !HAS_MOD_PM) {
+		if (selectedSimd == Simd::AVX2) {
+			calcSteadyChannelAVX2<HAS_CAR_AM, HAS_MOD_AM, HAS_MOD_FB>(
+				ch, buf, num, tmp_am_phase, car_fixed_env, mod_fixed_env);
+			return;
+		}
+	}
+#endif
 
 	unsigned sample = 0;
 	do {
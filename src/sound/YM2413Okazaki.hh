@@ -154,6 +154,17 @@ public:
 	template <unsigned FLAGS>
 	inline void calcChannel(Channel& ch, float* buf, unsigned num);
 
+	/** Instruction set used to calculate channels in a steady state
+	  * (fixed envelope and no vibrato). The best one supported by the CPU
+	  * is selected automatically, the methods below are only meant for
+	  * unittests and benchmarks.
+	  */
+	enum class Simd { SCALAR, AVX2 };
+	[[nodiscard]] static bool isSupported(Simd simd);
+	[[nodiscard]] static Simd getSimd();
+	/** Not thread-safe: there should be no sound generation running. */
+	static void setSimd(Simd simd);
+
 	template<typename Archive>
 	void serialize(Archive& ar, unsigned version);
 
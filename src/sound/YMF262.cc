@@ -486,12 +486,6 @@ static constexpr SinTab getSinTab()
 constexpr SinTab sin = getSinTab();
 
 
-// TODO clean this up
-static int phase_modulation;  // phase modulation input (SLOT 2)
-static int phase_modulation2; // phase modulation input (SLOT 3
-                              // in 4 operator channels)
-
-
 YMF262::Slot::Slot()
 	: Cnt(0), Incr(0)
 {
@@ -680,7 +674,8 @@ inline int YMF262::Slot::op_calc(unsigned phase, unsigned lfo_am) const
 
 // calculate output of a standard 2 operator channel
 // (or 1st part of a 4-op channel)
-void YMF262::Channel::chan_calc(unsigned lfo_am)
+void YMF262::Channel::chan_calc(unsigned lfo_am, int& phase_modulation,
+                                int& phase_modulation2)
 {
 	// !! something is wrong with this, it caused bug
 	// !!    [2823673] moonsound 4 operator FM fail
@@ -719,7 +714,8 @@ void YMF262::Channel::chan_calc(unsigned lfo_am)
 }
 
 // calculate output of a 2nd part of 4-op channel
-void YMF262::Channel::chan_calc_ext(unsigned lfo_am)
+void YMF262::Channel::chan_calc_ext(unsigned lfo_am, int& phase_modulation,
+                                    int& phase_modulation2)
 {
 	// !! see remark in chan_cal(), something is wrong with this
 	// !! optimization disabled for now
@@ -1476,6 +1472,7 @@ YMF262::YMF262(const std::string& name_,
 
 	// avoid (harmless) UMR in serialize()
 	memset(chanout, 0, sizeof(chanout));
+	phase_modulation = phase_modulation2 = 0;
 	memset(reg, 0, sizeof(reg));
 
 	// For debugging: print out tables to be able to compare before/after
@@ -1581,31 +1578,31 @@ void YMF262::generateChannels(float** bufs, unsigned num)
 				auto& ch0 = channel[k + i + 0];
 				auto& ch3 = channel[k + i + 3];
 				// extended 4op ch#0 part 1 or 2op ch#0
-				ch0.chan_calc(lfo_am);
+				ch0.chan_calc(lfo_am, phase_modulation, phase_modulation2);
 				if (ch0.extended) {
 					// extended 4op ch#0 part 2
-					ch3.chan_calc_ext(lfo_am);
+					ch3.chan_calc_ext(lfo_am, phase_modulation, phase_modulation2);
 				} else {
 					// standard 2op ch#3
-					ch3.chan_calc(lfo_am);
+					ch3.chan_calc(lfo_am, phase_modulation, phase_modulation2);
 				}
 			}
 		}
 
 		// channels 6,7,8 rhythm or 2op mode
 		if (!rhythmEnabled) {
-			channel[6].chan_calc(lfo_am);
-			channel[7].chan_calc(lfo_am);
-			channel[8].chan_calc(lfo_am);
+			channel[6].chan_calc(lfo_am, phase_modulation, phase_modulation2);
+			channel[7].chan_calc(lfo_am, phase_modulation, phase_modulation2);
+			channel[8].chan_calc(lfo_am, phase_modulation, phase_modulation2);
 		} else {
 			// Rhythm part
 			chan_calc_rhythm(lfo_am);
 		}
 
 		// channels 15,16,17 are fixed 2-operator channels only
-		channel[15].chan_calc(lfo_am);
-		channel[16].chan_calc(lfo_am);
-		channel[17].chan_calc(lfo_am);
+		channel[15].chan_calc(lfo_am, phase_modulation, phase_modulation2);
+		channel[16].chan_calc(lfo_am, phase_modulation, phase_modulation2);
+		channel[17].chan_calc(lfo_am, phase_modulation, phase_modulation2);
 
 		for (int i = 0; i < 18; ++i) {
 			bufs[i][2 * j + 0] += int(chanout[i] & pan[4 * i + 0]);
@@ -0,0 +1,59 @@
+#include "ThreadPool.hh"
+
+namespace openmsx {
+
+ThreadPool::ThreadPool(unsigned numThreads)
+	: stop(false)
+{
+	if (numThreads == 0) numThreads = defaultNumThreads();
+	threads.reserve(numThreads);
+	for (unsigned i = 0; i < numThreads; ++i) {
+		threads.emplace_back([this]() { run(); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	condition.notify_all();
+	for (auto& t : threads) t.join();
+}
+
+unsigned ThreadPool::defaultNumThreads()
+{
+	unsigned hw = std::thread::hardware_concurrency();
+	return (hw > 1) ? hw - 1 : 1;
+}
+
+std::shared_future<void> ThreadPool::enqueueTask(std::packaged_task<void()> task)
+{
+	auto result = task.get_future().share();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	condition.notify_one();
+	return result;
+}
+
+void ThreadPool::run()
+{
+	while (true) {
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&] { return stop || !tasks.empty(); });
+			// Also on 'stop' first drain the queue, some other
+			// thread may be waiting on the result of these tasks.
+			if (tasks.empty()) return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+} // namespace openmsx
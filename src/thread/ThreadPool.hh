@@ -0,0 +1,75 @@
+#ifndef THREADPOOL_HH
+#define THREADPOOL_HH
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openmsx {
+
+/** A fixed-size pool of worker threads that executes tasks in FIFO order.
+  *
+  * Tasks are started in the order they were enqueued. This means a task may
+  * safely wait for the completion of a task that was enqueued before it
+  * (that earlier task is guaranteed to already be running or finished), but
+  * never for one that is enqueued later.
+  *
+  * The destructor finishes all pending tasks before joining the threads.
+  */
+class ThreadPool final
+{
+public:
+	/** Create a pool with the given number of threads. A value of zero
+	  * means: pick a default based on the number of hardware threads.
+	  */
+	explicit ThreadPool(unsigned numThreads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/** Schedule a task for execution on one of the worker threads.
+	  * The task is any callable without parameters, it may be move-only.
+	  * @return A future that becomes ready once the task has finished.
+	  */
+	template<typename F>
+	[[nodiscard]] std::shared_future<void> enqueue(F&& task)
+	{
+		// The packaged_task (and thus the callable) is owned by the
+		// shared state of the returned future. Move the callable out
+		// while executing it, so that its captures are released as
+		// soon as it's finished instead of when the last future is
+		// gone (this also avoids reference cycles).
+		return enqueueTask(std::packaged_task<void()>(
+			[f = std::forward<F>(task)]() mutable {
+				auto g = std::move(f);
+				g();
+			}));
+	}
+
+	/** Number of worker threads in this pool. */
+	[[nodiscard]] unsigned size() const { return unsigned(threads.size()); }
+
+	/** The number of worker threads used when none is explicitly given:
+	  * one less than the number of hardware threads (the main thread
+	  * keeps running as well), but at least one.
+	  */
+	[[nodiscard]] static unsigned defaultNumThreads();
+
+private:
+	[[nodiscard]] std::shared_future<void> enqueueTask(std::packaged_task<void()> task);
+	void run();
+
+	std::vector<std::thread> threads;
+	std::deque<std::packaged_task<void()>> tasks;
+	std::mutex mutex; // protects 'tasks' and 'stop'
+	std::condition_variable condition;
+	bool stop;
+};
+
+} // namespace openmsx
+
+#endif
@@ -8,7 +8,19 @@ using namespace std;
 static vector<string> parse(const string& stream)
 {
 	vector<string> result;
-	AdhocCliCommParser parser([&](const string& cmd) { result.push_back(cmd); });
+	AdhocCliCommParser parser([&](const string& cmd, const string& /*id*/) {
+		result.push_back(cmd);
+	});
+	parser.parse(stream.data(), stream.size());
+	return result;
+}
+
+static vector<pair<string, string>> parseWithId(const string& stream)
+{
+	vector<pair<string, string>> result;
+	AdhocCliCommParser parser([&](const string& cmd, const string& id) {
+		result.emplace_back(cmd, id);
+	});
 	parser.parse(stream.data(), stream.size());
 	return result;
 }
@@ -74,6 +86,23 @@ TEST_CASE("AdhocCliCommParser")
 		CHECK(parse("<openmsx-control></openmsx-control><command>foo</command>") ==
 		      vector<string>{"foo"});
 	}
+	SECTION("id attribute") {
+		CHECK(parseWithId("<command id=\"42\">foo</command>") ==
+		      vector<pair<string, string>>{{"foo", "42"}});
+		CHECK(parseWithId("<command id=\"\">foo</command>") ==
+		      vector<pair<string, string>>{{"foo", ""}});
+		CHECK(parseWithId("<command id=\"a b\">foo</command><command>bar</command>") ==
+		      vector<pair<string, string>>{{"foo", "a b"}, {"bar", ""}});
+		// other (or malformed) attributes are not accepted
+		CHECK(parse("<command  id=\"1\">foo</command>") ==
+		      vector<string>{});
+		CHECK(parse("<command id='1'>foo</command>") ==
+		      vector<string>{});
+		CHECK(parse("<command id=\"1\" >foo</command>") ==
+		      vector<string>{});
+		CHECK(parse("<command idx=\"1\">foo</command><command>bar</command>") ==
+		      vector<string>{"bar"});
+	}
 	SECTION("old (XML) parser did accept this, AdhocCliCommParser does not") {
 		// attributes are no longer accepted
 		CHECK(parse("<command value=\"3\">foo</command>") ==
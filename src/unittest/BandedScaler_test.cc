@@ -0,0 +1,164 @@
+#include "catch.hpp"
+#include "BandedScaler.hh"
+#include "PixelFormat.hh"
+#include "PixelOperations.hh"
+#include "RawFrame.hh"
+#include "Scale2xScaler.hh"
+#include "ScalerOutput.hh"
+#include "MemBuffer.hh"
+#include "build-info.hh"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if HAVE_32BPP
+
+using namespace openmsx;
+using Pixel = uint32_t;
+
+constexpr unsigned SRC_HEIGHT = 240;
+constexpr unsigned WIDTH = 640;
+constexpr unsigned HEIGHT = 480;
+
+class MemoryScalerOutput final : public ScalerOutput<Pixel>
+{
+public:
+	explicit MemoryScalerOutput(Pixel* pixels_) : pixels(pixels_) {}
+	unsigned getWidth()  const override { return WIDTH; }
+	unsigned getHeight() const override { return HEIGHT; }
+	Pixel* acquireLine(unsigned y) override { return &pixels[y * WIDTH]; }
+	void releaseLine(unsigned /*y*/, Pixel* /*buf*/) override {}
+	void fillLine(unsigned y, Pixel color) override {
+		std::fill_n(&pixels[y * WIDTH], WIDTH, color);
+	}
+private:
+	Pixel* pixels;
+};
+
+static const PixelFormat format(32,
+	0x00FF0000, 16, 0, 0x0000FF00, 8, 0,
+	0x000000FF,  0, 0, 0xFF000000, 24, 0);
+
+static void setLine(RawFrame& frame, unsigned y, unsigned width, unsigned seed)
+{
+	// only a few different colors, so that Scale2x finds some edges
+	static constexpr Pixel colors[4] = {
+		0xFF000000, 0xFFFF0000, 0xFF00FF00, 0xFFFFFFFF
+	};
+	auto* line = frame.getLinePtrDirect<Pixel>(y);
+	for (unsigned x = 0; x < width; ++x) {
+		seed = seed * 1103515245 + 12345;
+		line[x] = colors[(seed >> 16) & 3];
+	}
+	frame.setLineWidth(y, width);
+}
+
+static std::vector<Pixel> scale(
+	BandedScaler<Pixel>& bandedScaler,
+	std::vector<std::unique_ptr<Scaler<Pixel>>>& scalers,
+	RawFrame& frame, unsigned maxBands, bool cacheable)
+{
+	PixelOperations<Pixel> pixelOps(format);
+	MemBuffer<Pixel, 64> screen(WIDTH * HEIGHT);
+	// garbage, every pixel must be (re)written
+	std::fill_n(screen.data(), WIDTH * HEIGHT, 0x12345678);
+
+	BandedScaler<Pixel>::Params params;
+	params.inWidth = 1;
+	params.width = WIDTH;
+	params.height = HEIGHT;
+	bandedScaler.scale(
+		frame, nullptr, params, maxBands, cacheable,
+		[&](unsigned band) -> Scaler<Pixel>& {
+			while (scalers.size() <= band) {
+				scalers.push_back(std::make_unique<Scale2xScaler<Pixel>>(pixelOps));
+			}
+			return *scalers[band];
+		},
+		[&] { return std::make_unique<MemoryScalerOutput>(screen.data()); },
+		[&](unsigned y) { return &screen[y * WIDTH]; });
+	return std::vector<Pixel>(screen.data(), screen.data() + WIDTH * HEIGHT);
+}
+
+// Compare without letting catch print both images on failure.
+static bool sameImage(const std::vector<Pixel>& actual, const std::vector<Pixel>& expected)
+{
+	auto a = std::mismatch(actual.begin(), actual.end(), expected.begin()).first;
+	if (a == actual.end()) return true;
+	auto i = a - actual.begin();
+	UNSCOPED_INFO("first difference at x=" << (i % WIDTH) << " y=" << (i / WIDTH));
+	return false;
+}
+
+// Scale the whole frame at once, without cache.
+static std::vector<Pixel> scaleSerial(RawFrame& frame)
+{
+	BandedScaler<Pixel> bandedScaler;
+	std::vector<std::unique_ptr<Scaler<Pixel>>> scalers;
+	return scale(bandedScaler, scalers, frame, 1, false);
+}
+
+TEST_CASE("BandedScaler")
+{
+	RawFrame frame(format, 640, SRC_HEIGHT);
+	frame.init(FrameSource::FIELD_NONINTERLACED);
+	for (unsigned y = 0; y < SRC_HEIGHT; ++y) {
+		if (y < 20) {
+			frame.setBlank(y, Pixel(0xFF0000FF));
+		} else if (y < 100) {
+			setLine(frame, y, 320, y);
+		} else if (y < 140) {
+			// blank region, crosses the band boundary at line 120
+			frame.setBlank(y, Pixel(0xFF00FFFF));
+		} else if (y < 180) {
+			setLine(frame, y, 640, y);
+		} else {
+			setLine(frame, y, 320, y);
+		}
+	}
+
+	BandedScaler<Pixel> cached;
+	std::vector<std::unique_ptr<Scaler<Pixel>>> cachedScalers;
+
+	SECTION("banded") {
+		auto expected = scaleSerial(frame);
+		for (unsigned bands : {2, 3, 4, 7}) {
+			BandedScaler<Pixel> banded;
+			std::vector<std::unique_ptr<Scaler<Pixel>>> scalers;
+			CHECK(sameImage(scale(banded, scalers, frame, bands, false), expected));
+		}
+	}
+	SECTION("cached") {
+		// first frame fills the cache
+		CHECK(sameImage(scale(cached, cachedScalers, frame, 4, true), scaleSerial(frame)));
+		// unchanged frame, all lines come from the cache
+		CHECK(sameImage(scale(cached, cachedScalers, frame, 4, true), scaleSerial(frame)));
+
+		// change some content
+		setLine(frame, 50, 320, 1234);
+		// non-blank line in the middle of a blank region
+		setLine(frame, 125, 320, 5678);
+		// different line widths
+		for (unsigned y = 140; y < 150; ++y) setLine(frame, y, 320, y);
+		setLine(frame, 190, 640, 42);
+		// blank line in the middle of a non-blank region
+		frame.setBlank(200, Pixel(0xFFFF00FF));
+		CHECK(sameImage(scale(cached, cachedScalers, frame, 4, true), scaleSerial(frame)));
+
+		// and back
+		frame.setBlank(125, Pixel(0xFF00FFFF));
+		setLine(frame, 200, 320, 200);
+		CHECK(sameImage(scale(cached, cachedScalers, frame, 4, true), scaleSerial(frame)));
+
+		// change the color of a whole blank region
+		for (unsigned y = 0; y < 20; ++y) frame.setBlank(y, Pixel(0xFF123456));
+		CHECK(sameImage(scale(cached, cachedScalers, frame, 1, true), scaleSerial(frame)));
+
+		// after invalidate() everything is scaled again
+		cached.invalidate();
+		CHECK(sameImage(scale(cached, cachedScalers, frame, 4, true), scaleSerial(frame)));
+	}
+}
+
+#endif
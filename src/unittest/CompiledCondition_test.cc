@@ -0,0 +1,137 @@
+#include "catch.hpp"
+#include "CompiledCondition.hh"
+#include "Debuggable.hh"
+#include <map>
+#include <vector>
+
+using namespace openmsx;
+
+class TestDebuggable final : public Debuggable
+{
+public:
+	explicit TestDebuggable(unsigned size) : data(size) {}
+	unsigned getSize() const override { return unsigned(data.size()); }
+	const std::string& getDescription() const override { return desc; }
+	byte read(unsigned address) override { return data[address]; }
+	void write(unsigned address, byte value) override { data[address] = value; }
+
+	std::vector<byte> data;
+	std::string desc;
+};
+
+class TestContext final : public CompiledCondition::Context
+{
+public:
+	TestContext()
+		: regs(28), memory(0x10000), ioports(0x100), slotted(0x40000 * 4)
+	{
+	}
+
+	Debuggable* findDebuggable(std::string_view name) override {
+		if (name == "CPU regs") return &regs;
+		if (name == "memory") return &memory;
+		if (name == "ioports") return &ioports;
+		if (name == "slotted memory") return &slotted;
+		return nullptr;
+	}
+	bool isExpanded(int ps) override { return ps == 3; }
+
+	void setPC(unsigned pc) {
+		regs.data[20] = byte(pc >> 8);
+		regs.data[21] = byte(pc & 255);
+	}
+
+	TestDebuggable regs, memory, ioports, slotted;
+};
+
+static std::optional<bool> eval(std::string_view expr, TestContext& context)
+{
+	auto cond = CompiledCondition::compile(expr);
+	REQUIRE(cond);
+	return cond->evaluate(context);
+}
+
+TEST_CASE("CompiledCondition: arithmetic")
+{
+	TestContext c;
+	CHECK(eval("1", c) == true);
+	CHECK(eval("0", c) == false);
+	CHECK(eval("1 + 2 * 3 == 7", c) == true);
+	CHECK(eval("(1 + 2) * 3 == 9", c) == true);
+	CHECK(eval("0x10 == 16 && 0b101 == 5 && 0o17 == 15", c) == true);
+	CHECK(eval("-7 / 2 == -4", c) == true); // rounds towards -inf
+	CHECK(eval("-7 % 2 == 1", c) == true);
+	CHECK(eval("7 % -2 == -1", c) == true);
+	CHECK(eval("1 << 4 == 16 && 256 >> 4 == 16", c) == true);
+	CHECK(eval("(5 & 3) == 1 && (5 | 3) == 7 && (5 ^ 3) == 6", c) == true);
+	CHECK(eval("~0 == -1 && !5 == 0 && !0 == 1", c) == true);
+	CHECK(eval("1 < 2 && 2 <= 2 && 3 > 2 && 3 >= 3 && 1 != 2", c) == true);
+	CHECK(eval("0 || 0", c) == false);
+	CHECK(eval("1 ? 2 : 0", c) == true);
+	CHECK(eval("0 ? 2 : 0", c) == false);
+
+	// errors are left to Tcl
+	CHECK(eval("1 / 0", c) == std::nullopt);
+	CHECK(eval("1 % 0", c) == std::nullopt);
+	CHECK(eval("1 << -1", c) == std::nullopt);
+	CHECK(eval("0x7fffffffffffffff + 1", c) == std::nullopt);
+	// but not when short-circuited
+	CHECK(eval("0 && (1 / 0)", c) == false);
+}
+
+TEST_CASE("CompiledCondition: commands")
+{
+	TestContext c;
+	c.setPC(0x4000);
+	c.regs.data[6] = 0x12; // H
+	c.regs.data[7] = 0x34; // L
+	c.memory.data[0xF3AE] = 5;
+	c.memory.data[0x1234] = 0xFE;
+	c.memory.data[0x1235] = 0xFF;
+
+	CHECK(eval("[reg PC] == 0x4000 && [peek 0xF3AE] > 3", c) == true);
+	CHECK(eval("[reg pc] == 0x4000", c) == true);
+	CHECK(eval("[::reg HL] == 0x1234 && [reg H] == 0x12", c) == true);
+	CHECK(eval("[peek [reg HL]] == 0xFE", c) == true);
+	CHECK(eval("[peek_s8 0x1234] == -2", c) == true);
+	CHECK(eval("[peek16 0x1234] == 0xFFFE", c) == true);
+	CHECK(eval("[peek16_BE 0x1234] == 0xFEFF", c) == true);
+	CHECK(eval("[peek_s16 0x1234] == -2", c) == true);
+	CHECK(eval("[peek 0xF3AE {memory}] == 5", c) == true);
+	CHECK(eval("[debug read \"memory\" 0xF3AE] == 5", c) == true);
+
+	// invalid address, unknown debuggable
+	CHECK(eval("[peek16 0xFFFF]", c) == std::nullopt);
+	CHECK(eval("[peek 0 foo]", c) == std::nullopt);
+}
+
+TEST_CASE("CompiledCondition: pc_in_slot")
+{
+	TestContext c;
+	c.setPC(0x4000); // page 1
+	c.ioports.data[0xA8] = 0b11'11'01'00; // page 1 in slot 1
+	CHECK(eval("[pc_in_slot 1]", c) == true);
+	CHECK(eval("[pc_in_slot 2]", c) == false);
+	CHECK(eval("[pc_in_slot 1 3]", c) == true); // slot 1 is not expanded
+	CHECK(eval("![pc_in_slot 0]", c) == true);
+
+	c.setPC(0xC000); // page 3, slot 3 (expanded)
+	c.slotted.data[0x40000 * 3 + 0xFFFF] = byte(~0b10'00'00'00);
+	CHECK(eval("[pc_in_slot 3 2]", c) == true);
+	CHECK(eval("[pc_in_slot 3 1]", c) == false);
+	CHECK(eval("[pc_in_slot 3 X]", c) == true);
+}
+
+TEST_CASE("CompiledCondition: unsupported")
+{
+	for (auto* expr : {
+		"", "$::wp_last_address == 0", "[reg PC] eq 16", "1.5 > 1",
+		"010 == 8", "2 ** 3", "[pc_in_slot 1] == 1", "[reg PC 0]",
+		"[reg XYZ]", "[peek 0x4000 {a b}c]", "[some_proc 1]",
+		"[peek [expr {1 + 2}]]", "[pc_in_slot 1 0 2]", "abs(-1)",
+		"1 +", "(1", "[reg PC",
+	}) {
+		INFO(expr);
+		CHECK(!CompiledCondition::compile(expr));
+	}
+}
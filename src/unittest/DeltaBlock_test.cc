@@ -0,0 +1,276 @@
+#include "catch.hpp"
+#include "benchmark.hh"
+#include "DeltaBlock.hh"
+#include "ThreadPool.hh"
+#include "MemBuffer.hh"
+#include "xrange.hh"
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+
+using namespace openmsx;
+
+static void check(const DeltaBlock& block, const std::vector<uint8_t>& expected)
+{
+	std::vector<uint8_t> buf(expected.size());
+	block.apply(buf.data(), buf.size());
+	CHECK(buf == expected);
+}
+
+// Simple in-memory implementation, only used to test the spill logic.
+class TestStore final : public DeltaBlockStore
+{
+public:
+	Handle store(const uint8_t* data, size_t size) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		Handle handle;
+		handle.offset = next++;
+		handle.size = size;
+		blobs[handle.offset].assign(data, data + size);
+		return handle;
+	}
+	void load(const Handle& handle, uint8_t* dst) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto& blob = blobs.at(handle.offset);
+		REQUIRE(blob.size() == handle.size);
+		memcpy(dst, blob.data(), blob.size());
+	}
+	void release(const Handle& handle) override {
+		std::lock_guard<std::mutex> lock(mutex);
+		blobs.erase(handle.offset);
+	}
+	size_t numBlobs() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return blobs.size();
+	}
+
+private:
+	std::mutex mutex;
+	std::map<size_t, std::vector<uint8_t>> blobs;
+	size_t next = 0;
+};
+
+static void test(ThreadPool* pool)
+{
+	LastDeltaBlocks lastDeltaBlocks;
+	lastDeltaBlocks.setThreadPool(pool);
+
+	// Simulate a memory block (e.g. RAM) that gets snapshotted several
+	// times with only a few changes in between.
+	const size_t SIZE = 4096;
+	MemBuffer<uint8_t> mem(SIZE);
+	for (auto i : xrange(SIZE)) mem[i] = uint8_t(i * 7);
+
+	std::vector<std::shared_ptr<DeltaBlock>> blocks;
+	std::vector<std::vector<uint8_t>> expected;
+	for (auto n : xrange(100)) {
+		mem[(n * 97) % SIZE] ^= 0x55;
+		mem[(n * 13) % SIZE] += 1;
+		if ((n % 10) == 9) {
+			// sometimes change a large area
+			memset(mem.data() + (n * 31) % (SIZE / 2), n, SIZE / 3);
+		}
+		blocks.push_back(lastDeltaBlocks.createNew(mem.data(), mem.data(), SIZE));
+		expected.emplace_back(mem.data(), mem.data() + SIZE);
+	}
+	// changing the source memory must not influence the created blocks
+	memset(mem.data(), 0, SIZE);
+	lastDeltaBlocks.clear();
+
+	// a counter shared by all blocks, follows their (changing) sizes
+	auto counter = std::make_shared<std::atomic<size_t>>(0);
+	for (auto& block : blocks) block->setMemoryCounter(counter);
+	auto totalSize = [&] {
+		size_t result = 0;
+		for (auto& block : blocks) result += block->getMemorySize();
+		return result;
+	};
+
+	for (auto i : xrange(blocks.size())) {
+		check(*blocks[i], expected[i]);
+	}
+	CHECK(*counter == totalSize()); // (check() waits for all jobs)
+	CHECK(!blocks[0]->isRecompressRequested());
+	CHECK(!blocks[0]->isSpillRequested());
+
+	// recompress the oldest half, spill the oldest quarter
+	auto store = std::make_shared<TestStore>();
+	for (auto i : xrange(blocks.size() / 2)) {
+		blocks[i]->recompress(pool);
+	}
+	for (auto i : xrange(blocks.size() / 4)) {
+		blocks[i]->spill(store, pool);
+	}
+	for (auto i : xrange(blocks.size())) {
+		check(*blocks[i], expected[i]);
+	}
+	for (auto i : xrange(blocks.size() / 4)) {
+		CHECK(blocks[i]->getMemorySize() == 0);
+		CHECK(blocks[i]->isSpillRequested());
+		CHECK(blocks[i]->isRecompressRequested());
+	}
+	CHECK(!blocks.back()->isSpillRequested());
+	CHECK(*counter == totalSize());
+	for (auto& block : blocks) block->setMemoryCounter(nullptr);
+	CHECK(*counter == 0);
+	CHECK(store->numBlobs() != 0);
+	blocks.clear();
+	CHECK(store->numBlobs() == 0);
+}
+
+TEST_CASE("DeltaBlock")
+{
+	SECTION("synchronous") {
+		test(nullptr);
+	}
+	SECTION("thread pool") {
+		ThreadPool pool(3);
+		test(&pool);
+	}
+}
+
+static void testDirtyPages(ThreadPool* pool)
+{
+	LastDeltaBlocks lastDeltaBlocks;
+	lastDeltaBlocks.setThreadPool(pool);
+
+	const size_t SIZE = 10000; // not a multiple of the page size
+	MemBuffer<uint8_t> mem(SIZE);
+	for (auto i : xrange(SIZE)) mem[i] = uint8_t(i * 5);
+	DirtyPages dirty(SIZE);
+	CHECK(dirty.getNumPages() == 40);
+	CHECK(dirty.any()); // initially all dirty
+
+	std::vector<std::shared_ptr<DeltaBlock>> blocks;
+	std::vector<std::vector<uint8_t>> expected;
+	for (auto n : xrange(60)) {
+		auto write = [&](size_t addr, uint8_t value) {
+			mem[addr] = value;
+			dirty.mark(addr);
+		};
+		write((n * 97) % SIZE, uint8_t(n));
+		write((n * 13) % SIZE, uint8_t(n + 1));
+		write(SIZE - 1, uint8_t(n + 2)); // last (partial) page
+		if ((n % 10) == 9) {
+			auto start = (n * 31) % (SIZE / 2);
+			memset(mem.data() + start, n, SIZE / 3);
+			dirty.markRange(start, SIZE / 3);
+		}
+		blocks.push_back(lastDeltaBlocks.createNew(
+			mem.data(), mem.data(), SIZE, &dirty));
+		expected.emplace_back(mem.data(), mem.data() + SIZE);
+		CHECK(!dirty.any());
+	}
+	for (auto i : xrange(blocks.size())) {
+		check(*blocks[i], expected[i]);
+	}
+
+	// no writes -> same block
+	auto b1 = lastDeltaBlocks.createNew(mem.data(), mem.data(), SIZE, &dirty);
+	CHECK(b1 == blocks.back());
+#ifndef DEBUG // (in debug mode this triggers an assert)
+	// An unreported write is not noticed, only dirty pages are compared.
+	mem[5000] ^= 1;
+	auto b2 = lastDeltaBlocks.createNew(mem.data(), mem.data(), SIZE, &dirty);
+	CHECK(b2 == b1);
+	// A different history doesn't rely on the dirty state.
+	LastDeltaBlocks other;
+	auto b3 = other.createNew(mem.data(), mem.data(), SIZE, &dirty);
+	check(*b3, std::vector<uint8_t>(mem.data(), mem.data() + SIZE));
+	mem[5000] ^= 1;
+#endif
+}
+
+TEST_CASE("DeltaBlock: dirty pages")
+{
+	SECTION("synchronous") {
+		testDirtyPages(nullptr);
+	}
+	SECTION("thread pool") {
+		ThreadPool pool(3);
+		testDirtyPages(&pool);
+	}
+}
+
+static const char* const simdNames[] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+static constexpr DeltaBlock::Simd allSimd[] = {
+	DeltaBlock::Simd::SCALAR, DeltaBlock::Simd::SSE2,
+	DeltaBlock::Simd::AVX2, DeltaBlock::Simd::AVX512,
+};
+
+TEST_CASE("DeltaBlock: all instruction sets")
+{
+	auto orig = DeltaBlock::getSimd();
+	CHECK(DeltaBlock::isSupported(orig));
+
+	// Differences at all positions relative to the (16, 32 or 64 byte)
+	// words, both buffers equally and differently aligned, and buffer
+	// sizes around the minimum size for the word-at-a-time loop.
+	std::vector<uint8_t> oldBuf(1024), newBuf(1024);
+	for (auto i : xrange(oldBuf.size())) oldBuf[i] = uint8_t(i * 3);
+	for (auto simd : allSimd) {
+		if (!DeltaBlock::isSupported(simd)) continue;
+		INFO(simdNames[int(simd)]);
+		DeltaBlock::setSimd(simd);
+		for (size_t size : {1, 15, 16, 31, 33, 79, 80, 127, 128, 129, 200, 500}) {
+			for (size_t oldOffset : {0, 1, 8}) {
+				for (size_t newOffset : {0, 3, 8}) {
+					auto ref = std::make_shared<DeltaBlockCopy>(&oldBuf[oldOffset], size);
+					for (size_t pos = 0; pos < size; pos += 7) {
+						std::copy_n(&oldBuf[oldOffset], size, &newBuf[newOffset]);
+						newBuf[newOffset + pos] ^= 1;
+						if (pos + 40 < size) newBuf[newOffset + pos + 40] ^= 2;
+						DeltaBlockDiff diff(ref, &newBuf[newOffset], size);
+						check(diff, std::vector<uint8_t>(&newBuf[newOffset], &newBuf[newOffset + size]));
+						CHECK(diff.getDeltaSize() != 0);
+					}
+					// no differences
+					std::copy_n(&oldBuf[oldOffset], size, &newBuf[newOffset]);
+					DeltaBlockDiff diff(ref, &newBuf[newOffset], size);
+					check(diff, std::vector<uint8_t>(&oldBuf[oldOffset], &oldBuf[oldOffset + size]));
+				}
+			}
+		}
+	}
+	DeltaBlock::setSimd(orig);
+}
+
+// The speed of calculating diffs with the different instruction sets, for a
+// 1MB RAM with only a few changes since the previous snapshot.
+TEST_CASE("DeltaBlock: benchmark", "[.benchmark]")
+{
+	const size_t SIZE = 1024 * 1024;
+	auto oldBuf = benchmark::ramLikeData(SIZE);
+	auto newBuf = oldBuf;
+	std::mt19937 gen(5678);
+	for (auto n : xrange(100)) {
+		(void)n;
+		// some small (stack, variables) and larger (buffers) changes
+		auto pos = gen() % (SIZE - 256);
+		auto len = (gen() % 8) ? (1 + gen() % 8) : (gen() % 256);
+		for (auto i : xrange(len)) newBuf[pos + i] ^= 0xff;
+	}
+	auto ref = std::make_shared<DeltaBlockCopy>(oldBuf.data(), SIZE);
+
+	auto orig = DeltaBlock::getSimd();
+	for (auto simd : allSimd) {
+		if (!DeltaBlock::isSupported(simd)) continue;
+		DeltaBlock::setSimd(simd);
+		const int REPEAT = 200;
+		size_t total = 0;
+		auto duration = benchmark::measure([&] {
+			for ([[maybe_unused]] auto r : xrange(REPEAT)) {
+				DeltaBlockDiff diff(ref, newBuf.data(), SIZE);
+				total += diff.getDeltaSize();
+			}
+		});
+		std::cout << simdNames[int(simd)] << ": "
+		          << (double(SIZE) * REPEAT / duration) / (1024 * 1024 * 1024)
+		          << " GB/s\n";
+		CHECK(total != 0);
+	}
+	DeltaBlock::setSimd(orig);
+}
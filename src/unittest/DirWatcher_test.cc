@@ -0,0 +1,63 @@
+#include "catch.hpp"
+#include "DirWatcher.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "systemfuncs.hh"
+#include <string>
+#include <unistd.h>
+
+using namespace openmsx;
+
+TEST_CASE("DirWatcher: fallback")
+{
+	// Can't be watched (and without inotify nothing can), so every call
+	// must report (possible) changes, forcing the caller to poll.
+	auto dir = FileOperations::getTempDir() + "/openmsx_dirwatcher_does_not_exist/";
+	DirWatcher watcher(dir);
+	CHECK(watcher.hasChanges());
+	watcher.clear();
+	CHECK(watcher.hasChanges());
+	watcher.clear();
+	CHECK(watcher.hasChanges());
+}
+
+#if HAVE_INOTIFY_INIT1
+TEST_CASE("DirWatcher: inotify")
+{
+	auto dir = FileOperations::getTempDir() +
+	           "/openmsx_dirwatcher_test_" + std::to_string(getpid()) + '/';
+	FileOperations::deleteRecursive(dir);
+	FileOperations::mkdirp(dir);
+	{
+		DirWatcher watcher(dir);
+		CHECK(watcher.hasChanges()); // initially true
+		watcher.clear();
+		CHECK(!watcher.hasChanges());
+
+		// new file
+		File(dir + "a", File::TRUNCATE).write("x", 1);
+		CHECK(watcher.hasChanges());
+		watcher.clear();
+		CHECK(!watcher.hasChanges());
+
+		// new subdirectory, and a file in it
+		FileOperations::mkdirp(dir + "sub");
+		CHECK(watcher.hasChanges());
+		watcher.clear();
+		File(dir + "sub/b", File::TRUNCATE).write("y", 1);
+		CHECK(watcher.hasChanges());
+		watcher.clear();
+
+		// subdirectories starting with a '.' are not watched
+		FileOperations::mkdirp(dir + ".hidden");
+		watcher.clear();
+		File(dir + ".hidden/c", File::TRUNCATE).write("z", 1);
+		CHECK(!watcher.hasChanges());
+
+		// removed file
+		FileOperations::unlink(dir + "a");
+		CHECK(watcher.hasChanges());
+	}
+	FileOperations::deleteRecursive(dir);
+}
+#endif
@@ -0,0 +1,90 @@
+#include "catch.hpp"
+#include "InstructionTrace.hh"
+#include "CPURegs.hh"
+#include "EmuDuration.hh"
+#include "EmuTime.hh"
+#include "StringOp.hh"
+#include "strCat.hh"
+#include <string>
+
+using namespace openmsx;
+
+static void record(InstructionTraceBuffer& trace, CPURegs& regs, uint64_t n)
+{
+	static constexpr byte NOP[4] = {0x00, 0x00, 0x00, 0x00};
+	regs.setPC(word(n));
+	trace.record(regs, EmuTime::zero() + EmuDuration(n), NOP, false);
+}
+
+TEST_CASE("InstructionTrace: ring buffer")
+{
+	static constexpr auto CAP = InstructionTraceBuffer::CAPACITY;
+	InstructionTraceBuffer trace;
+	CPURegs regs(false);
+	CHECK(trace.size() == 0);
+
+	// not yet full
+	for (uint64_t n = 0; n < 10; ++n) record(trace, regs, n);
+	CHECK(trace.size() == 10);
+	CHECK(trace[0].time == 0);
+	CHECK(trace[9].time == 9);
+
+	// fill up exactly
+	for (uint64_t n = 10; n < CAP; ++n) record(trace, regs, n);
+	CHECK(trace.size() == CAP);
+	CHECK(trace[0].time == 0);
+	CHECK(trace[CAP - 1].time == CAP - 1);
+
+	// wrap around: the oldest entries get overwritten
+	for (uint64_t n = CAP; n < CAP + 123; ++n) record(trace, regs, n);
+	CHECK(trace.size() == CAP);
+	CHECK(trace[0].time == 123);
+	CHECK(trace[0].pc == 123);
+	CHECK(trace[CAP - 1].time == CAP + 122);
+	CHECK(trace[CAP - 1].pc == word(CAP + 122));
+	for (unsigned i = 1; i < CAP; ++i) {
+		REQUIRE(trace[i].time == trace[i - 1].time + 1);
+	}
+
+	trace.clear();
+	CHECK(trace.size() == 0);
+	record(trace, regs, 7);
+	CHECK(trace.size() == 1);
+	CHECK(trace[0].time == 7);
+}
+
+TEST_CASE("InstructionTrace: format")
+{
+	InstructionTraceBuffer trace;
+	CPURegs regs(false);
+	regs.setAF(0x1234); regs.setBC(0x2345); regs.setDE(0x3456);
+	regs.setHL(0x4567); regs.setIX(0x5678); regs.setIY(0x6789);
+	regs.setSP(0xF000); regs.setAF2(0xA1B2); regs.setBC2(0xB2C3);
+	regs.setDE2(0xC3D4); regs.setHL2(0xD4E5);
+	regs.setI(0x3F); regs.setR(0x42); regs.setIM(1);
+	regs.setIFF1(true); regs.setIFF2(false);
+	regs.setPC(0x4010);
+
+	static constexpr byte LD_A_N[4] = {0x3E, 0x99, 0xFF, 0xFF}; // ld a,#99
+	trace.record(regs, EmuTime::zero(), LD_A_N, false);
+	regs.setPC(0x4012);
+	static constexpr byte LD_IX_D_N[4] = {0xDD, 0x36, 0x05, 0x77}; // ld (ix+#05),#77
+	trace.record(regs, EmuTime::zero(), LD_IX_D_N, true);
+	REQUIRE(trace.size() == 2);
+
+	std::string result, dasmOutput;
+	InstructionTraceBuffer::format(trace[0], result, dasmOutput);
+	InstructionTraceBuffer::format(trace[1], result, dasmOutput);
+
+	auto lines = StringOp::split(result, '\n');
+	REQUIRE(lines.size() == 2);
+	CHECK(result.back() == '\n');
+
+	std::string_view regsStr =
+		" AF=1234 BC=2345 DE=3456 HL=4567 IX=5678 IY=6789 SP=f000"
+		" AF'=a1b2 BC'=b2c3 DE'=c3d4 HL'=d4e5 I=3f R=42 IM=1 IFF=1";
+
+	// unused opcode bytes and short mnemonics are padded, so the columns line up
+	CHECK(lines[0] == strCat("0 z80  4010  3e 99       ld     a,#99       ", regsStr));
+	CHECK(lines[1] == strCat("0 r800 4012  dd 36 05 77 ld     (ix+#05),#77", regsStr));
+}
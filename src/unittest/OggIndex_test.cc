@@ -0,0 +1,176 @@
+#include "catch.hpp"
+#include "components.hh"
+
+#if COMPONENT_LASERDISC
+
+#include "OggIndex.hh"
+#include "MemoryBufferFile.hh"
+#include "File.hh"
+#include "MSXException.hh"
+#include "endian.hh"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace openmsx;
+
+constexpr int VIDEO_SERIAL = 0x1234;
+constexpr int AUDIO_SERIAL = 0x5678;
+constexpr int GRANULE_SHIFT = 6;
+
+// Append an ogg page with the given header fields and a body of 'bodySize'
+// (dummy) bytes. Returns the offset of the page.
+static size_t addPage(std::vector<uint8_t>& ogg, int serial, int64_t granulePos,
+                      size_t bodySize)
+{
+	auto offset = ogg.size();
+	unsigned numSegments = unsigned(bodySize / 255 + 1);
+	ogg.resize(offset + 27 + numSegments + bodySize, 0xAA);
+	auto* p = &ogg[offset];
+	memcpy(p, "OggS", 4);
+	p[4] = 0; // version
+	p[5] = 0; // header type
+	Endian::write_UA_L64(p + 6, uint64_t(granulePos));
+	Endian::write_UA_L32(p + 14, serial);
+	Endian::write_UA_L32(p + 18, 0); // page sequence number
+	Endian::write_UA_L32(p + 22, 0); // crc (not checked)
+	p[26] = uint8_t(numSegments);
+	for (unsigned i = 0; i < numSegments; ++i) {
+		p[27 + i] = uint8_t((i == numSegments - 1) ? bodySize % 255 : 255);
+	}
+	return offset;
+}
+
+static int64_t videoGranule(size_t keyFrame, size_t frame)
+{
+	return int64_t((keyFrame << GRANULE_SHIFT) | (frame - keyFrame));
+}
+
+TEST_CASE("OggIndex")
+{
+	std::vector<uint8_t> ogg;
+	// header pages, no packet ends in these
+	addPage(ogg, VIDEO_SERIAL, -1, 100);
+	addPage(ogg, AUDIO_SERIAL, -1, 300);
+	auto v1 = addPage(ogg, VIDEO_SERIAL, videoGranule(1, 1), 1000);
+	auto a1 = addPage(ogg, AUDIO_SERIAL, 1000, 400);
+	auto v2 = addPage(ogg, VIDEO_SERIAL, videoGranule(1, 4), 50);
+	auto a2 = addPage(ogg, AUDIO_SERIAL, 2000, 400);
+	auto v3 = addPage(ogg, VIDEO_SERIAL, videoGranule(5, 5), 2000);
+	addPage(ogg, 999, 42, 10); // unrelated stream
+	auto v4 = addPage(ogg, VIDEO_SERIAL, videoGranule(5, 9), 70);
+	auto a3 = addPage(ogg, AUDIO_SERIAL, 3000, 400);
+
+	std::atomic<bool> abort = false;
+	File file = memory_buffer_file(ogg);
+	auto idx = OggIndex::build(file, VIDEO_SERIAL, AUDIO_SERIAL, GRANULE_SHIFT, abort);
+	REQUIRE(idx);
+
+	SECTION("build") {
+		CHECK(idx->fileSize == ogg.size());
+		REQUIRE(idx->video.size() == 4);
+		CHECK(idx->video[0].offset == v1);
+		CHECK(idx->video[0].keyFrame == 1);
+		CHECK(idx->video[0].frame == 1);
+		CHECK(idx->video[1].offset == v2);
+		CHECK(idx->video[1].frame == 4);
+		CHECK(idx->video[2].offset == v3);
+		CHECK(idx->video[2].keyFrame == 5);
+		CHECK(idx->video[3].offset == v4);
+		CHECK(idx->video[3].keyFrame == 5);
+		CHECK(idx->video[3].frame == 9);
+		REQUIRE(idx->audio.size() == 3);
+		CHECK(idx->audio[0].offset == a1);
+		CHECK(idx->audio[0].sample == 1000);
+		CHECK(idx->audio[1].offset == a2);
+		CHECK(idx->audio[2].offset == a3);
+		CHECK(idx->audio[2].sample == 3000);
+		CHECK(idx->getTotalFrames() == 9);
+	}
+	SECTION("build: truncated file") {
+		// the last page is incomplete, the others are still indexed
+		auto truncated = ogg;
+		truncated.resize(a3 + 20);
+		File file2 = memory_buffer_file(truncated);
+		auto idx2 = OggIndex::build(file2, VIDEO_SERIAL, AUDIO_SERIAL, GRANULE_SHIFT, abort);
+		REQUIRE(idx2);
+		CHECK(idx2->video.size() == 4);
+		CHECK(idx2->audio.size() == 2);
+	}
+	SECTION("build: damaged, aborted or without audio") {
+		auto damaged = ogg;
+		damaged[v3] = 'X';
+		File file2 = memory_buffer_file(damaged);
+		CHECK_THROWS_AS(OggIndex::build(file2, VIDEO_SERIAL, AUDIO_SERIAL, GRANULE_SHIFT, abort),
+		                MSXException);
+
+		File file3 = memory_buffer_file(ogg);
+		CHECK(!OggIndex::build(file3, VIDEO_SERIAL, 4321, GRANULE_SHIFT, abort));
+
+		abort = true;
+		File file4 = memory_buffer_file(ogg);
+		CHECK(!OggIndex::build(file4, VIDEO_SERIAL, AUDIO_SERIAL, GRANULE_SHIFT, abort));
+	}
+	SECTION("save and load") {
+		auto buf = idx->save();
+		auto loaded = OggIndex::load(buf, idx->fileSize, idx->modificationTime);
+		REQUIRE(loaded);
+		REQUIRE(loaded->video.size() == idx->video.size());
+		for (size_t i = 0; i < idx->video.size(); ++i) {
+			CHECK(loaded->video[i].offset   == idx->video[i].offset);
+			CHECK(loaded->video[i].keyFrame == idx->video[i].keyFrame);
+			CHECK(loaded->video[i].frame    == idx->video[i].frame);
+		}
+		REQUIRE(loaded->audio.size() == idx->audio.size());
+		for (size_t i = 0; i < idx->audio.size(); ++i) {
+			CHECK(loaded->audio[i].offset == idx->audio[i].offset);
+			CHECK(loaded->audio[i].sample == idx->audio[i].sample);
+		}
+
+		// for a different version of the file
+		CHECK(!OggIndex::load(buf, idx->fileSize + 1, idx->modificationTime));
+		CHECK(!OggIndex::load(buf, idx->fileSize, idx->modificationTime + 1));
+
+		// truncated
+		auto truncated = buf;
+		truncated.pop_back();
+		CHECK(!OggIndex::load(truncated, idx->fileSize, idx->modificationTime));
+		CHECK(!OggIndex::load(span<const uint8_t>(buf.data(), 20), idx->fileSize, idx->modificationTime));
+
+		// page counts that overflow when multiplied by the page size
+		auto damaged = buf;
+		Endian::write_UA_L64(&damaged[24], (uint64_t(1) << 61) + 4);
+		CHECK(!OggIndex::load(damaged, idx->fileSize, idx->modificationTime));
+		damaged = buf;
+		Endian::write_UA_L64(&damaged[32], (uint64_t(1) << 60) + 3);
+		CHECK(!OggIndex::load(damaged, idx->fileSize, idx->modificationTime));
+	}
+	SECTION("find") {
+		// before the first key frame: from the start
+		auto pos = idx->find(0, 0);
+		CHECK(pos.offset == 0);
+		CHECK(pos.keyFrame == 1);
+
+		// key frame 1, the first video page completes frame 1
+		pos = idx->find(3, 500);
+		CHECK(pos.keyFrame == 1);
+		CHECK(pos.offset == 0);
+
+		// key frame 5: start at the page that completes frame 4
+		pos = idx->find(7, 2500);
+		CHECK(pos.keyFrame == 5);
+		CHECK(pos.offset == v2);
+
+		// audio needs an earlier start than video
+		pos = idx->find(7, 1500);
+		CHECK(pos.keyFrame == 5);
+		CHECK(pos.offset == a1);
+
+		// past the end is clamped to the last frame and sample
+		pos = idx->find(1000, 100000);
+		CHECK(pos.keyFrame == 5);
+		CHECK(pos.offset == v2);
+	}
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "catch.hpp"
+#include "benchmark.hh"
+#include "PoolAllocator.hh"
+#include "InputEvents.hh"
+#include "circular_buffer.hh"
+#include "xrange.hh"
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+using namespace openmsx;
+
+struct Small { int a[4]; };
+struct Big { int a[64]; };
+
+TEST_CASE("PoolAllocator: blocks are recycled")
+{
+	auto& pool = BlockPool<64>::instance();
+
+	auto p1 = make_pooled_shared<Small>();
+	p1->a[3] = 42;
+	const void* addr = p1.get();
+	auto before = pool.getNumFree();
+	p1.reset();
+	CHECK(pool.getNumFree() == before + 1);
+
+	// the freed block is reused for the next allocation
+	auto p2 = make_pooled_shared<Small>();
+	CHECK(p2.get() == addr);
+	CHECK(pool.getNumFree() == before);
+
+	// objects that don't fit in a block don't use the pool
+	auto p3 = make_pooled_shared<Big>();
+	p3.reset();
+	CHECK(pool.getNumFree() == before);
+
+	// the (small) input events do fit
+	auto e = make_pooled_shared<KeyDownEvent>(Keys::K_A, 'a');
+	std::shared_ptr<const Event> e2 = e;
+	CHECK(e2->getType() == OPENMSX_KEY_DOWN_EVENT);
+	e.reset();
+	e2.reset();
+	CHECK(pool.getNumFree() == before + 1);
+}
+
+// Create 'num' key events and pass them through a queue, like
+// EventDistributor does.
+template<typename Create>
+static uint64_t eventThroughput(unsigned num, Create create)
+{
+	cb_queue<std::shared_ptr<const Event>> queue(256);
+	uint64_t sum = 0;
+	for (auto i : xrange(num / 64)) {
+		for (auto j : xrange(64u)) {
+			queue.push_back(create(Keys::KeyCode(Keys::K_A + (i + j) % 26)));
+		}
+		while (!queue.empty()) {
+			auto event = queue.pop_front();
+			switch (event->getType()) {
+			case OPENMSX_KEY_DOWN_EVENT:
+			case OPENMSX_KEY_UP_EVENT: {
+				auto& keyEvent = static_cast<const KeyEvent&>(*event);
+				sum += keyEvent.getKeyCode();
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+	return sum;
+}
+
+template<typename Create>
+static void printThroughput(const char* name, Create create)
+{
+	constexpr unsigned NUM = 1 << 22;
+	uint64_t sum = 0;
+	auto seconds = benchmark::measure([&] { sum = eventThroughput(NUM, create); });
+	std::cout << name << ": " << NUM / seconds / 1e6
+	          << " Mevents/s (" << sum << ")\n";
+}
+
+// Allocating the events is a large part of their cost, compare the default
+// allocator with the pool.
+TEST_CASE("PoolAllocator: event throughput benchmark", "[.benchmark]")
+{
+	printThroughput("make_shared", [](Keys::KeyCode key) {
+		return std::make_shared<KeyDownEvent>(key);
+	});
+	printThroughput("make_pooled_shared", [](Keys::KeyCode key) {
+		return make_pooled_shared<KeyDownEvent>(key);
+	});
+}
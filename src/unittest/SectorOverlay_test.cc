@@ -0,0 +1,134 @@
+#include "catch.hpp"
+#include "SectorOverlay.hh"
+#include "serialize.hh"
+#include "FileOperations.hh"
+#include "MSXException.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace openmsx;
+
+static SectorBuffer makeSector(byte value)
+{
+	SectorBuffer buf;
+	for (auto i : xrange(sizeof(buf.raw))) {
+		buf.raw[i] = byte(value + i);
+	}
+	return buf;
+}
+
+static bool equal(const SectorBuffer& a, const SectorBuffer& b)
+{
+	return std::equal(std::begin(a.raw), std::end(a.raw), std::begin(b.raw));
+}
+
+TEST_CASE("SectorOverlay: read/write")
+{
+	SectorOverlay overlay;
+	CHECK(overlay.empty());
+
+	SectorBuffer buf;
+	CHECK(!overlay.read(5, buf));
+
+	overlay.write(5, makeSector(1));
+	overlay.write(1000000, makeSector(2));
+	CHECK(overlay.size() == 2);
+	REQUIRE(overlay.read(5, buf));
+	CHECK(equal(buf, makeSector(1)));
+	REQUIRE(overlay.read(1000000, buf));
+	CHECK(equal(buf, makeSector(2)));
+	CHECK(!overlay.read(6, buf));
+
+	// overwrite
+	overlay.write(5, makeSector(3));
+	CHECK(overlay.size() == 2);
+	REQUIRE(overlay.read(5, buf));
+	CHECK(equal(buf, makeSector(3)));
+
+	overlay.clear();
+	CHECK(overlay.empty());
+	CHECK(!overlay.read(5, buf));
+}
+
+TEST_CASE("SectorOverlay: commit")
+{
+	SectorOverlay overlay;
+	overlay.write(7, makeSector(7));
+	overlay.write(3, makeSector(3));
+	overlay.write(9, makeSector(9));
+
+	SECTION("success") {
+		std::vector<SectorBuffer> image(10, makeSector(0));
+		std::vector<size_t> order;
+		overlay.commit([&](size_t sector, const SectorBuffer& buf) {
+			order.push_back(sector);
+			image[sector] = buf;
+		});
+		CHECK(overlay.empty());
+		CHECK(order == std::vector<size_t>{3, 7, 9});
+		CHECK(equal(image[3], makeSector(3)));
+		CHECK(equal(image[7], makeSector(7)));
+		CHECK(equal(image[9], makeSector(9)));
+		CHECK(equal(image[4], makeSector(0)));
+	}
+	SECTION("write error") {
+		// the second write fails: sector 3 is committed, 7 and 9 remain
+		CHECK_THROWS_AS(overlay.commit([&](size_t sector, const SectorBuffer& /*buf*/) {
+			if (sector == 7) throw MSXException("write error");
+		}), MSXException);
+		CHECK(overlay.size() == 2);
+		SectorBuffer buf;
+		CHECK(!overlay.read(3, buf));
+		CHECK(overlay.read(7, buf));
+		CHECK(overlay.read(9, buf));
+	}
+}
+
+struct OverlayState
+{
+	SectorOverlay overlay;
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned version)
+	{
+		overlay.serialize(ar, version);
+	}
+};
+
+template<typename OutArchive, typename InArchive>
+static void checkLoadState(const std::string& filename)
+{
+	OverlayState saved;
+	saved.overlay.write(42, makeSector(42));
+	saved.overlay.write(3, makeSector(3));
+	{
+		OutArchive out(filename);
+		out.serialize("state", saved);
+		out.close();
+	}
+
+	// loading replaces the current content
+	OverlayState loaded;
+	loaded.overlay.write(5, makeSector(5));
+	{
+		InArchive in(filename);
+		in.serialize("state", loaded);
+	}
+	CHECK(loaded.overlay.size() == 2);
+	SectorBuffer buf;
+	REQUIRE(loaded.overlay.read(42, buf));
+	CHECK(equal(buf, makeSector(42)));
+	REQUIRE(loaded.overlay.read(3, buf));
+	CHECK(equal(buf, makeSector(3)));
+	CHECK(!loaded.overlay.read(5, buf));
+	FileOperations::unlink(filename);
+}
+
+TEST_CASE("SectorOverlay: loadstate")
+{
+	auto dir = FileOperations::getTempDir();
+	checkLoadState<XmlOutputArchive, XmlInputArchive>(dir + "/openmsx_overlay_test.xml.gz");
+	checkLoadState<BinOutputArchive, BinInputArchive>(dir + "/openmsx_overlay_test.oms");
+}
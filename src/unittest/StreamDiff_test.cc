@@ -0,0 +1,123 @@
+#include "catch.hpp"
+#include "StreamDiff.hh"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace openmsx;
+
+struct Record {
+	uint32_t offset;
+	std::vector<byte> data;
+};
+
+static uint32_t readLE32(const std::string& s, size_t pos)
+{
+	uint32_t result = 0;
+	for (int i = 3; i >= 0; --i) {
+		result = (result << 8) | uint8_t(s[pos + i]);
+	}
+	return result;
+}
+
+static std::vector<Record> diff(const std::vector<byte>& current,
+                                const std::vector<byte>& previous)
+{
+	std::string out = "prefix";
+	appendStreamDiff(out, current, previous);
+	REQUIRE(out.substr(0, 6) == "prefix"); // only appends
+
+	std::vector<Record> result;
+	size_t pos = 6;
+	while (pos != out.size()) {
+		REQUIRE((pos + 8) <= out.size());
+		auto offset = readLE32(out, pos);
+		auto length = readLE32(out, pos + 4);
+		pos += 8;
+		REQUIRE((pos + length) <= out.size());
+		result.push_back({offset, std::vector<byte>(
+			out.begin() + pos, out.begin() + pos + length)});
+		pos += length;
+	}
+	return result;
+}
+
+// Applying the records to 'previous' must give 'current'.
+static void checkApply(const std::vector<byte>& current,
+                       const std::vector<byte>& previous)
+{
+	auto result = previous;
+	for (const auto& r : diff(current, previous)) {
+		REQUIRE((r.offset + r.data.size()) <= result.size());
+		std::copy(r.data.begin(), r.data.end(), result.begin() + r.offset);
+	}
+	CHECK(result == current);
+}
+
+TEST_CASE("appendStreamDiff")
+{
+	std::vector<byte> prev(32);
+	for (size_t i = 0; i < prev.size(); ++i) prev[i] = byte(i);
+
+	SECTION("first message: the whole range") {
+		auto records = diff(prev, {});
+		REQUIRE(records.size() == 1);
+		CHECK(records[0].offset == 0);
+		CHECK(records[0].data == prev);
+	}
+	SECTION("size changed: the whole range") {
+		std::vector<byte> cur(prev.begin(), prev.begin() + 10);
+		auto records = diff(cur, prev);
+		REQUIRE(records.size() == 1);
+		CHECK(records[0].offset == 0);
+		CHECK(records[0].data == cur);
+	}
+	SECTION("no changes") {
+		CHECK(diff(prev, prev).empty());
+		CHECK(diff({}, {}).empty());
+	}
+	SECTION("single byte") {
+		auto cur = prev;
+		cur[5] = 99;
+		auto records = diff(cur, prev);
+		REQUIRE(records.size() == 1);
+		CHECK(records[0].offset == 5);
+		CHECK(records[0].data == std::vector<byte>{99});
+	}
+	SECTION("first and last byte") {
+		auto cur = prev;
+		cur[0] = 99;
+		cur[31] = 98;
+		auto records = diff(cur, prev);
+		REQUIRE(records.size() == 2);
+		CHECK(records[0].offset == 0);
+		CHECK(records[0].data == std::vector<byte>{99});
+		CHECK(records[1].offset == 31);
+		CHECK(records[1].data == std::vector<byte>{98});
+	}
+	SECTION("short gaps are merged") {
+		// a gap of 7 unchanged bytes is merged, a gap of 8 bytes (the
+		// size of a record header) is not
+		auto cur = prev;
+		cur[2] = 99;
+		cur[10] = 99; // gap of 7
+		cur[19] = 99; // gap of 8
+		auto records = diff(cur, prev);
+		REQUIRE(records.size() == 2);
+		CHECK(records[0].offset == 2);
+		CHECK(records[0].data.size() == 9);
+		CHECK(records[1].offset == 19);
+		CHECK(records[1].data == std::vector<byte>{99});
+	}
+	SECTION("apply") {
+		for (unsigned seed = 0; seed < 100; ++seed) {
+			auto cur = prev;
+			unsigned x = seed;
+			for (int i = 0; i < 5; ++i) {
+				x = x * 1103515245 + 12345;
+				cur[(x >> 16) % cur.size()] ^= byte(x >> 8) | 1;
+			}
+			checkApply(cur, prev);
+		}
+	}
+}
@@ -2,6 +2,7 @@
 #include "TigerTree.hh"
 #include "tiger.hh"
 #include <cstring>
+#include <vector>
 
 using namespace openmsx;
 
@@ -20,6 +21,28 @@ struct TTTestData final : public TTData
 	uint8_t* buffer;
 };
 
+// Straightforward (non-incremental) tiger-tree-hash implementation.
+static std::string referenceHash(const uint8_t* data, size_t size)
+{
+	std::vector<TigerHash> level;
+	for (size_t offset = 0; offset < size; offset += 1024) {
+		std::vector<uint8_t> leaf(1, 0); // prefix byte
+		leaf.insert(leaf.end(), data + offset, data + std::min(offset + 1024, size));
+		tiger(leaf.data(), leaf.size(), level.emplace_back());
+	}
+	while (level.size() > 1) {
+		std::vector<TigerHash> next;
+		for (size_t i = 0; i < level.size(); i += 2) {
+			if ((i + 1) < level.size()) {
+				tiger_int(level[i], level[i + 1], next.emplace_back());
+			} else {
+				next.push_back(level[i]); // promote unpaired node
+			}
+		}
+		level = std::move(next);
+	}
+	return level[0].toString();
+}
 
 // TODO check that hash (re)calculation is indeed incremental
 
@@ -79,3 +102,59 @@ TEST_CASE("TigerTree")
 		       "SJUYB3QVIJXNKZMSQZGIMHA7GA2MYU2UECDA26A");
 	}
 }
+
+TEST_CASE("TigerTree: parallel and persisted")
+{
+	constexpr size_t SIZE = 1000 * 1024 + 300; // many blocks, last is partial
+	std::vector<uint8_t> buffer_(SIZE + 1);
+	uint8_t* buffer = buffer_.data() + 1;
+	for (size_t i = 0; i < SIZE; ++i) buffer[i] = uint8_t(i * 7 + (i >> 10));
+	TTTestData data;
+	data.buffer = buffer;
+	std::string name = "persisted";
+	time_t time = 1234;
+	auto dummyCallback = [](size_t, size_t) {};
+
+	std::vector<uint8_t> saved;
+	{
+		TigerTree tt(data, SIZE, name);
+		CHECK(tt.calcHash(dummyCallback).toString() == referenceHash(buffer, SIZE));
+		tt.notifyChange(0, 1, time); // only to set the time
+		CHECK(tt.needsCacheSave());
+		saved = tt.saveCache(time);
+		CHECK(!tt.needsCacheSave());
+		CHECK(!tt.isCacheHeaderValid(saved)); // already calculated
+		CHECK(tt.calcHash(dummyCallback).toString() == referenceHash(buffer, SIZE));
+		CHECK(tt.needsCacheSave()); // block 0 got rehashed
+		saved = tt.saveCache(time);
+	}
+	SECTION("unchanged") {
+		TigerTree tt(data, SIZE, name); // starts with an empty cache
+		tt.notifyChange(0, 1, time);
+		CHECK(tt.getCacheSize() == saved.size());
+		CHECK(tt.isCacheHeaderValid(span<const uint8_t>(saved.data(), TigerTree::CACHE_HEADER_SIZE)));
+		REQUIRE(tt.loadCache(saved));
+		CHECK(!tt.needsCacheSave());
+		CHECK(tt.calcHash(dummyCallback).toString() == referenceHash(buffer, SIZE));
+		CHECK(!tt.needsCacheSave()); // only hashed nodes below the persisted level
+	}
+	SECTION("changed after loading") {
+		TigerTree tt(data, SIZE, name);
+		tt.notifyChange(0, 1, time);
+		REQUIRE(tt.loadCache(saved));
+		memset(buffer + 300 * 1024 + 5, 0xFF, 3000); // spans 4 blocks
+		tt.notifyChange(300 * 1024 + 5, 3000, time);
+		memset(buffer + SIZE - 10, 0xFF, 10); // partial last block
+		tt.notifyChange(SIZE - 10, 10, time);
+		CHECK(tt.calcHash(dummyCallback).toString() == referenceHash(buffer, SIZE));
+	}
+	SECTION("rejected") {
+		TigerTree tt(data, SIZE, name);
+		tt.notifyChange(0, 1, time + 1);
+		CHECK(!tt.isCacheHeaderValid(saved));
+		CHECK(!tt.loadCache(saved)); // different time
+		TigerTree tt2(data, SIZE - 1, name);
+		tt2.notifyChange(0, 1, time);
+		CHECK(!tt2.loadCache(saved)); // different size
+	}
+}
@@ -0,0 +1,105 @@
+#include "catch.hpp"
+#include "YM2413Okazaki.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace openmsx;
+using YM2413Okazaki::YM2413;
+
+struct RegWrite { byte reg, value; unsigned samples; };
+
+// A bit of everything: all ROM instruments (with and without AM, vibrato and
+// feedback), a custom instrument, sustain, key-off and rhythm mode. The
+// number of samples between the register writes is deliberately irregular.
+static std::vector<RegWrite> createScript()
+{
+	std::vector<RegWrite> result;
+	auto write = [&](byte reg, byte value, unsigned samples = 0) {
+		result.push_back({reg, value, samples});
+	};
+	// custom instrument
+	for (auto [r, v] : {std::pair<byte, byte>
+			{0x00, 0x21}, {0x01, 0x21}, {0x02, 0x1E}, {0x03, 0x17},
+			{0x04, 0xF0}, {0x05, 0x7F}, {0x06, 0x00}, {0x07, 0x17}}) {
+		write(r, v);
+	}
+	for (auto instr : xrange(16)) {
+		auto ch = byte(instr % 9);
+		write(0x30 + ch, byte((instr << 4) | (instr & 7)));
+		write(0x10 + ch, byte(0x57 + 13 * instr));
+		write(0x20 + ch, byte(0x10 | (instr & 0x0E)), 1000 + 173 * instr);
+		if (instr & 1) {
+			write(0x20 + ch, byte(0x20 | (instr & 0x0E)), 777);
+		} else {
+			write(0x20 + ch, byte(instr & 0x0E), 333);
+		}
+	}
+	// custom instrument with AM, without feedback
+	write(0x00, 0xA1); write(0x01, 0xA2); write(0x03, 0x00);
+	write(0x30, 0x03); write(0x10, 0x80);
+	write(0x20, 0x1A, 3000);
+	write(0x01, 0x22, 1500);
+	write(0x20, 0x0A, 500);
+	// rhythm
+	write(0x0E, 0x20);
+	write(0x36, 0x01); write(0x37, 0x11); write(0x38, 0x11);
+	write(0x16, 0x20); write(0x17, 0x50); write(0x18, 0xC0);
+	write(0x26, 0x05); write(0x27, 0x05); write(0x28, 0x01);
+	for (auto i : xrange(10)) {
+		write(0x0E, byte(0x20 | (1 << (i % 5))), 500 + 61 * i);
+		write(0x0E, 0x20, 201);
+	}
+	write(0x0E, 0x00, 3000);
+	return result;
+}
+
+// Returns a hash of all generated samples (of all channels).
+static uint32_t generate(YM2413Core& core, const std::vector<RegWrite>& script)
+{
+	constexpr unsigned MAX_SAMPLES = 512;
+	std::vector<float> buffer((9 + 5) * MAX_SAMPLES);
+
+	uint32_t hash = 2166136261u; // FNV-1a
+	auto addToHash = [&](int32_t value) {
+		for (auto i : xrange(4)) {
+			hash = (hash ^ ((value >> (8 * i)) & 0xFF)) * 16777619u;
+		}
+	};
+	for (const auto& w : script) {
+		core.writeReg(w.reg, w.value);
+		unsigned remaining = w.samples;
+		while (remaining) {
+			unsigned num = std::min(remaining, MAX_SAMPLES);
+			remaining -= num;
+			std::fill(buffer.begin(), buffer.end(), 0.0f);
+			float* bufs[9 + 5];
+			for (auto i : xrange(9 + 5)) {
+				bufs[i] = &buffer[i * MAX_SAMPLES];
+			}
+			core.generateChannels(bufs, num);
+			for (auto i : xrange(9 + 5)) {
+				if (!bufs[i]) { addToHash(-1); continue; }
+				for (auto j : xrange(num)) {
+					addToHash(int32_t(bufs[i][j]));
+				}
+			}
+		}
+	}
+	return hash;
+}
+
+TEST_CASE("YM2413Okazaki: golden output")
+{
+	auto script = createScript();
+	auto orig = YM2413::getSimd();
+	for (auto simd : {YM2413::Simd::SCALAR, YM2413::Simd::AVX2}) {
+		if (!YM2413::isSupported(simd)) continue;
+		INFO("simd=" << int(simd));
+		YM2413::setSimd(simd);
+		YM2413 core;
+		CHECK(generate(core, script) == 514392462u);
+	}
+	YM2413::setSimd(orig);
+}
@@ -0,0 +1,41 @@
+#ifndef UNITTEST_BENCHMARK_HH
+#define UNITTEST_BENCHMARK_HH
+
+// Helpers for the benchmarks in the unit tests. Those test cases are tagged
+// "[.benchmark]", so they're not run by default. Use
+//     unittest "[benchmark]"
+// (or 'meson test --benchmark') to run them.
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace openmsx::benchmark {
+
+/** Data that resembles (a snapshot of) MSX RAM: mostly zeros and a limited
+  * set of values. The same seed always gives the same data.
+  */
+[[nodiscard]] inline std::vector<uint8_t> ramLikeData(size_t size, unsigned seed = 1234)
+{
+	std::mt19937 gen(seed);
+	std::vector<uint8_t> result(size);
+	for (auto& b : result) {
+		b = (gen() % 4) ? 0 : uint8_t(gen() % 16);
+	}
+	return result;
+}
+
+/** Execute 'f' once, returns how long that took, in seconds. */
+template<typename F>
+[[nodiscard]] double measure(F&& f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+} // namespace openmsx::benchmark
+
+#endif
@@ -0,0 +1,59 @@
+#include "catch.hpp"
+#include "parallelFor.hh"
+#include "ThreadPool.hh"
+#include "xrange.hh"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace openmsx;
+
+TEST_CASE("parallelFor: all indices exactly once")
+{
+	for (size_t n : {0, 1, 2, 3, 17, 1000}) {
+		std::vector<std::atomic<int>> count(n);
+		parallelFor(n, [&](size_t i) { ++count[i]; });
+		for (auto i : xrange(n)) CHECK(count[i] == 1);
+	}
+}
+
+TEST_CASE("parallelFor: exceptions")
+{
+	std::atomic<int> num = 0;
+	CHECK_THROWS_AS(parallelFor(100, [&](size_t i) {
+		++num;
+		if (i == 10) throw std::runtime_error("oops");
+	}), std::runtime_error);
+	CHECK(num <= 100);
+
+	// all later calls still work
+	std::atomic<int> sum = 0;
+	parallelFor(10, [&](size_t i) { sum += int(i); });
+	CHECK(sum == 45);
+}
+
+TEST_CASE("parallelFor: doesn't wait for a busy pool")
+{
+	// Occupy all workers with a task that only finishes after the
+	// parallelFor() below. That call must then do all the work itself.
+	auto& pool = getSharedThreadPool();
+	std::atomic<bool> release = false;
+	std::vector<std::shared_future<void>> blockers;
+	for ([[maybe_unused]] auto i : xrange(pool.size())) {
+		blockers.push_back(pool.enqueue([&] { while (!release) {} }));
+	}
+	std::atomic<int> count = 0;
+	parallelFor(50, [&](size_t) { ++count; });
+	CHECK(count == 50);
+	release = true;
+	for (auto& b : blockers) b.wait();
+}
+
+TEST_CASE("parallelFor: nested")
+{
+	std::atomic<int> count = 0;
+	parallelFor(8, [&](size_t) {
+		parallelFor(8, [&](size_t) { ++count; });
+	});
+	CHECK(count == 64);
+}
@@ -0,0 +1,239 @@
+#include "catch.hpp"
+#include "benchmark.hh"
+#include "serialize.hh"
+#include "serialize_stl.hh"
+#include "File.hh"
+#include "FileOperations.hh"
+#include "MSXException.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace openmsx;
+
+struct SerTestItem
+{
+	int i = 0;
+	uint8_t b = 0;
+	double d = 0.0;
+	std::string s;
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned /*version*/)
+	{
+		ar.serialize("i", i,
+		             "b", b,
+		             "d", d,
+		             "s", s);
+	}
+};
+
+struct SerTestState
+{
+	std::vector<SerTestItem> items;
+	long long ll = 0;
+	unsigned long long ull = 0;
+	bool flag = false;
+	std::vector<uint8_t> ram;
+
+	template<typename Archive>
+	void serialize(Archive& ar, unsigned /*version*/)
+	{
+		ar.serialize("items", items,
+		             "ll", ll,
+		             "ull", ull,
+		             "flag", flag);
+		ar.serialize_blob("ram", ram.data(), ram.size());
+	}
+};
+
+namespace openmsx {
+	SERIALIZE_CLASS_VERSION(SerTestItem, 3);
+}
+
+static SerTestState createState(size_t ramSize)
+{
+	SerTestState result;
+	for (auto n : xrange(200)) {
+		result.items.push_back(SerTestItem{
+			-77 * n, uint8_t(n), n * 0.25, std::string(n % 7, 'x')});
+	}
+	result.ll = -1234567890123LL;
+	result.ull = ~0ULL;
+	result.flag = true;
+	result.ram = benchmark::ramLikeData(ramSize);
+	return result;
+}
+
+template<typename OutArchive, typename InArchive>
+static SerTestState saveAndLoad(const SerTestState& state, const std::string& filename)
+{
+	{
+		OutArchive out(filename);
+		out.serialize("state", state);
+		out.close();
+	}
+	SerTestState result;
+	result.ram.resize(state.ram.size());
+	InArchive in(filename);
+	in.serialize("state", result);
+	return result;
+}
+
+static void checkEqual(const SerTestState& a, const SerTestState& b)
+{
+	REQUIRE(a.items.size() == b.items.size());
+	for (auto n : xrange(a.items.size())) {
+		CHECK(a.items[n].i == b.items[n].i);
+		CHECK(a.items[n].b == b.items[n].b);
+		CHECK(a.items[n].d == b.items[n].d);
+		CHECK(a.items[n].s == b.items[n].s);
+	}
+	CHECK(a.ll   == b.ll);
+	CHECK(a.ull  == b.ull);
+	CHECK(a.flag == b.flag);
+	CHECK(a.ram  == b.ram);
+}
+
+TEST_CASE("serialize: Bin archive")
+{
+	auto filename = FileOperations::getTempDir() + "/openmsx_serialize_test.oms";
+	auto state = createState(64 * 1024);
+
+	auto loaded = saveAndLoad<BinOutputArchive, BinInputArchive>(state, filename);
+	checkEqual(state, loaded);
+	CHECK(BinInputArchive::isBinFile(filename));
+
+	saveAndLoad<XmlOutputArchive, XmlInputArchive>(state, filename);
+	CHECK(!BinInputArchive::isBinFile(filename));
+
+	FileOperations::unlink(filename);
+}
+
+static std::string readFile(const std::string& filename)
+{
+	File file(filename);
+	std::string result(file.getSize(), '\0');
+	file.read(result.data(), result.size());
+	return result;
+}
+
+static void writeFile(const std::string& filename, std::string_view data)
+{
+	File file(filename, File::TRUNCATE);
+	file.write(data.data(), data.size());
+}
+
+static bool loadFails(const std::string& filename)
+{
+	try {
+		SerTestState loaded;
+		loaded.ram.resize(4096);
+		BinInputArchive in(filename);
+		in.serialize("state", loaded);
+	} catch (MSXException&) {
+		return true;
+	}
+	return false;
+}
+
+TEST_CASE("serialize: corrupt Bin archive")
+{
+	auto filename = FileOperations::getTempDir() + "/openmsx_serialize_corrupt.oms";
+	auto state = createState(4096);
+	{
+		BinOutputArchive out(filename);
+		out.serialize("state", state);
+		out.close();
+	}
+	auto orig = readFile(filename);
+	REQUIRE(!loadFails(filename));
+
+	SECTION("truncated") {
+		for (auto len : {orig.size() - 1, orig.size() / 2, size_t(20)}) {
+			writeFile(filename, std::string_view(orig).substr(0, len));
+			CHECK(loadFails(filename));
+		}
+	}
+	SECTION("damaged blob") {
+		// The blob data directly follows the "lz4" encoding attribute,
+		// prefixed with its (uleb encoded) length.
+		auto pos = orig.find("lz4");
+		REQUIRE(pos != std::string::npos);
+		pos += 3;
+		size_t len = 0;
+		for (int shift = 0; ; shift += 7) {
+			auto b = uint8_t(orig[pos++]);
+			len |= size_t(b & 0x7F) << shift;
+			if ((b & 0x80) == 0) break;
+		}
+		REQUIRE(pos + len <= orig.size());
+
+		// literal length runs past the end of the input
+		auto data = orig;
+		std::fill_n(&data[pos], len, char(0xFF));
+		writeFile(filename, data);
+		CHECK(loadFails(filename));
+
+		// match offset points before the start of the output
+		data = orig;
+		std::fill_n(&data[pos], len, char(0xFF));
+		data[pos] = 0x00;
+		writeFile(filename, data);
+		CHECK(loadFails(filename));
+	}
+	SECTION("nested too deep") {
+		std::string data = orig.substr(0, 8); // magic
+		data += std::string("\x00\x01" "a", 3); // new name "a"
+		data += std::string("\x00\x00\x01", 3); // no attributes, no data, 1 child
+		for (auto i : xrange(100000)) {
+			(void)i;
+			data += std::string("\x00\x00\x00\x01", 4); // same, with name "a"
+		}
+		writeFile(filename, data);
+		CHECK(loadFails(filename));
+	}
+	FileOperations::unlink(filename);
+}
+
+// Save and load the same state a few times, print the average times and the
+// size of the resulting file.
+template<typename OutArchive, typename InArchive>
+static void saveLoadTimes(const char* name, const SerTestState& state, const std::string& filename)
+{
+	const int REPEAT = 10;
+	double saveTime = 0.0, loadTime = 0.0;
+	for ([[maybe_unused]] auto r : xrange(REPEAT)) {
+		saveTime += benchmark::measure([&] {
+			OutArchive out(filename);
+			out.serialize("state", state);
+			out.close();
+		});
+		SerTestState loaded;
+		loaded.ram.resize(state.ram.size());
+		loadTime += benchmark::measure([&] {
+			InArchive in(filename);
+			in.serialize("state", loaded);
+		});
+	}
+	FileOperations::Stat st;
+	REQUIRE(FileOperations::getStat(filename, st));
+	std::cout << name << ": "
+	          << "save " << 1000.0 * saveTime / REPEAT << "ms, "
+	          << "load " << 1000.0 * loadTime / REPEAT << "ms, "
+	          << "size " << st.st_size << " bytes\n";
+	FileOperations::unlink(filename);
+}
+
+// The XML versus the Bin archive format, for a state with 1MB of RAM.
+TEST_CASE("serialize: benchmark", "[.benchmark]")
+{
+	auto state = createState(1024 * 1024);
+	auto dir = FileOperations::getTempDir();
+	saveLoadTimes<XmlOutputArchive, XmlInputArchive>("XML", state, dir + "/openmsx_benchmark.xml.gz");
+	saveLoadTimes<BinOutputArchive, BinInputArchive>("Bin", state, dir + "/openmsx_benchmark.oms");
+}
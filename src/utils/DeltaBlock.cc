@@ -1,17 +1,28 @@
 #include "DeltaBlock.hh"
+#include "ThreadPool.hh"
+#include "MSXException.hh"
 #include "likely.hh"
 #include "ranges.hh"
+#include "xrange.hh"
 #include "lz4.hh"
 #include <cassert>
 #include <cstring>
+#include <mutex>
 #include <tuple>
 #include <utility>
+#include <zlib.h>
 #if STATISTICS
 #include <iostream>
 #endif
 #ifdef __SSE2__
 #include <emmintrin.h>
 #endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DELTA_BLOCK_AVX 1
+#include <immintrin.h>
+#else
+#define DELTA_BLOCK_AVX 0
+#endif
 
 namespace openmsx {
 
@@ -76,6 +87,84 @@ template<> bool comp<16>(const uint8_t* p, const uint8_t* q)
 
 // --- Optimized mismatch function ---
 
+// The inner loop of scan_mismatch(). These functions compare STEP bytes at a
+// time and return the offset of the first STEP-sized chunk that contains a
+// difference. The caller guarantees that such a chunk exists (the sentinel)
+// and that both buffers are aligned to ALIGN bytes.
+using MismatchLoop = size_t (*)(const uint8_t* p, const uint8_t* q);
+
+template<int N> static size_t mismatchLoop(const uint8_t* p, const uint8_t* q)
+{
+	size_t i = 0;
+	while (comp<N>(p + i, q + i)) i += N;
+	return i;
+}
+
+#if DELTA_BLOCK_AVX
+// Not all x86_64 CPUs have AVX2 or AVX-512, so these routines are compiled
+// for those instruction sets separately, and only used when the CPU
+// supports them (checked at run-time).
+__attribute__((target("avx2")))
+static size_t mismatchLoopAVX2(const uint8_t* p, const uint8_t* q)
+{
+	size_t i = 0;
+	while (true) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + i));
+		__m256i d = _mm256_cmpeq_epi8(a, b);
+		if (unsigned(_mm256_movemask_epi8(d)) != 0xffffffff) return i;
+		i += sizeof(__m256i);
+	}
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t mismatchLoopAVX512(const uint8_t* p, const uint8_t* q)
+{
+	size_t i = 0;
+	while (true) {
+		__m512i a = _mm512_loadu_si512(p + i);
+		__m512i b = _mm512_loadu_si512(q + i);
+		if (_mm512_cmpneq_epi8_mask(a, b)) return i;
+		i += sizeof(__m512i);
+	}
+}
+#endif
+
+struct MismatchImpl {
+	MismatchLoop loop;
+	int step;
+};
+
+static MismatchImpl getMismatchImpl(DeltaBlock::Simd simd)
+{
+	switch (simd) {
+#ifdef __SSE2__
+	case DeltaBlock::Simd::SSE2:
+		return {mismatchLoop<sizeof(__m128i)>, sizeof(__m128i)};
+#endif
+#if DELTA_BLOCK_AVX
+	case DeltaBlock::Simd::AVX2:
+		return {mismatchLoopAVX2, sizeof(__m256i)};
+	case DeltaBlock::Simd::AVX512:
+		return {mismatchLoopAVX512, sizeof(__m512i)};
+#endif
+	default:
+		return {mismatchLoop<sizeof(void*)>, sizeof(void*)};
+	}
+}
+
+static DeltaBlock::Simd detectSimd()
+{
+	using Simd = DeltaBlock::Simd;
+	for (auto simd : {Simd::AVX512, Simd::AVX2, Simd::SSE2}) {
+		if (DeltaBlock::isSupported(simd)) return simd;
+	}
+	return Simd::SCALAR;
+}
+
+static DeltaBlock::Simd selectedSimd = detectSimd();
+static MismatchImpl mismatchImpl = getMismatchImpl(selectedSimd);
+
 // This is much like the function std::mismatch(). You pass in two buffers,
 // the corresponding elements of both buffers are compared and the first
 // position where the elements no longer match is returned.
@@ -83,51 +172,52 @@ template<> bool comp<16>(const uint8_t* p, const uint8_t* q)
 // Compared to the std::mismatch() this implementation is faster because:
 // - We make use of sentinels. This requires to temporarily change the content
 //   of the buffer. So it won't work with read-only-memory.
-// - We compare words-at-a-time instead of byte-at-a-time.
+// - We compare words-at-a-time instead of byte-at-a-time. Depending on the
+//   instruction set supported by the CPU a word is 4, 8, 16, 32 or 64 bytes.
 static std::pair<const uint8_t*, const uint8_t*> scan_mismatch(
 	const uint8_t* p, const uint8_t* p_end, const uint8_t* q, const uint8_t* q_end)
 {
 	assert((p_end - p) == (q_end - q));
 
-	// When SSE is available, work with 16-byte words, otherwise 4 or 8
-	// bytes. This routine also benefits from AVX2 instructions. Though not
-	// all x86_64 CPUs have AVX2 (all have SSE2), so using them requires
-	// extra run-time checks and that's not worth it at this point.
-	constexpr int WORD_SIZE =
+	// Both buffers must have the same alignment (modulo ALIGN). The
+	// SSE2 (or scalar) loop requires this, the AVX loops don't, but
+	// aligned loads are still faster.
+	constexpr int ALIGN =
 #ifdef __SSE2__
 		sizeof(__m128i);
 #else
 		sizeof(void*);
 #endif
+	auto [loop, step] = mismatchImpl;
 
 	// Region too small or
 	// both buffers are differently aligned.
-	if (unlikely((p_end - p) < (2 * WORD_SIZE)) ||
-	    unlikely((reinterpret_cast<uintptr_t>(p) & (WORD_SIZE - 1)) !=
-	             (reinterpret_cast<uintptr_t>(q) & (WORD_SIZE - 1)))) {
+	if (unlikely((p_end - p) < (step + ALIGN)) ||
+	    unlikely((reinterpret_cast<uintptr_t>(p) & (ALIGN - 1)) !=
+	             (reinterpret_cast<uintptr_t>(q) & (ALIGN - 1)))) {
 		goto end;
 	}
 
-	// Align to WORD_SIZE boundary. No need for end-of-buffer checks.
-	if (unlikely(reinterpret_cast<uintptr_t>(p) & (WORD_SIZE - 1))) {
+	// Align to ALIGN boundary. No need for end-of-buffer checks.
+	if (unlikely(reinterpret_cast<uintptr_t>(p) & (ALIGN - 1))) {
 		do {
 			if (*p != *q) return {p, q};
 			p += 1; q += 1;
-		} while (reinterpret_cast<uintptr_t>(p) & (WORD_SIZE - 1));
+		} while (reinterpret_cast<uintptr_t>(p) & (ALIGN - 1));
 	}
 
 	// Fast path. Compare words-at-a-time.
 	{
-		// Place a sentinel in the last full word. This ensures we'll
-		// find a mismatch within the buffer, and so we can omit the
-		// end-of-buffer checks.
-		auto* sentinel = &const_cast<uint8_t*>(p_end)[-WORD_SIZE];
+		// Place a sentinel 'step' bytes before the end. This ensures
+		// we'll find a mismatch within the buffer (the word that
+		// contains the sentinel ends at or before p_end), and so we can
+		// omit the end-of-buffer checks.
+		auto* sentinel = &const_cast<uint8_t*>(p_end)[-step];
 		auto save = *sentinel;
-		*sentinel = ~q_end[-WORD_SIZE];
+		*sentinel = ~q_end[-step];
 
-		while (comp<WORD_SIZE>(p, q)) {
-			p += WORD_SIZE; q += WORD_SIZE;
-		}
+		auto offset = loop(p, q);
+		p += offset; q += offset;
 
 		// Restore sentinel.
 		*sentinel = save;
@@ -136,6 +226,7 @@ static std::pair<const uint8_t*, const uint8_t*> scan_mismatch(
 	// Slow path. This handles:
 	// - Small or differently aligned buffers.
 	// - The bytes at and after the (restored) sentinel.
+	// - Finding the exact position within the mismatching word.
 end:	return std::mismatch(p, p_end, q);
 }
 
@@ -176,15 +267,61 @@ static std::pair<const uint8_t*, const uint8_t*> scan_match(
 
 // --- delta (de)compression routines ---
 
+// The scan functions above temporarily modify their first buffer. Call 'scan'
+// with the (p, q) buffers swapped when 'q' is the one that may be modified.
+template<bool SENTINEL_IN_Q, typename Scan>
+static std::pair<const uint8_t*, const uint8_t*> scan(
+	Scan scanFunc,
+	const uint8_t* p, const uint8_t* p_end, const uint8_t* q, const uint8_t* q_end)
+{
+	if constexpr (SENTINEL_IN_Q) {
+		auto [q2, p2] = scanFunc(q, q_end, p, p_end);
+		return {p2, q2};
+	} else {
+		return scanFunc(p, p_end, q, q_end);
+	}
+}
+
+// Builds a 'delta' stream (see calcDeltaRange() below) piece by piece.
+class DeltaWriter
+{
+public:
+	void equal(size_t n) { pendingEqual += n; }
+	void different(const uint8_t* data, size_t n) {
+		assert(n != 0);
+		storeUleb(result, pendingEqual);
+		pendingEqual = 0;
+		storeUleb(result, n);
+		result.insert(result.end(), data, data + n);
+	}
+	[[nodiscard]] vector<uint8_t> finish() {
+		// Trailing equal bytes are implicit, except when the stream
+		// would otherwise be empty.
+		if (pendingEqual || result.empty()) storeUleb(result, pendingEqual);
+		result.shrink_to_fit();
+		return std::move(result);
+	}
+
+private:
+	vector<uint8_t> result;
+	size_t pendingEqual = 0;
+};
+
 // Calculate a 'delta' between two binary buffers of equal size.
 // The result is a stream of:
 //   n1 number of bytes are equal
 //   n2 number of bytes are different, and here are the bytes
 //   n3 number of bytes are equal
 //   ...
-static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, size_t size)
+// During the calculation either 'oldBuf' (SENTINEL_IN_NEW=false) or 'newBuf'
+// (SENTINEL_IN_NEW=true) is temporarily modified. So that buffer should not
+// be concurrently accessed by other threads.
+template<bool SENTINEL_IN_NEW>
+static void calcDeltaRange(DeltaWriter& writer,
+                           const uint8_t* oldBuf, const uint8_t* newBuf, size_t size)
 {
-	vector<uint8_t> result;
+	auto findMismatch = [](auto... args) { return scan<SENTINEL_IN_NEW>(scan_mismatch, args...); };
+	auto findMatch    = [](auto... args) { return scan<SENTINEL_IN_NEW>(scan_match,    args...); };
 
 	auto* p = oldBuf;
 	auto* q = newBuf;
@@ -193,31 +330,47 @@ static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, s
 
 	// scan equal bytes (possibly zero)
 	auto* q1 = q;
-	std::tie(p, q) = scan_mismatch(p, p_end, q, q_end);
-	auto n1 = q - q1;
-	storeUleb(result, n1);
+	std::tie(p, q) = findMismatch(p, p_end, q, q_end);
+	writer.equal(q - q1);
 
 	while (q != q_end) {
 		assert(*p != *q);
 
 		auto* q2 = q;
 	different:
-		std::tie(p, q) = scan_match(p + 1, p_end, q + 1, q_end);
+		std::tie(p, q) = findMatch(p + 1, p_end, q + 1, q_end);
 		auto n2 = q - q2;
 
 		auto* q3 = q;
-		std::tie(p, q) = scan_mismatch(p, p_end, q, q_end);
+		std::tie(p, q) = findMismatch(p, p_end, q, q_end);
 		auto n3 = q - q3;
 		if ((q != q_end) && (n3 <= 2)) goto different;
 
-		storeUleb(result, n2);
-		result.insert(result.end(), q2, q3);
-
-		if (n3 != 0) storeUleb(result, n3);
+		writer.different(q2, n2);
+		writer.equal(n3);
 	}
+}
 
-	result.shrink_to_fit();
-	return result;
+// Like calcDeltaRange(), but only the given ranges (sorted, non-overlapping)
+// can differ, all other bytes are known to be equal. When 'compact' is true,
+// 'newBuf' only contains the bytes of these ranges (concatenated).
+template<bool SENTINEL_IN_NEW>
+static vector<uint8_t> calcDelta(const uint8_t* oldBuf, const uint8_t* newBuf, size_t size,
+                                 const DeltaBlockDiff::Ranges& ranges, bool compact)
+{
+	DeltaWriter writer;
+	size_t pos = 0;
+	for (const auto& [offset, len] : ranges) {
+		assert(pos <= offset);
+		assert((offset + len) <= size);
+		writer.equal(offset - pos);
+		calcDeltaRange<SENTINEL_IN_NEW>(writer, oldBuf + offset,
+		                                compact ? newBuf : newBuf + offset, len);
+		if (compact) newBuf += len;
+		pos = offset + len;
+	}
+	writer.equal(size - pos);
+	return writer.finish();
 }
 
 // Apply a previously calculated 'delta' to 'oldBuf' to get 'newbuf'.
@@ -237,9 +390,52 @@ static void applyDeltaInPlace(uint8_t* buf, size_t size, const uint8_t* delta)
 	}
 }
 
+// class DeltaBlock
+
+bool DeltaBlock::isSupported(Simd simd)
+{
+	switch (simd) {
+	case Simd::SCALAR:
+		return true;
+	case Simd::SSE2:
+#ifdef __SSE2__
+		return true;
+#else
+		return false;
+#endif
+	case Simd::AVX2:
+#if DELTA_BLOCK_AVX
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	case Simd::AVX512:
+#if DELTA_BLOCK_AVX
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx512f") &&
+		       __builtin_cpu_supports("avx512bw");
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+DeltaBlock::Simd DeltaBlock::getSimd()
+{
+	return selectedSimd;
+}
+
+void DeltaBlock::setSimd(Simd simd)
+{
+	assert(isSupported(simd));
+	selectedSimd = simd;
+	mismatchImpl = getMismatchImpl(simd);
+}
+
 #if STATISTICS
 
-// class DeltaBlock
 
 DeltaBlock::~DeltaBlock()
 {
@@ -250,16 +446,60 @@ DeltaBlock::~DeltaBlock()
 
 #endif
 
+static std::mutex memoryCounterMutex;
+
+void DeltaBlock::setMemoryCounter(std::shared_ptr<std::atomic<size_t>> counter) const
+{
+	std::lock_guard<std::mutex> lock(memoryCounterMutex);
+	if (memoryCounter) *memoryCounter -= memorySize;
+	memoryCounter = std::move(counter);
+	if (memoryCounter) *memoryCounter += memorySize;
+}
+
+void DeltaBlock::setMemorySize(size_t size)
+{
+	std::lock_guard<std::mutex> lock(memoryCounterMutex);
+	if (memoryCounter) {
+		// (unsigned wrap-around in between is fine)
+		*memoryCounter += size - memorySize;
+	}
+	memorySize = size;
+}
+
+template<typename Func>
+void DeltaBlock::runJob(ThreadPool* pool, Func&& func)
+{
+	if (!pool) {
+		waitForJob();
+		func();
+		return;
+	}
+	// The previous job was enqueued earlier, so (because the pool starts
+	// jobs in FIFO order) it's already running or finished. Waiting for it
+	// can't deadlock.
+	job = pool->enqueue(
+		[prevJob = job, func = std::forward<Func>(func)]() mutable {
+			if (prevJob.valid()) prevJob.wait();
+			func();
+		});
+}
+
+
 // class DeltaBlockCopy
 
 DeltaBlockCopy::DeltaBlockCopy(const uint8_t* data, size_t size)
 	: block(size)
+	, uncompressedSize(size)
 	, compressedSize(0)
+	, compression(Compression::NONE)
+	, accDeltaSize(0)
+	, sealed(false)
 {
 #ifdef DEBUG
 	sha1 = SHA1::calc(data, size);
 #endif
 	memcpy(block.data(), data, size);
+	setMemorySize(size);
 	assert(!compressed());
 #if STATISTICS
 	allocSize = size;
@@ -269,22 +509,65 @@ DeltaBlockCopy::DeltaBlockCopy(const uint8_t* data, size_t size)
 #endif
 }
 
+DeltaBlockCopy::~DeltaBlockCopy()
+{
+	if (store) store->release(handle);
+}
+
 void DeltaBlockCopy::apply(uint8_t* dst, size_t size) const
 {
-	if (compressed()) {
-		LZ4::decompress(block.data(), dst, int(compressedSize), int(size));
+	(void)size;
+	assert(size == uncompressedSize);
+	waitForJob();
+	if (store) {
+		MemBuffer<uint8_t> buf(handle.size);
+		store->load(handle, buf.data());
+		decompress(buf.data(), dst);
 	} else {
-		memcpy(dst, block.data(), size);
+		decompress(block.data(), dst);
 	}
 #ifdef DEBUG
 	assert(SHA1::calc(dst, size) == sha1);
 #endif
 }
 
-void DeltaBlockCopy::compress(size_t size)
+void DeltaBlockCopy::decompress(const uint8_t* src, uint8_t* dst) const
+{
+	switch (compression) {
+	case Compression::NONE:
+		memcpy(dst, src, uncompressedSize);
+		break;
+	case Compression::LZ4:
+		LZ4::decompress(src, dst, int(compressedSize), int(uncompressedSize));
+		break;
+	case Compression::DEFLATE: {
+		uLongf dstLen = uncompressedSize;
+		[[maybe_unused]] int r = uncompress(dst, &dstLen, src, uLong(compressedSize));
+		assert(r == Z_OK);
+		assert(dstLen == uncompressedSize);
+		break;
+	}
+	}
+}
+
+void DeltaBlockCopy::seal(ThreadPool* pool)
+{
+	if (sealed) return;
+	sealed = true;
+	runJob(pool, [self = shared_from_this()] {
+		// All readers were enqueued before this job, so (FIFO) they
+		// are already running or finished.
+		for (auto& r : self->readers) r.wait();
+		self->readers.clear();
+		self->compress();
+	});
+}
+
+void DeltaBlockCopy::compress()
 {
 	if (compressed()) return;
 
+	size_t size = uncompressedSize;
 	size_t dstLen = LZ4::compressBound(size);
 	MemBuffer<uint8_t> buf2(dstLen);
 	dstLen = LZ4::compress(block.data(), buf2.data(), int(size));
@@ -294,12 +577,15 @@ void DeltaBlockCopy::compress(size_t size)
 		return;
 	}
 	compressedSize = dstLen;
+	compression = Compression::LZ4;
 	block.swap(buf2);
 	block.resize(compressedSize); // shrink to fit
+	setMemorySize(compressedSize);
 	assert(compressed());
 #ifdef DEBUG
+	// Note: don't use apply(), possibly we're running as part of 'job'.
 	MemBuffer<uint8_t> buf3(size);
-	apply(buf3.data(), size);
+	decompress(block.data(), buf3.data());
 	assert(memcmp(buf3.data(), buf2.data(), size) == 0);
 #endif
 #if STATISTICS
@@ -311,9 +597,69 @@ void DeltaBlockCopy::compress(size_t size)
 #endif
 }
 
+size_t DeltaBlockCopy::recompress(ThreadPool* pool)
+{
+	// An unsealed block is still used as reference for new diffs.
+	if (!sealed || recompressRequested || spillRequested) return 0;
+	recompressRequested = true;
+	runJob(pool, [self = shared_from_this()] { self->deflate(); });
+	// Rough estimate: deflate saves about a third compared to LZ4.
+	return getMemorySize() / 3;
+}
+
+void DeltaBlockCopy::deflate()
+{
+	if ((compression == Compression::DEFLATE) || store) return;
+
+	MemBuffer<uint8_t> raw;
+	const uint8_t* src = block.data();
+	if (compressed()) {
+		raw.resize(uncompressedSize);
+		decompress(block.data(), raw.data());
+		src = raw.data();
+	}
+	uLongf dstLen = compressBound(uLong(uncompressedSize));
+	MemBuffer<uint8_t> buf(dstLen);
+	if ((compress2(buf.data(), &dstLen, src, uLong(uncompressedSize), 9) != Z_OK) ||
+	    (dstLen >= getMemorySize())) {
+		// failed or not beneficial, keep the current representation
+		return;
+	}
+	buf.resize(dstLen); // shrink to fit
+	block.swap(buf);
+	compressedSize = dstLen;
+	compression = Compression::DEFLATE;
+	setMemorySize(compressedSize);
+}
+
+size_t DeltaBlockCopy::spill(const std::shared_ptr<DeltaBlockStore>& store_,
+                             ThreadPool* pool)
+{
+	if (!sealed || spillRequested) return 0;
+	spillRequested = true;
+	runJob(pool, [self = shared_from_this(), store_] { self->moveTo(store_); });
+	return getMemorySize();
+}
+
+void DeltaBlockCopy::moveTo(std::shared_ptr<DeltaBlockStore> store_)
+{
+	if (store) return;
+	try {
+		handle = store_->store(block.data(), compressed() ? compressedSize
+		                                                  : uncompressedSize);
+	} catch (MSXException&) {
+		// e.g. disk full, just keep the data in memory
+		return;
+	}
+	store = std::move(store_);
+	block.clear();
+	setMemorySize(0);
+}
+
 const uint8_t* DeltaBlockCopy::getData()
 {
 	assert(!compressed());
+	assert(!store);
 	return block.data();
 }
 
@@ -324,14 +670,94 @@ DeltaBlockDiff::DeltaBlockDiff(
 		std::shared_ptr<DeltaBlockCopy> prev_,
 		const uint8_t* data, size_t size)
 	: prev(std::move(prev_))
-	, delta(calcDelta(prev->getData(), data, size))
 {
 #ifdef DEBUG
 	sha1 = SHA1::calc(data, size);
+#endif
+	calc(data, size, {{0, size}}, false, false);
+}
 
+DeltaBlockDiff::DeltaBlockDiff(
+		std::shared_ptr<DeltaBlockCopy> prev_,
+		const uint8_t* data, size_t size, const Ranges& ranges)
+	: prev(std::move(prev_))
+{
+#ifdef DEBUG
+	sha1 = SHA1::calc(data, size);
+#endif
+	calc(data, size, ranges, false, false);
+}
+
+DeltaBlockDiff::DeltaBlockDiff(std::shared_ptr<DeltaBlockCopy> prev_)
+	: prev(std::move(prev_))
+{
+}
+
+DeltaBlockDiff::~DeltaBlockDiff()
+{
+	if (store) store->release(handle);
+}
+
+std::shared_ptr<DeltaBlockDiff> DeltaBlockDiff::createAsync(
+		std::shared_ptr<DeltaBlockCopy> prev_,
+		const uint8_t* data, size_t size, ThreadPool& pool)
+{
+	return createAsync(std::move(prev_), data, size, {{0, size}}, pool);
+}
+
+std::shared_ptr<DeltaBlockDiff> DeltaBlockDiff::createAsync(
+		std::shared_ptr<DeltaBlockCopy> prev_,
+		const uint8_t* data, size_t size, Ranges ranges, ThreadPool& pool)
+{
+	// (private constructor, so can't use std::make_shared())
+	std::shared_ptr<DeltaBlockDiff> result(new DeltaBlockDiff(std::move(prev_)));
+#ifdef DEBUG
+	result->sha1 = SHA1::calc(data, size);
+#endif
+	// Only this copy (of the possibly changed ranges) is made on the
+	// calling thread.
+	size_t copySize = 0;
+	for (const auto& r : ranges) copySize += r.second;
+	MemBuffer<uint8_t> copy(copySize);
+	auto* dst = copy.data();
+	for (const auto& [offset, len] : ranges) {
+		memcpy(dst, data + offset, len);
+		dst += len;
+	}
+	result->setMemorySize(copySize);
+	result->runJob(&pool,
+		[self = result, copy = std::move(copy), size, ranges = std::move(ranges)] {
+			self->calc(copy.data(), size, ranges, true, true);
+		});
+	// Keep the reference block uncompressed until this job is done.
+	result->prev->readers.push_back(result->job);
+	return result;
+}
+
+void DeltaBlockDiff::calc(const uint8_t* data, size_t size, const Ranges& ranges,
+                          bool compact, bool privateData)
+{
+	// Several diffs against the same 'prev' may be calculated in parallel,
+	// in that case the (temporary) modifications must be done on our own
+	// private copy of the new data.
+	delta = privateData ? calcDelta<true >(prev->getData(), data, size, ranges, compact)
+	                    : calcDelta<false>(prev->getData(), data, size, ranges, compact);
+	prev->accDeltaSize += delta.size();
+	setMemorySize(delta.size());
+#ifdef DEBUG
+	// Note: don't use prev->apply(), prev is possibly waiting on us.
 	MemBuffer<uint8_t> buf(size);
-	apply(buf.data(), size);
-	assert(memcmp(buf.data(), data, size) == 0);
+	memcpy(buf.data(), prev->getData(), size);
+	applyDeltaInPlace(buf.data(), size, delta.data());
+	if (compact) {
+		// (the bytes outside 'ranges' are checked via sha1 in apply())
+		for (const auto& [offset, len] : ranges) {
+			assert(memcmp(buf.data() + offset, data, len) == 0);
+			data += len;
+		}
+	} else {
+		assert(memcmp(buf.data(), data, size) == 0);
+	}
 #endif
 #if STATISTICS
 	allocSize = delta.size();
@@ -343,23 +769,91 @@ DeltaBlockDiff::DeltaBlockDiff(
 
 void DeltaBlockDiff::apply(uint8_t* dst, size_t size) const
 {
+	waitForJob();
 	prev->apply(dst, size);
-	applyDeltaInPlace(dst, size, delta.data());
+	if (store) {
+		vector<uint8_t> buf(handle.size);
+		store->load(handle, buf.data());
+		applyDeltaInPlace(dst, size, buf.data());
+	} else {
+		applyDeltaInPlace(dst, size, delta.data());
+	}
 #ifdef DEBUG
 	assert(SHA1::calc(dst, size) == sha1);
 #endif
 }
 
+size_t DeltaBlockDiff::recompress(ThreadPool* pool)
+{
+	// The delta itself is already compact, but the reference block it
+	// depends on can still be recompressed.
+	return prev->recompress(pool);
+}
+
+size_t DeltaBlockDiff::spill(const std::shared_ptr<DeltaBlockStore>& store_,
+                             ThreadPool* pool)
+{
+	size_t result = prev->spill(store_, pool);
+	if (spillRequested) return result;
+	spillRequested = true;
+	runJob(pool, [self = shared_from_this(), store_] { self->moveTo(store_); });
+	return result + getMemorySize();
+}
+
+void DeltaBlockDiff::moveTo(std::shared_ptr<DeltaBlockStore> store_)
+{
+	if (store) return;
+	try {
+		handle = store_->store(delta.data(), delta.size());
+	} catch (MSXException&) {
+		// e.g. disk full, just keep the data in memory
+		return;
+	}
+	store = std::move(store_);
+	vector<uint8_t>().swap(delta);
+	setMemorySize(0);
+}
+
 size_t DeltaBlockDiff::getDeltaSize() const
 {
-	return delta.size();
+	waitForJob();
+	return store ? handle.size : delta.size();
 }
 
 
 // class LastDeltaBlocks
 
+static std::atomic<unsigned> lastDeltaBlocksCounter = 0;
+
+LastDeltaBlocks::LastDeltaBlocks()
+	: trackerId(++lastDeltaBlocksCounter)
+{
+}
+
+// Convert the set bits (dirty pages) in 'bits' to a list of byte ranges.
+static DeltaBlockDiff::Ranges getDirtyRanges(const vector<uint64_t>& bits, size_t size)
+{
+	DeltaBlockDiff::Ranges result;
+	auto numPages = (size + DirtyPages::PAGE_SIZE - 1) >> DirtyPages::PAGE_BITS;
+	size_t page = 0;
+	while (page < numPages) {
+		if (!((bits[page / 64] >> (page % 64)) & 1)) {
+			++page;
+			continue;
+		}
+		auto first = page;
+		do {
+			++page;
+		} while ((page < numPages) && ((bits[page / 64] >> (page % 64)) & 1));
+		auto begin = first << DirtyPages::PAGE_BITS;
+		auto end = std::min(page << DirtyPages::PAGE_BITS, size);
+		result.emplace_back(begin, end - begin);
+	}
+	return result;
+}
+
 std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNew(
-		const void* id, const uint8_t* data, size_t size)
+		const void* id, const uint8_t* data, size_t size, DirtyPages* dirty)
 {
 	auto it = ranges::lower_bound(infos, std::tuple(id, size),
 		[](const Info& info, const std::tuple<const void*, size_t>& info2) {
@@ -371,54 +865,60 @@ std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNew(
 	assert(it->id   == id);
 	assert(it->size == size);
 
+	if (dirty) {
+		// (pages beyond 'size' are ignored)
+		assert(dirty->getNumPages() >=
+		       (size + DirtyPages::PAGE_SIZE - 1) >> DirtyPages::PAGE_BITS);
+		auto& acc = it->accDirty;
+		acc.resize(dirty->bits.size());
+		if (dirty->owner != trackerId) {
+			// The dirty state is relative to some other history
+			// (or to nothing at all), assume everything changed.
+			ranges::fill(acc, ~uint64_t(0));
+		} else if (!dirty->any()) {
+			// Nothing changed since the previous snapshot.
+			if (auto last = it->last.lock()) {
+#ifdef DEBUG
+				assert(SHA1::calc(data, size) == last->sha1);
+#endif
+				return last;
+			}
+		} else {
+			for (auto i : xrange(acc.size())) acc[i] |= dirty->bits[i];
+		}
+		dirty->clean(trackerId);
+	}
+
 	auto ref = it->ref.lock();
-	if (it->accSize >= size || !ref) {
+	// Note: in the asynchronous case, the accumulated size only includes
+	// the diffs that have already been calculated. So it may lag a bit
+	// behind, that's fine for this heuristic.
+	if (!ref || ref->getAccDeltaSize() >= size) {
 		if (ref) {
 			// We will switch to a new DeltaBlockCopy object. So
 			// now is a good time to compress the old one.
-			ref->compress(size);
+			ref->seal(pool);
 		}
 		// Heuristic: create a new block when too many small
 		// differences have accumulated.
 		auto b = std::make_shared<DeltaBlockCopy>(data, size);
 		it->ref = b;
 		it->last = b;
-		it->accSize = 0;
+		ranges::fill(it->accDirty, 0);
 		return b;
 	} else {
-		// Create diff based on earlier reference block.
+		// Create diff based on earlier reference block. When the
+		// pages that were written since that reference block was
+		// created are known, only those need to be compared.
 		// Reference remains unchanged.
-		auto b = std::make_shared<DeltaBlockDiff>(ref, data, size);
-		it->last = b;
-		it->accSize += b->getDeltaSize();
-		return b;
-	}
-}
-
-std::shared_ptr<DeltaBlock> LastDeltaBlocks::createNullDiff(
-		const void* id, const uint8_t* data, size_t size)
-{
-	auto it = ranges::lower_bound(infos, id,
-		[](const Info& info, const void* id2) {
-			return info.id < id2; });
-	if ((it == end(infos)) || (it->id != id)) {
-		// no previous block yet
-		it = infos.emplace(it, id, size);
-	}
-	assert(it->size == size);
-
-	auto last = it->last.lock();
-	if (!last) {
-		auto b = std::make_shared<DeltaBlockCopy>(data, size);
-		it->ref = b;
+		auto dirtyRanges = dirty
+			? getDirtyRanges(it->accDirty, size)
+			: DeltaBlockDiff::Ranges{{0, size}};
+		std::shared_ptr<DeltaBlockDiff> b = pool
+			? DeltaBlockDiff::createAsync(ref, data, size, std::move(dirtyRanges), *pool)
+			: std::make_shared<DeltaBlockDiff>(ref, data, size, dirtyRanges);
 		it->last = b;
-		it->accSize = 0;
 		return b;
-	} else {
-#ifdef DEBUG
-		assert(SHA1::calc(data, size) == last->sha1);
-#endif
-		return last;
 	}
 }
 
@@ -426,7 +926,7 @@ void LastDeltaBlocks::clear()
 {
 	for (const Info& info : infos) {
 		if (auto ref = info.ref.lock()) {
-			ref->compress(info.size);
+			ref->seal(pool);
 		}
 	}
 	infos.clear();
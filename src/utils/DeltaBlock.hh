@@ -3,9 +3,13 @@
 
 #define STATISTICS 0
 
+#include "DirtyPages.hh"
 #include "MemBuffer.hh"
+#include <atomic>
 #include <cstdint>
+#include <future>
 #include <memory>
+#include <utility>
 #include <vector>
 #ifdef DEBUG
 #include "sha1.hh"
@@ -13,6 +17,30 @@
 
 namespace openmsx {
 
+class ThreadPool;
+
+/** Storage for DeltaBlock data that is moved out of main memory (e.g. to a
+  * file on disk). All methods can be called from any thread.
+  */
+class DeltaBlockStore
+{
+public:
+	struct Handle {
+		size_t offset = 0;
+		size_t size = 0;
+	};
+
+	virtual ~DeltaBlockStore() = default;
+	/** Store a copy of the given data.
+	  * @throw MSXException when the data could not be stored. */
+	[[nodiscard]] virtual Handle store(const uint8_t* data, size_t size) = 0;
+	/** Copy previously stored data to 'dst' (handle.size bytes). */
+	virtual void load(const Handle& handle, uint8_t* dst) = 0;
+	/** The stored data is no longer needed. */
+	virtual void release(const Handle& handle) = 0;
+};
+
+
 class DeltaBlock
 {
 public:
@@ -23,9 +51,80 @@ public:
 #endif
 	virtual void apply(uint8_t* dst, size_t size) const = 0;
 
+	/** Instruction set used to compare buffers while calculating diffs.
+	  * The best one supported by the CPU is selected automatically, the
+	  * methods below are only meant for unittests and benchmarks.
+	  */
+	enum class Simd { SCALAR, SSE2, AVX2, AVX512 };
+	[[nodiscard]] static bool isSupported(Simd simd);
+	[[nodiscard]] static Simd getSimd();
+	/** Not thread-safe: there should be no diff calculations running. */
+	static void setSimd(Simd simd);
+
+	/** Number of bytes this block currently occupies in memory. This does
+	  * not include the block it depends on (see getBase()).
+	  */
+	[[nodiscard]] size_t getMemorySize() const { return memorySize; }
+
+	/** Keep 'counter' up to date with the memory size of this block, also
+	  * when that size changes later on (e.g. when the block is compressed
+	  * in the background). So a counter that's shared by several blocks
+	  * holds the sum of their sizes. Pass nullptr to detach again (that
+	  * also subtracts the current size).
+	  */
+	void setMemoryCounter(std::shared_ptr<std::atomic<size_t>> counter) const;
+
+	/** The block this block depends on, or nullptr. */
+	[[nodiscard]] virtual const DeltaBlock* getBase() const { return nullptr; }
+
+	/** Reduce memory usage by using a slower but stronger compression
+	  * algorithm. When a ThreadPool is given, the work is done on that
+	  * pool, otherwise it's done right away.
+	  * @return (An estimate of) the number of bytes that will be freed.
+	  */
+	virtual size_t recompress(ThreadPool* pool) = 0;
+
+	/** Move the data of this block (and of the blocks it depends on) out
+	  * of main memory into the given store. Loading the data back happens
+	  * transparently in apply().
+	  * @return (An estimate of) the number of bytes that will be freed.
+	  */
+	virtual size_t spill(const std::shared_ptr<DeltaBlockStore>& store,
+	                     ThreadPool* pool) = 0;
+
+	/** Were recompress() resp. spill() already requested for this block
+	  * (and for the block it depends on)? Then calling them again can't
+	  * free any more memory.
+	  */
+	[[nodiscard]] virtual bool isRecompressRequested() const = 0;
+	[[nodiscard]] virtual bool isSpillRequested() const = 0;
+
 protected:
 	DeltaBlock() = default;
 
+	void setMemorySize(size_t size);
+
+	/** Block till the background work on this block (if any) is done. */
+	void waitForJob() const { if (job.valid()) job.wait(); }
+
+	/** Execute 'func' after all earlier work on this block has finished,
+	  * either on the given pool or (when there's no pool) right away.
+	  */
+	template<typename Func> void runJob(ThreadPool* pool, Func&& func);
+
+	// Pending (or finished) work on a ThreadPool, see LastDeltaBlocks.
+	std::shared_future<void> job;
+
+	// Only accessed from the thread that creates the blocks, avoids
+	// requesting the same (asynchronous) work twice.
+	bool recompressRequested = false;
+	bool spillRequested = false;
+
+private:
+	std::atomic<size_t> memorySize{0};
+	// Both only change while holding 'memoryCounterMutex' (DeltaBlock.cc).
+	mutable std::shared_ptr<std::atomic<size_t>> memoryCounter;
+
 #ifdef DEBUG
 public:
 	Sha1Sum sha1;
@@ -40,57 +139,145 @@ protected:
 
 
 class DeltaBlockCopy final : public DeltaBlock
+                           , public std::enable_shared_from_this<DeltaBlockCopy>
 {
 public:
 	DeltaBlockCopy(const uint8_t* data, size_t size);
+	~DeltaBlockCopy() override;
 	void apply(uint8_t* dst, size_t size) const override;
-	void compress(size_t size);
+	size_t recompress(ThreadPool* pool) override;
+	size_t spill(const std::shared_ptr<DeltaBlockStore>& store_,
+	             ThreadPool* pool) override;
+	[[nodiscard]] bool isRecompressRequested() const override {
+		return recompressRequested || spillRequested;
+	}
+	[[nodiscard]] bool isSpillRequested() const override { return spillRequested; }
+
+	/** No more diffs will be made against this block, so it can be
+	  * compressed. When a ThreadPool is given, the compression is done on
+	  * that pool, after all diffs against this block that are still being
+	  * calculated have finished.
+	  */
+	void seal(ThreadPool* pool);
 	[[nodiscard]] const uint8_t* getData();
 
+	/** Sum of the sizes of all (finished) diffs against this block. */
+	[[nodiscard]] size_t getAccDeltaSize() const { return accDeltaSize; }
+
 private:
-	[[nodiscard]] bool compressed() const { return compressedSize != 0; }
+	enum class Compression : uint8_t { NONE, LZ4, DEFLATE };
 
-	MemBuffer<uint8_t> block;
+	void compress();
+	void deflate();
+	void moveTo(std::shared_ptr<DeltaBlockStore> store_);
+	void decompress(const uint8_t* src, uint8_t* dst) const;
+	[[nodiscard]] bool compressed() const { return compression != Compression::NONE; }
+
+	MemBuffer<uint8_t> block; // empty when moved to 'store'
+	const size_t uncompressedSize;
 	size_t compressedSize;
+	Compression compression;
+	std::atomic<size_t> accDeltaSize;
+	// Diff calculations (on a ThreadPool) that read from 'block'.
+	std::vector<std::shared_future<void>> readers;
+	// When spilled, the data of 'block' lives here.
+	std::shared_ptr<DeltaBlockStore> store;
+	DeltaBlockStore::Handle handle;
+	bool sealed;
+
+	friend class DeltaBlockDiff;
 };
 
 
 class DeltaBlockDiff final : public DeltaBlock
+                           , public std::enable_shared_from_this<DeltaBlockDiff>
 {
 public:
+	/** List of (offset, size) pairs, sorted and non-overlapping. */
+	using Ranges = std::vector<std::pair<size_t, size_t>>;
+
 	DeltaBlockDiff(std::shared_ptr<DeltaBlockCopy> prev_,
 	               const uint8_t* data, size_t size);
+	/** Only the bytes in the given ranges can differ from 'prev_'. */
+	DeltaBlockDiff(std::shared_ptr<DeltaBlockCopy> prev_,
+	               const uint8_t* data, size_t size, const Ranges& ranges);
+	/** Create a diff of which the delta is calculated on the given
+	  * ThreadPool. The calling thread only makes a copy of 'data' (or of
+	  * the given ranges of 'data').
+	  */
+	[[nodiscard]] static std::shared_ptr<DeltaBlockDiff> createAsync(
+		std::shared_ptr<DeltaBlockCopy> prev_,
+		const uint8_t* data, size_t size, ThreadPool& pool);
+	[[nodiscard]] static std::shared_ptr<DeltaBlockDiff> createAsync(
+		std::shared_ptr<DeltaBlockCopy> prev_,
+		const uint8_t* data, size_t size, Ranges ranges, ThreadPool& pool);
+	~DeltaBlockDiff() override;
 	void apply(uint8_t* dst, size_t size) const override;
+	[[nodiscard]] const DeltaBlock* getBase() const override { return prev.get(); }
+	size_t recompress(ThreadPool* pool) override;
+	size_t spill(const std::shared_ptr<DeltaBlockStore>& store_,
+	             ThreadPool* pool) override;
+	[[nodiscard]] bool isRecompressRequested() const override {
+		return prev->isRecompressRequested();
+	}
+	[[nodiscard]] bool isSpillRequested() const override {
+		return spillRequested && prev->isSpillRequested();
+	}
 	[[nodiscard]] size_t getDeltaSize() const;
 
 private:
+	explicit DeltaBlockDiff(std::shared_ptr<DeltaBlockCopy> prev_);
+	void calc(const uint8_t* data, size_t size, const Ranges& ranges,
+	          bool compact, bool privateData);
+	void moveTo(std::shared_ptr<DeltaBlockStore> store_);
+
 	const std::shared_ptr<DeltaBlockCopy> prev;
-	const std::vector<uint8_t> delta; // TODO could be tweaked to use OutputBuffer
+	std::vector<uint8_t> delta; // TODO could be tweaked to use OutputBuffer
+	// When spilled, the content of 'delta' lives here.
+	std::shared_ptr<DeltaBlockStore> store;
+	DeltaBlockStore::Handle handle;
 };
 
 
 class LastDeltaBlocks
 {
 public:
+	/** When a ThreadPool is set, the expensive parts of creating new
+	  * blocks (calculating diffs and compressing reference blocks) are
+	  * offloaded to that pool. Otherwise it's all done synchronously.
+	  */
+	LastDeltaBlocks();
+
+	void setThreadPool(ThreadPool* pool_) { pool = pool_; }
+
+	/** Create a block for the given data. When 'dirty' is given, it
+	  * tells which pages were written since the previous call for this
+	  * data. Then only those pages are compared and afterwards all pages
+	  * are marked clean.
+	  */
 	[[nodiscard]] std::shared_ptr<DeltaBlock> createNew(
-		const void* id, const uint8_t* data, size_t size);
-	[[nodiscard]] std::shared_ptr<DeltaBlock> createNullDiff(
-		const void* id, const uint8_t* data, size_t size);
+		const void* id, const uint8_t* data, size_t size,
+		DirtyPages* dirty = nullptr);
 	void clear();
 
 private:
 	struct Info {
 		Info(const void* id_, size_t size_)
-			: id(id_), size(size_), accSize(0) {}
+			: id(id_), size(size_) {}
 
 		const void* id;
 		size_t size;
 		std::weak_ptr<DeltaBlockCopy> ref;
 		std::weak_ptr<DeltaBlock> last;
-		size_t accSize;
+		// Pages written since 'ref' was created (only used with
+		// DirtyPages).
+		std::vector<uint64_t> accDirty;
 	};
 
 	std::vector<Info> infos;
+	ThreadPool* pool = nullptr;
+	// Identifies this history in DirtyPages.
+	const unsigned trackerId;
 };
 
 } // namespace openmsx
@@ -0,0 +1,90 @@
+#ifndef DIRTYPAGES_HH
+#define DIRTYPAGES_HH
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace openmsx {
+
+/** Keeps track of which pages (of 256 bytes) of a memory block were written
+  * since the last reverse snapshot.
+  *
+  * The owner of the memory block must call mark() on every write. When the
+  * block is serialized for a reverse snapshot, the delta with the previous
+  * snapshot is calculated by only looking at the written pages (see
+  * LastDeltaBlocks::createNew()), and afterwards all pages are clean again.
+  * So the cost of taking a snapshot scales with the amount of written memory
+  * instead of with the total memory size.
+  *
+  * Initially all pages are dirty.
+  */
+class DirtyPages
+{
+public:
+	static constexpr unsigned PAGE_BITS = 8;
+	static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+	explicit DirtyPages(size_t size)
+		: numPages((size + PAGE_SIZE - 1) >> PAGE_BITS)
+		, bits((numPages + 63) / 64, ~uint64_t(0))
+	{
+	}
+
+	void mark(size_t address) {
+		auto page = address >> PAGE_BITS;
+		assert(page < numPages);
+		bits[page / 64] |= uint64_t(1) << (page % 64);
+	}
+	void markRange(size_t address, size_t size) {
+		if (size == 0) return;
+		auto last = (address + size - 1) >> PAGE_BITS;
+		for (auto page = address >> PAGE_BITS; page <= last; ++page) {
+			bits[page / 64] |= uint64_t(1) << (page % 64);
+		}
+	}
+	void markAll() {
+		std::fill(bits.begin(), bits.end(), ~uint64_t(0));
+	}
+
+	[[nodiscard]] bool isDirty(size_t page) const {
+		assert(page < numPages);
+		return (bits[page / 64] >> (page % 64)) & 1;
+	}
+	[[nodiscard]] bool any() const {
+		return std::any_of(bits.begin(), bits.end(),
+		                   [](uint64_t w) { return w != 0; });
+	}
+	[[nodiscard]] size_t getNumPages() const { return numPages; }
+
+	/** Called right after all pages became clean (typically while taking
+	  * a reverse snapshot). E.g. to revoke direct (untracked) write access
+	  * to the memory block.
+	  */
+	void setCleanCallback(std::function<void()> callback) {
+		cleanCallback = std::move(callback);
+	}
+
+private:
+	friend class LastDeltaBlocks;
+
+	/** Mark all pages clean. 'owner_' identifies the snapshot history
+	  * the dirty state is relative to from now on. */
+	void clean(unsigned owner_) {
+		std::fill(bits.begin(), bits.end(), 0);
+		owner = owner_;
+		if (cleanCallback) cleanCallback();
+	}
+
+	const size_t numPages;
+	std::vector<uint64_t> bits;
+	std::function<void()> cleanCallback;
+	unsigned owner = 0; // see LastDeltaBlocks, 0 means 'none'
+};
+
+} // namespace openmsx
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef POOLALLOCATOR_HH
+#define POOLALLOCATOR_HH
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace openmsx {
+
+/** A thread-safe list of free memory blocks, all of the same size.
+  *
+  * Freed blocks are kept (up to MAX_FREE of them) for later allocations,
+  * so once the pool is warmed up, allocating and freeing a block no longer
+  * goes to the heap. There's one pool per block size, shared by all users.
+  */
+template<size_t BLOCK_SIZE, size_t MAX_FREE = 1024>
+class BlockPool
+{
+public:
+	static BlockPool& instance()
+	{
+		static BlockPool oneInstance;
+		return oneInstance;
+	}
+
+	BlockPool(const BlockPool&) = delete;
+	BlockPool& operator=(const BlockPool&) = delete;
+
+	~BlockPool()
+	{
+		while (freeList) {
+			auto* next = freeList->next;
+			::operator delete(freeList);
+			freeList = next;
+		}
+	}
+
+	[[nodiscard]] void* allocate()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (auto* node = freeList) {
+				freeList = node->next;
+				--numFree;
+				return node;
+			}
+		}
+		return ::operator new(BLOCK_SIZE);
+	}
+
+	void deallocate(void* p)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (numFree < MAX_FREE) {
+				auto* node = static_cast<Node*>(p);
+				node->next = freeList;
+				freeList = node;
+				++numFree;
+				return;
+			}
+		}
+		::operator delete(p);
+	}
+
+	[[nodiscard]] size_t getNumFree()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return numFree;
+	}
+
+private:
+	BlockPool() = default;
+
+	struct Node { Node* next; };
+	static_assert(BLOCK_SIZE >= sizeof(Node));
+
+	std::mutex mutex;
+	Node* freeList = nullptr;
+	size_t numFree = 0;
+};
+
+/** Allocator (as in the standard library allocator requirements) that takes
+  * single objects of at most BLOCK_SIZE bytes from a BlockPool. Bigger
+  * objects and arrays go to the heap as usual.
+  *
+  * This is meant for std::allocate_shared() of small objects that are
+  * created and destroyed at a high rate, see make_pooled_shared().
+  */
+template<typename T, size_t BLOCK_SIZE = 64>
+class PoolAllocator
+{
+public:
+	using value_type = T;
+	template<typename U> struct rebind {
+		using other = PoolAllocator<U, BLOCK_SIZE>;
+	};
+
+	PoolAllocator() = default;
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U, BLOCK_SIZE>& /*other*/) {}
+
+	[[nodiscard]] T* allocate(size_t n)
+	{
+		if (usePool(n)) {
+			return static_cast<T*>(BlockPool<BLOCK_SIZE>::instance().allocate());
+		}
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+		if (usePool(n)) {
+			BlockPool<BLOCK_SIZE>::instance().deallocate(p);
+		} else {
+			::operator delete(p);
+		}
+	}
+
+	template<typename U>
+	[[nodiscard]] bool operator==(const PoolAllocator<U, BLOCK_SIZE>& /*other*/) const { return true; }
+	template<typename U>
+	[[nodiscard]] bool operator!=(const PoolAllocator<U, BLOCK_SIZE>& /*other*/) const { return false; }
+
+private:
+	[[nodiscard]] static constexpr bool usePool(size_t n)
+	{
+		return (n == 1) && (sizeof(T) <= BLOCK_SIZE) &&
+		       (alignof(T) <= alignof(std::max_align_t));
+	}
+};
+
+/** Same as std::make_shared<T>(args...), but the (combined object and
+  * reference count) memory block is recycled via a BlockPool.
+  */
+template<typename T, typename... Args>
+[[nodiscard]] std::shared_ptr<T> make_pooled_shared(Args&&... args)
+{
+	return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+} // namespace openmsx
+
+#endif // POOLALLOCATOR_HH
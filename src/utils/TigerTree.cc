@@ -2,6 +2,10 @@
 #include "tiger.hh"
 #include "Math.hh"
 #include "MemBuffer.hh"
+#include "parallelFor.hh"
+#include "endian.hh"
+#include "xrange.hh"
+#include <algorithm>
 #include <map>
 #include <cstring>
 #include <cassert>
@@ -10,6 +14,19 @@ namespace openmsx {
 
 constexpr size_t BLOCK_SIZE = 1024;
 
+// Only nodes at this level or higher (covering at least this many blocks) are
+// stored by saveCache(). Must be a power of 2.
+constexpr size_t PERSIST_LEVEL = 64;
+constexpr char CACHE_MAGIC[8] = {'o', 'M', 'S', 'X', 'T', 'T', 'H', '1'};
+static_assert(TigerTree::CACHE_HEADER_SIZE == sizeof(CACHE_MAGIC) + 8 + 8);
+
+// Number of leaves that are fetched before they're hashed (in parallel).
+constexpr size_t BATCH_LEAVES = 1024;
+constexpr size_t MIN_LEAVES_PER_TASK = 64;
+// tiger_leaf() temporarily overwrites the byte in front of the block, so in
+// the batch buffer each block gets its own (aligned) prefix.
+constexpr size_t SLOT_SIZE = BLOCK_SIZE + 8;
+
 struct TTCacheEntry
 {
 	MemBuffer<TigerHash> hash;
@@ -17,6 +34,7 @@ struct TTCacheEntry
 	size_t numNodes;
 	time_t time = -1;
 	size_t numNodesValid;
+	bool persistedChanged = false; // see TigerTree::needsCacheSave()
 };
 // Typically contains 0 or 1 element, and only rarely 2 or more. But we need
 // the address of existing elements to remain stable when new elements are
@@ -40,10 +58,21 @@ static TTCacheEntry& getCacheEntry(
 		result.numNodes = numNodes;
 		memset(result.valid.data(), 0, numNodes); // all invalid
 		result.numNodesValid = 0;
+		result.persistedChanged = false;
 	}
 	return result;
 }
 
+static size_t numPersistedNodes(size_t numNodes)
+{
+	// node 'n' has level >= PERSIST_LEVEL iff its lowest bits are all 1
+	return numNodes / PERSIST_LEVEL;
+}
+static size_t persistedNode(size_t i)
+{
+	return (PERSIST_LEVEL - 1) + i * PERSIST_LEVEL;
+}
+
 TigerTree::TigerTree(TTData& data_, size_t dataSize_, const std::string& name)
 	: data(data_)
 	, dataSize(dataSize_)
@@ -53,7 +82,14 @@ TigerTree::TigerTree(TTData& data_, size_t dataSize_, const std::string& name)
 
 const TigerHash& TigerTree::calcHash(const std::function<void(size_t, size_t)>& progressCallback)
 {
-	return calcHash(getTop(), progressCallback);
+	hashLeavesParallel(progressCallback);
+	const auto& result = calcHash(getTop(), progressCallback);
+	if (progressCallback && (entry.numNodesValid != entry.numNodes)) {
+		// after loadCache() lower nodes can remain invalid, still
+		// signal completion
+		progressCallback(entry.numNodes, entry.numNodes);
+	}
+	return result;
 }
 
 void TigerTree::notifyChange(size_t offset, size_t len, time_t time)
@@ -63,23 +99,146 @@ void TigerTree::notifyChange(size_t offset, size_t len, time_t time)
 	assert((offset + len) <= dataSize);
 	if (len == 0) return;
 
-	if (entry.valid[getTop().n]) {
-		entry.valid[getTop().n] = false; // set sentinel
-		entry.numNodesValid--;
-	}
+	// Normally an invalid node implies that all its ancestors are invalid
+	// as well. But after loadCache() that's only true for the nodes at
+	// PERSIST_LEVEL or higher, so below that level always continue.
+	auto top = getTop().n;
 	auto first = offset / BLOCK_SIZE;
 	auto last = (offset + len - 1) / BLOCK_SIZE;
 	assert(first <= last); // requires len != 0
 	do {
 		auto node = getLeaf(first);
-		while (entry.valid[node.n]) {
-			entry.valid[node.n] = false;
-			entry.numNodesValid--;
+		while (true) {
+			if (entry.valid[node.n]) {
+				entry.valid[node.n] = false;
+				entry.numNodesValid--;
+			} else if (node.l >= PERSIST_LEVEL) {
+				break;
+			}
+			if (node.n == top) break;
 			node = getParent(node);
 		}
 	} while (++first <= last);
 }
 
+std::vector<uint8_t> TigerTree::saveCache(time_t time)
+{
+	entry.persistedChanged = false;
+	std::vector<uint8_t> result(getCacheSize());
+	auto num = numPersistedNodes(entry.numNodes);
+	auto* p = result.data();
+	memcpy(p, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	Endian::write_UA_L64(p +  8, dataSize);
+	Endian::write_UA_L64(p + 16, uint64_t(time));
+	auto* valid = p + CACHE_HEADER_SIZE;
+	auto* hash = valid + num;
+	for (auto i : xrange(num)) {
+		auto n = persistedNode(i);
+		valid[i] = entry.valid[n];
+		if (entry.valid[n]) {
+			memcpy(hash + i * sizeof(TigerHash), entry.hash[n].h8, sizeof(TigerHash));
+		}
+	}
+	return result;
+}
+
+bool TigerTree::needsCacheSave() const
+{
+	return entry.persistedChanged;
+}
+
+size_t TigerTree::getCacheSize() const
+{
+	auto num = numPersistedNodes(entry.numNodes);
+	return CACHE_HEADER_SIZE + num * (1 + sizeof(TigerHash));
+}
+
+bool TigerTree::isCacheHeaderValid(span<const uint8_t> header) const
+{
+	if (entry.numNodesValid != 0) return false;
+	if (header.size() < CACHE_HEADER_SIZE) return false;
+	const auto* p = header.data();
+	return (memcmp(p, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0) &&
+	       (Endian::read_UA_L64(p + 8) == dataSize) &&
+	       (time_t(Endian::read_UA_L64(p + 16)) == entry.time);
+}
+
+bool TigerTree::loadCache(span<const uint8_t> buf)
+{
+	if (buf.size() != getCacheSize()) return false;
+	if (!isCacheHeaderValid(buf)) return false;
+
+	auto num = numPersistedNodes(entry.numNodes);
+	const auto* valid = buf.data() + CACHE_HEADER_SIZE;
+	const auto* hash = valid + num;
+	for (auto i : xrange(num)) {
+		if (!valid[i]) continue;
+		auto n = persistedNode(i);
+		memcpy(entry.hash[n].h8, hash + i * sizeof(TigerHash), sizeof(TigerHash));
+		entry.valid[n] = true;
+		entry.numNodesValid++;
+	}
+	entry.persistedChanged = false;
+	return true;
+}
+
+// Hashing the leaves (1kB each) is by far the most expensive part of the
+// calculation, an interior node only hashes 48 bytes. So only the leaves are
+// hashed in parallel.
+// Fetching the data must happen on this thread (TTData implementations don't
+// need to be reentrant), so first copy a batch of blocks and then hash them on
+// a few threads. This only handles the full blocks, the remaining (interior
+// and partial) nodes are calculated by calcHash(Node).
+void TigerTree::hashLeavesParallel(const std::function<void(size_t, size_t)>& progressCallback)
+{
+	if (entry.valid[getTop().n]) return;
+
+	auto numFullBlocks = dataSize / BLOCK_SIZE;
+	MemBuffer<uint8_t> buffer; // only allocated when needed
+	std::vector<size_t> batch; // node numbers
+	auto hashBatch = [&] {
+		auto num = batch.size();
+		if (num == 0) return;
+		auto hashRange = [&](size_t begin, size_t end) {
+			for (auto i : xrange(begin, end)) {
+				tiger_leaf(&buffer[i * SLOT_SIZE + 8], entry.hash[batch[i]]);
+			}
+		};
+		auto numTasks = std::clamp<size_t>(num / MIN_LEAVES_PER_TASK, 1, parallelForMaxThreads());
+		parallelFor(numTasks, [&](size_t t) {
+			hashRange((num * t) / numTasks, (num * (t + 1)) / numTasks);
+		});
+
+		for (auto n : batch) entry.valid[n] = true;
+		entry.numNodesValid += num;
+		batch.clear();
+		if (progressCallback) {
+			progressCallback(entry.numNodesValid, entry.numNodes);
+		}
+	};
+	forEachInvalidLeaf(getTop(), [&](size_t n) {
+		auto block = n / 2;
+		if (block >= numFullBlocks) return; // partial last block
+		if (buffer.empty()) buffer.resize(BATCH_LEAVES * SLOT_SIZE);
+		memcpy(&buffer[batch.size() * SLOT_SIZE + 8],
+		       data.getData(block * BLOCK_SIZE, BLOCK_SIZE), BLOCK_SIZE);
+		batch.push_back(n);
+		if (batch.size() == BATCH_LEAVES) hashBatch();
+	});
+	hashBatch();
+}
+
+void TigerTree::forEachInvalidLeaf(Node node, const std::function<void(size_t)>& action) const
+{
+	if (entry.valid[node.n]) return;
+	if (node.n & 1) {
+		forEachInvalidLeaf(getLeftChild (node), action);
+		forEachInvalidLeaf(getRightChild(node), action);
+	} else {
+		action(node.n);
+	}
+}
+
 const TigerHash& TigerTree::calcHash(Node node, const std::function<void(size_t, size_t)>& progressCallback)
 {
 	auto n = node.n;
@@ -110,6 +269,7 @@ const TigerHash& TigerTree::calcHash(Node node, const std::function<void(size_t,
 		}
 		entry.valid[n] = true;
 		entry.numNodesValid++;
+		if (node.l >= PERSIST_LEVEL) entry.persistedChanged = true;
 		if (progressCallback) {
 			progressCallback(entry.numNodesValid, entry.numNodes);
 		}
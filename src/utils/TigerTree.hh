@@ -28,10 +28,12 @@
 #ifndef TIGERTREE_HH
 #define TIGERTREE_HH
 
+#include "span.hh"
 #include <string>
 #include <cstdint>
 #include <ctime>
 #include <functional>
+#include <vector>
 
 namespace openmsx {
 
@@ -88,6 +90,41 @@ public:
 	 */
 	void notifyChange(size_t offset, size_t len, time_t time);
 
+	/** Serialize the (already calculated part of the) upper levels of
+	 * the tree, so that it can be stored between openMSX sessions. The
+	 * nodes near the leaves are not included, this keeps the result small
+	 * (roughly 1/1300 of the data size) while a modification still only
+	 * requires to rehash a few blocks.
+	 * The result is tied to the data size and to the given modification
+	 * time, loadCache() rejects it when either changed.
+	 */
+	[[nodiscard]] std::vector<uint8_t> saveCache(time_t time);
+
+	/** Were nodes that are included in saveCache() calculated since the
+	 * last saveCache() or loadCache() call? If not, there's no need to
+	 * save (again).
+	 */
+	[[nodiscard]] bool needsCacheSave() const;
+
+	/** The size of the saveCache() result.
+	 */
+	[[nodiscard]] size_t getCacheSize() const;
+
+	/** Would loadCache() accept a cache with this header (the first
+	 * CACHE_HEADER_SIZE bytes)? This allows to skip reading the (much
+	 * larger) rest of an outdated cache.
+	 */
+	[[nodiscard]] bool isCacheHeaderValid(span<const uint8_t> header) const;
+
+	/** Restore the result of an earlier saveCache() call. This is only
+	 * done when nothing was calculated yet for this data (otherwise the
+	 * in-memory cache is at least as good).
+	 * @return Was the cache restored?
+	 */
+	bool loadCache(span<const uint8_t> buf);
+
+	static constexpr size_t CACHE_HEADER_SIZE = 8 + 8 + 8;
+
 private:
 	// functions to navigate in binary tree
 	struct Node {
@@ -102,6 +139,8 @@ private:
 	[[nodiscard]] Node getRightChild(Node node) const;
 
 	[[nodiscard]] const TigerHash& calcHash(Node node, const std::function<void(size_t, size_t)>& progressCallback);
+	void hashLeavesParallel(const std::function<void(size_t, size_t)>& progressCallback);
+	void forEachInvalidLeaf(Node node, const std::function<void(size_t)>& action) const;
 
 	TTData& data;
 	const size_t dataSize;
@@ -753,4 +753,70 @@ safe_match_copy:
 	return int(op - dst); // Nb of output bytes decoded
 }
 
+static bool read_variable_length_safe(const uint8_t*& ip, const uint8_t* iend, size_t& length)
+{
+	unsigned s;
+	do {
+		if (ip == iend) return false;
+		s = *ip++;
+		length += s;
+	} while (s == 255);
+	return true;
+}
+
+int decompressSafe(const uint8_t* src, uint8_t* dst, int srcSize, int dstCapacity)
+{
+	const uint8_t* ip = src;
+	const uint8_t* const iend = ip + srcSize;
+
+	uint8_t* op = dst;
+	uint8_t* const oend = op + dstCapacity;
+
+	if (srcSize <= 0) return -1;
+
+	while (true) {
+		if (ip == iend) return -1;
+		unsigned token = *ip++;
+
+		// literals
+		size_t length = token >> ML_BITS;
+		if ((length == RUN_MASK) && !read_variable_length_safe(ip, iend, length)) {
+			return -1;
+		}
+		if ((length > size_t(iend - ip)) || (length > size_t(oend - op))) {
+			return -1;
+		}
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+		if (ip == iend) break; // the last sequence only has literals
+
+		// match
+		if ((iend - ip) < 2) return -1;
+		size_t offset = Endian::read_UA_L16(ip);
+		ip += 2;
+		if ((offset == 0) || (offset > size_t(op - dst))) return -1;
+
+		length = token & ML_MASK;
+		if ((length == ML_MASK) && !read_variable_length_safe(ip, iend, length)) {
+			return -1;
+		}
+		length += MINMATCH;
+		if (length > size_t(oend - op)) return -1;
+
+		const uint8_t* match = op - offset;
+		if (offset >= length) {
+			memcpy(op, match, length);
+			op += length;
+		} else {
+			// overlapping, repeats the last 'offset' bytes
+			for (size_t i = 0; i < length; ++i) {
+				*op++ = *match++;
+			}
+		}
+	}
+
+	return int(op - dst);
+}
+
 } // namespace LZ4
@@ -37,8 +37,9 @@
 //
 // The most important changes are:
 // - Stripped out all functions we don't use.
-// - Removed all safety checks. We only decompress data returned from the
-//   compress function, and that data is never stored/reloaded from disk.
+// - Removed all safety checks from decompress(). It's only used on data
+//   returned from the compress function that was never stored/reloaded from
+//   disk. Use decompressSafe() for data that was read from a file.
 // - Rewrite in C++ style.
 // - Use existing openMSX helper functions.
 
@@ -55,6 +56,12 @@ namespace LZ4 {
 
 	[[nodiscard]] int compress  (const uint8_t* src, uint8_t* dst, int srcSize);
 	int decompress(const uint8_t* src, uint8_t* dst, int compressedSize, int dstCapacity);
+
+	/** Same as decompress(), but checks that the input is valid (as in
+	  * it's never read or written outside the given buffers). Slower.
+	  * @return The number of decompressed bytes, or -1 on invalid input.
+	  */
+	[[nodiscard]] int decompressSafe(const uint8_t* src, uint8_t* dst, int compressedSize, int dstCapacity);
 }
 
 #endif
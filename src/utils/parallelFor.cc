@@ -0,0 +1,93 @@
+#include "parallelFor.hh"
+#include "ThreadPool.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace openmsx {
+
+ThreadPool& getSharedThreadPool()
+{
+	static ThreadPool pool(ThreadPool::defaultNumThreads());
+	return pool;
+}
+
+unsigned parallelForMaxThreads()
+{
+	return getSharedThreadPool().size() + 1;
+}
+
+namespace {
+// Shared between the calling thread and the helper tasks. A helper that only
+// starts after the parallelFor() call returned doesn't find any work anymore,
+// but it still needs this state to find that out.
+struct ParallelForState {
+	ParallelForState(size_t n_, const std::function<void(size_t)>& fn_)
+		: n(n_), fn(fn_) {}
+
+	// Claim and execute indices until there are none left.
+	void run()
+	{
+		size_t count = 0;
+		for (size_t i = next++; i < n; i = next++) {
+			if (!failed) {
+				try {
+					fn(i);
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error) error = std::current_exception();
+					failed = true;
+				}
+			}
+			++count;
+		}
+		if (count == 0) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		finished += count;
+		if (finished == n) done.notify_all();
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return finished == n; });
+	}
+
+	const size_t n;
+	const std::function<void(size_t)>& fn; // only used for claimed indices
+	std::atomic<size_t> next = 0;
+	std::atomic<bool> failed = false;
+
+	std::mutex mutex; // protects 'finished' and 'error'
+	std::condition_variable done;
+	size_t finished = 0;
+	std::exception_ptr error;
+};
+}
+
+void parallelFor(size_t n, const std::function<void(size_t)>& fn)
+{
+	auto& pool = getSharedThreadPool();
+	if (n <= 1 || pool.size() == 0) {
+		for (auto i : xrange(n)) fn(i);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelForState>(n, fn);
+	try {
+		for ([[maybe_unused]] auto h : xrange(std::min<size_t>(n - 1, pool.size()))) {
+			(void)pool.enqueue([state] { state->run(); });
+		}
+	} catch (...) {
+		// Ignore, with fewer helpers the calling thread does more work.
+	}
+	state->run();
+	state->wait();
+	if (state->error) std::rethrow_exception(state->error);
+}
+
+} // namespace openmsx
@@ -0,0 +1,35 @@
+#ifndef PARALLELFOR_HH
+#define PARALLELFOR_HH
+
+#include <cstddef>
+#include <functional>
+
+namespace openmsx {
+
+class ThreadPool;
+
+/** The worker threads that are shared by all of openMSX: the helpers of
+  * parallelFor(), but also background work like hashing files or
+  * compressing snapshots. Use enqueue() on it for such background tasks.
+  */
+[[nodiscard]] ThreadPool& getSharedThreadPool();
+
+/** The maximum number of threads that execute a parallelFor() call: the
+  * workers of the shared pool plus the calling thread. Useful to decide in
+  * how many parts some work should be split.
+  */
+[[nodiscard]] unsigned parallelForMaxThreads();
+
+/** Call 'fn(i)' for all 'i' in [0, n), in parallel on the calling thread
+  * and on the shared pool. Returns when all calls have finished.
+  *
+  * The calling thread does all calls that weren't started yet by a worker,
+  * so it never waits for unrelated (possibly long running) tasks on the
+  * shared pool. When 'fn' throws, the remaining calls are skipped and the
+  * first exception is rethrown (after all running calls have finished).
+  */
+void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+} // namespace openmsx
+
+#endif
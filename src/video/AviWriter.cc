@@ -6,6 +6,7 @@
 #include "build-info.hh"
 #include "Version.hh"
 #include "cstdiop.hh" // for snprintf
+#include "FrameSource.hh"
 #include <cassert>
 #include <cstring>
 #include <ctime>
@@ -14,6 +15,11 @@ namespace openmsx {
 
 constexpr unsigned AVI_HEADER_SIZE = 500;
 
+// Maximum number of frames that are captured but not yet written. When the
+// encoder thread can't keep up, the emulation waits (instead of using an
+// unbounded amount of memory).
+constexpr size_t MAX_QUEUED_FRAMES = 4;
+
 AviWriter::AviWriter(const Filename& filename, unsigned width_,
                      unsigned height_, unsigned bpp, unsigned channels_,
                      unsigned freq_)
@@ -33,10 +39,20 @@ AviWriter::AviWriter(const Filename& filename, unsigned width_,
 	frames = 0;
 	written = 0;
 	audiowritten = 0;
+
+	encodeThread = std::thread([this] { encodeLoop(); });
 }
 
 AviWriter::~AviWriter()
 {
+	// write the remaining frames
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finish = true;
+	}
+	condition.notify_all();
+	encodeThread.join();
+
 	if (written == 0) {
 		// no data written yet (a recording less than one video frame)
 		std::string filename = file.getURL();
@@ -263,22 +279,92 @@ void AviWriter::addAviChunk(const char* tag, unsigned size, void* data, unsigned
 
 void AviWriter::addFrame(FrameSource* frame, unsigned samples, int16_t* sampleData)
 {
-	bool keyFrame = (frames++ % 300 == 0);
+	assert((samples % channels) == 0);
+	assert((samples == 0) || (audiorate != 0));
+
+	Frame f;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [&] {
+			return error || (queue.size() < MAX_QUEUED_FRAMES);
+		});
+		if (error) std::rethrow_exception(error);
+		if (!freeBuffers.empty()) {
+			f.pixels = std::move(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+	}
+	// The FrameSource is only valid during this call, so copy it now
+	// (without holding the lock).
+	codec.captureFrame(frame, f.pixels);
+	f.pixelFormat = frame->getPixelFormat();
+	f.samples.assign(sampleData, sampleData + samples);
+	f.keyFrame = (frames++ % 300 == 0);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(f));
+	}
+	condition.notify_all();
+}
+
+// Executed on 'encodeThread'. Frames depend on the previous frame (and share
+// one zlib stream), so they're compressed one after the other. The motion
+// search within a frame is done in parallel, see ZMBVEncoder.
+void AviWriter::encodeLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		condition.wait(lock, [&] { return finish || !queue.empty(); });
+		if (queue.empty()) return; // finished
+		Frame frame = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		condition.notify_all(); // there's room in the queue again
+
+		std::exception_ptr e;
+		try {
+			writeFrame(frame);
+		} catch (MSXException&) {
+			e = std::current_exception();
+		} catch (std::exception& ex) {
+			// e.g. std::bad_alloc, don't let it terminate openMSX. The
+			// callers of addFrame() only expect MSXException.
+			try {
+				throw MSXException(ex.what());
+			} catch (MSXException&) {
+				e = std::current_exception();
+			}
+		}
+
+		lock.lock();
+		if (e) {
+			// drop the remaining frames, the error is reported to
+			// the next addFrame() call
+			error = e;
+			queue.clear();
+			condition.notify_all();
+			return;
+		}
+		freeBuffers.push_back(std::move(frame.pixels));
+	}
+}
+
+void AviWriter::writeFrame(Frame& frame)
+{
 	void* buffer;
 	unsigned size;
-	codec.compressFrame(keyFrame, frame, buffer, size);
-	addAviChunk("00dc", size, buffer, keyFrame ? 0x10 : 0x0);
+	codec.compressFrame(frame.keyFrame, frame.pixelFormat, frame.pixels,
+	                    buffer, size);
+	addAviChunk("00dc", size, buffer, frame.keyFrame ? 0x10 : 0x0);
 
-	if (samples) {
-		assert((samples % channels) == 0);
-		assert(audiorate != 0);
+	if (auto samples = unsigned(frame.samples.size())) {
 		if (OPENMSX_BIGENDIAN) {
 			// See comment in WavWriter::write()
 			//VLA(Endian::L16, buf, samples); // doesn't work in clang
-			std::vector<Endian::L16> buf(sampleData, sampleData + samples);
+			std::vector<Endian::L16> buf(frame.samples.begin(), frame.samples.end());
 			addAviChunk("01wb", samples * sizeof(int16_t), buf.data(), 0);
 		} else {
-			addAviChunk("01wb", samples * sizeof(int16_t), sampleData, 0);
+			addAviChunk("01wb", samples * sizeof(int16_t), frame.samples.data(), 0);
 		}
 		audiowritten += samples;
 	}
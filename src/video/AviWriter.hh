@@ -5,8 +5,14 @@
 
 #include "ZMBVEncoder.hh"
 #include "File.hh"
+#include "PixelFormat.hh"
 #include "endian.hh"
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace openmsx {
@@ -20,16 +26,41 @@ public:
 	AviWriter(const Filename& filename, unsigned width, unsigned height,
 	          unsigned bpp, unsigned channels, unsigned freq);
 	~AviWriter();
+
+	/** Add a video frame and the audio samples belonging to it. The frame
+	  * is only copied here, compressing and writing it happens on a
+	  * separate thread. This only blocks when that thread is too far
+	  * behind.
+	  * @throws MSXException when writing an earlier frame failed.
+	  */
 	void addFrame(FrameSource* frame, unsigned samples, int16_t* sampleData);
 	void setFps(float fps_) { fps = fps_; }
 
 private:
+	struct Frame {
+		ZMBVEncoder::FrameBuffer pixels;
+		PixelFormat pixelFormat;
+		std::vector<int16_t> samples;
+		bool keyFrame;
+	};
+
+	void encodeLoop();
+	void writeFrame(Frame& frame);
 	void addAviChunk(const char* tag, unsigned size, void* data, unsigned flags);
 
 	File file;
 	ZMBVEncoder codec;
 	std::vector<Endian::L32> index;
 
+	// Frames wait in 'queue' until they're written by 'encodeThread'.
+	std::thread encodeThread;
+	std::mutex mutex; // protects the members below
+	std::condition_variable condition;
+	std::deque<Frame> queue;
+	std::vector<ZMBVEncoder::FrameBuffer> freeBuffers; // for reuse
+	std::exception_ptr error; // set when writing failed
+	bool finish = false;
+
 	float fps;
 	const unsigned width;
 	const unsigned height;
@@ -0,0 +1,208 @@
+#include "BandedScaler.hh"
+#include "FrameSource.hh"
+#include "PostProcessor.hh"
+#include "Scaler.hh"
+#include "ScalerOutput.hh"
+#include "parallelFor.hh"
+#include "Math.hh"
+#include "xrange.hh"
+#include <algorithm>
+#include <cassert>
+
+namespace openmsx {
+
+/** Minimum number of destination lines per band when scaling in parallel.
+  */
+constexpr unsigned MIN_LINES_PER_BAND = 64;
+
+template<typename Pixel>
+void BandedScaler<Pixel>::scaleBand(
+	FrameSource& src, const RawFrame* superImpose,
+	Scaler<Pixel>& scaler, ScalerOutput<Pixel>& dst,
+	unsigned srcStartY, unsigned dstStartY, unsigned bandEndY,
+	unsigned srcStep, unsigned dstStep)
+{
+	// TODO: Store all MSX lines in RawFrame and only scale the ones that fit
+	//       on the PC screen, as a preparation for resizable output window.
+	const unsigned srcHeight = src.getHeight();
+	while (dstStartY < bandEndY) {
+		// Currently this is true because the source frame height
+		// is always >= dstHeight/(dstStep/srcStep).
+		assert(srcStartY < srcHeight);
+
+		// get region with equal lineWidth
+		unsigned lineWidth = PostProcessor::getLineWidth(&src, srcStartY, srcStep);
+		unsigned srcEndY = srcStartY + srcStep;
+		unsigned dstEndY = dstStartY + dstStep;
+		while ((srcEndY < srcHeight) && (dstEndY < bandEndY) &&
+		       (PostProcessor::getLineWidth(&src, srcEndY, srcStep) == lineWidth)) {
+			srcEndY += srcStep;
+			dstEndY += dstStep;
+		}
+
+		// fill region
+		scaler.scaleImage(
+			src, superImpose,
+			srcStartY, srcEndY, lineWidth, // source
+			dst, dstStartY, dstEndY); // dest
+
+		// next region
+		srcStartY = srcEndY;
+		dstStartY = dstEndY;
+	}
+}
+
+template<typename Pixel>
+std::vector<bool> BandedScaler<Pixel>::getDirtyUnits(
+	FrameSource& src, const Params& params, bool cacheable,
+	unsigned srcStep, unsigned numUnits)
+{
+	std::vector<bool> dirty(numUnits, true);
+	if (!cacheable) {
+		lineHashes.clear();
+		return dirty;
+	}
+
+	const unsigned srcHeight = src.getHeight();
+	std::vector<uint64_t> hashes(srcHeight);
+	for (auto y : xrange(srcHeight)) {
+		hashes[y] = src.getLineHash<Pixel>(y);
+	}
+	if ((params == cacheParams) && (hashes.size() == lineHashes.size())) {
+		// A unit must be rescaled when one of its source lines, or
+		// one of the lines around it that the scaler reads, changed.
+		constexpr int KERNEL_MARGIN = 2;
+		std::vector<bool> changed(srcHeight);
+		for (auto y : xrange(srcHeight)) {
+			changed[y] = hashes[y] != lineHashes[y];
+		}
+		for (auto u : xrange(numUnits)) {
+			int begin = std::max(int(u * srcStep) - KERNEL_MARGIN, 0);
+			int end = std::min(int((u + 1) * srcStep) + KERNEL_MARGIN,
+			                   int(srcHeight));
+			bool d = false;
+			for (auto y : xrange(begin, end)) d |= changed[y];
+			dirty[u] = d;
+		}
+	} else {
+		cacheParams = params;
+		scaledCache.resize(size_t(params.width) * params.height);
+	}
+	lineHashes = std::move(hashes);
+	return dirty;
+}
+
+template<typename Pixel>
+void BandedScaler<Pixel>::scale(
+	FrameSource& src, const RawFrame* superImpose,
+	const Params& params, unsigned maxBands, bool cacheable,
+	const std::function<Scaler<Pixel>&(unsigned)>& getScaler,
+	const std::function<std::unique_ptr<ScalerOutput<Pixel>>()>& createOutput,
+	const std::function<Pixel*(unsigned)>& getLinePtr)
+{
+	const unsigned srcHeight = src.getHeight();
+	const unsigned dstHeight = params.height;
+
+	unsigned g = Math::gcd(srcHeight, dstHeight);
+	unsigned srcStep = srcHeight / g;
+	unsigned dstStep = dstHeight / g;
+
+	// Split the frame in bands of consecutive (srcStep, dstStep) units,
+	// unit 'i' covers source lines [i * srcStep, (i + 1) * srcStep).
+	unsigned numBands = std::clamp(dstHeight / MIN_LINES_PER_BAND, 1u, maxBands);
+	auto isBlank = [&](unsigned unit) {
+		return PostProcessor::getLineWidth(&src, unit * srcStep, srcStep) == 1;
+	};
+	std::vector<unsigned> bandBegin;
+	bandBegin.push_back(0);
+	for (auto t : xrange(1u, numBands)) {
+		unsigned unit = std::max(g * t / numBands, bandBegin.back());
+		// The last line of a blank region is scaled together with the
+		// next (non-blank) region, so don't split in the middle of a
+		// blank region.
+		while ((0 < unit) && (unit < g) &&
+		       isBlank(unit - 1) && isBlank(unit)) {
+			++unit;
+		}
+		if ((unit != bandBegin.back()) && (unit < g)) bandBegin.push_back(unit);
+	}
+	bandBegin.push_back(g);
+	numBands = unsigned(bandBegin.size() - 1);
+
+	// Each band gets its own scaler and output object. The latter are
+	// created (and destroyed) on this thread because they may lock the
+	// output surface.
+	std::vector<Scaler<Pixel>*> scalers;
+	std::vector<std::unique_ptr<ScalerOutput<Pixel>>> dsts;
+	for (auto t : xrange(numBands)) {
+		scalers.push_back(&getScaler(t));
+		dsts.push_back(createOutput());
+	}
+
+	// Only rescale the units that (might have) changed since the previous
+	// frame, copy the others from 'scaledCache'. A blank region is always
+	// scaled as a whole (see above), so if one of its units is dirty, all
+	// of them are.
+	auto dirty = getDirtyUnits(src, params, cacheable, srcStep, g);
+	bool useCache = !lineHashes.empty();
+	for (auto u : xrange(1u, g)) {
+		if (dirty[u - 1] && isBlank(u - 1) && isBlank(u)) dirty[u] = true;
+	}
+	for (unsigned u = g - 1; u > 0; --u) {
+		if (dirty[u] && isBlank(u - 1) && isBlank(u)) dirty[u - 1] = true;
+	}
+	std::vector<Pixel*> lines(dstHeight);
+	if (useCache) {
+		for (auto y : xrange(dstHeight)) lines[y] = getLinePtr(y);
+	}
+	const unsigned width = params.width;
+	auto copyRows = [&](unsigned unitBegin, unsigned unitEnd, bool toCache) {
+		for (auto y : xrange(unitBegin * dstStep, unitEnd * dstStep)) {
+			auto* line = lines[y];
+			auto* cached = &scaledCache[y * width];
+			if (toCache) {
+				std::copy_n(line, width, cached);
+			} else {
+				std::copy_n(cached, width, line);
+			}
+		}
+	};
+
+	// Scale the bands in parallel, each band with its own scaler.
+	// All scalers only write the destination lines of their own band (they
+	// do read source lines from the neighbouring bands, but the frame isn't
+	// modified while scaling), so the result is exactly the same as when
+	// scaling the whole frame at once. The same holds for the runs of
+	// dirty units within a band.
+	parallelFor(numBands, [&](size_t t) {
+		unsigned begin = bandBegin[t];
+		unsigned end = bandBegin[t + 1];
+		while (begin < end) {
+			unsigned runEnd = begin + 1;
+			while ((runEnd < end) && (dirty[runEnd] == dirty[begin])) {
+				++runEnd;
+			}
+			if (dirty[begin]) {
+				scaleBand(src, superImpose, *scalers[t], *dsts[t],
+				          begin * srcStep,
+				          begin * dstStep, runEnd * dstStep,
+				          srcStep, dstStep);
+				if (useCache) copyRows(begin, runEnd, true);
+			} else {
+				copyRows(begin, runEnd, false);
+			}
+			begin = runEnd;
+		}
+	});
+}
+
+
+// Force template instantiation.
+#if HAVE_16BPP
+template class BandedScaler<uint16_t>;
+#endif
+#if HAVE_32BPP
+template class BandedScaler<uint32_t>;
+#endif
+
+} // namespace openmsx
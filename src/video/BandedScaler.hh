@@ -0,0 +1,96 @@
+#ifndef BANDEDSCALER_HH
+#define BANDEDSCALER_HH
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace openmsx {
+
+class FrameSource;
+class RawFrame;
+template<typename Pixel> class Scaler;
+template<typename Pixel> class ScalerOutput;
+
+/** Applies a scaler to a whole frame, used by FBPostProcessor.
+  *
+  * The frame is split in horizontal bands which are scaled in parallel (each
+  * band with its own scaler instance). A copy of the scaled image is kept, on
+  * the next frame only the lines of which the source changed are scaled
+  * again, the others are copied from that cache. Neither of these changes the
+  * result: it's always exactly the same as scaling the whole frame at once.
+  */
+template<typename Pixel>
+class BandedScaler
+{
+public:
+	/** Settings (other than the scaler itself) that influence the scaled
+	  * image. When one of these changes, the cached image is invalid.
+	  */
+	struct Params {
+		int scanlineFactor = -1;
+		int blurFactor = -1;
+		unsigned inWidth = 0;
+		unsigned width = 0;  // of the output
+		unsigned height = 0; // of the output
+
+		bool operator==(const Params& other) const {
+			return (scanlineFactor == other.scanlineFactor) &&
+			       (blurFactor     == other.blurFactor) &&
+			       (inWidth        == other.inWidth) &&
+			       (width          == other.width) &&
+			       (height         == other.height);
+		}
+		bool operator!=(const Params& other) const {
+			return !(*this == other);
+		}
+	};
+
+	/** Forget the cached image, must be called when the scaler changes.
+	  */
+	void invalidate() { lineHashes.clear(); }
+
+	/** Scale 'src' to the output lines [0, params.height).
+	  * @param maxBands Maximum number of bands, 1 means scale serially.
+	  * @param cacheable False if the scaled image can't be reused, e.g. for
+	  *        MLAA (looks at a whole region at once) or when superimposing
+	  *        video (changes every frame anyway).
+	  * @param getScaler Returns the scaler for the given band, the same one
+	  *        for the same band number on every call.
+	  * @param createOutput Creates the ScalerOutput for one band.
+	  * @param getLinePtr Pointer to a line of the output, used to fill and
+	  *        use the cache.
+	  * The callbacks are only called from the calling thread.
+	  */
+	void scale(FrameSource& src, const RawFrame* superImpose,
+	           const Params& params, unsigned maxBands, bool cacheable,
+	           const std::function<Scaler<Pixel>&(unsigned)>& getScaler,
+	           const std::function<std::unique_ptr<ScalerOutput<Pixel>>()>& createOutput,
+	           const std::function<Pixel*(unsigned)>& getLinePtr);
+
+private:
+	void scaleBand(FrameSource& src, const RawFrame* superImpose,
+	               Scaler<Pixel>& scaler, ScalerOutput<Pixel>& dst,
+	               unsigned srcStartY, unsigned dstStartY, unsigned bandEndY,
+	               unsigned srcStep, unsigned dstStep);
+	std::vector<bool> getDirtyUnits(
+		FrameSource& src, const Params& params, bool cacheable,
+		unsigned srcStep, unsigned numUnits);
+
+	Params cacheParams;
+
+	/** Hashes of the source lines of the previously scaled frame, empty
+	  * when 'scaledCache' is invalid.
+	  */
+	std::vector<uint64_t> lineHashes;
+
+	/** Copy of the previously scaled image. Rows of which the source lines
+	  * didn't change are copied from here instead of being scaled again.
+	  */
+	std::vector<Pixel> scaledCache;
+};
+
+} // namespace openmsx
+
+#endif
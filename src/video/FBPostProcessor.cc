@@ -6,6 +6,7 @@
 #include "Scaler.hh"
 #include "ScalerFactory.hh"
 #include "SDLOutputSurface.hh"
+#include "parallelFor.hh"
 #include "Math.hh"
 #include "aligned.hh"
 #include "checked_cast.hh"
@@ -16,6 +17,8 @@
 #include <cmath>
 #include <cstdint>
 #include <cstddef>
+#include <memory>
+#include <vector>
 #ifdef __SSE2__
 #include <emmintrin.h>
 #endif
@@ -277,52 +280,46 @@ void FBPostProcessor<Pixel>::paint(OutputSurface& output_)
 		currScaler = ScalerFactory<Pixel>::createScaler(
 			PixelOperations<Pixel>(output.getPixelFormat()),
 			renderSettings);
+		bandScalers.clear();
+		bandedScaler.invalidate();
 	}
 
 	// Scale image.
-	const unsigned srcHeight = paintFrame->getHeight();
-	const unsigned dstHeight = output.getLogicalHeight();
-
-	unsigned g = Math::gcd(srcHeight, dstHeight);
-	unsigned srcStep = srcHeight / g;
-	unsigned dstStep = dstHeight / g;
-
-	// TODO: Store all MSX lines in RawFrame and only scale the ones that fit
-	//       on the PC screen, as a preparation for resizable output window.
-	unsigned srcStartY = 0;
-	unsigned dstStartY = 0;
-	while (dstStartY < dstHeight) {
-		// Currently this is true because the source frame height
-		// is always >= dstHeight/(dstStep/srcStep).
-		assert(srcStartY < srcHeight);
-
-		// get region with equal lineWidth
-		unsigned lineWidth = getLineWidth(paintFrame, srcStartY, srcStep);
-		unsigned srcEndY = srcStartY + srcStep;
-		unsigned dstEndY = dstStartY + dstStep;
-		while ((srcEndY < srcHeight) && (dstEndY < dstHeight) &&
-		       (getLineWidth(paintFrame, srcEndY, srcStep) == lineWidth)) {
-			srcEndY += srcStep;
-			dstEndY += dstStep;
+	// MLAA detects edges over a whole region at once, so it can't be split
+	// in bands, and neither can the scaled image be reused for it. A
+	// superimposed video changes every frame anyway.
+	bool splittable = algo != RenderSettings::SCALER_MLAA;
+	unsigned maxBands = (renderSettings.getRenderParallel() && splittable)
+		? parallelForMaxThreads() : 1;
+	bool cacheable = splittable && !superImposeVideoFrame;
+
+	typename BandedScaler<Pixel>::Params params;
+	params.scanlineFactor = renderSettings.getScanlineFactor();
+	params.blurFactor = renderSettings.getBlurFactor();
+	params.inWidth = lrintf(renderSettings.getHorizontalStretch());
+	params.width = output.getLogicalWidth();
+	params.height = output.getLogicalHeight();
+
+	auto getScaler = [&](unsigned band) -> Scaler<Pixel>& {
+		if (band == 0) return *currScaler;
+		while (bandScalers.size() < band) {
+			bandScalers.push_back(ScalerFactory<Pixel>::createScaler(
+				PixelOperations<Pixel>(output.getPixelFormat()),
+				renderSettings));
 		}
-
-		// fill region
-		//fprintf(stderr, "post processing lines %d-%d: %d\n",
-		//	srcStartY, srcEndY, lineWidth );
-		float horStretch = renderSettings.getHorizontalStretch();
-		unsigned inWidth = lrintf(horStretch);
-		std::unique_ptr<ScalerOutput<Pixel>> dst(
-			StretchScalerOutputFactory<Pixel>::create(
-				output, pixelOps, inWidth));
-		currScaler->scaleImage(
-			*paintFrame, superImposeVideoFrame,
-			srcStartY, srcEndY, lineWidth, // source
-			*dst, dstStartY, dstEndY); // dest
-
-		// next region
-		srcStartY = srcEndY;
-		dstStartY = dstEndY;
-	}
+		return *bandScalers[band - 1];
+	};
+	auto createOutput = [&] {
+		return StretchScalerOutputFactory<Pixel>::create(
+			output, pixelOps, params.inWidth);
+	};
+	auto pixelAccess = output.getDirectPixelAccess();
+	auto getLinePtr = [&](unsigned y) {
+		return pixelAccess.getLinePtr<Pixel>(y);
+	};
+	bandedScaler.scale(*paintFrame, superImposeVideoFrame, params,
+	                   maxBands, cacheable,
+	                   getScaler, createOutput, getLinePtr);
 
 	drawNoise(output);
 
@@ -2,14 +2,17 @@
 #define FBPOSTPROCESSOR_HH
 
 #include "PostProcessor.hh"
+#include "BandedScaler.hh"
 #include "RenderSettings.hh"
 #include "PixelOperations.hh"
+#include <cstdint>
 #include <vector>
 
 namespace openmsx {
 
 class MSXMotherBoard;
 class Display;
+class SDLOutputSurface;
 template<typename Pixel> class Scaler;
 
 /** Rasterizer using SDL.
@@ -43,6 +46,12 @@ private:
 	  */
 	std::unique_ptr<Scaler<Pixel>> currScaler;
 
+	/** Extra instances of the active scaler, one per additional band when
+	  * scaling in parallel (some scalers keep state while scaling, so the
+	  * bands can't share a single instance).
+	  */
+	std::vector<std::unique_ptr<Scaler<Pixel>>> bandScalers;
+
 	/** Currently active scale algorithm, used to detect scaler changes.
 	  */
 	RenderSettings::ScaleAlgorithm scaleAlgorithm;
@@ -51,6 +60,11 @@ private:
 	  */
 	unsigned scaleFactor;
 
+	/** Scales the frame in (parallel) bands and keeps the scaled image to
+	  * reuse the lines that didn't change.
+	  */
+	BandedScaler<Pixel> bandedScaler;
+
 	/** Remember the noise values to get a stable image when paused.
 	 */
 	std::vector<unsigned> noiseShift;
@@ -6,6 +6,7 @@
 #include "aligned.hh"
 #include "likely.hh"
 #include "vla.hh"
+#include "xxhash.hh"
 #include "build-info.hh"
 #include "components.hh"
 #include <cstdint>
@@ -66,6 +67,21 @@ const Pixel* FrameSource::getLinePtr960_720(unsigned line, Pixel* buf0) const
 	}
 }
 
+template <typename Pixel>
+uint64_t FrameSource::getLineHash(unsigned line) const
+{
+	alignas(SSE_ALIGNMENT) Pixel buf[1280]; // large enough for widest line
+	unsigned width;
+	auto* data = static_cast<const uint8_t*>(
+		getLineInfo(line, width, buf, 1280));
+	// Two 32-bit hashes with different seeds, a collision would leave a
+	// stale line on screen. The width is included via the size.
+	size_t size = width * sizeof(Pixel);
+	uint32_t h0 = xxhash_impl<false, 0xFF, 0>(data, size);
+	uint32_t h1 = xxhash_impl<false, 0xFF, 0x9E3779B9>(data, size);
+	return (uint64_t(h1) << 32) | h0;
+}
+
 template <typename Pixel>
 void FrameSource::scaleLine(
 	const Pixel* in, Pixel* out,
@@ -347,12 +363,14 @@ void FrameSource::scaleLine(
 template const uint16_t* FrameSource::getLinePtr320_240<uint16_t>(unsigned, uint16_t*) const;
 template const uint16_t* FrameSource::getLinePtr640_480<uint16_t>(unsigned, uint16_t*) const;
 template const uint16_t* FrameSource::getLinePtr960_720<uint16_t>(unsigned, uint16_t*) const;
+template uint64_t FrameSource::getLineHash<uint16_t>(unsigned) const;
 template void FrameSource::scaleLine<uint16_t>(const uint16_t*, uint16_t*, unsigned, unsigned) const;
 #endif
 #if HAVE_32BPP || COMPONENT_GL
 template const uint32_t* FrameSource::getLinePtr320_240<uint32_t>(unsigned, uint32_t*) const;
 template const uint32_t* FrameSource::getLinePtr640_480<uint32_t>(unsigned, uint32_t*) const;
 template const uint32_t* FrameSource::getLinePtr960_720<uint32_t>(unsigned, uint32_t*) const;
+template uint64_t FrameSource::getLineHash<uint32_t>(unsigned) const;
 template void FrameSource::scaleLine<uint32_t>(const uint32_t*, uint32_t*, unsigned, unsigned) const;
 #endif
 
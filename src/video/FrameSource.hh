@@ -5,6 +5,7 @@
 #include "aligned.hh"
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 
 namespace openmsx {
 
@@ -176,6 +177,14 @@ public:
 	template <typename Pixel>
 	const Pixel* getLinePtr960_720(unsigned line, Pixel* buf) const;
 
+	/** Get a hash of the content (width and pixels) of the given line.
+	  * Lines with equal hashes have (with very high probability) equal
+	  * content. This is used to detect which lines changed between two
+	  * frames.
+	  */
+	template <typename Pixel>
+	uint64_t getLineHash(unsigned line) const;
+
 	/** Returns the distance (in pixels) between two consecutive lines.
 	  * Is meant to be used in combination with getMultiLinePtr(). The
 	  * result is only meaningful when hasContiguousStorage() returns
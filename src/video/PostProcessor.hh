@@ -92,11 +92,11 @@ public:
 
 	CliComm& getCliComm();
 
-protected:
 	/** Returns the maximum width for lines [y..y+step).
 	  */
 	static unsigned getLineWidth(FrameSource* frame, unsigned y, unsigned step);
 
+protected:
 	PostProcessor(
 		MSXMotherBoard& motherBoard, Display& display,
 		OutputSurface& screen, const std::string& videoSource,
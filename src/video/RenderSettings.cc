@@ -129,6 +129,10 @@ RenderSettings::RenderSettings(CommandController& commandController)
 		"disablesprites", "disable sprite rendering",
 		false, Setting::DONT_SAVE)
 
+	, renderParallelSetting(commandController,
+		"render_parallel", "rasterize and scale the display lines of a "
+		"frame on multiple threads", false)
+
 	, cmdTimingSetting(commandController,
 		"cmdtiming", "VDP command timing", false,
 		EnumSetting<bool>::Map{{"real", false}, {"broken", true}},
@@ -130,6 +130,9 @@ public:
 	/** Disable sprite rendering? */
 	bool getDisableSprites() const { return disableSpritesSetting.getBoolean(); }
 
+	/** Rasterize display lines on multiple threads? */
+	bool getRenderParallel() const { return renderParallelSetting.getBoolean(); }
+
 	/** CmdTiming [real, broken].
 	  * This setting is intended for debugging only, not for users. */
 	EnumSetting<bool>& getCmdTimingSetting() { return cmdTimingSetting; }
@@ -218,6 +221,7 @@ private:
 	IntegerSetting scanlineAlphaSetting;
 	BooleanSetting limitSpritesSetting;
 	BooleanSetting disableSpritesSetting;
+	BooleanSetting renderParallelSetting;
 	EnumSetting<bool> cmdTimingSetting;
 	EnumSetting<bool> tooFastAccessSetting;
 	EnumSetting<DisplayDeform> displayDeformSetting;
@@ -8,12 +8,14 @@
 #include "PostProcessor.hh"
 #include "MemoryOps.hh"
 #include "OutputSurface.hh"
+#include "parallelFor.hh"
 #include "build-info.hh"
 #include "components.hh"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 using namespace gl;
 
@@ -51,6 +53,40 @@ static inline int translateX(int absoluteX, bool narrow)
 	return std::max(screenX, 0);
 }
 
+/** Minimum number of lines per task when rasterizing in parallel. Smaller
+  * ranges (e.g. the few lines drawn because of a mid-frame VDP change) are
+  * not worth the synchronization overhead.
+  */
+constexpr int MIN_LINES_PER_TASK = 32;
+
+/** Call 'renderLine(i)' for all 'i' in [0, num).
+  * In parallel mode a large enough range is split in consecutive chunks,
+  * that are rendered in parallel (see parallelFor()). This is only safe
+  * because 'renderLine(i)' only writes to (its own line in) the work frame
+  * and only reads VDP and VRAM state, and that state can't change until
+  * this function returns: the emulation thread is blocked waiting for it.
+  */
+template <typename F>
+static void forEachLine(bool parallel, int num, F renderLine)
+{
+	int numTasks = parallel
+		? std::min<int>(num / MIN_LINES_PER_TASK, parallelForMaxThreads())
+		: 1;
+	if (numTasks <= 1) {
+		for (int i = 0; i < num; ++i) renderLine(i);
+		return;
+	}
+
+	// Render the first line before starting the workers, this initializes
+	// lazily calculated state (e.g. the double pixel palette in
+	// BitmapConverter) that is shared by all lines.
+	renderLine(0);
+	auto chunkBegin = [&](int t) { return 1 + ((num - 1) * t) / numTasks; };
+	parallelFor(numTasks, [&](size_t t) {
+		for (int i = chunkBegin(int(t)); i < chunkBegin(int(t) + 1); ++i) renderLine(i);
+	});
+}
+
 template <class Pixel>
 inline void SDLRasterizer<Pixel>::renderBitmapLine(Pixel* buf, unsigned vramLine)
 {
@@ -543,8 +579,11 @@ void SDLRasterizer<Pixel>::drawDisplay(
 		pageBorder = pageSplit;
 	}
 
+	bool parallel = renderSettings.getRenderParallel();
 	if (mode.isBitmapMode()) {
-		for (int y = screenY; y < screenLimitY; y++) {
+		forEachLine(parallel, displayHeight, [&](int i) {
+			int y = screenY + i;
+			int lineY = (displayY + i) & 255;
 			// Which bits in the name mask determine the page?
 			// TODO optimize this?
 			//   Calculating pageMaskOdd/Even is a non-trivial amount
@@ -558,8 +597,8 @@ void SDLRasterizer<Pixel>::drawDisplay(
 				? (pageMaskOdd & ~0x100)
 				: pageMaskOdd;
 			const int vramLine[2] = {
-				(vram.nameTable.getMask() >> 7) & (pageMaskEven | displayY),
-				(vram.nameTable.getMask() >> 7) & (pageMaskOdd  | displayY)
+				(vram.nameTable.getMask() >> 7) & (pageMaskEven | lineY),
+				(vram.nameTable.getMask() >> 7) & (pageMaskOdd  | lineY)
 			};
 
 			Pixel buf[512];
@@ -591,27 +630,25 @@ void SDLRasterizer<Pixel>::drawDisplay(
 				       buf + x,
 				       (displayWidth - firstPageWidth) * sizeof(Pixel));
 			}
-
-			displayY = (displayY + 1) & 255;
-		}
+		});
 	} else {
 		// horizontal scroll (high) is implemented in CharacterConverter
-		for (int y = screenY; y < screenLimitY; y++) {
-			assert(!vdp.isMSX1VDP() || displayY < 192);
+		forEachLine(parallel, displayHeight, [&](int i) {
+			int y = screenY + i;
+			int lineY = (displayY + i) & 255;
+			assert(!vdp.isMSX1VDP() || lineY < 192);
 
 			Pixel* dst = workFrame->getLinePtrDirect<Pixel>(y)
 			           + leftBackground + displayX;
 			if ((displayX == 0) && (displayWidth == lineWidth)){
-				characterConverter.convertLine(dst, displayY);
+				characterConverter.convertLine(dst, lineY);
 			} else {
 				Pixel buf[512];
-				characterConverter.convertLine(buf, displayY);
+				characterConverter.convertLine(buf, lineY);
 				const Pixel* src = buf + displayX;
 				memcpy(dst, src, displayWidth * sizeof(Pixel));
 			}
-
-			displayY = (displayY + 1) & 255;
-		}
+		});
 	}
 }
 
@@ -644,31 +681,34 @@ void SDLRasterizer<Pixel>::drawSprites(
 	int screenX = translateX(
 		vdp.getLeftSprites(),
 		vdp.getDisplayMode().getLineWidth() == 512);
+	bool parallel = renderSettings.getRenderParallel();
+	auto drawLines = [&](auto drawLine) {
+		forEachLine(parallel, limitY - fromY, [&](int i) {
+			Pixel* pixelPtr = workFrame->getLinePtrDirect<Pixel>(screenY + i) + screenX;
+			drawLine(fromY + i, pixelPtr);
+		});
+	};
 	if (spriteMode == 1) {
-		for (int y = fromY; y < limitY; y++, screenY++) {
-			Pixel* pixelPtr = workFrame->getLinePtrDirect<Pixel>(screenY) + screenX;
+		drawLines([&](int y, Pixel* pixelPtr) {
 			spriteConverter.drawMode1(y, displayX, displayLimitX, pixelPtr);
-		}
+		});
 	} else {
 		byte mode = vdp.getDisplayMode().getByte();
 		if (mode == DisplayMode::GRAPHIC5) {
-			for (int y = fromY; y < limitY; y++, screenY++) {
-				Pixel* pixelPtr = workFrame->getLinePtrDirect<Pixel>(screenY) + screenX;
+			drawLines([&](int y, Pixel* pixelPtr) {
 				spriteConverter.template drawMode2<DisplayMode::GRAPHIC5>(
 					y, displayX, displayLimitX, pixelPtr);
-			}
+			});
 		} else if (mode == DisplayMode::GRAPHIC6) {
-			for (int y = fromY; y < limitY; y++, screenY++) {
-				Pixel* pixelPtr = workFrame->getLinePtrDirect<Pixel>(screenY) + screenX;
+			drawLines([&](int y, Pixel* pixelPtr) {
 				spriteConverter.template drawMode2<DisplayMode::GRAPHIC6>(
 					y, displayX, displayLimitX, pixelPtr);
-			}
+			});
 		} else {
-			for (int y = fromY; y < limitY; y++, screenY++) {
-				Pixel* pixelPtr = workFrame->getLinePtrDirect<Pixel>(screenY) + screenX;
+			drawLines([&](int y, Pixel* pixelPtr) {
 				spriteConverter.template drawMode2<DisplayMode::GRAPHIC4>(
 					y, displayX, displayLimitX, pixelPtr);
-			}
+			});
 		}
 	}
 }
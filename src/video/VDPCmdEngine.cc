@@ -159,6 +159,17 @@ template<typename LogOp> static void psetFast(
 	op(time, vram, addr, src, color, mask);
 }
 
+/** Can the high-speed commands write (the rest of) line 'y' with
+  * VDPVRAM::cmdWriteDirect() instead of VDPVRAM::cmdWrite()?
+  * Mode::LINE_ADDR_BITS are the address bits that vary within one line.
+  */
+template<typename Mode> static inline bool isLineUnobserved(
+	const VDPVRAM& vram, unsigned y, bool extVRAM)
+{
+	return vram.isCmdWriteUnobserved(
+		Mode::addressOf(0, y, extVRAM), Mode::LINE_ADDR_BITS);
+}
+
 /** Represents V9938 Graphic 4 mode (SCREEN5).
   */
 struct Graphic4Mode
@@ -171,6 +182,7 @@ struct Graphic4Mode
 	static constexpr byte PIXELS_PER_BYTE = 2;
 	static constexpr byte PIXELS_PER_BYTE_SHIFT = 1;
 	static constexpr unsigned PIXELS_PER_LINE = 256;
+	static constexpr unsigned LINE_ADDR_BITS = 0x0007F;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
 	template <typename LogOp>
@@ -221,6 +233,7 @@ struct Graphic5Mode
 	static constexpr byte PIXELS_PER_BYTE = 4;
 	static constexpr byte PIXELS_PER_BYTE_SHIFT = 2;
 	static constexpr unsigned PIXELS_PER_LINE = 512;
+	static constexpr unsigned LINE_ADDR_BITS = 0x0007F;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
 	template <typename LogOp>
@@ -273,6 +286,7 @@ struct Graphic6Mode
 	static constexpr byte PIXELS_PER_BYTE = 2;
 	static constexpr byte PIXELS_PER_BYTE_SHIFT = 1;
 	static constexpr unsigned PIXELS_PER_LINE = 512;
+	static constexpr unsigned LINE_ADDR_BITS = 0x1007F;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
 	template <typename LogOp>
@@ -323,6 +337,7 @@ struct Graphic7Mode
 	static constexpr byte PIXELS_PER_BYTE = 1;
 	static constexpr byte PIXELS_PER_BYTE_SHIFT = 0;
 	static constexpr unsigned PIXELS_PER_LINE = 256;
+	static constexpr unsigned LINE_ADDR_BITS = 0x1007F;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
 	template<typename LogOp>
@@ -371,6 +386,7 @@ struct NonBitmapMode
 	static constexpr byte PIXELS_PER_BYTE = 1;
 	static constexpr byte PIXELS_PER_BYTE_SHIFT = 0;
 	static constexpr unsigned PIXELS_PER_LINE = 256;
+	static constexpr unsigned LINE_ADDR_BITS = 0x000FF;
 	static inline unsigned addressOf(unsigned x, unsigned y, bool extVRAM);
 	static inline byte point(VDPVRAM& vram, unsigned x, unsigned y, bool extVRAM);
 	template<typename LogOp>
@@ -1351,6 +1367,20 @@ void VDPCmdEngine::executeHmmv(EmuTime::param limit)
 	auto calculator = getSlotCalculator(limit);
 
 	while (!calculator.limitReached()) {
+		if (likely(doPset) && (ANX > 1) &&
+		    isLineUnobserved<Mode>(vram, DY, dstExt)) {
+			// Fast path: nobody observes this line, so write all
+			// but the last byte of it directly. The access slots
+			// are still stepped one by one, so the timing doesn't
+			// change.
+			do {
+				vram.cmdWriteDirect(
+					Mode::addressOf(ADX, DY, dstExt), COL);
+				ADX += TX; --ANX;
+				calculator.next(DELTA_48);
+			} while ((ANX > 1) && !calculator.limitReached());
+			continue;
+		}
 		if (likely(doPset)) {
 			vram.cmdWrite(Mode::addressOf(ADX, DY, dstExt),
 			              COL, calculator.getTime());
@@ -1469,6 +1499,29 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 		[[fallthrough]];
 	case 1: {
 		if (unlikely(calculator.limitReached())) { phase = 1; break; }
+		if (likely(doPset) && (ANX > 1) &&
+		    isLineUnobserved<Mode>(vram, DY, dstExt)) {
+			// Fast path, see executeHmmv(). Copy all but the last
+			// byte of this line, one read and one write slot each.
+			while (true) {
+				vram.cmdWriteDirect(
+					Mode::addressOf(ADX, DY, dstExt), tmpSrc);
+				ASX += TX; ADX += TX; --ANX;
+				calculator.next(DELTA_64);
+				if ((ANX == 1) || calculator.limitReached()) {
+					goto loop;
+				}
+				tmpSrc = likely(doPoint)
+					? vram.cmdReadWindow.readNP(
+					       Mode::addressOf(ASX, SY, srcExt))
+					: 0xFF;
+				calculator.next(DELTA_24);
+				if (unlikely(calculator.limitReached())) {
+					phase = 1;
+					goto done;
+				}
+			}
+		}
 		if (likely(doPset)) {
 			vram.cmdWrite(Mode::addressOf(ADX, DY, dstExt),
 			              tmpSrc, calculator.getTime());
@@ -1490,6 +1543,7 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 	default:
 		UNREACHABLE;
 	}
+done:
 	engineTime = calculator.getTime();
 	calcFinishTime(tmpNX, tmpNY, 24 + 64);
 
@@ -1603,6 +1657,26 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 		[[fallthrough]];
 	case 1:
 		if (unlikely(calculator.limitReached())) { phase = 1; break; }
+		if (likely(doPset) && (ANX > 1) &&
+		    isLineUnobserved<Mode>(vram, DY, dstExt)) {
+			// Fast path, see executeHmmm().
+			while (true) {
+				vram.cmdWriteDirect(
+					Mode::addressOf(ADX, DY, dstExt), tmpSrc);
+				ADX += TX; --ANX;
+				calculator.next(DELTA_40);
+				if ((ANX == 1) || calculator.limitReached()) {
+					goto loop;
+				}
+				tmpSrc = vram.cmdReadWindow.readNP(
+				       Mode::addressOf(ADX, SY, dstExt));
+				calculator.next(DELTA_24);
+				if (unlikely(calculator.limitReached())) {
+					phase = 1;
+					goto done;
+				}
+			}
+		}
 		if (likely(doPset)) {
 			vram.cmdWrite(Mode::addressOf(ADX, DY, dstExt),
 			              tmpSrc, calculator.getTime());
@@ -1622,6 +1696,7 @@ loop:		if (unlikely(calculator.limitReached())) { phase = 0; break; }
 	default:
 		UNREACHABLE;
 	}
+done:
 	engineTime = calculator.getTime();
 	calcFinishTime(tmpNX, tmpNY, 24 + 40);
 
@@ -126,6 +126,7 @@ VDPVRAM::VDPVRAM(VDP& vdp_, unsigned size, EmuTime::param time)
 {
 	(void)time;
 
+	data.enableDirtyTracking();
 	vrMode = vdp.getVRMode();
 	setSizeMask(time);
 
@@ -221,6 +222,7 @@ void VDPVRAM::updateVRMode(bool newVRmode, EmuTime::param time)
 			std::swap(data[i], data[swapAddr(i)]);
 		}
 	}
+	data.markAllDirty();
 }
 
 void VDPVRAM::setRenderer(Renderer* newRenderer, EmuTime::param time)
@@ -303,6 +305,7 @@ void VDPVRAM::change4k8kMapping(bool mapping8k)
 		}
 	}
 	memcpy(&data[0], tmp, sizeof(tmp));
+	data.markAllDirty();
 }
 
 
@@ -327,7 +330,7 @@ void VDPVRAM::serialize(Archive& ar, unsigned /*version*/)
 		setSizeMask(static_cast<MSXDevice&>(vdp).getCurrentTime());
 	}
 
-	ar.serialize_blob("data", &data[0], actualSize);
+	ar.serialize_blob("data", &data[0], actualSize, data.getDirtyPages());
 	ar.serialize("cmdReadWindow",       cmdReadWindow,
 	             "cmdWriteWindow",      cmdWriteWindow,
 	             "nameTable",           nameTable,
@@ -297,6 +297,17 @@ public:
 		return (address & combiMask) == unsigned(baseAddr);
 	}
 
+	/** Might the observer of this window be interested in a change of
+	  * any of the addresses 'a' with '(a & ~freeBits) == base'?
+	  * @param base Address with all 'freeBits' set to zero.
+	  * @param freeBits The bits that vary within the range.
+	  */
+	inline bool isObserved(unsigned base, unsigned freeBits) const {
+		assert((base & freeBits) == 0);
+		return hasObserver() && isEnabled() &&
+		       (((base ^ unsigned(baseAddr)) & combiMask & ~freeBits) == 0);
+	}
+
 	/** Notifies the observer of this window of a VRAM change,
 	  * if the changes address is inside this window.
 	  * @param address The address to test.
@@ -428,6 +439,33 @@ public:
 		writeCommon(address, value, time);
 	}
 
+	/** Can the command engine write to all addresses 'a' with
+	  * '(a & ~freeBits) == base' using cmdWriteDirect()?
+	  * That's the case when all these addresses are present VRAM (so no
+	  * mirroring and no missing chips) and none of them is inside a VRAM
+	  * window with an observer. Writing them then doesn't require any
+	  * subsystem synchronisation, so the exact moment of the write no
+	  * longer matters.
+	  * The windows and the size mask can't change while the command engine
+	  * is executing, so the result stays valid for the whole execution.
+	  */
+	inline bool isCmdWriteUnobserved(unsigned base, unsigned freeBits) const {
+		unsigned last = base | freeBits;
+		if ((last & ~sizeMask) || (last >= actualSize)) return false;
+		return !bitmapVisibleWindow.isObserved(base, freeBits) &&
+		       !spriteAttribTable  .isObserved(base, freeBits) &&
+		       !spritePatternTable .isObserved(base, freeBits);
+	}
+
+	/** Write a byte from the command engine, without any synchronisation.
+	  * Only allowed for an address range that was checked with
+	  * isCmdWriteUnobserved().
+	  */
+	inline void cmdWriteDirect(unsigned address, byte value) {
+		data[address] = value;
+		data.markDirty(address);
+	}
+
 	/** Write a byte to VRAM through the CPU interface.
 	  * @param address The address to write.
 	  * @param value The value to write.
@@ -568,6 +606,7 @@ private:
 		spritePatternTable.notify(address, time);
 
 		data[address] = value;
+		data.markDirty(address);
 
 		// Cache dirty marking should happen after the commit,
 		// otherwise the cache could be re-validated based on old state.
@@ -3,9 +3,12 @@
 #include "ZMBVEncoder.hh"
 #include "FrameSource.hh"
 #include "PixelOperations.hh"
+#include "parallelFor.hh"
 #include "endian.hh"
 #include "ranges.hh"
 #include "unreachable.hh"
+#include "xrange.hh"
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
@@ -163,13 +166,13 @@ void ZMBVEncoder::setupBuffers(unsigned bpp)
 	}
 
 	pitch = width + 2 * MAX_VECTOR;
-	unsigned bufsize = (height + 2 * MAX_VECTOR) * pitch * pixelSize + 2048;
+	frameSize = (height + 2 * MAX_VECTOR) * pitch * pixelSize + 2048;
 
-	oldframe.resize(bufsize);
-	newframe.resize(bufsize);
-	memset(oldframe.data(), 0, bufsize);
-	memset(newframe.data(), 0, bufsize);
-	work.resize(bufsize);
+	oldframe.resize(frameSize);
+	newframe.resize(frameSize);
+	memset(oldframe.data(), 0, frameSize);
+	memset(newframe.data(), 0, frameSize);
+	work.resize(frameSize);
 	outputSize = neededSize();
 	output.resize(outputSize);
 
@@ -195,11 +198,11 @@ unsigned ZMBVEncoder::neededSize()
 }
 
 template<class P>
-unsigned ZMBVEncoder::possibleBlock(int vx, int vy, unsigned offset)
+unsigned ZMBVEncoder::possibleBlock(int vx, int vy, unsigned offset) const
 {
 	int ret = 0;
-	auto* pold = &(reinterpret_cast<P*>(oldframe.data()))[offset + (vy * pitch) + vx];
-	auto* pnew = &(reinterpret_cast<P*>(newframe.data()))[offset];
+	auto* pold = &(reinterpret_cast<const P*>(oldframe.data()))[offset + (vy * pitch) + vx];
+	auto* pnew = &(reinterpret_cast<const P*>(newframe.data()))[offset];
 	for (unsigned y = 0; y < BLOCK_HEIGHT; y += 4) {
 		for (unsigned x = 0; x < BLOCK_WIDTH; x += 4) {
 			if (pold[x] != pnew[x]) ++ret;
@@ -211,11 +214,11 @@ unsigned ZMBVEncoder::possibleBlock(int vx, int vy, unsigned offset)
 }
 
 template<class P>
-unsigned ZMBVEncoder::compareBlock(int vx, int vy, unsigned offset)
+unsigned ZMBVEncoder::compareBlock(int vx, int vy, unsigned offset) const
 {
 	int ret = 0;
-	auto* pold = &(reinterpret_cast<P*>(oldframe.data()))[offset + (vy * pitch) + vx];
-	auto* pnew = &(reinterpret_cast<P*>(newframe.data()))[offset];
+	auto* pold = &(reinterpret_cast<const P*>(oldframe.data()))[offset + (vy * pitch) + vx];
+	auto* pnew = &(reinterpret_cast<const P*>(newframe.data()))[offset];
 	for (unsigned y = 0; y < BLOCK_HEIGHT; ++y) {
 		for (unsigned x = 0; x < BLOCK_WIDTH; ++x) {
 			if (pold[x] != pnew[x]) ++ret;
@@ -245,22 +248,15 @@ void ZMBVEncoder::addXorBlock(
 	}
 }
 
+// Find the best motion vector for the blocks in range [first, last). For each
+// block two bytes are written to 'vectors': the x and y offset multiplied by 2,
+// the lowest bit of the first byte is set when the block still changed.
 template<class P>
-void ZMBVEncoder::addXorFrame(const PixelFormat& pixelFormat, unsigned& workUsed)
+void ZMBVEncoder::searchBlocks(unsigned first, unsigned last, int8_t* vectors) const
 {
-	PixelOperations<P> pixelOps(pixelFormat);
-	auto* vectors = reinterpret_cast<int8_t*>(&work[workUsed]);
-
-	unsigned xblocks = width / BLOCK_WIDTH;
-	unsigned yblocks = height / BLOCK_HEIGHT;
-	unsigned blockcount = xblocks * yblocks;
-
-	// Align the following xor data on 4 byte boundary
-	workUsed = (workUsed + blockcount * 2 + 3) & ~3;
-
 	int bestvx = 0;
 	int bestvy = 0;
-	for (unsigned b = 0; b < blockcount; ++b) {
+	for (unsigned b = first; b < last; ++b) {
 		unsigned offset = blockOffsets[b];
 		// first try best vector of previous block
 		unsigned bestchange = compareBlock<P>(bestvx, bestvy, offset);
@@ -280,11 +276,41 @@ void ZMBVEncoder::addXorFrame(const PixelFormat& pixelFormat, unsigned& workUsed
 				}
 			}
 		}
-		vectors[b * 2 + 0] = (bestvx << 1);
+		vectors[b * 2 + 0] = (bestvx << 1) | (bestchange ? 1 : 0);
 		vectors[b * 2 + 1] = (bestvy << 1);
-		if (bestchange) {
-			vectors[b * 2 + 0] |= 1;
-			addXorBlock<P>(pixelOps, bestvx, bestvy, offset, workUsed);
+	}
+}
+
+template<class P>
+void ZMBVEncoder::addXorFrame(const PixelFormat& pixelFormat, unsigned& workUsed)
+{
+	PixelOperations<P> pixelOps(pixelFormat);
+	auto* vectors = reinterpret_cast<int8_t*>(&work[workUsed]);
+
+	unsigned xblocks = width / BLOCK_WIDTH;
+	unsigned yblocks = height / BLOCK_HEIGHT;
+	unsigned blockcount = xblocks * yblocks;
+
+	// Align the following xor data on 4 byte boundary
+	workUsed = (workUsed + blockcount * 2 + 3) & ~3;
+
+	// The motion search is by far the most expensive part. Blocks are
+	// searched independently (except that the search starts with the
+	// vector of the previous block), so split the frame in horizontal
+	// stripes and search those in parallel.
+	unsigned numStripes = std::min(parallelForMaxThreads(), yblocks);
+	parallelFor(numStripes, [&](size_t i) {
+		unsigned first = xblocks * ((yblocks * unsigned(i + 0)) / numStripes);
+		unsigned last  = xblocks * ((yblocks * unsigned(i + 1)) / numStripes);
+		searchBlocks<P>(first, last, vectors);
+	});
+
+	// Add the xor data of the changed blocks, in block order.
+	for (auto b : xrange(blockcount)) {
+		if (vectors[b * 2 + 0] & 1) {
+			int vx = vectors[b * 2 + 0] >> 1;
+			int vy = vectors[b * 2 + 1] >> 1;
+			addXorBlock<P>(pixelOps, vx, vy, blockOffsets[b], workUsed);
 		}
 	}
 }
@@ -308,7 +334,7 @@ void ZMBVEncoder::addFullFrame(const PixelFormat& pixelFormat, unsigned& workUse
 	}
 }
 
-const void* ZMBVEncoder::getScaledLine(FrameSource* frame, unsigned y, void* workBuf_)
+const void* ZMBVEncoder::getScaledLine(FrameSource* frame, unsigned y, void* workBuf_) const
 {
 #if HAVE_32BPP
 	if (pixelSize == 4) { // 32bpp
@@ -344,10 +370,34 @@ const void* ZMBVEncoder::getScaledLine(FrameSource* frame, unsigned y, void* wor
 	return nullptr; // avoid warning
 }
 
-void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
-                                void*& buffer, unsigned& written)
+void ZMBVEncoder::captureFrame(FrameSource* frame, FrameBuffer& buf) const
+{
+	if (buf.empty()) {
+		// The borders stay black, only the inner part is written below.
+		buf.resize(frameSize);
+		memset(buf.data(), 0, frameSize);
+	}
+
+	// copy lines (to add black border)
+	unsigned linePitch = pitch * pixelSize;
+	unsigned lineWidth = width * pixelSize;
+	uint8_t* dest =
+		&buf[pixelSize * (MAX_VECTOR + MAX_VECTOR * pitch)];
+	for (unsigned i = 0; i < height; ++i) {
+		auto* scaled = getScaledLine(frame, i, dest);
+		if (scaled != dest) memcpy(dest, scaled, lineWidth);
+		dest += linePitch;
+	}
+}
+
+void ZMBVEncoder::compressFrame(bool keyFrame, const PixelFormat& pixelFormat,
+                                FrameBuffer& frame, void*& buffer, unsigned& written)
 {
-	std::swap(newframe, oldframe); // replace oldframe with newframe
+	assert(!frame.empty());
+	// replace oldframe with newframe and newframe with the given frame,
+	// give the (old) oldframe buffer back to the caller
+	std::swap(newframe, oldframe);
+	std::swap(newframe, frame);
 
 	// Reset the work buffer
 	unsigned workUsed = 0;
@@ -369,29 +419,18 @@ void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
 		deflateReset(&zstream); // restart deflate
 	}
 
-	// copy lines (to add black border)
-	unsigned linePitch = pitch * pixelSize;
-	unsigned lineWidth = width * pixelSize;
-	uint8_t* dest =
-		&newframe[pixelSize * (MAX_VECTOR + MAX_VECTOR * pitch)];
-	for (unsigned i = 0; i < height; ++i) {
-		auto* scaled = getScaledLine(frame, i, dest);
-		if (scaled != dest) memcpy(dest, scaled, lineWidth);
-		dest += linePitch;
-	}
-
 	// Add the frame data.
 	if (keyFrame) {
 		// Key frame: full frame data.
 		switch (pixelSize) {
 #if HAVE_16BPP
 		case 2:
-			addFullFrame<uint16_t>(frame->getPixelFormat(), workUsed);
+			addFullFrame<uint16_t>(pixelFormat, workUsed);
 			break;
 #endif
 #if HAVE_32BPP
 		case 4:
-			addFullFrame<uint32_t>(frame->getPixelFormat(), workUsed);
+			addFullFrame<uint32_t>(pixelFormat, workUsed);
 			break;
 #endif
 		default:
@@ -402,12 +441,12 @@ void ZMBVEncoder::compressFrame(bool keyFrame, FrameSource* frame,
 		switch (pixelSize) {
 #if HAVE_16BPP
 		case 2:
-			addXorFrame<uint16_t>(frame->getPixelFormat(), workUsed);
+			addXorFrame<uint16_t>(pixelFormat, workUsed);
 			break;
 #endif
 #if HAVE_32BPP
 		case 4:
-			addXorFrame<uint32_t>(frame->getPixelFormat(), workUsed);
+			addXorFrame<uint32_t>(pixelFormat, workUsed);
 			break;
 #endif
 		default:
@@ -18,10 +18,25 @@ class ZMBVEncoder
 public:
 	static constexpr const char CODEC_4CC[5] = "ZMBV"; // 4 + zero-terminator
 
+	/** Holds one (captured, not yet compressed) frame. */
+	using FrameBuffer = MemBuffer<uint8_t, SSE2_ALIGNMENT>;
+
 	ZMBVEncoder(unsigned width, unsigned height, unsigned bpp);
 
-	void compressFrame(bool keyFrame, FrameSource* frame,
-	                   void*& buffer, unsigned& written);
+	/** Copy the content of the given frame into 'buf' (which can be a
+	  * buffer returned by an earlier compressFrame() call, or empty).
+	  * This is the only part that accesses the FrameSource, the (much
+	  * slower) compression can then be done on a different thread. It's
+	  * allowed to call this concurrently with compressFrame().
+	  */
+	void captureFrame(FrameSource* frame, FrameBuffer& buf) const;
+
+	/** Compress a frame captured by captureFrame(). Frames must be
+	  * compressed in order. On return 'frame' contains an unused buffer
+	  * that can be passed to a later captureFrame() call.
+	  */
+	void compressFrame(bool keyFrame, const PixelFormat& pixelFormat,
+	                   FrameBuffer& frame, void*& buffer, unsigned& written);
 
 private:
 	enum Format {
@@ -33,19 +48,21 @@ private:
 	unsigned neededSize();
 	template<class P> void addFullFrame(const PixelFormat& pixelFormat, unsigned& workUsed);
 	template<class P> void addXorFrame (const PixelFormat& pixelFormat, unsigned& workUsed);
-	template<class P> unsigned possibleBlock(int vx, int vy, unsigned offset);
-	template<class P> unsigned compareBlock(int vx, int vy, unsigned offset);
+	template<class P> void searchBlocks(unsigned first, unsigned last, int8_t* vectors) const;
+	template<class P> unsigned possibleBlock(int vx, int vy, unsigned offset) const;
+	template<class P> unsigned compareBlock(int vx, int vy, unsigned offset) const;
 	template<class P> void addXorBlock(
 		const PixelOperations<P>& pixelOps, int vx, int vy,
 		unsigned offset, unsigned& workUsed);
-	const void* getScaledLine(FrameSource* frame, unsigned y, void* workBuf);
+	const void* getScaledLine(FrameSource* frame, unsigned y, void* workBuf) const;
 
-	MemBuffer<uint8_t, SSE2_ALIGNMENT> oldframe;
-	MemBuffer<uint8_t, SSE2_ALIGNMENT> newframe;
+	FrameBuffer oldframe;
+	FrameBuffer newframe;
 	MemBuffer<uint8_t, SSE2_ALIGNMENT> work;
 	MemBuffer<uint8_t> output;
 	MemBuffer<unsigned> blockOffsets;
 	unsigned outputSize;
+	unsigned frameSize;
 
 	z_stream zstream;
 